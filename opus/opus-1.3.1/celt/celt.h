@@ -131,6 +131,12 @@ typedef struct {
 #define CELT_SET_SILK_INFO_REQUEST    10028
 #define CELT_SET_SILK_INFO(x) CELT_SET_SILK_INFO_REQUEST, __celt_check_silkinfo_ptr(x)
 
+/* Makes the decoder write unsigned samples shifted right by x bits, with each
+   sample repeated y times (see opus_decode_ex()). y=0 restores PCM output.
+   Only supported in fixed-point. */
+#define CELT_SET_OUTPUT_FORMAT_REQUEST    10030
+#define CELT_SET_OUTPUT_FORMAT(x, y) CELT_SET_OUTPUT_FORMAT_REQUEST, __opus_check_int(x), __opus_check_int(y)
+
 /* Encoder stuff */
 
 int celt_encoder_get_size(int channels);
@@ -83,6 +83,10 @@ struct OpusCustomDecoder {
    int signalling;
    int disable_inv;
    int arch;
+#ifdef FIXED_POINT
+   int out_shift;
+   int out_upsample;
+#endif
 
    /* Everything beyond this point gets cleared on a reset */
 #define DECODER_RESET_START rng
@@ -254,6 +258,78 @@ static void deemphasis_stereo_simple(celt_sig *in[], opus_val16 *pcm, int N, con
 }
 #endif
 
+#ifdef FIXED_POINT
+/* Same as deemphasis(), but writes unsigned samples shifted right by shift
+   bits, with each sample repeated upsample times, so that the output can go
+   straight to a PWM or DAC without another pass over it. The repeated samples
+   would overwrite the SILK signal before it is read, so accumulating is only
+   supported without repetition. */
+static void deemphasis_output(celt_sig *in[], opus_val16 *pcm, int N, int C,
+      int downsample, const opus_val16 *coef, celt_sig *mem, int accum,
+      int shift, int upsample)
+{
+   int c;
+   int Nd;
+   opus_val16 coef0;
+   VARDECL(celt_sig, scratch);
+   SAVE_STACK;
+#ifdef CUSTOM_MODES
+   celt_assert(coef[1] == 0);
+#endif
+   celt_assert(!accum || upsample == 1);
+   ALLOC(scratch, downsample>1 ? N : ALLOC_NONE, celt_sig);
+   coef0 = coef[0];
+   Nd = N/downsample;
+   c=0; do {
+      int j, k;
+      celt_sig * OPUS_RESTRICT x;
+      opus_val16  * OPUS_RESTRICT y;
+      celt_sig m = mem[c];
+      x =in[c];
+      y = pcm+c;
+      if (downsample>1)
+      {
+         for (j=0;j<N;j++)
+         {
+            celt_sig tmp = x[j] + VERY_SMALL + m;
+            m = MULT16_32_Q15(coef0, tmp);
+            scratch[j] = tmp;
+         }
+         for (j=0;j<Nd;j++)
+         {
+            opus_val16 s = SCALEOUT(SIG2WORD16(scratch[j*downsample]));
+            if (accum)
+               s = SAT16(ADD32(y[j*C], s));
+            s = (opus_val16)((opus_uint16)(s + 32768) >> shift);
+            for (k=0;k<upsample;k++)
+               y[(j*upsample+k)*C] = s;
+         }
+      } else if (accum) {
+         for (j=0;j<N;j++)
+         {
+            celt_sig tmp = x[j] + m + VERY_SMALL;
+            opus_val16 s;
+            m = MULT16_32_Q15(coef0, tmp);
+            s = SAT16(ADD32(y[j*C], SCALEOUT(SIG2WORD16(tmp))));
+            y[j*C] = (opus_val16)((opus_uint16)(s + 32768) >> shift);
+         }
+      } else {
+         for (j=0;j<N;j++)
+         {
+            celt_sig tmp = x[j] + VERY_SMALL + m;
+            opus_val16 s;
+            m = MULT16_32_Q15(coef0, tmp);
+            s = (opus_val16)((opus_uint16)(SCALEOUT(SIG2WORD16(tmp)) + 32768) >> shift);
+            for (k=0;k<upsample;k++)
+               y[(j*upsample+k)*C] = s;
+         }
+      }
+      mem[c] = m;
+   } while (++c<C);
+   RESTORE_STACK;
+}
+#endif
+
 #ifndef RESYNTH
 static
 #endif
@@ -929,6 +1005,12 @@ int celt_decode_with_ec(CELTDecoder * OPUS_RESTRICT st, const unsigned char *dat
    if (data == NULL || len<=1)
    {
       celt_decode_lost(st, N, LM);
+#ifdef FIXED_POINT
+      if (st->out_upsample)
+         deemphasis_output(out_syn, pcm, N, CC, st->downsample, mode->preemph,
+               st->preemph_memD, accum, st->out_shift, st->out_upsample);
+      else
+#endif
       deemphasis(out_syn, pcm, N, CC, st->downsample, mode->preemph, st->preemph_memD, accum);
       RESTORE_STACK;
       return frame_size/st->downsample;
@@ -1168,6 +1250,12 @@ int celt_decode_with_ec(CELTDecoder * OPUS_RESTRICT st, const unsigned char *dat
    } while (++c<2);
    st->rng = dec->rng;
 
+#ifdef FIXED_POINT
+   if (st->out_upsample)
+      deemphasis_output(out_syn, pcm, N, CC, st->downsample, mode->preemph,
+            st->preemph_memD, accum, st->out_shift, st->out_upsample);
+   else
+#endif
    deemphasis(out_syn, pcm, N, CC, st->downsample, mode->preemph, st->preemph_memD, accum);
    st->loss_count = 0;
    RESTORE_STACK;
@@ -1338,6 +1426,18 @@ int opus_custom_decoder_ctl(CELTDecoder * OPUS_RESTRICT st, int request, ...)
          *value=st->rng;
       }
       break;
+#ifdef FIXED_POINT
+      case CELT_SET_OUTPUT_FORMAT_REQUEST:
+      {
+         opus_int32 shift = va_arg(ap, opus_int32);
+         opus_int32 upsample = va_arg(ap, opus_int32);
+         if (shift<0 || shift>15 || upsample<0)
+            goto bad_arg;
+         st->out_shift = shift;
+         st->out_upsample = upsample;
+      }
+      break;
+#endif
       case OPUS_SET_PHASE_INVERSION_DISABLED_REQUEST:
       {
           opus_int32 value = va_arg(ap, opus_int32);
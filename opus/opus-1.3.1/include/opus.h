@@ -398,6 +398,19 @@ OPUS_EXPORT int opus_encoder_ctl(OpusEncoder *st, int request, ...) OPUS_ARG_NON
   */
 typedef struct OpusDecoder OpusDecoder;
 
+/** Output format for opus_decode_ex().
+  * The decoded samples are written as unsigned integers of \a bits bits, as
+  * needed by a PWM or DAC output, with 0 mapped to the middle of the range.
+  * Each sample (across all channels) is then repeated \a upsample times,
+  * so that a stream decoded below the output rate can be played at that
+  * rate by a simple integer upsampling.
+  * @see opus_decode_ex
+  */
+typedef struct OpusOutputFormat {
+   int bits;      /**< Width of the output samples, from 1 to 16 */
+   int upsample;  /**< Number of times each sample is repeated, at least 1 */
+} OpusOutputFormat;
+
 /** Gets the size of an <code>OpusDecoder</code> structure.
   * @param [in] channels <tt>int</tt>: Number of channels.
   *                                    This must be 1 or 2.
@@ -493,6 +506,33 @@ OPUS_EXPORT OPUS_WARN_UNUSED_RESULT int opus_decode_float(
     int decode_fec
 ) OPUS_ARG_NONNULL(1) OPUS_ARG_NONNULL(4);
 
+/** Decode an Opus packet straight into an output format.
+  * This is the same as opus_decode(), followed by converting each sample
+  * s to <tt>(s + 32768) >> (16 - bits)</tt> and repeating it, but in the
+  * fixed-point decoder the conversion is done while the decoder writes the
+  * samples rather than as another pass over them.
+  * @param [in] st <tt>OpusDecoder*</tt>: Decoder state
+  * @param [in] data <tt>char*</tt>: Input payload. Use a NULL pointer to indicate packet loss
+  * @param [in] len <tt>opus_int32</tt>: Number of bytes in payload
+  * @param [out] pcm <tt>opus_int16*</tt>: Output signal (interleaved if 2 channels). length
+  *  is frame_size*channels*upsample*sizeof(opus_int16)
+  * @param [in] frame_size Number of samples per channel of available space in \a pcm,
+  *  before repetition. See opus_decode() for the PLC and FEC requirements.
+  * @param [in] decode_fec <tt>int</tt>: Flag (0 or 1) to request that any in-band forward error correction data be
+  *  decoded. If no such data is available the frame is decoded as if it were lost.
+  * @param [in] format <tt>const OpusOutputFormat*</tt>: The output format
+  * @returns Number of decoded samples per channel, before repetition, or @ref opus_errorcodes
+  */
+OPUS_EXPORT OPUS_WARN_UNUSED_RESULT int opus_decode_ex(
+    OpusDecoder *st,
+    const unsigned char *data,
+    opus_int32 len,
+    opus_int16 *pcm,
+    int frame_size,
+    int decode_fec,
+    const OpusOutputFormat *format
+) OPUS_ARG_NONNULL(1) OPUS_ARG_NONNULL(4) OPUS_ARG_NONNULL(7);
+
 /** Perform a CTL function on an Opus decoder.
   *
   * Generally the request and subsequent arguments are generated
@@ -46,6 +46,7 @@ extern "C" {
 /**@{*/
 #define __opus_check_encstate_ptr(ptr) ((ptr) + ((ptr) - (OpusEncoder**)(ptr)))
 #define __opus_check_decstate_ptr(ptr) ((ptr) + ((ptr) - (OpusDecoder**)(ptr)))
+#define __opus_check_executor_ptr(ptr) ((ptr) + ((ptr) - (const OpusMSExecutor*)(ptr)))
 /**@}*/
 
 /** These are the actual encoder and decoder CTL ID numbers.
@@ -54,10 +55,25 @@ extern "C" {
 /**@{*/
 #define OPUS_MULTISTREAM_GET_ENCODER_STATE_REQUEST 5120
 #define OPUS_MULTISTREAM_GET_DECODER_STATE_REQUEST 5122
+#define OPUS_MULTISTREAM_SET_EXECUTOR_REQUEST 5124
 /**@}*/
 
 /** @endcond */
 
+/** Runs a batch of independent tasks, possibly at the same time.
+  * It must call <code>task(arg, i)</code> exactly once for every
+  * <code>i</code> from <code>0</code> to <code>count-1</code>, in any order
+  * and on any threads, and may only return once all the calls have returned.
+  * @see OPUS_MULTISTREAM_SET_EXECUTOR
+  */
+typedef struct OpusMSExecutor {
+   /** Runs the tasks. @c data is the field below. */
+   void (*run)(void *data, void (*task)(void *arg, int index), void *arg,
+         int count);
+   /** Passed back to @c run, e.g. a thread pool. */
+   void *data;
+} OpusMSExecutor;
+
 /** @defgroup opus_multistream_ctls Multistream specific encoder and decoder CTLs
   *
   * These are convenience macros that are specific to the
@@ -98,6 +114,38 @@ extern "C" {
   */
 #define OPUS_MULTISTREAM_GET_DECODER_STATE(x,y) OPUS_MULTISTREAM_GET_DECODER_STATE_REQUEST, __opus_check_int(x), __opus_check_decstate_ptr(y)
 
+/** Lets the encoder or decoder run its streams through the given executor.
+  * Each stream has its own state, so once the multistream encoder has split
+  * up the input, or the decoder has found each stream's sub-packet, the
+  * streams can be coded at the same time. The output is bit-exact with the
+  * serial encoder or decoder.
+  *
+  * The encoder only hands a stream to the executor when its size cannot
+  * depend on the bytes used by the streams before it, so the packet must
+  * have room for every stream at its largest: 1278 bytes per stream for frames of
+  * 20 ms or less and 7664 bytes per stream for longer frames. In CBR the
+  * last stream is always encoded after the others. With less room the
+  * streams are encoded one after the other as before. A dispatch takes
+  * 2*frame_size samples and about 7.5 kB of stack per stream.
+  *
+  * The decoder hands every stream to the executor. Each stream decodes
+  * into its own buffer, which takes a frame of samples per decoded channel
+  * on the stack. For a lost packet or FEC the frame is the caller's
+  * frame_size. When the buffers would take more than 120 ms of 16 channels
+  * at 48 kHz, the streams are decoded one after the other instead. The
+  * channel mapping, or the demixing matrix of a projection decoder, is
+  * applied afterwards in a single pass.
+  *
+  * The executor is copied, so it may be on the stack. It is kept through
+  * #OPUS_RESET_STATE.
+  * @param[in] x <tt>const OpusMSExecutor*</tt>: The executor to use, or
+  *                                            a null pointer to code
+  *                                            the streams serially (the
+  *                                            default).
+  * @hideinitializer
+  */
+#define OPUS_MULTISTREAM_SET_EXECUTOR(x) OPUS_MULTISTREAM_SET_EXECUTOR_REQUEST, __opus_check_executor_ptr(x)
+
 /**@}*/
 
 /** @defgroup opus_multistream Opus Multistream API
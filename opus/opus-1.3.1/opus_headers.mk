@@ -6,4 +6,6 @@ src/opus_private.h \
 src/analysis.h \
 src/mapping_matrix.h \
 src/mlp.h \
-src/tansig_table.h
+src/tansig_table.h \
+src/arm/mapping_matrix_arm.h \
+src/x86/mapping_matrix_sse.h
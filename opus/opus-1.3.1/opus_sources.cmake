@@ -13,6 +13,11 @@ get_opus_sources(SILK_SOURCES_FIXED_ARM_NEON_INTR silk_sources.mk
 
 get_opus_sources(OPUS_SOURCES opus_sources.mk opus_sources)
 get_opus_sources(OPUS_SOURCES_FLOAT opus_sources.mk opus_sources_float)
+get_opus_sources(OPUS_SOURCES_SSE opus_sources.mk opus_sources_sse)
+get_opus_sources(OPUS_SOURCES_SSE4_1 opus_sources.mk opus_sources_sse4_1)
+get_opus_sources(OPUS_SOURCES_ARM opus_sources.mk opus_sources_arm)
+get_opus_sources(OPUS_SOURCES_ARM_NEON_INTR opus_sources.mk
+                 opus_sources_arm_neon_intr)
 
 get_opus_sources(CELT_SOURCES celt_sources.mk celt_sources)
 get_opus_sources(CELT_SOURCES_SSE celt_sources.mk celt_sources_sse)
@@ -27,6 +32,8 @@ get_opus_sources(CELT_SOURCES_ARM_NEON_INTR celt_sources.mk
 get_opus_sources(CELT_SOURCES_ARM_NE10 celt_sources.mk celt_sources_arm_ne10)
 
 get_opus_sources(opus_demo_SOURCES Makefile.am opus_demo_sources)
+get_opus_sources(opus_bench_SOURCES Makefile.am opus_bench_sources)
+get_opus_sources(opus_batch_SOURCES Makefile.am opus_batch_sources)
 get_opus_sources(opus_custom_demo_SOURCES Makefile.am opus_custom_demo_sources)
 get_opus_sources(opus_compare_SOURCES Makefile.am opus_compare_sources)
 get_opus_sources(tests_test_opus_api_SOURCES Makefile.am test_opus_api_sources)
@@ -14,3 +14,15 @@ OPUS_SOURCES_FLOAT = \
 src/analysis.c \
 src/mlp.c \
 src/mlp_data.c
+
+OPUS_SOURCES_SSE = \
+src/x86/x86_opus_map.c
+
+OPUS_SOURCES_SSE4_1 = \
+src/x86/mapping_matrix_sse4_1.c
+
+OPUS_SOURCES_ARM = \
+src/arm/arm_opus_map.c
+
+OPUS_SOURCES_ARM_NEON_INTR = \
+src/arm/mapping_matrix_neon_intr.c
@@ -0,0 +1,54 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "../mapping_matrix.h"
+
+#if defined(OPUS_HAVE_RTCD)
+
+# if defined(OPUS_ARM_MAY_HAVE_NEON_INTR) && !defined(OPUS_ARM_PRESUME_NEON_INTR)
+void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_SHORT_IMPL[OPUS_ARCHMASK+1])(
+      const MappingMatrix *, const opus_int16 *, int, opus_val16 *, int, int, int) = {
+  mapping_matrix_multiply_channel_in_short_c,   /* ARMv4 */
+  mapping_matrix_multiply_channel_in_short_c,   /* EDSP */
+  mapping_matrix_multiply_channel_in_short_c,   /* Media */
+  mapping_matrix_multiply_channel_in_short_neon /* NEON */
+};
+
+void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_SHORT_IMPL[OPUS_ARCHMASK+1])(
+      const MappingMatrix *, const opus_val16 *, int, int, opus_int16 *, int, int) = {
+  mapping_matrix_multiply_channel_out_short_c,   /* ARMv4 */
+  mapping_matrix_multiply_channel_out_short_c,   /* EDSP */
+  mapping_matrix_multiply_channel_out_short_c,   /* Media */
+  mapping_matrix_multiply_channel_out_short_neon /* NEON */
+};
+# endif
+
+#endif
@@ -0,0 +1,166 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <arm_neon.h>
+#include "arch.h"
+#include "float_cast.h"
+#include "stack_alloc.h"
+#include "../mapping_matrix.h"
+
+#define MATRIX_INDEX(nb_rows, row, col) (nb_rows * col + row)
+
+void mapping_matrix_multiply_channel_in_short_neon(
+    const MappingMatrix *matrix,
+    const opus_int16 *input,
+    int input_rows,
+    opus_val16 *output,
+    int output_row,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, col;
+  VARDECL(opus_int32, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, input_rows, opus_int32);
+  for (col = 0; col < input_rows; col++)
+    coef[col] = matrix_data[MATRIX_INDEX(matrix->rows, output_row, col)];
+
+#if defined(FIXED_POINT)
+  for (i = 0; i < frame_size; i++)
+  {
+    const opus_int16 *x = input + input_rows * i;
+    int32x4_t sum = vdupq_n_s32(0);
+    int32x2_t sum2;
+    opus_val32 tmp;
+    for (col = 0; col < input_rows - 3; col += 4)
+    {
+      int32x4_t prod = vmulq_s32(vld1q_s32(coef + col), vmovl_s16(vld1_s16(x + col)));
+      sum = vaddq_s32(sum, vshrq_n_s32(prod, 8));
+    }
+    sum2 = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+    sum2 = vpadd_s32(sum2, sum2);
+    tmp = vget_lane_s32(sum2, 0);
+    for (; col < input_rows; col++)
+    {
+      tmp += (coef[col] * (opus_int32)x[col]) >> 8;
+    }
+    output[output_rows * i] = (opus_int16)((tmp + 64) >> 7);
+  }
+#else
+  /* Float sums keep the C order of the columns, four samples at a time */
+  for (i = 0; i < frame_size - 3; i += 4)
+  {
+    const opus_int16 *x = input + input_rows * i;
+    float32x4_t tmp = vdupq_n_f32(0);
+    float out[4];
+    for (col = 0; col < input_rows; col++)
+    {
+      opus_int32 in[4];
+      in[0] = x[col];
+      in[1] = x[input_rows + col];
+      in[2] = x[2 * input_rows + col];
+      in[3] = x[3 * input_rows + col];
+      tmp = vaddq_f32(tmp,
+          vcvtq_f32_s32(vmulq_n_s32(vld1q_s32(in), coef[col])));
+    }
+    vst1q_f32(out, vmulq_n_f32(tmp, 1/(32768.f*32768.f)));
+    output[output_rows * i] = out[0];
+    output[output_rows * (i + 1)] = out[1];
+    output[output_rows * (i + 2)] = out[2];
+    output[output_rows * (i + 3)] = out[3];
+  }
+  for (; i < frame_size; i++)
+  {
+    opus_val32 tmp = 0;
+    for (col = 0; col < input_rows; col++)
+    {
+      tmp += coef[col] * input[MATRIX_INDEX(input_rows, col, i)];
+    }
+    output[output_rows * i] = (1/(32768.f*32768.f))*tmp;
+  }
+#endif
+  RESTORE_STACK;
+}
+
+void mapping_matrix_multiply_channel_out_short_neon(
+    const MappingMatrix *matrix,
+    const opus_val16 *input,
+    int input_row,
+    int input_rows,
+    opus_int16 *output,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, row;
+  opus_int32 input_sample;
+  VARDECL(opus_int32, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, output_rows, opus_int32);
+  for (row = 0; row < output_rows; row++)
+    coef[row] = matrix_data[MATRIX_INDEX(matrix->rows, row, input_row)];
+
+  for (i = 0; i < frame_size; i++)
+  {
+    opus_int16 *y = output + output_rows * i;
+#if defined(FIXED_POINT)
+    input_sample = (opus_int32)input[input_rows * i];
+#else
+    input_sample = (opus_int32)FLOAT2INT16(input[input_rows * i]);
+#endif
+    for (row = 0; row < output_rows - 3; row += 4)
+    {
+      /* (tmp + 16384) >> 15, then wrapped to 16 bits like the C version */
+      int32x4_t tmp = vrshrq_n_s32(vmulq_n_s32(vld1q_s32(coef + row), input_sample), 15);
+      int32x4_t out = vaddq_s32(vmovl_s16(vld1_s16(y + row)), tmp);
+      vst1_s16(y + row, vmovn_s32(out));
+    }
+    for (; row < output_rows; row++)
+    {
+      opus_int32 tmp = coef[row] * input_sample;
+      y[row] += (tmp + 16384) >> 15;
+    }
+  }
+  RESTORE_STACK;
+}
@@ -82,7 +82,7 @@ void mapping_matrix_init(MappingMatrix * const matrix,
 }
 
 #ifndef DISABLE_FLOAT_API
-void mapping_matrix_multiply_channel_in_float(
+void mapping_matrix_multiply_channel_in_float_c(
     const MappingMatrix *matrix,
     const float *input,
     int input_rows,
@@ -116,7 +116,7 @@ void mapping_matrix_multiply_channel_in_float(
   }
 }
 
-void mapping_matrix_multiply_channel_out_float(
+void mapping_matrix_multiply_channel_out_float_c(
     const MappingMatrix *matrix,
     const opus_val16 *input,
     int input_row,
@@ -153,7 +153,7 @@ void mapping_matrix_multiply_channel_out_float(
 }
 #endif /* DISABLE_FLOAT_API */
 
-void mapping_matrix_multiply_channel_in_short(
+void mapping_matrix_multiply_channel_in_short_c(
     const MappingMatrix *matrix,
     const opus_int16 *input,
     int input_rows,
@@ -193,7 +193,7 @@ void mapping_matrix_multiply_channel_in_short(
   }
 }
 
-void mapping_matrix_multiply_channel_out_short(
+void mapping_matrix_multiply_channel_out_short_c(
     const MappingMatrix *matrix,
     const opus_val16 *input,
     int input_row,
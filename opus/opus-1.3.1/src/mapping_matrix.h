@@ -35,6 +35,8 @@
 
 #include "opus_types.h"
 #include "opus_projection.h"
+#include "arch.h"
+#include "cpu_support.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -62,7 +64,7 @@ void mapping_matrix_init(
 );
 
 #ifndef DISABLE_FLOAT_API
-void mapping_matrix_multiply_channel_in_float(
+void mapping_matrix_multiply_channel_in_float_c(
     const MappingMatrix *matrix,
     const float *input,
     int input_rows,
@@ -72,7 +74,7 @@ void mapping_matrix_multiply_channel_in_float(
     int frame_size
 );
 
-void mapping_matrix_multiply_channel_out_float(
+void mapping_matrix_multiply_channel_out_float_c(
     const MappingMatrix *matrix,
     const opus_val16 *input,
     int input_row,
@@ -83,7 +85,7 @@ void mapping_matrix_multiply_channel_out_float(
 );
 #endif /* DISABLE_FLOAT_API */
 
-void mapping_matrix_multiply_channel_in_short(
+void mapping_matrix_multiply_channel_in_short_c(
     const MappingMatrix *matrix,
     const opus_int16 *input,
     int input_rows,
@@ -93,7 +95,7 @@ void mapping_matrix_multiply_channel_in_short(
     int frame_size
 );
 
-void mapping_matrix_multiply_channel_out_short(
+void mapping_matrix_multiply_channel_out_short_c(
     const MappingMatrix *matrix,
     const opus_val16 *input,
     int input_row,
@@ -103,6 +105,44 @@ void mapping_matrix_multiply_channel_out_short(
     int frame_size
 );
 
+#if defined(OPUS_X86_MAY_HAVE_SSE4_1)
+#include "x86/mapping_matrix_sse.h"
+#endif
+
+#if defined(OPUS_ARM_MAY_HAVE_NEON_INTR)
+#include "arm/mapping_matrix_arm.h"
+#endif
+
+#ifndef DISABLE_FLOAT_API
+#if !defined(OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_FLOAT)
+#define mapping_matrix_multiply_channel_in_float(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_in_float_c(matrix, input, \
+      input_rows, output, output_row, output_rows, frame_size))
+#endif
+
+#if !defined(OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_FLOAT)
+#define mapping_matrix_multiply_channel_out_float(matrix, input, input_row, \
+      input_rows, output, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_out_float_c(matrix, input, \
+      input_row, input_rows, output, output_rows, frame_size))
+#endif
+#endif /* DISABLE_FLOAT_API */
+
+#if !defined(OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_SHORT)
+#define mapping_matrix_multiply_channel_in_short(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_in_short_c(matrix, input, \
+      input_rows, output, output_row, output_rows, frame_size))
+#endif
+
+#if !defined(OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_SHORT)
+#define mapping_matrix_multiply_channel_out_short(matrix, input, input_row, \
+      input_rows, output, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_out_short_c(matrix, input, \
+      input_row, input_rows, output, output_rows, frame_size))
+#endif
+
 /* Pre-computed mixing and demixing matrices for 1st to 3rd-order ambisonics.
  *   foa: first-order ambisonics
  *   soa: second-order ambisonics
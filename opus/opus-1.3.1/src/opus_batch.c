@@ -0,0 +1,987 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Batch transcoder.  Runs many opus_demo jobs in one process: each line of
+   a manifest holds the arguments that opus_demo would be given for one
+   file, and a pool of worker threads works through them.  Each worker keeps
+   one encoder and one decoder, allocated once for the largest
+   configuration, and resets them between jobs with OPUS_RESET_STATE, or
+   re-initializes them in place when the sampling rate, channels or
+   application change.  Since every setting is applied again for each job,
+   a job gives the same output as opus_demo run on its own.
+
+   The jobs are dealt out to the workers longest input first, and a worker
+   whose own queue runs dry takes jobs from the far end of another's.  The
+   output of each worker goes through two buffers, one being filled while
+   the other is written by the I/O thread. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "opus.h"
+
+#define MAX_PACKET      1500
+#define MAX_FRAME_SIZE  (48000*2)
+#define MAX_THREADS     256
+#define MAX_LINE        4096
+#define MAX_ARGS        64
+#define OUT_BUFFER_SIZE (256*1024)
+
+typedef struct {
+   int line;
+   int encode_only;
+   int decode_only;
+   int application;
+   opus_int32 sampling_rate;
+   int channels;
+   opus_int32 bitrate_bps;
+   int frame_size;
+   int use_vbr;
+   int cvbr;
+   int bandwidth;
+   int max_payload_bytes;
+   int complexity;
+   int use_inbandfec;
+   int forcechannels;
+   int use_dtx;
+   int packet_loss_perc;
+   char *text;          /* the line, split into the arguments */
+   char *in_file;
+   char *out_file;
+   long in_size;
+   /* Filled in by the worker that ran the job */
+   int worker;
+   int failed;
+   double audio_s;
+   double start_us;
+   double end_us;
+} batch_job;
+
+typedef struct out_buffer {
+   unsigned char *data;
+   size_t len;
+   FILE *file;
+   int busy;
+   int error;
+   struct out_buffer *next;
+} out_buffer;
+
+typedef struct {
+   int id;
+   pthread_t thread;
+   /* The jobs still queued for this worker.  The worker takes them from
+      head and other workers steal them from tail */
+   pthread_mutex_t lock;
+   int *queue;
+   int head;
+   int tail;
+   OpusEncoder *enc;
+   OpusDecoder *dec;
+   opus_int32 enc_rate;
+   int enc_channels;
+   int enc_application;
+   opus_int32 dec_rate;
+   int dec_channels;
+   short *in;
+   short *out;
+   unsigned char *fbytes;
+   unsigned char *data[2];
+   out_buffer buf[2];
+   int cur;
+   int nb_workers;
+   int jobs;
+   int stolen;
+   double busy_us;
+} batch_worker;
+
+static batch_job *jobs;
+static int nb_jobs;
+static batch_worker *workers;
+static double pool_start_us;
+
+/* The I/O thread writes out the full buffers queued here, in order */
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t io_done = PTHREAD_COND_INITIALIZER;
+static out_buffer *io_head;
+static out_buffer *io_tail;
+static int io_stop;
+
+static double now_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec*1e6 + ts.tv_nsec*1e-3;
+}
+
+static void int_to_char(opus_uint32 i, unsigned char ch[4])
+{
+    ch[0] = i>>24;
+    ch[1] = (i>>16)&0xFF;
+    ch[2] = (i>>8)&0xFF;
+    ch[3] = i&0xFF;
+}
+
+static opus_uint32 char_to_int(unsigned char ch[4])
+{
+    return ((opus_uint32)ch[0]<<24) | ((opus_uint32)ch[1]<<16)
+         | ((opus_uint32)ch[2]<< 8) |  (opus_uint32)ch[3];
+}
+
+void print_usage( char* argv[] )
+{
+    fprintf(stderr, "Usage: %s [options] <manifest>\n\n", argv[0]);
+    fprintf(stderr, "Each line of the manifest, or of stdin if it is -, is one job, given as\n"
+        "the arguments of opus_demo:\n\n");
+    fprintf(stderr, "  [-e] <application> <sampling rate (Hz)> <channels (1/2)> "
+        "<bits per second> [options] <input> <output>\n");
+    fprintf(stderr, "  -d <sampling rate (Hz)> <channels (1/2)> "
+        "[options] <input> <output>\n\n");
+    fprintf(stderr, "with the options -cbr, -cvbr, -bandwidth, -framesize, -max_payload,\n"
+        "-complexity, -inbandfec, -forcemono, -dtx and -loss.  Blank lines and\n"
+        "lines starting with # are skipped.  With -loss, the packets that are\n"
+        "lost are drawn from a generator of each job's own, so they are not the\n"
+        "ones that opus_demo loses.\n\n");
+    fprintf(stderr, "options:\n" );
+    fprintf(stderr, "-threads <n>         : worker threads; default: one per processor\n" );
+    fprintf(stderr, "-q                   : only print the summary, not a line per job\n" );
+}
+
+/* Parses the arguments of one job as opus_demo parses its command line */
+static int parse_job(batch_job *job, int argc, char **argv)
+{
+   int args = 0;
+
+   memset(job, 0, sizeof(*job));
+   job->application = OPUS_APPLICATION_AUDIO;
+   if (argc > 0 && strcmp(argv[args], "-e")==0)
+   {
+      job->encode_only = 1;
+      args++;
+   } else if (argc > 0 && strcmp(argv[args], "-d")==0)
+   {
+      job->decode_only = 1;
+      args++;
+   }
+   if (argc - args < (job->decode_only ? 4 : 6))
+   {
+      fprintf(stderr, "too few arguments\n");
+      return -1;
+   }
+   if (!job->decode_only)
+   {
+      if (strcmp(argv[args], "voip")==0)
+         job->application = OPUS_APPLICATION_VOIP;
+      else if (strcmp(argv[args], "restricted-lowdelay")==0)
+         job->application = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+      else if (strcmp(argv[args], "audio")!=0) {
+         fprintf(stderr, "unknown application: %s\n", argv[args]);
+         return -1;
+      }
+      args++;
+   }
+   job->sampling_rate = (opus_int32)atol(argv[args++]);
+   if (job->sampling_rate != 8000 && job->sampling_rate != 12000
+    && job->sampling_rate != 16000 && job->sampling_rate != 24000
+    && job->sampling_rate != 48000)
+   {
+      fprintf(stderr, "Supported sampling rates are 8000, 12000, "
+              "16000, 24000 and 48000.\n");
+      return -1;
+   }
+   job->frame_size = job->sampling_rate/50;
+   job->channels = atoi(argv[args++]);
+   if (job->channels < 1 || job->channels > 2)
+   {
+      fprintf(stderr, "only 1 or 2 channels are supported\n");
+      return -1;
+   }
+   if (!job->decode_only)
+      job->bitrate_bps = (opus_int32)atol(argv[args++]);
+
+   job->use_vbr = 1;
+   job->bandwidth = OPUS_AUTO;
+   job->max_payload_bytes = MAX_PACKET;
+   job->complexity = 10;
+   job->forcechannels = OPUS_AUTO;
+
+   while (args < argc - 2)
+   {
+      const char *opt = argv[args];
+      int has_value = args + 1 < argc - 2;
+      int encoder_option = 1;
+
+      if (strcmp(opt, "-cbr")==0) {
+         job->use_vbr = 0;
+         args++;
+      } else if (strcmp(opt, "-cvbr")==0) {
+         job->cvbr = 1;
+         args++;
+      } else if (strcmp(opt, "-forcemono")==0) {
+         job->forcechannels = 1;
+         args++;
+      } else if (strcmp(opt, "-dtx")==0) {
+         job->use_dtx = 1;
+         args++;
+      } else if (strcmp(opt, "-inbandfec")==0) {
+         job->use_inbandfec = 1;
+         encoder_option = 0;
+         args++;
+      } else if (!has_value) {
+         fprintf(stderr, "unrecognized setting: %s\n", opt);
+         return -1;
+      } else if (strcmp(opt, "-bandwidth")==0) {
+         const char *bw = argv[args + 1];
+         if (strcmp(bw, "NB")==0)
+            job->bandwidth = OPUS_BANDWIDTH_NARROWBAND;
+         else if (strcmp(bw, "MB")==0)
+            job->bandwidth = OPUS_BANDWIDTH_MEDIUMBAND;
+         else if (strcmp(bw, "WB")==0)
+            job->bandwidth = OPUS_BANDWIDTH_WIDEBAND;
+         else if (strcmp(bw, "SWB")==0)
+            job->bandwidth = OPUS_BANDWIDTH_SUPERWIDEBAND;
+         else if (strcmp(bw, "FB")==0)
+            job->bandwidth = OPUS_BANDWIDTH_FULLBAND;
+         else {
+            fprintf(stderr, "Unknown bandwidth %s. "
+                    "Supported are NB, MB, WB, SWB, FB.\n", bw);
+            return -1;
+         }
+         args += 2;
+      } else if (strcmp(opt, "-framesize")==0) {
+         const char *fs = argv[args + 1];
+         opus_int32 rate = job->sampling_rate;
+         if (strcmp(fs, "2.5")==0)
+            job->frame_size = rate/400;
+         else if (strcmp(fs, "5")==0)
+            job->frame_size = rate/200;
+         else if (strcmp(fs, "10")==0)
+            job->frame_size = rate/100;
+         else if (strcmp(fs, "20")==0)
+            job->frame_size = rate/50;
+         else if (strcmp(fs, "40")==0)
+            job->frame_size = rate/25;
+         else if (strcmp(fs, "60")==0)
+            job->frame_size = 3*rate/50;
+         else if (strcmp(fs, "80")==0)
+            job->frame_size = 4*rate/50;
+         else if (strcmp(fs, "100")==0)
+            job->frame_size = 5*rate/50;
+         else if (strcmp(fs, "120")==0)
+            job->frame_size = 6*rate/50;
+         else {
+            fprintf(stderr, "Unsupported frame size: %s ms. "
+                    "Supported are 2.5, 5, 10, 20, 40, 60, 80, 100, 120.\n",
+                    fs);
+            return -1;
+         }
+         args += 2;
+      } else if (strcmp(opt, "-max_payload")==0) {
+         job->max_payload_bytes = atoi(argv[args + 1]);
+         args += 2;
+      } else if (strcmp(opt, "-complexity")==0) {
+         job->complexity = atoi(argv[args + 1]);
+         args += 2;
+      } else if (strcmp(opt, "-loss")==0) {
+         job->packet_loss_perc = atoi(argv[args + 1]);
+         encoder_option = 0;
+         args += 2;
+      } else {
+         fprintf(stderr, "unrecognized setting: %s\n", opt);
+         return -1;
+      }
+      if (encoder_option && job->decode_only)
+      {
+         fprintf(stderr, "option %s is only for encoding\n", opt);
+         return -1;
+      }
+   }
+   if (job->max_payload_bytes < 0 || job->max_payload_bytes > MAX_PACKET)
+   {
+      fprintf(stderr, "max_payload_bytes must be between 0 and %d\n",
+              MAX_PACKET);
+      return -1;
+   }
+   job->in_file = argv[argc - 2];
+   job->out_file = argv[argc - 1];
+   return 0;
+}
+
+/* Reads the manifest into jobs.  The arguments of each job point into a
+   copy of its line, kept in text */
+static int read_manifest(const char *path)
+{
+   char line[MAX_LINE];
+   FILE *f;
+   int line_no = 0;
+   int max_jobs = 0;
+
+   f = strcmp(path, "-")==0 ? stdin : fopen(path, "r");
+   if (f == NULL)
+   {
+      fprintf(stderr, "Could not open manifest %s\n", path);
+      return -1;
+   }
+   while (fgets(line, sizeof(line), f) != NULL)
+   {
+      char *argv[MAX_ARGS];
+      char *copy;
+      char *tok;
+      int argc = 0;
+
+      line_no++;
+      copy = strdup(line);
+      if (copy == NULL)
+         return -1;
+      for (tok = strtok(copy, " \t\r\n"); tok != NULL && argc < MAX_ARGS;
+           tok = strtok(NULL, " \t\r\n"))
+         argv[argc++] = tok;
+      if (argc == 0 || argv[0][0] == '#')
+      {
+         free(copy);
+         continue;
+      }
+      if (nb_jobs == max_jobs)
+      {
+         batch_job *grown;
+         max_jobs = max_jobs ? 2*max_jobs : 64;
+         grown = (batch_job*)realloc(jobs, max_jobs*sizeof(*jobs));
+         if (grown == NULL)
+            return -1;
+         jobs = grown;
+      }
+      if (parse_job(&jobs[nb_jobs], argc, argv) != 0)
+      {
+         fprintf(stderr, "in line %d of %s\n", line_no, path);
+         return -1;
+      }
+      jobs[nb_jobs].text = copy;
+      jobs[nb_jobs].line = line_no;
+      nb_jobs++;
+   }
+   if (f != stdin)
+      fclose(f);
+   return 0;
+}
+
+static void *io_thread(void *arg)
+{
+   (void)arg;
+   pthread_mutex_lock(&io_lock);
+   for (;;)
+   {
+      out_buffer *buf;
+      while (io_head == NULL && !io_stop)
+         pthread_cond_wait(&io_work, &io_lock);
+      if (io_head == NULL)
+         break;
+      buf = io_head;
+      io_head = buf->next;
+      if (io_head == NULL)
+         io_tail = NULL;
+      pthread_mutex_unlock(&io_lock);
+
+      if (fwrite(buf->data, 1, buf->len, buf->file) != buf->len)
+         buf->error = 1;
+
+      pthread_mutex_lock(&io_lock);
+      buf->len = 0;
+      buf->busy = 0;
+      pthread_cond_broadcast(&io_done);
+   }
+   pthread_mutex_unlock(&io_lock);
+   return NULL;
+}
+
+/* Hands the buffer being filled to the I/O thread and waits for the other
+   one to be written, so that it can be filled next */
+static void out_flush(batch_worker *w)
+{
+   out_buffer *buf = &w->buf[w->cur];
+
+   pthread_mutex_lock(&io_lock);
+   if (buf->len > 0)
+   {
+      buf->busy = 1;
+      buf->next = NULL;
+      if (io_tail)
+         io_tail->next = buf;
+      else
+         io_head = buf;
+      io_tail = buf;
+      pthread_cond_signal(&io_work);
+   }
+   w->cur ^= 1;
+   while (w->buf[w->cur].busy)
+      pthread_cond_wait(&io_done, &io_lock);
+   pthread_mutex_unlock(&io_lock);
+}
+
+static void out_write(batch_worker *w, const unsigned char *p, size_t n)
+{
+   while (n > 0)
+   {
+      out_buffer *buf = &w->buf[w->cur];
+      size_t room = OUT_BUFFER_SIZE - buf->len;
+      if (room > n)
+         room = n;
+      memcpy(buf->data + buf->len, p, room);
+      buf->len += room;
+      p += room;
+      n -= room;
+      if (buf->len == OUT_BUFFER_SIZE)
+         out_flush(w);
+   }
+}
+
+/* Writes out what is left of the output of a job and closes the file */
+static int out_close(batch_worker *w, FILE *f)
+{
+   int error;
+
+   out_flush(w);
+   out_flush(w);
+   error = w->buf[0].error || w->buf[1].error;
+   w->buf[0].error = w->buf[1].error = 0;
+   if (fclose(f) != 0)
+      error = 1;
+   return error ? -1 : 0;
+}
+
+/* Gets the worker's encoder and decoder ready for a job.  They are only
+   initialized again when the job needs a different configuration, or else
+   reset, and all the settings of the job are applied either way */
+static int setup_codecs(batch_worker *w, const batch_job *job, opus_int32 *skip)
+{
+   int err;
+
+   *skip = 0;
+   if (!job->decode_only)
+   {
+      OpusEncoder *enc = w->enc;
+      if (w->enc_rate == job->sampling_rate
+       && w->enc_channels == job->channels
+       && w->enc_application == job->application)
+      {
+         err = opus_encoder_ctl(enc, OPUS_RESET_STATE);
+      } else {
+         err = opus_encoder_init(enc, job->sampling_rate, job->channels,
+                                 job->application);
+         w->enc_rate = err == OPUS_OK ? job->sampling_rate : 0;
+         w->enc_channels = job->channels;
+         w->enc_application = job->application;
+      }
+      if (err != OPUS_OK)
+      {
+         fprintf(stderr, "Cannot set up encoder: %s\n", opus_strerror(err));
+         return -1;
+      }
+      opus_encoder_ctl(enc, OPUS_SET_BITRATE(job->bitrate_bps));
+      opus_encoder_ctl(enc, OPUS_SET_BANDWIDTH(job->bandwidth));
+      opus_encoder_ctl(enc, OPUS_SET_VBR(job->use_vbr));
+      opus_encoder_ctl(enc, OPUS_SET_VBR_CONSTRAINT(job->cvbr));
+      opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(job->complexity));
+      opus_encoder_ctl(enc, OPUS_SET_INBAND_FEC(job->use_inbandfec));
+      opus_encoder_ctl(enc, OPUS_SET_FORCE_CHANNELS(job->forcechannels));
+      opus_encoder_ctl(enc, OPUS_SET_DTX(job->use_dtx));
+      opus_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(job->packet_loss_perc));
+      opus_encoder_ctl(enc, OPUS_GET_LOOKAHEAD(skip));
+      opus_encoder_ctl(enc, OPUS_SET_LSB_DEPTH(16));
+      opus_encoder_ctl(enc, OPUS_SET_EXPERT_FRAME_DURATION(OPUS_FRAMESIZE_ARG));
+   }
+   if (!job->encode_only)
+   {
+      if (w->dec_rate == job->sampling_rate
+       && w->dec_channels == job->channels)
+      {
+         err = opus_decoder_ctl(w->dec, OPUS_RESET_STATE);
+      } else {
+         err = opus_decoder_init(w->dec, job->sampling_rate, job->channels);
+         w->dec_rate = err == OPUS_OK ? job->sampling_rate : 0;
+         w->dec_channels = job->channels;
+      }
+      if (err != OPUS_OK)
+      {
+         fprintf(stderr, "Cannot set up decoder: %s\n", opus_strerror(err));
+         return -1;
+      }
+   }
+   return 0;
+}
+
+/* Runs one job the way opus_demo runs its file, leaving out the options
+   that only opus_demo has */
+static int run_job(batch_worker *w, batch_job *job)
+{
+   OpusEncoder *enc = w->enc;
+   OpusDecoder *dec = w->dec;
+   short *in = w->in;
+   short *out = w->out;
+   unsigned char *fbytes = w->fbytes;
+   unsigned char **data = w->data;
+   FILE *fin;
+   FILE *fout;
+   int channels = job->channels;
+   int frame_size = job->frame_size;
+   int use_inbandfec = job->use_inbandfec;
+   int len[2] = {0, 0};
+   opus_uint32 enc_final_range[2] = {0, 0};
+   opus_uint32 dec_final_range;
+   opus_uint64 tot_in = 0, tot_out = 0;
+   double tot_samples = 0;
+   opus_int32 skip;
+   opus_int32 count = 0;
+   opus_uint32 seed = 1;
+   int lost = 0, lost_prev = 1;
+   int toggle = 0;
+   int stop = 0;
+   int ret = 0;
+   size_t num_read;
+
+   fin = fopen(job->in_file, "rb");
+   if (fin == NULL)
+   {
+      fprintf(stderr, "Could not open input file %s\n", job->in_file);
+      return -1;
+   }
+   fout = fopen(job->out_file, "wb+");
+   if (fout == NULL)
+   {
+      fprintf(stderr, "Could not open output file %s\n", job->out_file);
+      fclose(fin);
+      return -1;
+   }
+   w->buf[0].file = w->buf[1].file = fout;
+   if (setup_codecs(w, job, &skip) != 0)
+   {
+      fclose(fin);
+      fclose(fout);
+      return -1;
+   }
+
+   while (!stop)
+   {
+      int nb_encoded = 0;
+
+      if (job->decode_only)
+      {
+         unsigned char ch[4];
+         num_read = fread(ch, 1, 4, fin);
+         if (num_read!=4)
+            break;
+         len[toggle] = char_to_int(ch);
+         if (len[toggle]>job->max_payload_bytes || len[toggle]<0)
+         {
+            fprintf(stderr, "Invalid payload length: %d\n", len[toggle]);
+            break;
+         }
+         num_read = fread(ch, 1, 4, fin);
+         if (num_read!=4)
+            break;
+         enc_final_range[toggle] = char_to_int(ch);
+         num_read = fread(data[toggle], 1, len[toggle], fin);
+         if (num_read!=(size_t)len[toggle])
+         {
+            fprintf(stderr, "Ran out of input, expecting %d bytes got %d\n",
+                    len[toggle], (int)num_read);
+            break;
+         }
+      } else {
+         int i;
+         int curr_read;
+         num_read = fread(fbytes, sizeof(short)*channels, frame_size, fin);
+         curr_read = (int)num_read;
+         tot_in += curr_read;
+         for (i=0;i<curr_read*channels;i++)
+         {
+            opus_int32 s;
+            s=fbytes[2*i+1]<<8|fbytes[2*i];
+            s=((s&0xFFFF)^0x8000)-0x8000;
+            in[i]=s;
+         }
+         if (curr_read < frame_size)
+         {
+            for (i=curr_read*channels;i<frame_size*channels;i++)
+               in[i] = 0;
+            if (job->encode_only)
+               stop = 1;
+         }
+         len[toggle] = opus_encode(enc, in, frame_size, data[toggle],
+                                   job->max_payload_bytes);
+         opus_encoder_ctl(enc, OPUS_GET_FINAL_RANGE(&enc_final_range[toggle]));
+         if (len[toggle] < 0)
+         {
+            fprintf(stderr, "opus_encode() returned %d\n", len[toggle]);
+            ret = -1;
+            break;
+         }
+         nb_encoded = opus_packet_get_samples_per_frame(data[toggle],
+               job->sampling_rate)*opus_packet_get_nb_frames(data[toggle],
+               len[toggle]);
+      }
+
+      if (job->encode_only)
+      {
+         unsigned char int_field[4];
+         int_to_char(len[toggle], int_field);
+         out_write(w, int_field, 4);
+         int_to_char(enc_final_range[toggle], int_field);
+         out_write(w, int_field, 4);
+         out_write(w, data[toggle], len[toggle]);
+         tot_samples += nb_encoded;
+      } else {
+         opus_int32 output_samples;
+         if (job->packet_loss_perc > 0)
+            seed = seed*1103515245 + 12345;
+         lost = len[toggle]==0 || (job->packet_loss_perc>0
+               && (int)((seed>>16)%100) < job->packet_loss_perc);
+         if (lost)
+            opus_decoder_ctl(dec, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
+         else
+            output_samples = MAX_FRAME_SIZE;
+         if (count >= use_inbandfec) {
+            /* delay by one packet when using in-band FEC */
+            if (use_inbandfec) {
+               if (lost_prev) {
+                  /* attempt to decode with in-band FEC from next packet */
+                  opus_decoder_ctl(dec, OPUS_GET_LAST_PACKET_DURATION(&output_samples));
+                  output_samples = opus_decode(dec, lost ? NULL : data[toggle],
+                        len[toggle], out, output_samples, 1);
+               } else {
+                  /* regular decode */
+                  output_samples = MAX_FRAME_SIZE;
+                  output_samples = opus_decode(dec, data[1-toggle],
+                        len[1-toggle], out, output_samples, 0);
+               }
+            } else {
+               output_samples = opus_decode(dec, lost ? NULL : data[toggle],
+                     len[toggle], out, output_samples, 0);
+            }
+            if (output_samples>0)
+            {
+               if (!job->decode_only && tot_out + output_samples > tot_in)
+               {
+                  stop=1;
+                  output_samples = (opus_int32)(tot_in - tot_out);
+               }
+               if (output_samples>skip) {
+                  int i;
+                  for (i=0;i<(output_samples-skip)*channels;i++)
+                  {
+                     short s;
+                     s=out[i+(skip*channels)];
+                     fbytes[2*i]=s&0xFF;
+                     fbytes[2*i+1]=(s>>8)&0xFF;
+                  }
+                  out_write(w, fbytes,
+                        sizeof(short)*channels*(output_samples-skip));
+                  tot_out += output_samples-skip;
+               }
+               if (output_samples<skip) skip -= output_samples;
+               else skip = 0;
+            } else {
+               fprintf(stderr, "error decoding frame: %s\n",
+                       opus_strerror(output_samples));
+            }
+            tot_samples += output_samples;
+         }
+      }
+
+      if (!job->encode_only)
+         opus_decoder_ctl(dec, OPUS_GET_FINAL_RANGE(&dec_final_range));
+      /* compare final range encoder rng values of encoder and decoder */
+      if (enc_final_range[toggle^use_inbandfec]!=0 && !job->encode_only
+       && !lost && !lost_prev
+       && dec_final_range != enc_final_range[toggle^use_inbandfec]) {
+         fprintf(stderr, "Error: Range coder state mismatch "
+                 "between encoder and decoder in frame %ld\n", (long)count);
+         ret = -1;
+         break;
+      }
+      lost_prev = lost;
+      count++;
+      toggle = (toggle + use_inbandfec) & 1;
+   }
+
+   fclose(fin);
+   if (out_close(w, fout) != 0)
+   {
+      fprintf(stderr, "Error writing %s\n", job->out_file);
+      ret = -1;
+   }
+   job->audio_s = tot_samples/job->sampling_rate;
+   return ret;
+}
+
+/* Takes the next job of the worker's own queue, or steals the last one of
+   another worker's.  Returns -1 when there are none left anywhere */
+static int next_job(batch_worker *w)
+{
+   int i;
+   int job = -1;
+
+   pthread_mutex_lock(&w->lock);
+   if (w->head < w->tail)
+      job = w->queue[w->head++];
+   pthread_mutex_unlock(&w->lock);
+   for (i = 1; job < 0 && i < w->nb_workers; i++)
+   {
+      batch_worker *victim = &workers[(w->id + i) % w->nb_workers];
+      pthread_mutex_lock(&victim->lock);
+      if (victim->head < victim->tail)
+      {
+         job = victim->queue[--victim->tail];
+         w->stolen++;
+      }
+      pthread_mutex_unlock(&victim->lock);
+   }
+   return job;
+}
+
+static void *worker_thread(void *arg)
+{
+   batch_worker *w = (batch_worker*)arg;
+   int j;
+
+   while ((j = next_job(w)) >= 0)
+   {
+      batch_job *job = &jobs[j];
+      job->worker = w->id;
+      job->start_us = now_us();
+      job->failed = run_job(w, job) != 0;
+      if (job->failed)
+         fprintf(stderr, "job on line %d failed\n", job->line);
+      job->end_us = now_us();
+      w->busy_us += job->end_us - job->start_us;
+      w->jobs++;
+   }
+   return NULL;
+}
+
+static int worker_init(batch_worker *w, int id, int nb_workers)
+{
+   int i;
+
+   memset(w, 0, sizeof(*w));
+   w->id = id;
+   w->nb_workers = nb_workers;
+   pthread_mutex_init(&w->lock, NULL);
+   w->queue = (int*)malloc(nb_jobs*sizeof(int));
+   w->enc = (OpusEncoder*)malloc(opus_encoder_get_size(2));
+   w->dec = (OpusDecoder*)malloc(opus_decoder_get_size(2));
+   w->in = (short*)malloc(MAX_FRAME_SIZE*2*sizeof(short));
+   w->out = (short*)malloc(MAX_FRAME_SIZE*2*sizeof(short));
+   w->fbytes = (unsigned char*)malloc(MAX_FRAME_SIZE*2*sizeof(short));
+   w->data[0] = (unsigned char*)calloc(MAX_PACKET, 1);
+   w->data[1] = (unsigned char*)calloc(MAX_PACKET, 1);
+   if (!w->queue || !w->enc || !w->dec || !w->in || !w->out || !w->fbytes
+    || !w->data[0] || !w->data[1])
+      return -1;
+   for (i = 0; i < 2; i++)
+   {
+      w->buf[i].data = (unsigned char*)malloc(OUT_BUFFER_SIZE);
+      if (!w->buf[i].data)
+         return -1;
+   }
+   return 0;
+}
+
+static void worker_free(batch_worker *w)
+{
+   pthread_mutex_destroy(&w->lock);
+   free(w->queue);
+   free(w->enc);
+   free(w->dec);
+   free(w->in);
+   free(w->out);
+   free(w->fbytes);
+   free(w->data[0]);
+   free(w->data[1]);
+   free(w->buf[0].data);
+   free(w->buf[1].data);
+}
+
+static int compare_size(const void *a, const void *b)
+{
+   long sa = jobs[*(const int*)a].in_size;
+   long sb = jobs[*(const int*)b].in_size;
+   return sa < sb ? 1 : sa > sb ? -1 : *(const int*)a - *(const int*)b;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+   double da = *(const double*)a;
+   double db = *(const double*)b;
+   return da < db ? -1 : da > db;
+}
+
+int main(int argc, char *argv[])
+{
+   pthread_t io;
+   int *order;
+   double *run_ms;
+   double wall_us;
+   double audio_s = 0;
+   int nb_threads;
+   int quiet = 0;
+   int failed = 0;
+   int args;
+   int i;
+
+   nb_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   for (args = 1; args < argc - 1; args++)
+   {
+      if (strcmp(argv[args], "-threads")==0 && args + 1 < argc - 1)
+         nb_threads = atoi(argv[++args]);
+      else if (strcmp(argv[args], "-q")==0)
+         quiet = 1;
+      else
+         break;
+   }
+   if (args != argc - 1 || nb_threads < 1 || nb_threads > MAX_THREADS)
+   {
+      print_usage(argv);
+      return EXIT_FAILURE;
+   }
+   if (read_manifest(argv[args]) != 0)
+      return EXIT_FAILURE;
+   if (nb_jobs == 0)
+   {
+      fprintf(stderr, "No jobs in %s\n", argv[args]);
+      return EXIT_FAILURE;
+   }
+   if (nb_threads > nb_jobs)
+      nb_threads = nb_jobs;
+   fprintf(stderr, "%s\n", opus_get_version_string());
+
+   /* Deal the jobs out longest first, so that the long ones start early and
+      the short ones at the end fill in the gaps */
+   order = (int*)malloc(nb_jobs*sizeof(int));
+   run_ms = (double*)malloc(nb_jobs*sizeof(double));
+   workers = (batch_worker*)calloc(nb_threads, sizeof(batch_worker));
+   if (!order || !run_ms || !workers)
+   {
+      fprintf(stderr, "Out of memory\n");
+      return EXIT_FAILURE;
+   }
+   for (i = 0; i < nb_jobs; i++)
+   {
+      FILE *f = fopen(jobs[i].in_file, "rb");
+      jobs[i].in_size = 0;
+      if (f != NULL)
+      {
+         fseek(f, 0, SEEK_END);
+         jobs[i].in_size = ftell(f);
+         fclose(f);
+      }
+      order[i] = i;
+   }
+   qsort(order, nb_jobs, sizeof(int), compare_size);
+   for (i = 0; i < nb_threads; i++)
+   {
+      if (worker_init(&workers[i], i, nb_threads) != 0)
+      {
+         fprintf(stderr, "Out of memory\n");
+         return EXIT_FAILURE;
+      }
+   }
+   for (i = 0; i < nb_jobs; i++)
+   {
+      batch_worker *w = &workers[i % nb_threads];
+      w->queue[w->tail++] = order[i];
+   }
+
+   pool_start_us = now_us();
+   if (pthread_create(&io, NULL, io_thread, NULL) != 0)
+   {
+      fprintf(stderr, "Cannot start the I/O thread\n");
+      return EXIT_FAILURE;
+   }
+   for (i = 0; i < nb_threads; i++)
+   {
+      if (pthread_create(&workers[i].thread, NULL, worker_thread,
+                         &workers[i]) != 0)
+      {
+         fprintf(stderr, "Cannot start worker %d\n", i);
+         return EXIT_FAILURE;
+      }
+   }
+   for (i = 0; i < nb_threads; i++)
+      pthread_join(workers[i].thread, NULL);
+   wall_us = now_us() - pool_start_us;
+   pthread_mutex_lock(&io_lock);
+   io_stop = 1;
+   pthread_cond_signal(&io_work);
+   pthread_mutex_unlock(&io_lock);
+   pthread_join(io, NULL);
+
+   if (!quiet)
+      printf("line,worker,input,audio_s,wait_ms,run_ms,realtime,status\n");
+   for (i = 0; i < nb_jobs; i++)
+   {
+      batch_job *job = &jobs[i];
+      run_ms[i] = (job->end_us - job->start_us)*1e-3;
+      audio_s += job->audio_s;
+      failed += job->failed;
+      if (!quiet)
+         printf("%d,%d,%s,%.3f,%.1f,%.1f,%.1f,%s\n", job->line, job->worker,
+               job->in_file, job->audio_s,
+               (job->start_us - pool_start_us)*1e-3, run_ms[i],
+               run_ms[i] > 0 ? job->audio_s*1e3/run_ms[i] : 0.0,
+               job->failed ? "failed" : "ok");
+   }
+   qsort(run_ms, nb_jobs, sizeof(double), compare_double);
+
+   fprintf(stderr, "jobs:                        %d on %d threads, %d failed\n",
+           nb_jobs, nb_threads, failed);
+   fprintf(stderr, "audio:                       %.3f s in %.3f s, %.1fx realtime\n",
+           audio_s, wall_us*1e-6, audio_s*1e6/wall_us);
+   fprintf(stderr, "job time:                    p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           run_ms[nb_jobs/2], run_ms[(nb_jobs*99)/100], run_ms[nb_jobs - 1]);
+   for (i = 0; i < nb_threads; i++)
+   {
+      batch_worker *w = &workers[i];
+      fprintf(stderr, "thread %-3d                   %d jobs (%d stolen), "
+              "%.3f s busy, %.0f%% utilization\n", i, w->jobs, w->stolen,
+              w->busy_us*1e-6, 100.0*w->busy_us/wall_us);
+      worker_free(w);
+   }
+
+   for (i = 0; i < nb_jobs; i++)
+      free(jobs[i].text);
+   free(order);
+   free(run_ms);
+   free(workers);
+   free(jobs);
+   return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,594 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Encoder benchmark.  Does on the host what the testenc command of the
+   TM4C opus_enc_dec application does on the board, over a whole grid of
+   settings: every combination of sampling rate, channels, forced mode,
+   frame size, complexity and bitrate encodes the same corpus, and the time
+   of each opus_encode() call is kept.  One CSV line or JSON object per
+   combination gives the percentiles of those times, the speed as a
+   multiple of real time and the bytes per frame. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "opus.h"
+#include "opus_private.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define MAX_PACKET 1500
+#define MAX_LIST   16
+#define BENCH_PI   3.14159265358979323846
+
+/* Corpus files are raw 16 bit little endian PCM at this rate, stereo
+   unless -mono-input is given */
+#define CORPUS_RATE 48000
+
+#define MODE_AUTO 0
+
+typedef struct {
+   int n;
+   int v[MAX_LIST];
+} int_list;
+
+typedef struct {
+   int rate;
+   int channels;
+   int mode;
+   int frame_size;      /* in samples at rate */
+   int complexity;
+   opus_int32 bitrate;
+} bench_config;
+
+typedef struct {
+   long frames;
+   double bytes;
+   double total_us;
+   double mean_us;
+   double p50_us;
+   double p99_us;
+   double max_us;
+   double realtime;
+   long coded[3];       /* frames the encoder coded in SILK, hybrid, CELT */
+} bench_result;
+
+static const char *mode_name(int mode)
+{
+   switch (mode)
+   {
+   case MODE_SILK_ONLY: return "silk";
+   case MODE_HYBRID:    return "hybrid";
+   case MODE_CELT_ONLY: return "celt";
+   default:             return "auto";
+   }
+}
+
+static double now_us(void)
+{
+#ifdef _WIN32
+   LARGE_INTEGER freq, count;
+   QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+   return (double)count.QuadPart*1e6/(double)freq.QuadPart;
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec*1e6 + ts.tv_nsec*1e-3;
+#endif
+}
+
+void print_usage( char* argv[] )
+{
+    fprintf(stderr, "Usage: %s [options] [<corpus.pcm> ...]\n\n", argv[0]);
+    fprintf(stderr, "Corpus files are raw 16 bit little endian PCM at 48 kHz, stereo unless\n"
+        "-mono-input is given.  Without any, a generated mix of speech-like\n"
+        "sound and music is used.  Lists are comma separated.\n\n");
+    fprintf(stderr, "options:\n" );
+    fprintf(stderr, "-rate <list>         : sampling rates in Hz; default: 48000\n" );
+    fprintf(stderr, "-channels <list>     : 1 and/or 2; default: 1,2\n" );
+    fprintf(stderr, "-mode <list>         : auto, silk, hybrid, celt; default: silk,hybrid,celt\n" );
+    fprintf(stderr, "-framesize <list>    : 2.5, 5, 10, 20, 40 or 60 ms; default: all of them\n" );
+    fprintf(stderr, "-complexity <list>   : 0 to 10; default: 0 to 10\n" );
+    fprintf(stderr, "-bitrate <list>      : bits per second; default: 32000\n" );
+    fprintf(stderr, "-application <voip|audio|restricted-lowdelay> : default: audio\n" );
+    fprintf(stderr, "-cbr                 : constant bitrate; default: variable\n" );
+    fprintf(stderr, "-mono-input          : the corpus files are mono\n" );
+    fprintf(stderr, "-seconds <n>         : length of the generated corpus; default: 10\n" );
+    fprintf(stderr, "-json                : JSON instead of CSV\n" );
+    fprintf(stderr, "-o <file>            : write the results there instead of stdout\n" );
+    fprintf(stderr, "\nCombinations a mode can not encode (SILK and hybrid below 10 ms, hybrid\n"
+        "below 24 kHz) are left out.\n");
+}
+
+/* Parses a comma separated list.  scale multiplies each number, so that
+   "2.5" ms can be kept in tenths of ms */
+static int parse_list(const char *s, int_list *list, double scale)
+{
+   char *end;
+   list->n = 0;
+   while (*s)
+   {
+      double v;
+      if (list->n == MAX_LIST)
+         return -1;
+      v = strtod(s, &end);
+      if (end == s)
+         return -1;
+      list->v[list->n++] = (int)floor(v*scale + .5);
+      s = end;
+      if (*s == ',')
+         s++;
+      else if (*s)
+         return -1;
+   }
+   return list->n > 0 ? 0 : -1;
+}
+
+static int parse_modes(const char *s, int_list *list)
+{
+   list->n = 0;
+   while (*s)
+   {
+      size_t len = strcspn(s, ",");
+      if (list->n == MAX_LIST)
+         return -1;
+      if (len == 4 && strncmp(s, "auto", 4) == 0)
+         list->v[list->n++] = MODE_AUTO;
+      else if (len == 4 && strncmp(s, "silk", 4) == 0)
+         list->v[list->n++] = MODE_SILK_ONLY;
+      else if (len == 6 && strncmp(s, "hybrid", 6) == 0)
+         list->v[list->n++] = MODE_HYBRID;
+      else if (len == 4 && strncmp(s, "celt", 4) == 0)
+         list->v[list->n++] = MODE_CELT_ONLY;
+      else
+         return -1;
+      s += len;
+      if (*s == ',')
+         s++;
+   }
+   return list->n > 0 ? 0 : -1;
+}
+
+/* Appends a corpus file to the 48 kHz stereo buffer */
+static int load_corpus(const char *path, int mono, opus_int16 **pcm,
+      long *samples)
+{
+   unsigned char buf[4096];
+   FILE *f;
+   size_t n;
+   int in_ch = mono ? 1 : 2;
+
+   f = fopen(path, "rb");
+   if (f == NULL)
+   {
+      fprintf(stderr, "Could not open corpus file %s\n", path);
+      return -1;
+   }
+   while ((n = fread(buf, 2*in_ch, sizeof(buf)/(2*in_ch), f)) > 0)
+   {
+      size_t i;
+      opus_int16 *p = (opus_int16 *)realloc(*pcm,
+            (*samples + n)*2*sizeof(opus_int16));
+      if (p == NULL)
+      {
+         fclose(f);
+         return -1;
+      }
+      *pcm = p;
+      for (i = 0; i < n; i++)
+      {
+         const unsigned char *s = buf + i*2*in_ch;
+         opus_int16 l = (opus_int16)(s[0] | (s[1] << 8));
+         opus_int16 r = mono ? l : (opus_int16)(s[2] | (s[3] << 8));
+         p[2*(*samples + i)] = l;
+         p[2*(*samples + i) + 1] = r;
+      }
+      *samples += n;
+   }
+   fclose(f);
+   return 0;
+}
+
+/* Alternates speech-like and music-like sections, so that the automatic
+   mode decision and every layer of the codec see their usual input */
+static opus_int16 *generate_corpus(int seconds, long *samples)
+{
+   opus_int16 *pcm;
+   long i, n = (long)seconds*CORPUS_RATE;
+   opus_uint32 seed = 1;
+   double phase[4] = {0, 0, 0, 0};
+
+   pcm = (opus_int16 *)malloc(n*2*sizeof(opus_int16));
+   if (pcm == NULL)
+      return NULL;
+   for (i = 0; i < n; i++)
+   {
+      double t = (double)i/CORPUS_RATE;
+      double l, r, noise;
+      seed = 1664525*seed + 1013904223;
+      noise = ((opus_int32)seed >> 16)/32768.0;
+      if (((long)t/2) % 2 == 0)
+      {
+         /* Voiced syllables: a 120 Hz pulse train with formants, 4 per s */
+         double env = .5 - .5*cos(2*BENCH_PI*4*t);
+         double f0 = 120 + 20*sin(2*BENCH_PI*.7*t);
+         phase[0] += 2*BENCH_PI*f0/CORPUS_RATE;
+         l = env*(.4*sin(phase[0]) + .25*sin(3*phase[0]) + .15*sin(7*phase[0]) +
+               .1*sin(17*phase[0])) + .02*noise;
+         r = .8*l;
+      } else {
+         /* Chords with different notes left and right */
+         phase[1] += 2*BENCH_PI*440/CORPUS_RATE;
+         phase[2] += 2*BENCH_PI*554.37/CORPUS_RATE;
+         phase[3] += 2*BENCH_PI*3520/CORPUS_RATE;
+         l = .3*sin(phase[1]) + .2*sin(phase[2]) + .05*sin(phase[3]) + .01*noise;
+         r = .3*sin(phase[1]) + .2*sin(1.5*phase[2]) + .08*sin(phase[3]) + .01*noise;
+      }
+      pcm[2*i] = (opus_int16)floor(.5 + 32767*l*.8);
+      pcm[2*i + 1] = (opus_int16)floor(.5 + 32767*r*.8);
+   }
+   *samples = n;
+   return pcm;
+}
+
+/* The corpus at the rate and channels of a combination.  The rates Opus
+   takes all divide 48 kHz, averaging each group of samples is filter
+   enough for timing */
+static opus_int16 *convert_corpus(const opus_int16 *pcm, long samples,
+      int rate, int channels, long *out_samples)
+{
+   int step = CORPUS_RATE/rate;
+   long i, n = samples/step;
+   opus_int16 *out = (opus_int16 *)malloc(n*channels*sizeof(opus_int16));
+
+   if (out == NULL)
+      return NULL;
+   for (i = 0; i < n; i++)
+   {
+      opus_int32 l = 0, r = 0;
+      int k;
+      for (k = 0; k < step; k++)
+      {
+         l += pcm[2*(i*step + k)];
+         r += pcm[2*(i*step + k) + 1];
+      }
+      if (channels == 1)
+      {
+         out[i] = (opus_int16)((l + r)/(2*step));
+      } else {
+         out[2*i] = (opus_int16)(l/step);
+         out[2*i + 1] = (opus_int16)(r/step);
+      }
+   }
+   *out_samples = n;
+   return out;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+   double x = *(const double *)a, y = *(const double *)b;
+   return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of sorted times */
+static double percentile(const double *sorted, long n, double p)
+{
+   long rank = (long)ceil(p/100*n);
+   if (rank < 1)
+      rank = 1;
+   return sorted[rank - 1];
+}
+
+static int run_config(const bench_config *cfg, int application, int cbr,
+      const opus_int16 *pcm, long samples, double *times, bench_result *res)
+{
+   unsigned char packet[MAX_PACKET];
+   OpusEncoder *enc;
+   long i;
+   int err;
+
+   enc = opus_encoder_create(cfg->rate, cfg->channels, application, &err);
+   if (err != OPUS_OK)
+   {
+      fprintf(stderr, "Cannot create encoder: %s\n", opus_strerror(err));
+      return -1;
+   }
+   opus_encoder_ctl(enc, OPUS_SET_BITRATE(cfg->bitrate));
+   opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(cfg->complexity));
+   opus_encoder_ctl(enc, OPUS_SET_VBR(!cbr));
+   if (cfg->mode != MODE_AUTO)
+      opus_encoder_ctl(enc, OPUS_SET_FORCE_MODE(cfg->mode));
+   /* Above wideband the encoder adds CELT to a forced SILK, making it
+      hybrid */
+   if (cfg->mode == MODE_SILK_ONLY)
+      opus_encoder_ctl(enc, OPUS_SET_MAX_BANDWIDTH(OPUS_BANDWIDTH_WIDEBAND));
+
+   memset(res, 0, sizeof(*res));
+   for (i = 0; i + cfg->frame_size <= samples; i += cfg->frame_size)
+   {
+      double start = now_us();
+      int len = opus_encode(enc, pcm + i*cfg->channels, cfg->frame_size,
+            packet, MAX_PACKET);
+      double elapsed = now_us() - start;
+      if (len < 0)
+      {
+         fprintf(stderr, "opus_encode() returned %s\n", opus_strerror(len));
+         opus_encoder_destroy(enc);
+         return -1;
+      }
+      times[res->frames++] = elapsed;
+      res->bytes += len;
+      /* The TOC configuration tells the mode actually used */
+      if (len > 0)
+         res->coded[(packet[0] >> 3) < 12 ? 0 : (packet[0] >> 3) < 16 ? 1 : 2]++;
+      res->total_us += elapsed;
+   }
+   opus_encoder_destroy(enc);
+   if (res->frames == 0)
+      return -1;
+
+   res->mean_us = res->total_us/res->frames;
+   res->bytes /= res->frames;
+   res->realtime = (double)res->frames*cfg->frame_size/cfg->rate*1e6/res->total_us;
+   qsort(times, res->frames, sizeof(*times), compare_double);
+   res->p50_us = percentile(times, res->frames, 50);
+   res->p99_us = percentile(times, res->frames, 99);
+   res->max_us = times[res->frames - 1];
+   return 0;
+}
+
+static void print_result(FILE *out, int json, int first,
+      const bench_config *cfg, const bench_result *res)
+{
+   static const int coded_modes[3] = {MODE_SILK_ONLY, MODE_HYBRID, MODE_CELT_ONLY};
+   double frame_ms = cfg->frame_size*1000.0/cfg->rate;
+   double kbps = res->bytes*8/frame_ms;
+   int coded = 0;
+   int i;
+   /* Forcing a mode is a request, the encoder still falls back when the
+      bandwidth or bitrate do not allow it.  Say what most frames were */
+   for (i = 1; i < 3; i++)
+   {
+      if (res->coded[i] > res->coded[coded])
+         coded = i;
+   }
+   if (json)
+   {
+      fprintf(out, "%s    {\"rate\": %d, \"channels\": %d, \"mode\": \"%s\", "
+            "\"coded_mode\": \"%s\", \"frame_ms\": %g, \"complexity\": %d, \"bitrate\": %ld, "
+            "\"frames\": %ld, \"bytes_per_frame\": %.2f, \"kbps\": %.2f, "
+            "\"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, "
+            "\"max_us\": %.2f, \"realtime\": %.2f}",
+            first ? "" : ",\n", cfg->rate, cfg->channels, mode_name(cfg->mode),
+            mode_name(coded_modes[coded]), frame_ms, cfg->complexity, (long)cfg->bitrate, res->frames,
+            res->bytes, kbps, res->mean_us, res->p50_us, res->p99_us,
+            res->max_us, res->realtime);
+   } else {
+      fprintf(out, "%s,%d,%d,%s,%s,%g,%d,%ld,%ld,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+            opus_get_version_string(), cfg->rate, cfg->channels,
+            mode_name(cfg->mode), mode_name(coded_modes[coded]), frame_ms, cfg->complexity, (long)cfg->bitrate,
+            res->frames, res->bytes, kbps, res->mean_us, res->p50_us,
+            res->p99_us, res->max_us, res->realtime);
+   }
+   fflush(out);
+}
+
+int main(int argc, char *argv[])
+{
+   int_list rates, channels, modes, frame_ms, complexities, bitrates;
+   int application = OPUS_APPLICATION_AUDIO;
+   int cbr = 0, mono_input = 0, json = 0, seconds = 10;
+   int first = 1, skipped = 0;
+   const char *out_path = NULL;
+   opus_int16 *corpus = NULL;
+   long corpus_samples = 0;
+   double *times;
+   FILE *out = stdout;
+   int args;
+   int r, c, m, f, x, b;
+
+   parse_list("48000", &rates, 1);
+   parse_list("1,2", &channels, 1);
+   parse_modes("silk,hybrid,celt", &modes);
+   parse_list("2.5,5,10,20,40,60", &frame_ms, 10);
+   parse_list("0,1,2,3,4,5,6,7,8,9,10", &complexities, 1);
+   parse_list("32000", &bitrates, 1);
+
+   for (args = 1; args < argc && argv[args][0] == '-'; args++)
+   {
+      int ok = 1;
+      const char *opt = argv[args];
+      const char *val = args + 1 < argc ? argv[args + 1] : NULL;
+      if (strcmp(opt, "-cbr") == 0) {
+         cbr = 1;
+         continue;
+      } else if (strcmp(opt, "-mono-input") == 0) {
+         mono_input = 1;
+         continue;
+      } else if (strcmp(opt, "-json") == 0) {
+         json = 1;
+         continue;
+      } else if (val == NULL) {
+         ok = 0;
+      } else if (strcmp(opt, "-rate") == 0) {
+         ok = parse_list(val, &rates, 1) == 0;
+      } else if (strcmp(opt, "-channels") == 0) {
+         ok = parse_list(val, &channels, 1) == 0;
+      } else if (strcmp(opt, "-mode") == 0) {
+         ok = parse_modes(val, &modes) == 0;
+      } else if (strcmp(opt, "-framesize") == 0) {
+         ok = parse_list(val, &frame_ms, 10) == 0;
+      } else if (strcmp(opt, "-complexity") == 0) {
+         ok = parse_list(val, &complexities, 1) == 0;
+      } else if (strcmp(opt, "-bitrate") == 0) {
+         ok = parse_list(val, &bitrates, 1) == 0;
+      } else if (strcmp(opt, "-application") == 0) {
+         if (strcmp(val, "voip") == 0)
+            application = OPUS_APPLICATION_VOIP;
+         else if (strcmp(val, "audio") == 0)
+            application = OPUS_APPLICATION_AUDIO;
+         else if (strcmp(val, "restricted-lowdelay") == 0)
+            application = OPUS_APPLICATION_RESTRICTED_LOWDELAY;
+         else
+            ok = 0;
+      } else if (strcmp(opt, "-seconds") == 0) {
+         seconds = atoi(val);
+         ok = seconds > 0;
+      } else if (strcmp(opt, "-o") == 0) {
+         out_path = val;
+      } else {
+         ok = 0;
+      }
+      if (!ok)
+      {
+         print_usage(argv);
+         return EXIT_FAILURE;
+      }
+      args++;
+   }
+
+   for (r = 0; r < rates.n; r++)
+   {
+      if (CORPUS_RATE % rates.v[r] != 0 || (rates.v[r] != 8000 &&
+            rates.v[r] != 12000 && rates.v[r] != 16000 &&
+            rates.v[r] != 24000 && rates.v[r] != 48000))
+      {
+         fprintf(stderr, "Unsupported sampling rate %d\n", rates.v[r]);
+         return EXIT_FAILURE;
+      }
+   }
+   for (f = 0; f < frame_ms.n; f++)
+   {
+      int v = frame_ms.v[f];
+      if (v != 25 && v != 50 && v != 100 && v != 200 && v != 400 && v != 600)
+      {
+         fprintf(stderr, "Unsupported frame size %g ms\n", v/10.0);
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (args == argc)
+   {
+      corpus = generate_corpus(seconds, &corpus_samples);
+   } else {
+      for (; args < argc; args++)
+      {
+         if (load_corpus(argv[args], mono_input, &corpus, &corpus_samples) != 0)
+            return EXIT_FAILURE;
+      }
+   }
+   if (corpus == NULL || corpus_samples == 0)
+   {
+      fprintf(stderr, "Empty corpus\n");
+      return EXIT_FAILURE;
+   }
+
+   /* The most frames any combination makes: 2.5 ms at 48 kHz */
+   times = (double *)malloc((corpus_samples/120 + 1)*sizeof(*times));
+   if (times == NULL)
+      return EXIT_FAILURE;
+
+   if (out_path != NULL)
+   {
+      out = fopen(out_path, "w");
+      if (out == NULL)
+      {
+         fprintf(stderr, "Could not open %s\n", out_path);
+         return EXIT_FAILURE;
+      }
+   }
+   if (json)
+      fprintf(out, "{\n  \"version\": \"%s\",\n  \"corpus_seconds\": %.2f,\n"
+            "  \"results\": [\n", opus_get_version_string(),
+            (double)corpus_samples/CORPUS_RATE);
+   else
+      fprintf(out, "version,rate,channels,mode,coded_mode,frame_ms,complexity,bitrate,"
+            "frames,bytes_per_frame,kbps,mean_us,p50_us,p99_us,max_us,realtime\n");
+
+   for (r = 0; r < rates.n; r++)
+   for (c = 0; c < channels.n; c++)
+   {
+      long samples;
+      opus_int16 *pcm = convert_corpus(corpus, corpus_samples, rates.v[r],
+            channels.v[c], &samples);
+      if (pcm == NULL)
+         return EXIT_FAILURE;
+      for (m = 0; m < modes.n; m++)
+      for (f = 0; f < frame_ms.n; f++)
+      for (x = 0; x < complexities.n; x++)
+      for (b = 0; b < bitrates.n; b++)
+      {
+         bench_config cfg;
+         bench_result res;
+         cfg.rate = rates.v[r];
+         cfg.channels = channels.v[c];
+         cfg.mode = modes.v[m];
+         cfg.frame_size = cfg.rate/400*frame_ms.v[f]/25;
+         cfg.complexity = complexities.v[x];
+         cfg.bitrate = bitrates.v[b];
+
+         /* SILK has no frames shorter than 10 ms, and hybrid codes the
+            band above 8 kHz with CELT so needs a rate that has one */
+         if ((cfg.mode == MODE_SILK_ONLY || cfg.mode == MODE_HYBRID) &&
+               frame_ms.v[f] < 100)
+         {
+            skipped++;
+            continue;
+         }
+         if (cfg.mode == MODE_HYBRID && cfg.rate < 24000)
+         {
+            skipped++;
+            continue;
+         }
+         if (run_config(&cfg, application, cbr, pcm, samples, times, &res) != 0)
+            return EXIT_FAILURE;
+         print_result(out, json, first, &cfg, &res);
+         first = 0;
+      }
+      free(pcm);
+   }
+   if (json)
+      fprintf(out, "%s  ]\n}\n", first ? "" : "\n");
+   if (skipped)
+      fprintf(stderr, "%d combinations a mode can not encode were left out\n",
+            skipped);
+
+   if (out != stdout)
+      fclose(out);
+   free(times);
+   free(corpus);
+   return EXIT_SUCCESS;
+}
@@ -217,8 +217,31 @@ static int opus_packet_get_mode(const unsigned char *data)
    return mode;
 }
 
+#ifdef FIXED_POINT
+/* Converts PCM to an output format in place. This works backwards so that
+   the repeated samples only overwrite samples that have been converted. */
+static void format_output(opus_val16 *pcm, int frame_size, int channels,
+      const OpusOutputFormat *format)
+{
+   int i, c, k;
+   int shift = 16-format->bits;
+   for (i=frame_size-1;i>=0;i--)
+   {
+      opus_val16 s[2];
+      for (c=0;c<channels;c++)
+         s[c] = (opus_val16)((opus_uint16)(pcm[i*channels+c] + 32768) >> shift);
+      for (k=format->upsample-1;k>=0;k--)
+      {
+         for (c=0;c<channels;c++)
+            pcm[(i*format->upsample+k)*channels+c] = s[c];
+      }
+   }
+}
+#endif
+
 static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
-      opus_int32 len, opus_val16 *pcm, int frame_size, int decode_fec)
+      opus_int32 len, opus_val16 *pcm, int frame_size, int decode_fec,
+      const OpusOutputFormat *format)
 {
    void *silk_dec;
    CELTDecoder *celt_dec;
@@ -248,6 +271,10 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    const opus_val16 *window;
    opus_uint32 redundant_rng = 0;
    int celt_accum;
+   int upsample;
+#ifdef FIXED_POINT
+   int fused;
+#endif
    ALLOC_STACK;
 
    silk_dec = (char*)st+st->silk_dec_offset;
@@ -256,6 +283,7 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    F10 = F20>>1;
    F5 = F10>>1;
    F2_5 = F5>>1;
+   upsample = format ? format->upsample : 1;
    if (frame_size < F2_5)
    {
       RESTORE_STACK;
@@ -286,6 +314,10 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
          /* If we haven't got any packet yet, all we can do is return zeros */
          for (i=0;i<audiosize*st->channels;i++)
             pcm[i] = 0;
+#ifdef FIXED_POINT
+         if (format)
+            format_output(pcm, audiosize, st->channels, format);
+#endif
          RESTORE_STACK;
          return audiosize;
       }
@@ -295,13 +327,13 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
       if (audiosize > F20)
       {
          do {
-            int ret = opus_decode_frame(st, NULL, 0, pcm, IMIN(audiosize, F20), 0);
+            int ret = opus_decode_frame(st, NULL, 0, pcm, IMIN(audiosize, F20), 0, format);
             if (ret<0)
             {
                RESTORE_STACK;
                return ret;
             }
-            pcm += ret*st->channels;
+            pcm += ret*st->channels*upsample;
             audiosize -= ret;
          } while (audiosize > 0);
          RESTORE_STACK;
@@ -341,7 +373,7 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    if (transition && mode == MODE_CELT_ONLY)
    {
       pcm_transition = pcm_transition_celt;
-      opus_decode_frame(st, NULL, 0, pcm_transition, IMIN(F5, audiosize), 0);
+      opus_decode_frame(st, NULL, 0, pcm_transition, IMIN(F5, audiosize), 0, NULL);
    }
    if (audiosize > frame_size)
    {
@@ -461,7 +493,7 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    if (transition && mode != MODE_CELT_ONLY)
    {
       pcm_transition = pcm_transition_silk;
-      opus_decode_frame(st, NULL, 0, pcm_transition, IMIN(F5, audiosize), 0);
+      opus_decode_frame(st, NULL, 0, pcm_transition, IMIN(F5, audiosize), 0, NULL);
    }
 
 
@@ -508,15 +540,33 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    /* MUST be after PLC */
    MUST_SUCCEED(celt_decoder_ctl(celt_dec, CELT_SET_START_BAND(start_band)));
 
+#ifdef FIXED_POINT
+   /* When CELT writes the final output of the frame, it can also convert it
+      to the output format. SILK-only frames and frames that are processed
+      further below are converted at the end instead. */
+   fused = format && !redundancy && !transition && !st->decode_gain
+         && (mode == MODE_CELT_ONLY
+             || (mode == MODE_HYBRID && celt_accum && upsample == 1));
+#endif
+
    if (mode != MODE_SILK_ONLY)
    {
       int celt_frame_size = IMIN(F20, frame_size);
       /* Make sure to discard any previous CELT state */
       if (mode != st->prev_mode && st->prev_mode > 0 && !st->prev_redundancy)
          MUST_SUCCEED(celt_decoder_ctl(celt_dec, OPUS_RESET_STATE));
+#ifdef FIXED_POINT
+      if (fused)
+         MUST_SUCCEED(celt_decoder_ctl(celt_dec,
+               CELT_SET_OUTPUT_FORMAT(16-format->bits, upsample)));
+#endif
       /* Decode CELT */
       celt_ret = celt_decode_with_ec(celt_dec, decode_fec ? NULL : data,
                                      len, pcm, celt_frame_size, &dec, celt_accum);
+#ifdef FIXED_POINT
+      if (fused)
+         MUST_SUCCEED(celt_decoder_ctl(celt_dec, CELT_SET_OUTPUT_FORMAT(0, 0)));
+#endif
    } else {
       unsigned char silence[2] = {0xFF, 0xFF};
       if (!celt_accum)
@@ -616,6 +666,10 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
    {
       if (OPUS_CHECK_ARRAY(pcm, audiosize*st->channels))
          OPUS_PRINT_INT(audiosize);
+#ifdef FIXED_POINT
+      if (format && !fused)
+         format_output(pcm, audiosize, st->channels, format);
+#endif
    }
 
    RESTORE_STACK;
@@ -625,7 +679,8 @@ static int opus_decode_frame(OpusDecoder *st, const unsigned char *data,
 
 int opus_decode_native(OpusDecoder *st, const unsigned char *data,
       opus_int32 len, opus_val16 *pcm, int frame_size, int decode_fec,
-      int self_delimited, opus_int32 *packet_offset, int soft_clip)
+      int self_delimited, opus_int32 *packet_offset, int soft_clip,
+      const OpusOutputFormat *format)
 {
    int i, nb_samples;
    int count, offset;
@@ -633,6 +688,7 @@ int opus_decode_native(OpusDecoder *st, const unsigned char *data,
    int packet_frame_size, packet_bandwidth, packet_mode, packet_stream_channels;
    /* 48 x 2.5 ms = 120 ms */
    opus_int16 size[48];
+   int upsample = format ? format->upsample : 1;
    VALIDATE_OPUS_DECODER(st);
    if (decode_fec<0 || decode_fec>1)
       return OPUS_BAD_ARG;
@@ -644,7 +700,7 @@ int opus_decode_native(OpusDecoder *st, const unsigned char *data,
       int pcm_count=0;
       do {
          int ret;
-         ret = opus_decode_frame(st, NULL, 0, pcm+pcm_count*st->channels, frame_size-pcm_count, 0);
+         ret = opus_decode_frame(st, NULL, 0, pcm+pcm_count*st->channels*upsample, frame_size-pcm_count, 0, format);
          if (ret<0)
             return ret;
          pcm_count += ret;
@@ -675,12 +731,12 @@ int opus_decode_native(OpusDecoder *st, const unsigned char *data,
       int ret;
       /* If no FEC can be present, run the PLC (recursive call) */
       if (frame_size < packet_frame_size || packet_mode == MODE_CELT_ONLY || st->mode == MODE_CELT_ONLY)
-         return opus_decode_native(st, NULL, 0, pcm, frame_size, 0, 0, NULL, soft_clip);
+         return opus_decode_native(st, NULL, 0, pcm, frame_size, 0, 0, NULL, soft_clip, format);
       /* Otherwise, run the PLC on everything except the size for which we might have FEC */
       duration_copy = st->last_packet_duration;
       if (frame_size-packet_frame_size!=0)
       {
-         ret = opus_decode_native(st, NULL, 0, pcm, frame_size-packet_frame_size, 0, 0, NULL, soft_clip);
+         ret = opus_decode_native(st, NULL, 0, pcm, frame_size-packet_frame_size, 0, 0, NULL, soft_clip, format);
          if (ret<0)
          {
             st->last_packet_duration = duration_copy;
@@ -693,8 +749,8 @@ int opus_decode_native(OpusDecoder *st, const unsigned char *data,
       st->bandwidth = packet_bandwidth;
       st->frame_size = packet_frame_size;
       st->stream_channels = packet_stream_channels;
-      ret = opus_decode_frame(st, data, size[0], pcm+st->channels*(frame_size-packet_frame_size),
-            packet_frame_size, 1);
+      ret = opus_decode_frame(st, data, size[0], pcm+st->channels*(frame_size-packet_frame_size)*upsample,
+            packet_frame_size, 1, format);
       if (ret<0)
          return ret;
       else {
@@ -718,7 +774,7 @@ int opus_decode_native(OpusDecoder *st, const unsigned char *data,
    for (i=0;i<count;i++)
    {
       int ret;
-      ret = opus_decode_frame(st, data, size[i], pcm+nb_samples*st->channels, frame_size-nb_samples, 0);
+      ret = opus_decode_frame(st, data, size[i], pcm+nb_samples*st->channels*upsample, frame_size-nb_samples, 0, format);
       if (ret<0)
          return ret;
       celt_assert(ret==packet_frame_size);
@@ -744,7 +800,16 @@ int opus_decode(OpusDecoder *st, const unsigned char *data,
 {
    if(frame_size<=0)
       return OPUS_BAD_ARG;
-   return opus_decode_native(st, data, len, pcm, frame_size, decode_fec, 0, NULL, 0);
+   return opus_decode_native(st, data, len, pcm, frame_size, decode_fec, 0, NULL, 0, NULL);
+}
+
+int opus_decode_ex(OpusDecoder *st, const unsigned char *data,
+      opus_int32 len, opus_int16 *pcm, int frame_size, int decode_fec,
+      const OpusOutputFormat *format)
+{
+   if(frame_size<=0 || format->bits<1 || format->bits>16 || format->upsample<1)
+      return OPUS_BAD_ARG;
+   return opus_decode_native(st, data, len, pcm, frame_size, decode_fec, 0, NULL, 0, format);
 }
 
 #ifndef DISABLE_FLOAT_API
@@ -772,7 +837,7 @@ int opus_decode_float(OpusDecoder *st, const unsigned char *data,
    celt_assert(st->channels == 1 || st->channels == 2);
    ALLOC(out, frame_size*st->channels, opus_int16);
 
-   ret = opus_decode_native(st, data, len, out, frame_size, decode_fec, 0, NULL, 0);
+   ret = opus_decode_native(st, data, len, out, frame_size, decode_fec, 0, NULL, 0, NULL);
    if (ret > 0)
    {
       for (i=0;i<ret*st->channels;i++)
@@ -810,7 +875,7 @@ int opus_decode(OpusDecoder *st, const unsigned char *data,
    celt_assert(st->channels == 1 || st->channels == 2);
    ALLOC(out, frame_size*st->channels, float);
 
-   ret = opus_decode_native(st, data, len, out, frame_size, decode_fec, 0, NULL, 1);
+   ret = opus_decode_native(st, data, len, out, frame_size, decode_fec, 0, NULL, 1, NULL);
    if (ret > 0)
    {
       for (i=0;i<ret*st->channels;i++)
@@ -820,12 +885,57 @@ int opus_decode(OpusDecoder *st, const unsigned char *data,
    return ret;
 }
 
+int opus_decode_ex(OpusDecoder *st, const unsigned char *data,
+      opus_int32 len, opus_int16 *pcm, int frame_size, int decode_fec,
+      const OpusOutputFormat *format)
+{
+   VARDECL(float, out);
+   int ret, i, c, k;
+   int nb_samples;
+   int shift;
+   ALLOC_STACK;
+
+   if(frame_size<=0 || format->bits<1 || format->bits>16 || format->upsample<1)
+   {
+      RESTORE_STACK;
+      return OPUS_BAD_ARG;
+   }
+   if (data != NULL && len > 0 && !decode_fec)
+   {
+      nb_samples = opus_decoder_get_nb_samples(st, data, len);
+      if (nb_samples>0)
+         frame_size = IMIN(frame_size, nb_samples);
+      else
+         return OPUS_INVALID_PACKET;
+   }
+   celt_assert(st->channels == 1 || st->channels == 2);
+   ALLOC(out, frame_size*st->channels, float);
+
+   ret = opus_decode_native(st, data, len, out, frame_size, decode_fec, 0, NULL, 1, NULL);
+   if (ret > 0)
+   {
+      shift = 16-format->bits;
+      for (i=0;i<ret;i++)
+      {
+         for (c=0;c<st->channels;c++)
+         {
+            opus_int16 s;
+            s = (opus_int16)((opus_uint16)(FLOAT2INT16(out[i*st->channels+c]) + 32768) >> shift);
+            for (k=0;k<format->upsample;k++)
+               pcm[(i*format->upsample+k)*st->channels+c] = s;
+         }
+      }
+   }
+   RESTORE_STACK;
+   return ret;
+}
+
 int opus_decode_float(OpusDecoder *st, const unsigned char *data,
       opus_int32 len, opus_val16 *pcm, int frame_size, int decode_fec)
 {
    if(frame_size<=0)
       return OPUS_BAD_ARG;
-   return opus_decode_native(st, data, len, pcm, frame_size, decode_fec, 0, NULL, 0);
+   return opus_decode_native(st, data, len, pcm, frame_size, decode_fec, 0, NULL, 0, NULL);
 }
 
 #endif
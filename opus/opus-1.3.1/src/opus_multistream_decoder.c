@@ -84,6 +84,8 @@ int opus_multistream_decoder_init(
    st->layout.nb_channels = channels;
    st->layout.nb_streams = streams;
    st->layout.nb_coupled_streams = coupled_streams;
+   st->executor.run = NULL;
+   st->executor.data = NULL;
 
    for (i=0;i<st->layout.nb_channels;i++)
       st->layout.mapping[i] = mapping[i];
@@ -175,6 +177,37 @@ static int opus_multistream_packet_validate(const unsigned char *data,
    return samples;
 }
 
+/* Most samples the per-stream buffers of the executor may take on the stack,
+   120 ms of 16 channels at 48 kHz. Larger decodes are done serially. */
+#define MS_JOB_BUF_MAX (16*5760)
+
+/* A stream handed to the executor, with its own sub-packet and output */
+typedef struct {
+   OpusDecoder *dec;
+   const unsigned char *data;
+   opus_int32 len;
+   opus_val16 *buf;
+   int ret;
+} MSStreamJob;
+
+typedef struct {
+   MSStreamJob *jobs;
+   int nb_streams;
+   int frame_size;
+   int decode_fec;
+   int soft_clip;
+} MSDecodeJobs;
+
+static void ms_decode_stream_job(void *arg, int index)
+{
+   MSDecodeJobs *jobs = (MSDecodeJobs*)arg;
+   MSStreamJob *job = &jobs->jobs[index];
+   opus_int32 packet_offset = 0;
+   job->ret = opus_decode_native(job->dec, job->data, job->len, job->buf,
+         jobs->frame_size, jobs->decode_fec, index!=jobs->nb_streams-1,
+         &packet_offset, jobs->soft_clip, NULL);
+}
+
 int opus_multistream_decode_native(
       OpusMSDecoder *st,
       const unsigned char *data,
@@ -193,7 +226,11 @@ int opus_multistream_decode_native(
    int s, c;
    char *ptr;
    int do_plc=0;
+   int nb_jobs;
+   int job_size;
    VARDECL(opus_val16, buf);
+   VARDECL(MSStreamJob, jobs);
+   VARDECL(opus_val16, job_buf);
    ALLOC_STACK;
 
    VALIDATE_MS_DECODER(st);
@@ -210,7 +247,7 @@ int opus_multistream_decode_native(
    coupled_size = opus_decoder_get_size(2);
    mono_size = opus_decoder_get_size(1);
 
-   if (len==0)
+   if (len==0 || data==NULL)
       do_plc = 1;
    if (len < 0)
    {
@@ -222,6 +259,9 @@ int opus_multistream_decode_native(
       RESTORE_STACK;
       return OPUS_INVALID_PACKET;
    }
+   /* Samples each stream will return. For PLC and FEC that is the caller's
+      frame_size, which is only limited by the clamp above. */
+   job_size = frame_size;
    if (!do_plc)
    {
       int ret = opus_multistream_packet_validate(data, len, st->layout.nb_streams, Fs);
@@ -234,25 +274,87 @@ int opus_multistream_decode_native(
          RESTORE_STACK;
          return OPUS_BUFFER_TOO_SMALL;
       }
+      if (!decode_fec)
+         job_size = ret;
+   }
+   nb_jobs = 0;
+#ifndef NONTHREADSAFE_PSEUDOSTACK
+   if (st->executor.run != NULL && st->layout.nb_streams > 1
+         && (st->layout.nb_streams+st->layout.nb_coupled_streams)*job_size <= MS_JOB_BUF_MAX)
+      nb_jobs = st->layout.nb_streams;
+#endif
+   ALLOC(jobs, IMAX(1, nb_jobs), MSStreamJob);
+   ALLOC(job_buf, nb_jobs > 0 ? (st->layout.nb_streams+st->layout.nb_coupled_streams)*job_size : 1, opus_val16);
+   if (nb_jobs > 0)
+   {
+      MSDecodeJobs args;
+      opus_val16 *job_ptr = job_buf;
+      /* The packet was validated, so this only finds where each stream's
+         sub-packet starts, the same way opus_decode_native() does */
+      for (s=0;s<nb_jobs;s++)
+      {
+         MSStreamJob *job = &jobs[s];
+         job->dec = (OpusDecoder*)ptr;
+         ptr += (s < st->layout.nb_coupled_streams) ? align(coupled_size) : align(mono_size);
+         job->data = data;
+         job->len = len;
+         job->buf = job_ptr;
+         job_ptr += (s < st->layout.nb_coupled_streams ? 2 : 1)*job_size;
+         if (!do_plc)
+         {
+            unsigned char toc;
+            opus_int16 size[48];
+            opus_int32 packet_offset;
+            if (len<=0 || opus_packet_parse_impl(data, len, s!=nb_jobs-1, &toc,
+                  NULL, size, NULL, &packet_offset) < 0)
+            {
+               RESTORE_STACK;
+               return OPUS_INTERNAL_ERROR;
+            }
+            data += packet_offset;
+            len -= packet_offset;
+         }
+      }
+      args.jobs = jobs;
+      args.nb_streams = nb_jobs;
+      args.frame_size = job_size;
+      args.decode_fec = decode_fec;
+      args.soft_clip = soft_clip;
+      st->executor.run(st->executor.data, ms_decode_stream_job, &args, nb_jobs);
    }
+   ptr = (char*)st + align(sizeof(OpusMSDecoder));
    for (s=0;s<st->layout.nb_streams;s++)
    {
       OpusDecoder *dec;
-      opus_int32 packet_offset;
+      opus_val16 *stream_buf;
       int ret;
 
       dec = (OpusDecoder*)ptr;
       ptr += (s < st->layout.nb_coupled_streams) ? align(coupled_size) : align(mono_size);
 
-      if (!do_plc && len<=0)
+      if (s < nb_jobs)
       {
-         RESTORE_STACK;
-         return OPUS_INTERNAL_ERROR;
+         ret = jobs[s].ret;
+         /* Every stream decodes the same number of samples */
+         if (ret > 0 && s > 0 && ret != frame_size)
+         {
+            RESTORE_STACK;
+            return OPUS_INTERNAL_ERROR;
+         }
+         stream_buf = jobs[s].buf;
+      } else {
+         opus_int32 packet_offset;
+         if (!do_plc && len<=0)
+         {
+            RESTORE_STACK;
+            return OPUS_INTERNAL_ERROR;
+         }
+         packet_offset = 0;
+         ret = opus_decode_native(dec, data, len, buf, frame_size, decode_fec, s!=st->layout.nb_streams-1, &packet_offset, soft_clip, NULL);
+         data += packet_offset;
+         len -= packet_offset;
+         stream_buf = buf;
       }
-      packet_offset = 0;
-      ret = opus_decode_native(dec, data, len, buf, frame_size, decode_fec, s!=st->layout.nb_streams-1, &packet_offset, soft_clip);
-      data += packet_offset;
-      len -= packet_offset;
       if (ret <= 0)
       {
          RESTORE_STACK;
@@ -267,7 +369,7 @@ int opus_multistream_decode_native(
          while ( (chan = get_left_channel(&st->layout, s, prev)) != -1)
          {
             (*copy_channel_out)(pcm, st->layout.nb_channels, chan,
-               buf, 2, frame_size, user_data);
+               stream_buf, 2, frame_size, user_data);
             prev = chan;
          }
          prev = -1;
@@ -275,7 +377,7 @@ int opus_multistream_decode_native(
          while ( (chan = get_right_channel(&st->layout, s, prev)) != -1)
          {
             (*copy_channel_out)(pcm, st->layout.nb_channels, chan,
-               buf+1, 2, frame_size, user_data);
+               stream_buf+1, 2, frame_size, user_data);
             prev = chan;
          }
       } else {
@@ -285,7 +387,7 @@ int opus_multistream_decode_native(
          while ( (chan = get_mono_channel(&st->layout, s, prev)) != -1)
          {
             (*copy_channel_out)(pcm, st->layout.nb_channels, chan,
-               buf, 1, frame_size, user_data);
+               stream_buf, 1, frame_size, user_data);
             prev = chan;
          }
       }
@@ -503,6 +605,15 @@ int opus_multistream_decoder_ctl_va_list(OpusMSDecoder *st, int request,
           *value = (OpusDecoder*)ptr;
        }
        break;
+       case OPUS_MULTISTREAM_SET_EXECUTOR_REQUEST:
+       {
+          const OpusMSExecutor *value = va_arg(ap, const OpusMSExecutor*);
+          if (value)
+             st->executor = *value;
+          else
+             st->executor.run = NULL;
+       }
+       break;
        case OPUS_SET_GAIN_REQUEST:
        case OPUS_SET_PHASE_INVERSION_DISABLED_REQUEST:
        {
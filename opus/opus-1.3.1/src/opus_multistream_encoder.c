@@ -455,6 +455,8 @@ static int opus_multistream_encoder_init_impl(
    st->bitrate_bps = OPUS_AUTO;
    st->application = application;
    st->variable_duration = OPUS_FRAMESIZE_ARG;
+   st->executor.run = NULL;
+   st->executor.data = NULL;
    for (i=0;i<st->layout.nb_channels;i++)
       st->layout.mapping[i] = mapping[i];
    if (!validate_layout(&st->layout))
@@ -798,6 +800,119 @@ static opus_int32 rate_allocation(
 
 /* Max size in case the encoder decides to return six frames (6 x 20 ms = 120 ms) */
 #define MS_FRAME_TMP (6*1275+12)
+
+/* A stream handed to the executor, with its own input and output */
+typedef struct {
+   OpusEncoder *enc;
+   opus_val16 *buf;
+   unsigned char *data;
+   opus_int32 max_bytes;
+   opus_val16 bandLogE[42];
+   int c1, c2;
+   int len;
+} MSStreamJob;
+
+typedef struct {
+   MSStreamJob *jobs;
+   const void *pcm;
+   int frame_size;
+   int analysis_frame_size;
+   int lsb_depth;
+   int nb_channels;
+   downmix_func downmix;
+   int float_api;
+} MSEncodeJobs;
+
+static void ms_encode_stream_job(void *arg, int index)
+{
+   MSEncodeJobs *jobs = (MSEncodeJobs*)arg;
+   MSStreamJob *job = &jobs->jobs[index];
+   job->len = opus_encode_native(job->enc, job->buf, jobs->frame_size,
+         job->data, job->max_bytes, jobs->lsb_depth, jobs->pcm,
+         jobs->analysis_frame_size, job->c1, job->c2, jobs->nb_channels,
+         jobs->downmix, jobs->float_api);
+}
+
+/* Copies the channels of stream s to buf and, for surround, its band
+   energies to bandLogE. */
+static void ms_prepare_stream(const OpusMSEncoder *st, int s,
+      opus_copy_channel_in_func copy_channel_in, const void *pcm,
+      int frame_size, void *user_data, const opus_val16 *bandSMR,
+      opus_val16 *buf, opus_val16 *bandLogE, int *c1, int *c2)
+{
+   int i;
+   if (s < st->layout.nb_coupled_streams)
+   {
+      int left, right;
+      left = get_left_channel(&st->layout, s, -1);
+      right = get_right_channel(&st->layout, s, -1);
+      (*copy_channel_in)(buf, 2,
+         pcm, st->layout.nb_channels, left, frame_size, user_data);
+      (*copy_channel_in)(buf+1, 2,
+         pcm, st->layout.nb_channels, right, frame_size, user_data);
+      if (st->mapping_type == MAPPING_TYPE_SURROUND)
+      {
+         for (i=0;i<21;i++)
+         {
+            bandLogE[i] = bandSMR[21*left+i];
+            bandLogE[21+i] = bandSMR[21*right+i];
+         }
+      }
+      *c1 = left;
+      *c2 = right;
+   } else {
+      int chan = get_mono_channel(&st->layout, s, -1);
+      (*copy_channel_in)(buf, 1,
+         pcm, st->layout.nb_channels, chan, frame_size, user_data);
+      if (st->mapping_type == MAPPING_TYPE_SURROUND)
+      {
+         for (i=0;i<21;i++)
+            bandLogE[i] = bandSMR[21*chan+i];
+      }
+      *c1 = chan;
+      *c2 = -1;
+   }
+}
+
+/* Number of leading streams whose packets cannot depend on the bytes used
+   by the streams before them, so they can be encoded at the same time.
+   Up to 20 ms, the encoder only looks at min(curr_max,1276). Longer frames
+   are split into several frames depending on the exact curr_max, so it has
+   to hit the MS_FRAME_TMP cap whatever the earlier streams used. */
+static int ms_independent_streams(const OpusMSEncoder *st, opus_int32 Fs,
+      int frame_size, opus_int32 max_data_bytes, int vbr)
+{
+   int s;
+   int single_frame;
+   opus_int32 worst_tot;
+   single_frame = frame_size*50 <= Fs;
+   worst_tot = 0;
+   for (s=0;s<st->layout.nb_streams;s++)
+   {
+      opus_int32 curr_max;
+      int last = s == st->layout.nb_streams-1;
+      /* The last CBR stream gets its bitrate from what is left */
+      if (!vbr && last)
+         break;
+      /* Same as in opus_multistream_encode_native(), before the cap */
+      curr_max = max_data_bytes - worst_tot;
+      curr_max -= IMAX(0,2*(st->layout.nb_streams-s-1)-1);
+      if (Fs/frame_size == 10)
+        curr_max -= st->layout.nb_streams-s-1;
+      if (single_frame)
+      {
+         if (curr_max - (last ? 0 : 2) < 1276)
+            break;
+         worst_tot += 1276+2;
+      } else {
+         if (curr_max < MS_FRAME_TMP)
+            break;
+         worst_tot += MS_FRAME_TMP+2;
+      }
+   }
+   return s;
+}
+
 int opus_multistream_encode_native
 (
     OpusMSEncoder *st,
@@ -831,6 +946,10 @@ int opus_multistream_encode_native
    int frame_size;
    opus_int32 rate_sum;
    opus_int32 smallest_packet;
+   int nb_jobs;
+   VARDECL(MSStreamJob, jobs);
+   VARDECL(opus_val16, job_buf);
+   VARDECL(unsigned char, job_data);
    ALLOC_STACK;
 
    if (st->mapping_type == MAPPING_TYPE_SURROUND)
@@ -921,12 +1040,56 @@ int opus_multistream_encode_native
       }
    }
 
+   nb_jobs = 0;
+#ifndef NONTHREADSAFE_PSEUDOSTACK
+   if (st->executor.run != NULL && st->layout.nb_streams > 1)
+      nb_jobs = ms_independent_streams(st, Fs, frame_size, max_data_bytes, vbr);
+   if (nb_jobs < 2)
+      nb_jobs = 0;
+#endif
+   /* Serial encodes keep using buf and tmp_data, so take no job space */
+   ALLOC(jobs, nb_jobs > 0 ? nb_jobs : ALLOC_NONE, MSStreamJob);
+   ALLOC(job_buf, nb_jobs > 0 ? nb_jobs*2*frame_size : ALLOC_NONE, opus_val16);
+   ALLOC(job_data, nb_jobs > 0 ? nb_jobs*MS_FRAME_TMP : ALLOC_NONE, unsigned char);
+   if (nb_jobs > 0)
+   {
+      MSEncodeJobs args;
+      ptr = (char*)st + align(sizeof(OpusMSEncoder));
+      for (s=0;s<nb_jobs;s++)
+      {
+         MSStreamJob *job = &jobs[s];
+         job->enc = (OpusEncoder*)ptr;
+         if (s < st->layout.nb_coupled_streams)
+            ptr += align(coupled_size);
+         else
+            ptr += align(mono_size);
+         job->buf = job_buf + s*2*frame_size;
+         job->data = job_data + s*MS_FRAME_TMP;
+         ms_prepare_stream(st, s, copy_channel_in, pcm, frame_size, user_data,
+               bandSMR, job->buf, job->bandLogE, &job->c1, &job->c2);
+         if (st->mapping_type == MAPPING_TYPE_SURROUND)
+            opus_encoder_ctl(job->enc, OPUS_SET_ENERGY_MASK(job->bandLogE));
+         /* What curr_max is below when the earlier streams leave room */
+         job->max_bytes = s != st->layout.nb_streams-1 ? MS_FRAME_TMP-2 : MS_FRAME_TMP;
+      }
+      args.jobs = jobs;
+      args.pcm = pcm;
+      args.frame_size = frame_size;
+      args.analysis_frame_size = analysis_frame_size;
+      args.lsb_depth = lsb_depth;
+      args.nb_channels = st->layout.nb_channels;
+      args.downmix = downmix;
+      args.float_api = float_api;
+      st->executor.run(st->executor.data, ms_encode_stream_job, &args, nb_jobs);
+   }
+
    ptr = (char*)st + align(sizeof(OpusMSEncoder));
    /* Counting ToC */
    tot_size = 0;
    for (s=0;s<st->layout.nb_streams;s++)
    {
       OpusEncoder *enc;
+      const unsigned char *frame;
       int len;
       int curr_max;
       int c1, c2;
@@ -935,42 +1098,9 @@ int opus_multistream_encode_native
       opus_repacketizer_init(&rp);
       enc = (OpusEncoder*)ptr;
       if (s < st->layout.nb_coupled_streams)
-      {
-         int i;
-         int left, right;
-         left = get_left_channel(&st->layout, s, -1);
-         right = get_right_channel(&st->layout, s, -1);
-         (*copy_channel_in)(buf, 2,
-            pcm, st->layout.nb_channels, left, frame_size, user_data);
-         (*copy_channel_in)(buf+1, 2,
-            pcm, st->layout.nb_channels, right, frame_size, user_data);
          ptr += align(coupled_size);
-         if (st->mapping_type == MAPPING_TYPE_SURROUND)
-         {
-            for (i=0;i<21;i++)
-            {
-               bandLogE[i] = bandSMR[21*left+i];
-               bandLogE[21+i] = bandSMR[21*right+i];
-            }
-         }
-         c1 = left;
-         c2 = right;
-      } else {
-         int i;
-         int chan = get_mono_channel(&st->layout, s, -1);
-         (*copy_channel_in)(buf, 1,
-            pcm, st->layout.nb_channels, chan, frame_size, user_data);
+      else
          ptr += align(mono_size);
-         if (st->mapping_type == MAPPING_TYPE_SURROUND)
-         {
-            for (i=0;i<21;i++)
-               bandLogE[i] = bandSMR[21*chan+i];
-         }
-         c1 = chan;
-         c2 = -1;
-      }
-      if (st->mapping_type == MAPPING_TYPE_SURROUND)
-         opus_encoder_ctl(enc, OPUS_SET_ENERGY_MASK(bandLogE));
       /* number of bytes left (+Toc) */
       curr_max = max_data_bytes - tot_size;
       /* Reserve one byte for the last stream and two for the others */
@@ -981,10 +1111,23 @@ int opus_multistream_encode_native
       curr_max = IMIN(curr_max,MS_FRAME_TMP);
       /* Repacketizer will add one or two bytes for self-delimited frames */
       if (s != st->layout.nb_streams-1) curr_max -=  curr_max>253 ? 2 : 1;
-      if (!vbr && s == st->layout.nb_streams-1)
-         opus_encoder_ctl(enc, OPUS_SET_BITRATE(curr_max*(8*Fs/frame_size)));
-      len = opus_encode_native(enc, buf, frame_size, tmp_data, curr_max, lsb_depth,
-            pcm, analysis_frame_size, c1, c2, st->layout.nb_channels, downmix, float_api);
+      if (s < nb_jobs)
+      {
+         celt_assert(curr_max == jobs[s].max_bytes ||
+               (frame_size*50 <= Fs && curr_max >= 1276));
+         frame = jobs[s].data;
+         len = jobs[s].len;
+      } else {
+         ms_prepare_stream(st, s, copy_channel_in, pcm, frame_size, user_data,
+               bandSMR, buf, bandLogE, &c1, &c2);
+         if (st->mapping_type == MAPPING_TYPE_SURROUND)
+            opus_encoder_ctl(enc, OPUS_SET_ENERGY_MASK(bandLogE));
+         if (!vbr && s == st->layout.nb_streams-1)
+            opus_encoder_ctl(enc, OPUS_SET_BITRATE(curr_max*(8*Fs/frame_size)));
+         len = opus_encode_native(enc, buf, frame_size, tmp_data, curr_max, lsb_depth,
+               pcm, analysis_frame_size, c1, c2, st->layout.nb_channels, downmix, float_api);
+         frame = tmp_data;
+      }
       if (len<0)
       {
          RESTORE_STACK;
@@ -993,7 +1136,7 @@ int opus_multistream_encode_native
       /* We need to use the repacketizer to add the self-delimiting lengths
          while taking into account the fact that the encoder can now return
          more than one frame at a time (e.g. 60 ms CELT-only) */
-      ret = opus_repacketizer_cat(&rp, tmp_data, len);
+      ret = opus_repacketizer_cat(&rp, frame, len);
       /* If the opus_repacketizer_cat() fails, then something's seriously wrong
          with the encoder. */
       if (ret != OPUS_OK)
@@ -1281,6 +1424,15 @@ int opus_multistream_encoder_ctl_va_list(OpusMSEncoder *st, int request,
        *value = st->variable_duration;
    }
    break;
+   case OPUS_MULTISTREAM_SET_EXECUTOR_REQUEST:
+   {
+      const OpusMSExecutor *value = va_arg(ap, const OpusMSExecutor*);
+      if (value)
+         st->executor = *value;
+      else
+         st->executor.run = NULL;
+   }
+   break;
    case OPUS_RESET_STATE:
    {
       int s;
@@ -31,6 +31,7 @@
 
 #include "arch.h"
 #include "opus.h"
+#include "opus_multistream.h"
 #include "celt.h"
 
 #include <stdarg.h> /* va_list */
@@ -65,6 +66,7 @@ struct OpusMSEncoder {
    int variable_duration;
    MappingType mapping_type;
    opus_int32 bitrate_bps;
+   OpusMSExecutor executor;
    /* Encoder states go here */
    /* then opus_val32 window_mem[channels*120]; */
    /* then opus_val32 preemph_mem[channels]; */
@@ -72,6 +74,7 @@ struct OpusMSEncoder {
 
 struct OpusMSDecoder {
    ChannelLayout layout;
+   OpusMSExecutor executor;
    /* Decoder states go here */
 };
 
@@ -148,7 +151,7 @@ opus_int32 opus_encode_native(OpusEncoder *st, const opus_val16 *pcm, int frame_
 
 int opus_decode_native(OpusDecoder *st, const unsigned char *data, opus_int32 len,
       opus_val16 *pcm, int frame_size, int decode_fec, int self_delimited,
-      opus_int32 *packet_offset, int soft_clip);
+      opus_int32 *packet_offset, int soft_clip, const OpusOutputFormat *format);
 
 /* Make sure everything is properly aligned. */
 static OPUS_INLINE int align(int i)
@@ -41,9 +41,25 @@
 struct OpusProjectionDecoder
 {
   opus_int32 demixing_matrix_size_in_bytes;
+  int arch;
   /* Encoder states go here */
 };
 
+static MappingMatrix *get_dec_demixing_matrix(OpusProjectionDecoder *st)
+{
+  /* void* cast avoids clang -Wcast-align warning */
+  return (MappingMatrix*)(void*)((char*)st +
+    align(sizeof(OpusProjectionDecoder)));
+}
+
+static OpusMSDecoder *get_multistream_decoder(OpusProjectionDecoder *st)
+{
+  /* void* cast avoids clang -Wcast-align warning */
+  return (OpusMSDecoder*)(void*)((char*)st +
+    align(sizeof(OpusProjectionDecoder) +
+    st->demixing_matrix_size_in_bytes));
+}
+
 #if !defined(DISABLE_FLOAT_API)
 static void opus_projection_copy_channel_out_float(
   void *dst,
@@ -55,16 +71,16 @@ static void opus_projection_copy_channel_out_float(
   void *user_data)
 {
   float *float_dst;
-  const MappingMatrix *matrix;
+  OpusProjectionDecoder *st;
   float_dst = (float *)dst;
-  matrix = (const MappingMatrix *)user_data;
+  st = (OpusProjectionDecoder *)user_data;
 
   if (dst_channel == 0)
     OPUS_CLEAR(float_dst, frame_size * dst_stride);
 
   if (src != NULL)
-    mapping_matrix_multiply_channel_out_float(matrix, src, dst_channel,
-      src_stride, float_dst, dst_stride, frame_size);
+    mapping_matrix_multiply_channel_out_float(get_dec_demixing_matrix(st), src,
+      dst_channel, src_stride, float_dst, dst_stride, frame_size, st->arch);
 }
 #endif
 
@@ -78,30 +94,15 @@ static void opus_projection_copy_channel_out_short(
   void *user_data)
 {
   opus_int16 *short_dst;
-  const MappingMatrix *matrix;
+  OpusProjectionDecoder *st;
   short_dst = (opus_int16 *)dst;
-  matrix = (const MappingMatrix *)user_data;
+  st = (OpusProjectionDecoder *)user_data;
   if (dst_channel == 0)
     OPUS_CLEAR(short_dst, frame_size * dst_stride);
 
   if (src != NULL)
-    mapping_matrix_multiply_channel_out_short(matrix, src, dst_channel,
-      src_stride, short_dst, dst_stride, frame_size);
-}
-
-static MappingMatrix *get_dec_demixing_matrix(OpusProjectionDecoder *st)
-{
-  /* void* cast avoids clang -Wcast-align warning */
-  return (MappingMatrix*)(void*)((char*)st +
-    align(sizeof(OpusProjectionDecoder)));
-}
-
-static OpusMSDecoder *get_multistream_decoder(OpusProjectionDecoder *st)
-{
-  /* void* cast avoids clang -Wcast-align warning */
-  return (OpusMSDecoder*)(void*)((char*)st +
-    align(sizeof(OpusProjectionDecoder) +
-    st->demixing_matrix_size_in_bytes));
+    mapping_matrix_multiply_channel_out_short(get_dec_demixing_matrix(st), src,
+      dst_channel, src_stride, short_dst, dst_stride, frame_size, st->arch);
 }
 
 opus_int32 opus_projection_decoder_get_size(int channels, int streams,
@@ -152,6 +153,7 @@ int opus_projection_decoder_init(OpusProjectionDecoder *st, opus_int32 Fs,
   }
 
   /* Assign demixing matrix. */
+  st->arch = opus_select_arch();
   st->demixing_matrix_size_in_bytes =
     mapping_matrix_get_size(channels, nb_input_streams);
   if (!st->demixing_matrix_size_in_bytes)
@@ -216,7 +218,7 @@ int opus_projection_decode(OpusProjectionDecoder *st, const unsigned char *data,
 {
   return opus_multistream_decode_native(get_multistream_decoder(st), data, len,
     pcm, opus_projection_copy_channel_out_short, frame_size, decode_fec, 0,
-    get_dec_demixing_matrix(st));
+    st);
 }
 #else
 int opus_projection_decode(OpusProjectionDecoder *st, const unsigned char *data,
@@ -225,7 +227,7 @@ int opus_projection_decode(OpusProjectionDecoder *st, const unsigned char *data,
 {
   return opus_multistream_decode_native(get_multistream_decoder(st), data, len,
     pcm, opus_projection_copy_channel_out_short, frame_size, decode_fec, 1,
-    get_dec_demixing_matrix(st));
+    st);
 }
 #endif
 
@@ -235,7 +237,7 @@ int opus_projection_decode_float(OpusProjectionDecoder *st, const unsigned char
 {
   return opus_multistream_decode_native(get_multistream_decoder(st), data, len,
     pcm, opus_projection_copy_channel_out_float, frame_size, decode_fec, 0,
-    get_dec_demixing_matrix(st));
+    st);
 }
 #endif
 
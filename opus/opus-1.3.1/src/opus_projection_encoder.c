@@ -42,39 +42,10 @@ struct OpusProjectionEncoder
 {
   opus_int32 mixing_matrix_size_in_bytes;
   opus_int32 demixing_matrix_size_in_bytes;
+  int arch;
   /* Encoder states go here */
 };
 
-#if !defined(DISABLE_FLOAT_API)
-static void opus_projection_copy_channel_in_float(
-  opus_val16 *dst,
-  int dst_stride,
-  const void *src,
-  int src_stride,
-  int src_channel,
-  int frame_size,
-  void *user_data
-)
-{
-  mapping_matrix_multiply_channel_in_float((const MappingMatrix*)user_data,
-    (const float*)src, src_stride, dst, src_channel, dst_stride, frame_size);
-}
-#endif
-
-static void opus_projection_copy_channel_in_short(
-  opus_val16 *dst,
-  int dst_stride,
-  const void *src,
-  int src_stride,
-  int src_channel,
-  int frame_size,
-  void *user_data
-)
-{
-  mapping_matrix_multiply_channel_in_short((const MappingMatrix*)user_data,
-    (const opus_int16*)src, src_stride, dst, src_channel, dst_stride, frame_size);
-}
-
 static int get_order_plus_one_from_channels(int channels, int *order_plus_one)
 {
   int order_plus_one_;
@@ -139,6 +110,40 @@ static OpusMSEncoder *get_multistream_encoder(OpusProjectionEncoder *st)
     st->demixing_matrix_size_in_bytes));
 }
 
+#if !defined(DISABLE_FLOAT_API)
+static void opus_projection_copy_channel_in_float(
+  opus_val16 *dst,
+  int dst_stride,
+  const void *src,
+  int src_stride,
+  int src_channel,
+  int frame_size,
+  void *user_data
+)
+{
+  OpusProjectionEncoder *st = (OpusProjectionEncoder *)user_data;
+  mapping_matrix_multiply_channel_in_float(get_mixing_matrix(st),
+    (const float*)src, src_stride, dst, src_channel, dst_stride, frame_size,
+    st->arch);
+}
+#endif
+
+static void opus_projection_copy_channel_in_short(
+  opus_val16 *dst,
+  int dst_stride,
+  const void *src,
+  int src_stride,
+  int src_channel,
+  int frame_size,
+  void *user_data
+)
+{
+  OpusProjectionEncoder *st = (OpusProjectionEncoder *)user_data;
+  mapping_matrix_multiply_channel_in_short(get_mixing_matrix(st),
+    (const opus_int16*)src, src_stride, dst, src_channel, dst_stride, frame_size,
+    st->arch);
+}
+
 opus_int32 opus_projection_ambisonics_encoder_get_size(int channels,
                                                        int mapping_family)
 {
@@ -216,6 +221,8 @@ int opus_projection_ambisonics_encoder_init(OpusProjectionEncoder *st, opus_int3
     return OPUS_BAD_ARG;
   }
 
+  st->arch = opus_select_arch();
+
   if (get_streams_from_channels(channels, mapping_family, streams,
     coupled_streams, &order_plus_one) != OPUS_OK)
     return OPUS_BAD_ARG;
@@ -347,7 +354,7 @@ int opus_projection_encode(OpusProjectionEncoder *st, const opus_int16 *pcm,
 {
   return opus_multistream_encode_native(get_multistream_encoder(st),
     opus_projection_copy_channel_in_short, pcm, frame_size, data,
-    max_data_bytes, 16, downmix_int, 0, get_mixing_matrix(st));
+    max_data_bytes, 16, downmix_int, 0, st);
 }
 
 #ifndef DISABLE_FLOAT_API
@@ -358,7 +365,7 @@ int opus_projection_encode_float(OpusProjectionEncoder *st, const float *pcm,
 {
   return opus_multistream_encode_native(get_multistream_encoder(st),
     opus_projection_copy_channel_in_float, pcm, frame_size, data,
-    max_data_bytes, 16, downmix_float, 1, get_mixing_matrix(st));
+    max_data_bytes, 16, downmix_float, 1, st);
 }
 #else
 int opus_projection_encode_float(OpusProjectionEncoder *st, const float *pcm,
@@ -367,7 +374,7 @@ int opus_projection_encode_float(OpusProjectionEncoder *st, const float *pcm,
 {
   return opus_multistream_encode_native(get_multistream_encoder(st),
     opus_projection_copy_channel_in_float, pcm, frame_size, data,
-    max_data_bytes, 24, downmix_float, 1, get_mixing_matrix(st));
+    max_data_bytes, 24, downmix_float, 1, st);
 }
 #endif
 #endif
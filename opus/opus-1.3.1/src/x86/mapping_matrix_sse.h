@@ -0,0 +1,181 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MAPPING_MATRIX_SSE_H
+#define MAPPING_MATRIX_SSE_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(OPUS_X86_MAY_HAVE_SSE4_1)
+
+#ifndef DISABLE_FLOAT_API
+#define OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_FLOAT
+
+void mapping_matrix_multiply_channel_in_float_sse4_1(
+         const MappingMatrix *matrix,
+         const float *input,
+         int input_rows,
+         opus_val16 *output,
+         int output_row,
+         int output_rows,
+         int frame_size);
+
+#if defined(OPUS_X86_PRESUME_SSE4_1)
+#define mapping_matrix_multiply_channel_in_float(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_in_float_sse4_1(matrix, \
+      input, input_rows, output, output_row, output_rows, frame_size))
+
+#else
+
+extern void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_FLOAT_IMPL[OPUS_ARCHMASK + 1])(
+         const MappingMatrix *matrix,
+         const float *input,
+         int input_rows,
+         opus_val16 *output,
+         int output_row,
+         int output_rows,
+         int frame_size);
+
+#define mapping_matrix_multiply_channel_in_float(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((*MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_FLOAT_IMPL[(arch) & OPUS_ARCHMASK])(matrix, \
+      input, input_rows, output, output_row, output_rows, frame_size))
+
+#endif
+
+#define OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_FLOAT
+
+void mapping_matrix_multiply_channel_out_float_sse4_1(
+         const MappingMatrix *matrix,
+         const opus_val16 *input,
+         int input_row,
+         int input_rows,
+         float *output,
+         int output_rows,
+         int frame_size);
+
+#if defined(OPUS_X86_PRESUME_SSE4_1)
+#define mapping_matrix_multiply_channel_out_float(matrix, input, input_row, input_rows, \
+      output, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_out_float_sse4_1(matrix, \
+      input, input_row, input_rows, output, output_rows, frame_size))
+
+#else
+
+extern void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_FLOAT_IMPL[OPUS_ARCHMASK + 1])(
+         const MappingMatrix *matrix,
+         const opus_val16 *input,
+         int input_row,
+         int input_rows,
+         float *output,
+         int output_rows,
+         int frame_size);
+
+#define mapping_matrix_multiply_channel_out_float(matrix, input, input_row, input_rows, \
+      output, output_rows, frame_size, arch) \
+    ((*MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_FLOAT_IMPL[(arch) & OPUS_ARCHMASK])(matrix, \
+      input, input_row, input_rows, output, output_rows, frame_size))
+
+#endif
+#endif /* DISABLE_FLOAT_API */
+
+#define OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_SHORT
+
+void mapping_matrix_multiply_channel_in_short_sse4_1(
+         const MappingMatrix *matrix,
+         const opus_int16 *input,
+         int input_rows,
+         opus_val16 *output,
+         int output_row,
+         int output_rows,
+         int frame_size);
+
+#if defined(OPUS_X86_PRESUME_SSE4_1)
+#define mapping_matrix_multiply_channel_in_short(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_in_short_sse4_1(matrix, \
+      input, input_rows, output, output_row, output_rows, frame_size))
+
+#else
+
+extern void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_SHORT_IMPL[OPUS_ARCHMASK + 1])(
+         const MappingMatrix *matrix,
+         const opus_int16 *input,
+         int input_rows,
+         opus_val16 *output,
+         int output_row,
+         int output_rows,
+         int frame_size);
+
+#define mapping_matrix_multiply_channel_in_short(matrix, input, input_rows, \
+      output, output_row, output_rows, frame_size, arch) \
+    ((*MAPPING_MATRIX_MULTIPLY_CHANNEL_IN_SHORT_IMPL[(arch) & OPUS_ARCHMASK])(matrix, \
+      input, input_rows, output, output_row, output_rows, frame_size))
+
+#endif
+
+#define OVERRIDE_MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_SHORT
+
+void mapping_matrix_multiply_channel_out_short_sse4_1(
+         const MappingMatrix *matrix,
+         const opus_val16 *input,
+         int input_row,
+         int input_rows,
+         opus_int16 *output,
+         int output_rows,
+         int frame_size);
+
+#if defined(OPUS_X86_PRESUME_SSE4_1)
+#define mapping_matrix_multiply_channel_out_short(matrix, input, input_row, input_rows, \
+      output, output_rows, frame_size, arch) \
+    ((void)(arch), mapping_matrix_multiply_channel_out_short_sse4_1(matrix, \
+      input, input_row, input_rows, output, output_rows, frame_size))
+
+#else
+
+extern void (*const MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_SHORT_IMPL[OPUS_ARCHMASK + 1])(
+         const MappingMatrix *matrix,
+         const opus_val16 *input,
+         int input_row,
+         int input_rows,
+         opus_int16 *output,
+         int output_rows,
+         int frame_size);
+
+#define mapping_matrix_multiply_channel_out_short(matrix, input, input_row, input_rows, \
+      output, output_rows, frame_size, arch) \
+    ((*MAPPING_MATRIX_MULTIPLY_CHANNEL_OUT_SHORT_IMPL[(arch) & OPUS_ARCHMASK])(matrix, \
+      input, input_row, input_rows, output, output_rows, frame_size))
+
+#endif
+
+#endif
+
+#endif
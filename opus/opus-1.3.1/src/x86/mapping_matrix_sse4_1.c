@@ -0,0 +1,302 @@
+/* Copyright (c) 2026 opus_test contributors */
+/*
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions
+   are met:
+
+   - Redistributions of source code must retain the above copyright
+   notice, this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright
+   notice, this list of conditions and the following disclaimer in the
+   documentation and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+   ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER
+   OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+   EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+   PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include "arch.h"
+#include "float_cast.h"
+#include "stack_alloc.h"
+#include "../mapping_matrix.h"
+#include "x86/x86cpu.h"
+
+#define MATRIX_INDEX(nb_rows, row, col) (nb_rows * col + row)
+
+/* The kernels below give the same results as the C versions in
+   mapping_matrix.c.  Sums that are done in floating point keep the C order
+   of the columns, so they are vectorized over four samples at a time.  The
+   other loops are vectorized over the rows or columns, which sit next to
+   each other in memory.  The copy callback of the projection encoder asks
+   for one output row at a time, so the _in kernels read the input once for
+   each row they produce. */
+
+#ifndef DISABLE_FLOAT_API
+void mapping_matrix_multiply_channel_in_float_sse4_1(
+    const MappingMatrix *matrix,
+    const float *input,
+    int input_rows,
+    opus_val16 *output,
+    int output_row,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, col;
+  VARDECL(float, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, input_rows, float);
+  for (col = 0; col < input_rows; col++)
+    coef[col] = matrix_data[MATRIX_INDEX(matrix->rows, output_row, col)];
+
+  for (i = 0; i < frame_size - 3; i += 4)
+  {
+    const float *x = input + input_rows * i;
+    __m128 tmp = _mm_setzero_ps();
+#if defined(FIXED_POINT)
+    __m128i out;
+#endif
+    for (col = 0; col < input_rows; col++)
+    {
+      __m128 in = _mm_setr_ps(x[col], x[input_rows + col],
+          x[2 * input_rows + col], x[3 * input_rows + col]);
+      tmp = _mm_add_ps(tmp, _mm_mul_ps(_mm_set1_ps(coef[col]), in));
+    }
+    tmp = _mm_mul_ps(_mm_set1_ps(1/32768.f), tmp);
+#if defined(FIXED_POINT)
+    /* FLOAT2INT16() */
+    tmp = _mm_mul_ps(tmp, _mm_set1_ps(CELT_SIG_SCALE));
+    tmp = _mm_max_ps(tmp, _mm_set1_ps(-32768));
+    tmp = _mm_min_ps(tmp, _mm_set1_ps(32767));
+    out = _mm_cvtps_epi32(tmp);
+    output[output_rows * i] = (opus_int16)_mm_extract_epi32(out, 0);
+    output[output_rows * (i + 1)] = (opus_int16)_mm_extract_epi32(out, 1);
+    output[output_rows * (i + 2)] = (opus_int16)_mm_extract_epi32(out, 2);
+    output[output_rows * (i + 3)] = (opus_int16)_mm_extract_epi32(out, 3);
+#else
+    _mm_store_ss(&output[output_rows * i], tmp);
+    _mm_store_ss(&output[output_rows * (i + 1)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(1, 1, 1, 1)));
+    _mm_store_ss(&output[output_rows * (i + 2)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(2, 2, 2, 2)));
+    _mm_store_ss(&output[output_rows * (i + 3)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(3, 3, 3, 3)));
+#endif
+  }
+  for (; i < frame_size; i++)
+  {
+    float tmp = 0;
+    for (col = 0; col < input_rows; col++)
+    {
+      tmp += coef[col] * input[MATRIX_INDEX(input_rows, col, i)];
+    }
+#if defined(FIXED_POINT)
+    output[output_rows * i] = FLOAT2INT16((1/32768.f)*tmp);
+#else
+    output[output_rows * i] = (1/32768.f)*tmp;
+#endif
+  }
+  RESTORE_STACK;
+}
+
+void mapping_matrix_multiply_channel_out_float_sse4_1(
+    const MappingMatrix *matrix,
+    const opus_val16 *input,
+    int input_row,
+    int input_rows,
+    float *output,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, row;
+  float input_sample;
+  VARDECL(float, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, output_rows, float);
+  for (row = 0; row < output_rows; row++)
+    coef[row] = (1/32768.f)*matrix_data[MATRIX_INDEX(matrix->rows, row, input_row)];
+
+  for (i = 0; i < frame_size; i++)
+  {
+    float *y = output + output_rows * i;
+    __m128 in;
+#if defined(FIXED_POINT)
+    input_sample = (1/32768.f)*input[input_rows * i];
+#else
+    input_sample = input[input_rows * i];
+#endif
+    in = _mm_set1_ps(input_sample);
+    for (row = 0; row < output_rows - 3; row += 4)
+    {
+      __m128 tmp = _mm_mul_ps(_mm_loadu_ps(coef + row), in);
+      _mm_storeu_ps(y + row, _mm_add_ps(_mm_loadu_ps(y + row), tmp));
+    }
+    for (; row < output_rows; row++)
+    {
+      y[row] += coef[row] * input_sample;
+    }
+  }
+  RESTORE_STACK;
+}
+#endif /* DISABLE_FLOAT_API */
+
+void mapping_matrix_multiply_channel_in_short_sse4_1(
+    const MappingMatrix *matrix,
+    const opus_int16 *input,
+    int input_rows,
+    opus_val16 *output,
+    int output_row,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, col;
+  VARDECL(opus_int32, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, input_rows, opus_int32);
+  for (col = 0; col < input_rows; col++)
+    coef[col] = matrix_data[MATRIX_INDEX(matrix->rows, output_row, col)];
+
+#if defined(FIXED_POINT)
+  for (i = 0; i < frame_size; i++)
+  {
+    const opus_int16 *x = input + input_rows * i;
+    __m128i sum = _mm_setzero_si128();
+    opus_val32 tmp;
+    for (col = 0; col < input_rows - 3; col += 4)
+    {
+      __m128i in = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(x + col)));
+      __m128i prod = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(coef + col)), in);
+      sum = _mm_add_epi32(sum, _mm_srai_epi32(prod, 8));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    tmp = _mm_cvtsi128_si32(sum);
+    for (; col < input_rows; col++)
+    {
+      tmp += (coef[col] * (opus_int32)x[col]) >> 8;
+    }
+    output[output_rows * i] = (opus_int16)((tmp + 64) >> 7);
+  }
+#else
+  for (i = 0; i < frame_size - 3; i += 4)
+  {
+    const opus_int16 *x = input + input_rows * i;
+    __m128 tmp = _mm_setzero_ps();
+    for (col = 0; col < input_rows; col++)
+    {
+      __m128i in = _mm_setr_epi32(x[col], x[input_rows + col],
+          x[2 * input_rows + col], x[3 * input_rows + col]);
+      __m128i prod = _mm_mullo_epi32(_mm_set1_epi32(coef[col]), in);
+      tmp = _mm_add_ps(tmp, _mm_cvtepi32_ps(prod));
+    }
+    tmp = _mm_mul_ps(_mm_set1_ps(1/(32768.f*32768.f)), tmp);
+    _mm_store_ss(&output[output_rows * i], tmp);
+    _mm_store_ss(&output[output_rows * (i + 1)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(1, 1, 1, 1)));
+    _mm_store_ss(&output[output_rows * (i + 2)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(2, 2, 2, 2)));
+    _mm_store_ss(&output[output_rows * (i + 3)],
+        _mm_shuffle_ps(tmp, tmp, _MM_SHUFFLE(3, 3, 3, 3)));
+  }
+  for (; i < frame_size; i++)
+  {
+    opus_val32 tmp = 0;
+    for (col = 0; col < input_rows; col++)
+    {
+      tmp += coef[col] * input[MATRIX_INDEX(input_rows, col, i)];
+    }
+    output[output_rows * i] = (1/(32768.f*32768.f))*tmp;
+  }
+#endif
+  RESTORE_STACK;
+}
+
+void mapping_matrix_multiply_channel_out_short_sse4_1(
+    const MappingMatrix *matrix,
+    const opus_val16 *input,
+    int input_row,
+    int input_rows,
+    opus_int16 *output,
+    int output_rows,
+    int frame_size)
+{
+  /* Matrix data is ordered col-wise. */
+  opus_int16* matrix_data;
+  int i, row;
+  opus_int32 input_sample;
+  VARDECL(opus_int32, coef);
+  SAVE_STACK;
+
+  celt_assert(input_rows <= matrix->cols && output_rows <= matrix->rows);
+
+  matrix_data = mapping_matrix_get_data(matrix);
+
+  ALLOC(coef, output_rows, opus_int32);
+  for (row = 0; row < output_rows; row++)
+    coef[row] = matrix_data[MATRIX_INDEX(matrix->rows, row, input_row)];
+
+  for (i = 0; i < frame_size; i++)
+  {
+    opus_int16 *y = output + output_rows * i;
+    __m128i in;
+#if defined(FIXED_POINT)
+    input_sample = (opus_int32)input[input_rows * i];
+#else
+    input_sample = (opus_int32)FLOAT2INT16(input[input_rows * i]);
+#endif
+    in = _mm_set1_epi32(input_sample);
+    for (row = 0; row < output_rows - 3; row += 4)
+    {
+      __m128i tmp = _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(coef + row)), in);
+      __m128i out = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(y + row)));
+      tmp = _mm_srai_epi32(_mm_add_epi32(tmp, _mm_set1_epi32(16384)), 15);
+      out = _mm_add_epi32(out, tmp);
+      /* Wrap to 16 bits like the C version, so the pack cannot saturate */
+      out = _mm_srai_epi32(_mm_slli_epi32(out, 16), 16);
+      _mm_storel_epi64((__m128i *)(y + row), _mm_packs_epi32(out, out));
+    }
+    for (; row < output_rows; row++)
+    {
+      opus_int32 tmp = coef[row] * input_sample;
+      y[row] += (tmp + 16384) >> 15;
+    }
+  }
+  RESTORE_STACK;
+}
@@ -43,6 +43,7 @@
 #define getpid _getpid
 #endif
 #include "opus.h"
+#include "opus_multistream.h"
 #include "test_opus_common.h"
 
 #define MAX_PACKET (1500)
@@ -380,6 +381,240 @@ int test_decoder_code0(int no_fuzz)
    return 0;
 }
 
+/* Checks that opus_decode_ex() gives the same output as opus_decode()
+   followed by the conversion, through mode switches, FEC, PLC and gain. */
+void test_decode_ex(void)
+{
+   static const int bitrates[6]={6000,12000,20000,32000,64000,128000};
+   static const int durations[4]={10,20,40,60};
+   static const int formats[3][2]={{11,0},{16,0},{8,1}};
+   opus_int16 *in;
+   opus_int16 *ref;
+   opus_int16 *out;
+   unsigned char packet[MAX_PACKET];
+   OpusEncoder *enc;
+   int fsi, c, f, i, j, k, err;
+
+   fprintf(stdout,"  Testing opus_decode_ex()...\n");
+   in=(opus_int16 *)malloc(sizeof(*in)*MAX_FRAME_SAMP*2);
+   ref=(opus_int16 *)malloc(sizeof(*ref)*MAX_FRAME_SAMP*2);
+   out=(opus_int16 *)malloc(sizeof(*out)*MAX_FRAME_SAMP*2*6);
+   if(in==NULL||ref==NULL||out==NULL)test_failed();
+   for(c=1;c<=2;c++)
+   {
+      enc=opus_encoder_create(48000,c,OPUS_APPLICATION_AUDIO,&err);
+      if(err!=OPUS_OK||enc==NULL)test_failed();
+      if(opus_encoder_ctl(enc,OPUS_SET_INBAND_FEC(1))!=OPUS_OK)test_failed();
+      if(opus_encoder_ctl(enc,OPUS_SET_PACKET_LOSS_PERC(20))!=OPUS_OK)test_failed();
+      for(fsi=0;fsi<5;fsi++)
+      {
+         static const int rates[5]={48000,24000,16000,12000,8000};
+         int fs=rates[fsi];
+         for(f=0;f<3;f++)
+         {
+            OpusDecoder *dec;
+            OpusDecoder *decex;
+            OpusOutputFormat format;
+            format.bits=formats[f][0];
+            format.upsample=formats[f][1]?48000/fs:1;
+            dec=opus_decoder_create(fs,c,&err);
+            if(err!=OPUS_OK||dec==NULL)test_failed();
+            decex=opus_decoder_create(fs,c,&err);
+            if(err!=OPUS_OK||decex==NULL)test_failed();
+            if(opus_encoder_ctl(enc,OPUS_RESET_STATE)!=OPUS_OK)test_failed();
+            for(i=0;i<120;i++)
+            {
+               int len, dur, ref_samples, out_samples;
+               int lost, fec;
+               dur=durations[fast_rand()%4];
+               if(opus_encoder_ctl(enc,OPUS_SET_BITRATE(bitrates[fast_rand()%6]))!=OPUS_OK)test_failed();
+               for(j=0;j<48*dur*c;j++)
+                  in[j]=(opus_int16)((fast_rand()&4095)-2048+(int)(8000*sin(j*0.013*(1+c))));
+               len=opus_encode(enc,in,48*dur,packet,MAX_PACKET);
+               if(len<0)test_failed();
+               if(i==60)
+               {
+                  if(opus_decoder_ctl(dec,OPUS_SET_GAIN(-300))!=OPUS_OK)test_failed();
+                  if(opus_decoder_ctl(decex,OPUS_SET_GAIN(-300))!=OPUS_OK)test_failed();
+               }
+               lost=i>0&&(fast_rand()&7)==0;
+               fec=lost&&(fast_rand()&1);
+               if(lost&&!fec)
+               {
+                  ref_samples=opus_decode(dec,NULL,0,ref,fs/1000*dur,0);
+                  out_samples=opus_decode_ex(decex,NULL,0,out,fs/1000*dur,0,&format);
+               } else {
+                  ref_samples=opus_decode(dec,packet,len,ref,fs/1000*dur,fec);
+                  out_samples=opus_decode_ex(decex,packet,len,out,fs/1000*dur,fec,&format);
+               }
+               if(ref_samples<=0||ref_samples!=out_samples)test_failed();
+               for(j=0;j<ref_samples;j++)
+               {
+                  for(k=0;k<c*format.upsample;k++)
+                  {
+                     int s=((opus_uint16)(ref[j*c+k%c]+32768))>>(16-format.bits);
+                     if(out[j*c*format.upsample+k]!=(opus_int16)s)test_failed();
+                  }
+               }
+            }
+            opus_decoder_destroy(dec);
+            opus_decoder_destroy(decex);
+         }
+      }
+      opus_encoder_destroy(enc);
+   }
+   {
+      OpusDecoder *dec;
+      OpusOutputFormat format;
+      dec=opus_decoder_create(48000,1,&err);
+      if(err!=OPUS_OK||dec==NULL)test_failed();
+      format.bits=0;
+      format.upsample=1;
+      if(opus_decode_ex(dec,NULL,0,out,960,0,&format)!=OPUS_BAD_ARG)test_failed();
+      format.bits=17;
+      if(opus_decode_ex(dec,NULL,0,out,960,0,&format)!=OPUS_BAD_ARG)test_failed();
+      format.bits=11;
+      format.upsample=0;
+      if(opus_decode_ex(dec,NULL,0,out,960,0,&format)!=OPUS_BAD_ARG)test_failed();
+      opus_decoder_destroy(dec);
+   }
+   free(in);
+   free(ref);
+   free(out);
+   fprintf(stdout,"  opus_decode_ex() ......................... OK.\n");
+}
+
+static int executor_runs;
+static int executor_tasks;
+
+/* Pseudostack builds decode every stream serially */
+#ifdef NONTHREADSAFE_PSEUDOSTACK
+#define EXECUTOR_USED 0
+#else
+#define EXECUTOR_USED 1
+#endif
+
+/* Runs the tasks backwards, so nothing can depend on the serial order */
+static void reverse_executor(void *data, void (*task)(void *arg, int index),
+                             void *arg, int count)
+{
+   int i;
+   (void)data;
+   for (i=count-1;i>=0;i--)
+   {
+      task(arg, i);
+      executor_tasks++;
+   }
+   executor_runs++;
+}
+
+/* A multistream decoder with an executor must match the serial decoder
+   through normal decoding, FEC and PLC, and hand every stream to the
+   executor in one run. For FEC and PLC the frame is the caller's
+   frame_size, up to the 120 ms clamp, and when the per-stream buffers for
+   it would take more than 120 ms of 16 channels the streams must be
+   decoded serially instead. */
+void test_ms_decode_executor(void)
+{
+   static const int frame_sizes[5]={120,480,960,2880,5760};
+   OpusMSExecutor executor;
+   opus_int16 *pcm;
+   opus_int16 *out[2];
+   unsigned char *packet;
+   int serial;
+   int f, c, i, j, k;
+
+   fprintf(stdout,"  Testing the multistream decoder executor...\n");
+   executor.run = reverse_executor;
+   executor.data = NULL;
+   pcm=(opus_int16 *)malloc(sizeof(*pcm)*MAX_FRAME_SAMP*18);
+   out[0]=(opus_int16 *)malloc(sizeof(*out[0])*MAX_FRAME_SAMP*18);
+   out[1]=(opus_int16 *)malloc(sizeof(*out[1])*MAX_FRAME_SAMP*18);
+   packet=(unsigned char *)malloc(18*7664);
+   if(pcm==NULL||out[0]==NULL||out[1]==NULL||packet==NULL)test_failed();
+   executor_runs=0;
+   serial=0;
+   /* 5.1 surround, and 18 mono streams whose 120 ms frames are too large
+      for the executor */
+   for(f=0;f<2;f++)
+   {
+      OpusMSEncoder *enc;
+      OpusMSDecoder *dec[2];
+      unsigned char mapping[255];
+      int channels, streams, coupled, err;
+      if(f==0)
+      {
+         channels=6;
+         enc=opus_multistream_surround_encoder_create(48000, channels, 1, &streams,
+               &coupled, mapping, OPUS_APPLICATION_VOIP, &err);
+      } else {
+         channels=streams=18;
+         coupled=0;
+         for(i=0;i<channels;i++)mapping[i]=i;
+         enc=opus_multistream_encoder_create(48000, channels, streams, coupled,
+               mapping, OPUS_APPLICATION_VOIP, &err);
+      }
+      if(err!=OPUS_OK||enc==NULL)test_failed();
+      /* SILK with in-band FEC, so that FEC decoding has something to use */
+      if(opus_multistream_encoder_ctl(enc, OPUS_SET_BITRATE(16000*streams))!=OPUS_OK)test_failed();
+      if(opus_multistream_encoder_ctl(enc, OPUS_SET_INBAND_FEC(1))!=OPUS_OK)test_failed();
+      if(opus_multistream_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(20))!=OPUS_OK)test_failed();
+      for(c=0;c<2;c++)
+      {
+         dec[c]=opus_multistream_decoder_create(48000, channels, streams, coupled, mapping, &err);
+         if(err!=OPUS_OK||dec[c]==NULL)test_failed();
+      }
+      if(opus_multistream_decoder_ctl(dec[1], OPUS_MULTISTREAM_SET_EXECUTOR(&executor))!=OPUS_OK)test_failed();
+      for(k=0;k<5;k++)
+      {
+         int frame_size=frame_sizes[k];
+         for(j=0;j<6;j++)
+         {
+            int len, ret[2], runs, tasks, mode, dec_size, job_size;
+            for(i=0;i<frame_size*channels;i++)
+            {
+               int ch = i%channels;
+               pcm[i] = (short)(8000*sin((i/channels+j*frame_size)*(ch+1)*0.013)
+                     + (fast_rand()&1023) - 512);
+            }
+            len=opus_multistream_encode(enc, pcm, frame_size, packet, 18*7664);
+            if(len<=0)test_failed();
+            /* Decode, then FEC, then PLC, the last time with a caller's
+               frame_size beyond the clamp */
+            mode=j%3;
+            dec_size = mode==0 ? MAX_FRAME_SAMP : mode==2&&j==5 ? 48000 : frame_size;
+            job_size = mode==0 ? frame_size : dec_size<MAX_FRAME_SAMP ? dec_size : MAX_FRAME_SAMP;
+            runs=executor_runs;
+            tasks=executor_tasks;
+            for(c=0;c<2;c++)
+            {
+               ret[c]=opus_multistream_decode(dec[c], mode==2 ? NULL : packet,
+                     mode==2 ? 0 : len, out[c], dec_size, mode==1);
+               if(ret[c]!=job_size)test_failed();
+            }
+            if(memcmp(out[0], out[1], sizeof(*out[0])*job_size*channels)!=0)test_failed();
+            if((streams+coupled)*job_size<=16*5760)
+            {
+               if(executor_runs!=runs+EXECUTOR_USED||executor_tasks!=tasks+streams*EXECUTOR_USED)test_failed();
+            } else {
+               if(executor_runs!=runs||executor_tasks!=tasks)test_failed();
+               serial++;
+            }
+         }
+      }
+      opus_multistream_encoder_destroy(enc);
+      opus_multistream_decoder_destroy(dec[0]);
+      opus_multistream_decoder_destroy(dec[1]);
+   }
+   /* Both the dispatched and the serial case must have been seen */
+   if((EXECUTOR_USED&&executor_runs==0)||serial==0)test_failed();
+   free(pcm);
+   free(out[0]);
+   free(out[1]);
+   free(packet);
+   fprintf(stdout,"  Multistream decoder executor ............. OK.\n");
+}
+
 #ifndef DISABLE_FLOAT_API
 void test_soft_clip(void)
 {
@@ -455,6 +690,8 @@ int main(int _argc, char **_argv)
      into the decoders. This is helpful because garbage data
      may cause the decoders to clip, which angers CLANG IOC.*/
    test_decoder_code0(getenv("TEST_OPUS_NOFUZZ")!=NULL);
+   test_decode_ex();
+   test_ms_decode_executor();
 #ifndef DISABLE_FLOAT_API
    test_soft_clip();
 #endif
@@ -629,6 +629,146 @@ int run_test1(int no_fuzz)
    return 0;
 }
 
+static int executor_runs;
+static int executor_tasks;
+
+/* Builds with the pseudostack never hand streams to an executor */
+#ifdef NONTHREADSAFE_PSEUDOSTACK
+#define EXECUTOR_USED 0
+#else
+#define EXECUTOR_USED 1
+#endif
+
+/* Runs the tasks backwards, so nothing can depend on the serial order */
+static void reverse_executor(void *data, void (*task)(void *arg, int index),
+                             void *arg, int count)
+{
+   int i;
+   (void)data;
+   for (i=count-1;i>=0;i--)
+   {
+      task(arg, i);
+      executor_tasks++;
+   }
+   executor_runs++;
+}
+
+/* The streams handed to an executor must come out bit-exact with the
+   serial encoder, with a packet budget that leaves room for all of them,
+   for some of them and for none of them, and likewise with the serial
+   decoder, including lost packets. */
+void test_ms_executor(void)
+{
+   static const int families[2] = {1, 2};
+   static const int channels[2] = {6, 9};
+   static const int frame_sizes[8] = {120, 240, 480, 960, 1920, 2880, 4800, 5760};
+   OpusMSExecutor executor;
+   short *pcm;
+   short *out[2];
+   float *outf[2];
+   unsigned char *packet[2];
+   int f, c, v, b, i, j, k;
+
+   executor.run = reverse_executor;
+   executor.data = NULL;
+   pcm = malloc(sizeof(*pcm)*MAX_FRAME_SAMP*9);
+   packet[0] = malloc(9*7664);
+   packet[1] = malloc(9*7664);
+   out[0] = malloc(sizeof(*out[0])*MAX_FRAME_SAMP*9);
+   out[1] = malloc(sizeof(*out[1])*MAX_FRAME_SAMP*9);
+   outf[0] = malloc(sizeof(*outf[0])*MAX_FRAME_SAMP*9);
+   outf[1] = malloc(sizeof(*outf[1])*MAX_FRAME_SAMP*9);
+   if(pcm==NULL||packet[0]==NULL||packet[1]==NULL||out[0]==NULL||out[1]==NULL
+      ||outf[0]==NULL||outf[1]==NULL)test_failed();
+   for(f=0;f<2;f++)
+   {
+      for(v=0;v<2;v++)
+      {
+         for(k=0;k<8;k++)
+         {
+            OpusMSEncoder *enc[2];
+            OpusMSDecoder *dec[2];
+            int streams, coupled, err;
+            unsigned char mapping[256];
+            int frame_size = frame_sizes[k];
+            for(c=0;c<2;c++)
+            {
+               enc[c]=opus_multistream_surround_encoder_create(48000, channels[f], families[f],
+                     &streams, &coupled, mapping, OPUS_APPLICATION_AUDIO, &err);
+               if(err!=OPUS_OK||enc[c]==NULL)test_failed();
+               if(opus_multistream_encoder_ctl(enc[c], OPUS_SET_VBR(v))!=OPUS_OK)test_failed();
+               if(opus_multistream_encoder_ctl(enc[c], OPUS_SET_BITRATE(64000*channels[f]))!=OPUS_OK)test_failed();
+               dec[c]=opus_multistream_decoder_create(48000, channels[f], streams, coupled, mapping, &err);
+               if(err!=OPUS_OK||dec[c]==NULL)test_failed();
+            }
+            if(opus_multistream_encoder_ctl(enc[1], OPUS_MULTISTREAM_SET_EXECUTOR(&executor))!=OPUS_OK)test_failed();
+            if(opus_multistream_decoder_ctl(dec[1], OPUS_MULTISTREAM_SET_EXECUTOR(&executor))!=OPUS_OK)test_failed();
+            for(j=0;j<12;j++)
+            {
+               int max_bytes, len[2], runs, tasks, packet_len;
+               /* All streams, about half of them, then none */
+               b = j%3;
+               max_bytes = b==0 ? streams*7664 : b==1 ? streams*1278-1000 : streams*300;
+               for(i=0;i<frame_size*channels[f];i++)
+               {
+                  int ch = i%channels[f];
+                  pcm[i] = (short)(8000*sin((i/channels[f]+j*frame_size)*(ch+1)*0.013)
+                        + (fast_rand()&1023) - 512);
+               }
+               runs = executor_runs;
+               tasks = executor_tasks;
+               for(c=0;c<2;c++)
+               {
+                  len[c]=opus_multistream_encode(enc[c], pcm, frame_size, packet[c], max_bytes);
+                  if(len[c]<=0||len[c]>max_bytes)test_failed();
+               }
+               /* A VBR encoder with room for every stream must use the executor,
+                  once, for at most every stream */
+               if(v&&b==0&&(executor_runs!=runs+EXECUTOR_USED||executor_tasks<tasks+EXECUTOR_USED))test_failed();
+               if(executor_tasks-tasks>streams*EXECUTOR_USED)test_failed();
+               if(len[0]!=len[1]||memcmp(packet[0], packet[1], len[0])!=0)test_failed();
+               /* Every fourth packet is lost */
+               packet_len = j%4==3 ? 0 : len[0];
+               runs = executor_runs;
+               tasks = executor_tasks;
+               if(j&1)
+               {
+                  for(c=0;c<2;c++)
+                  {
+                     len[c]=opus_multistream_decode_float(dec[c], packet[0], packet_len, outf[c], frame_size, 0);
+                     if(len[c]!=frame_size)test_failed();
+                  }
+                  if(memcmp(outf[0], outf[1], sizeof(*outf[0])*frame_size*channels[f])!=0)test_failed();
+               } else {
+                  for(c=0;c<2;c++)
+                  {
+                     len[c]=opus_multistream_decode(dec[c], packet[0], packet_len, out[c], frame_size, 0);
+                     if(len[c]!=frame_size)test_failed();
+                  }
+                  if(memcmp(out[0], out[1], sizeof(*out[0])*frame_size*channels[f])!=0)test_failed();
+               }
+               /* The decoder hands every stream to the executor in one run */
+               if(executor_runs!=runs+EXECUTOR_USED||executor_tasks!=tasks+streams*EXECUTOR_USED)test_failed();
+            }
+            /* Turning the executor off goes back to the serial encoder */
+            if(opus_multistream_encoder_ctl(enc[1], OPUS_MULTISTREAM_SET_EXECUTOR((const OpusMSExecutor*)NULL))!=OPUS_OK)test_failed();
+            opus_multistream_encoder_destroy(enc[0]);
+            opus_multistream_encoder_destroy(enc[1]);
+            opus_multistream_decoder_destroy(dec[0]);
+            opus_multistream_decoder_destroy(dec[1]);
+         }
+      }
+   }
+   free(pcm);
+   free(packet[0]);
+   free(packet[1]);
+   free(out[0]);
+   free(out[1]);
+   free(outf[0]);
+   free(outf[1]);
+   fprintf(stderr,"    Multistream executor .......................... OK.\n");
+}
+
 void print_usage(char* _argv[])
 {
    fprintf(stderr,"Usage: %s [<seed>] [-fuzz <num_encoders> <num_settings_per_encoder>]\n",_argv[0]);
@@ -690,6 +830,8 @@ int main(int _argc, char **_argv)
      may cause the decoders to clip, which angers CLANG IOC.*/
    run_test1(getenv("TEST_OPUS_NOFUZZ")!=NULL);
 
+   test_ms_executor();
+
    /* Fuzz encoder settings online */
    if(getenv("TEST_OPUS_NOFUZZ")==NULL) {
       fprintf(stderr,"Running fuzz_encoder_settings with %d encoder(s) and %d setting change(s) each.\n",
@@ -34,7 +34,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include "float_cast.h"
+#include "stack_alloc.h"
 #include "opus.h"
 #include "test_opus_common.h"
 #include "opus_projection.h"
@@ -52,6 +54,9 @@
 #define SIMPLE_MATRIX_INPUT_SIZE 30
 #define SIMPLE_MATRIX_OUTPUT_SIZE 40
 
+#define KERNEL_MAX_CHANNELS 18
+#define KERNEL_BENCH_FRAMES 2000
+
 int assert_is_equal(
   const opus_val16 *a, const opus_int16 *b, int size, opus_int16 tolerance)
 {
@@ -99,6 +104,7 @@ void test_simple_matrix(void)
   opus_val16 *output_val16;
   opus_int16 *output_int16;
   MappingMatrix *simple_matrix;
+  int arch = opus_select_arch();
 
   /* Allocate input/output buffers. */
   input_val16 = (opus_val16 *)opus_alloc(sizeof(opus_val16) * SIMPLE_MATRIX_INPUT_SIZE);
@@ -133,7 +139,7 @@ void test_simple_matrix(void)
   {
     mapping_matrix_multiply_channel_in_short(simple_matrix,
       input_int16, simple_matrix->cols, &output_val16[i], i,
-      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE);
+      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE, arch);
   }
   ret = assert_is_equal(output_val16, expected_output_int16, SIMPLE_MATRIX_OUTPUT_SIZE, ERROR_TOLERANCE);
   if (ret)
@@ -146,7 +152,7 @@ void test_simple_matrix(void)
   {
     mapping_matrix_multiply_channel_out_short(simple_matrix,
       &input_val16[i], i, simple_matrix->cols, output_int16,
-      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE);
+      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE, arch);
   }
   ret = assert_is_equal_short(output_int16, expected_output_int16, SIMPLE_MATRIX_OUTPUT_SIZE, ERROR_TOLERANCE);
   if (ret)
@@ -160,7 +166,7 @@ void test_simple_matrix(void)
   {
     mapping_matrix_multiply_channel_in_float(simple_matrix,
       input_val16, simple_matrix->cols, &output_val16[i], i,
-      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE);
+      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE, arch);
   }
   ret = assert_is_equal(output_val16, expected_output_int16, SIMPLE_MATRIX_OUTPUT_SIZE, ERROR_TOLERANCE);
   if (ret)
@@ -173,7 +179,7 @@ void test_simple_matrix(void)
   {
     mapping_matrix_multiply_channel_out_float(simple_matrix,
       &input_val16[i], i, simple_matrix->cols, output_val16,
-      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE);
+      simple_matrix->rows, SIMPLE_MATRIX_FRAME_SIZE, arch);
   }
   ret = assert_is_equal(output_val16, expected_output_int16, SIMPLE_MATRIX_OUTPUT_SIZE, ERROR_TOLERANCE);
   if (ret)
@@ -186,6 +192,227 @@ void test_simple_matrix(void)
   opus_free(simple_matrix);
 }
 
+static const MappingMatrix *const kernel_matrices[6] = {
+  &mapping_matrix_foa_mixing, &mapping_matrix_foa_demixing,
+  &mapping_matrix_soa_mixing, &mapping_matrix_soa_demixing,
+  &mapping_matrix_toa_mixing, &mapping_matrix_toa_demixing
+};
+
+static const opus_int16 *const kernel_matrix_data[6] = {
+  mapping_matrix_foa_mixing_data, mapping_matrix_foa_demixing_data,
+  mapping_matrix_soa_mixing_data, mapping_matrix_soa_demixing_data,
+  mapping_matrix_toa_mixing_data, mapping_matrix_toa_demixing_data
+};
+
+static MappingMatrix *create_kernel_matrix(int i)
+{
+  const MappingMatrix *params = kernel_matrices[i];
+  MappingMatrix *matrix;
+  matrix = (MappingMatrix *)opus_alloc(
+    mapping_matrix_get_size(params->rows, params->cols));
+  mapping_matrix_init(matrix, params->rows, params->cols, params->gain,
+    kernel_matrix_data[i],
+    params->rows * params->cols * sizeof(opus_int16));
+  return matrix;
+}
+
+static float random_float(void)
+{
+  /* Slightly beyond full scale so the FLOAT2INT16() clipping is covered. */
+  return ((opus_int32)(fast_rand() & 65535) - 32768) * (1.25f/32768.f);
+}
+
+static opus_val16 random_val16(void)
+{
+#ifdef FIXED_POINT
+  return (opus_int16)fast_rand();
+#else
+  return random_float();
+#endif
+}
+
+/* The dispatched kernels must give the same bits as the C versions for the
+   ambisonics matrices of orders 1 to 3, including frame sizes that are not a
+   multiple of the vector width. */
+void test_matrix_kernels(void)
+{
+  static const int frame_sizes[7] = {1, 3, 4, 7, 120, 481, 960};
+  int arch = opus_select_arch();
+  int m, f, i, j;
+  int size = MAX_FRAME_SAMPLES * KERNEL_MAX_CHANNELS;
+  opus_int16 *in_int16, *out_int16[2];
+  opus_val16 *in_val16, *out_val16[2];
+  float *in_float, *out_float[2];
+
+  in_int16 = (opus_int16 *)opus_alloc(sizeof(opus_int16) * size);
+  in_val16 = (opus_val16 *)opus_alloc(sizeof(opus_val16) * size);
+  in_float = (float *)opus_alloc(sizeof(float) * size);
+  for (i = 0; i < 2; i++)
+  {
+    out_int16[i] = (opus_int16 *)opus_alloc(sizeof(opus_int16) * size);
+    out_val16[i] = (opus_val16 *)opus_alloc(sizeof(opus_val16) * size);
+    out_float[i] = (float *)opus_alloc(sizeof(float) * size);
+  }
+
+  for (m = 0; m < 6; m++)
+  {
+    MappingMatrix *matrix = create_kernel_matrix(m);
+    int rows = matrix->rows;
+    int cols = matrix->cols;
+    for (f = 0; f < 7; f++)
+    {
+      int frame_size = frame_sizes[f];
+      for (i = 0; i < frame_size * KERNEL_MAX_CHANNELS; i++)
+      {
+        in_int16[i] = (opus_int16)fast_rand();
+        in_val16[i] = random_val16();
+        in_float[i] = random_float();
+      }
+
+      /* _in_short and _in_float fill one output row at a time. */
+      for (i = 0; i < 2; i++)
+        OPUS_CLEAR(out_val16[i], frame_size * rows);
+      for (j = 0; j < rows; j++)
+      {
+        mapping_matrix_multiply_channel_in_short_c(matrix, in_int16, cols,
+          &out_val16[0][j], j, rows, frame_size);
+        mapping_matrix_multiply_channel_in_short(matrix, in_int16, cols,
+          &out_val16[1][j], j, rows, frame_size, arch);
+      }
+      if (memcmp(out_val16[0], out_val16[1],
+          sizeof(opus_val16) * frame_size * rows))
+        test_failed();
+
+#if !defined(DISABLE_FLOAT_API)
+      for (j = 0; j < rows; j++)
+      {
+        mapping_matrix_multiply_channel_in_float_c(matrix, in_float, cols,
+          &out_val16[0][j], j, rows, frame_size);
+        mapping_matrix_multiply_channel_in_float(matrix, in_float, cols,
+          &out_val16[1][j], j, rows, frame_size, arch);
+      }
+      if (memcmp(out_val16[0], out_val16[1],
+          sizeof(opus_val16) * frame_size * rows))
+        test_failed();
+#endif
+
+      /* _out_short and _out_float accumulate into the output, which starts
+         out random so that the 16-bit wrap-around is covered as well. */
+      for (i = 0; i < frame_size * rows; i++)
+      {
+        out_int16[0][i] = out_int16[1][i] = (opus_int16)fast_rand();
+        out_float[0][i] = out_float[1][i] = random_float();
+      }
+      for (j = 0; j < cols; j++)
+      {
+        mapping_matrix_multiply_channel_out_short_c(matrix, &in_val16[j], j,
+          cols, out_int16[0], rows, frame_size);
+        mapping_matrix_multiply_channel_out_short(matrix, &in_val16[j], j,
+          cols, out_int16[1], rows, frame_size, arch);
+      }
+      if (memcmp(out_int16[0], out_int16[1],
+          sizeof(opus_int16) * frame_size * rows))
+        test_failed();
+
+#if !defined(DISABLE_FLOAT_API)
+      for (j = 0; j < cols; j++)
+      {
+        mapping_matrix_multiply_channel_out_float_c(matrix, &in_val16[j], j,
+          cols, out_float[0], rows, frame_size);
+        mapping_matrix_multiply_channel_out_float(matrix, &in_val16[j], j,
+          cols, out_float[1], rows, frame_size, arch);
+      }
+      if (memcmp(out_float[0], out_float[1],
+          sizeof(float) * frame_size * rows))
+        test_failed();
+#endif
+    }
+    opus_free(matrix);
+  }
+
+  opus_free(in_int16);
+  opus_free(in_val16);
+  opus_free(in_float);
+  for (i = 0; i < 2; i++)
+  {
+    opus_free(out_int16[i]);
+    opus_free(out_val16[i]);
+    opus_free(out_float[i]);
+  }
+}
+
+static double bench_seconds(clock_t start)
+{
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Times the C and the dispatched kernels on 20 ms frames at 48 kHz, the way
+   the projection encoder (_in_short) and decoder (_out_short) use them. */
+void bench_matrix_kernels(void)
+{
+  int arch = opus_select_arch();
+  int m, n, i, j;
+  int size = BUFFER_SIZE * KERNEL_MAX_CHANNELS;
+  opus_int16 *pcm;
+  opus_val16 *buf;
+  clock_t start;
+
+  pcm = (opus_int16 *)opus_alloc(sizeof(opus_int16) * size);
+  buf = (opus_val16 *)opus_alloc(sizeof(opus_val16) * size);
+  for (i = 0; i < size; i++)
+  {
+    pcm[i] = (opus_int16)fast_rand();
+    buf[i] = random_val16();
+  }
+
+  fprintf(stderr, "order  kernel     C (s)  arch %d (s)\n", arch);
+  for (m = 0; m < 6; m += 2)
+  {
+    MappingMatrix *matrix = create_kernel_matrix(m);
+    int rows = matrix->rows;
+    int cols = matrix->cols;
+    double t[2];
+
+    start = clock();
+    for (n = 0; n < KERNEL_BENCH_FRAMES; n++)
+      for (j = 0; j < rows; j++)
+        mapping_matrix_multiply_channel_in_short_c(matrix, pcm, cols,
+          &buf[j], j, rows, BUFFER_SIZE);
+    t[0] = bench_seconds(start);
+    start = clock();
+    for (n = 0; n < KERNEL_BENCH_FRAMES; n++)
+      for (j = 0; j < rows; j++)
+        mapping_matrix_multiply_channel_in_short(matrix, pcm, cols,
+          &buf[j], j, rows, BUFFER_SIZE, arch);
+    t[1] = bench_seconds(start);
+    fprintf(stderr, "%5d  in_short  %6.3f  %6.3f\n", m/2 + 1, t[0], t[1]);
+
+    start = clock();
+    for (n = 0; n < KERNEL_BENCH_FRAMES; n++)
+    {
+      OPUS_CLEAR(pcm, BUFFER_SIZE * rows);
+      for (j = 0; j < cols; j++)
+        mapping_matrix_multiply_channel_out_short_c(matrix, &buf[j], j,
+          cols, pcm, rows, BUFFER_SIZE);
+    }
+    t[0] = bench_seconds(start);
+    start = clock();
+    for (n = 0; n < KERNEL_BENCH_FRAMES; n++)
+    {
+      OPUS_CLEAR(pcm, BUFFER_SIZE * rows);
+      for (j = 0; j < cols; j++)
+        mapping_matrix_multiply_channel_out_short(matrix, &buf[j], j,
+          cols, pcm, rows, BUFFER_SIZE, arch);
+    }
+    t[1] = bench_seconds(start);
+    fprintf(stderr, "%5d  out_short %6.3f  %6.3f\n", m/2 + 1, t[0], t[1]);
+    opus_free(matrix);
+  }
+
+  opus_free(pcm);
+  opus_free(buf);
+}
+
 void test_creation_arguments(const int channels, const int mapping_family)
 {
   int streams;
@@ -371,16 +598,143 @@ bad_cleanup:
   test_failed();
 }
 
+static int executor_runs;
+static int executor_tasks;
+
+/* With the pseudostack the streams are never given to the executor */
+#ifdef NONTHREADSAFE_PSEUDOSTACK
+#define EXECUTOR_USED 0
+#else
+#define EXECUTOR_USED 1
+#endif
+
+/* Runs the tasks backwards, so nothing can depend on the serial order. */
+static void reverse_executor(void *data, void (*task)(void *arg, int index),
+                             void *arg, int count)
+{
+  int i;
+  (void)data;
+  for (i = count - 1; i >= 0; i--)
+  {
+    task(arg, i);
+    executor_tasks++;
+  }
+  executor_runs++;
+}
+
+/* A projection decoder with an executor must match the serial decoder,
+   through lost packets and FEC too, and hand every stream to the executor
+   in one run for each frame. */
+void test_decode_executor(opus_int32 channels, const int mapping_family)
+{
+  const opus_int32 Fs = 48000;
+  OpusMSExecutor executor;
+  OpusProjectionEncoder *st_enc;
+  OpusProjectionDecoder *st_dec[2];
+  int streams;
+  int coupled;
+  int error;
+  short *buffer_in;
+  short *buffer_out[2];
+  unsigned char data[MAX_DATA_BYTES];
+  opus_int32 matrix_size = 0;
+  unsigned char *matrix;
+  int i, c, len, mode, runs, tasks;
+  int out_samples[2];
+
+  executor.run = reverse_executor;
+  executor.data = NULL;
+  buffer_in = (short *)malloc(sizeof(short) * BUFFER_SIZE * channels);
+  buffer_out[0] = (short *)malloc(sizeof(short) * BUFFER_SIZE * channels);
+  buffer_out[1] = (short *)malloc(sizeof(short) * BUFFER_SIZE * channels);
+
+  st_enc = opus_projection_ambisonics_encoder_create(Fs, channels,
+    mapping_family, &streams, &coupled, OPUS_APPLICATION_AUDIO, &error);
+  if (error != OPUS_OK)
+    test_failed();
+  if (opus_projection_encoder_ctl(st_enc,
+    OPUS_SET_BITRATE(64 * 1000 * (streams + coupled))) != OPUS_OK)
+    test_failed();
+  if (opus_projection_encoder_ctl(st_enc,
+    OPUS_PROJECTION_GET_DEMIXING_MATRIX_SIZE_REQUEST, &matrix_size) != OPUS_OK
+    || !matrix_size)
+    test_failed();
+  matrix = (unsigned char *)opus_alloc(matrix_size);
+  if (opus_projection_encoder_ctl(st_enc,
+    OPUS_PROJECTION_GET_DEMIXING_MATRIX_REQUEST, matrix, matrix_size)
+    != OPUS_OK)
+    test_failed();
+  for (c = 0; c < 2; c++)
+  {
+    st_dec[c] = opus_projection_decoder_create(Fs, channels, streams, coupled,
+      matrix, matrix_size, &error);
+    if (error != OPUS_OK)
+      test_failed();
+  }
+  opus_free(matrix);
+  if (opus_projection_decoder_ctl(st_dec[1],
+    OPUS_MULTISTREAM_SET_EXECUTOR(&executor)) != OPUS_OK)
+    test_failed();
+
+  for (i = 0; i < 12; i++)
+  {
+    generate_music(buffer_in, BUFFER_SIZE, channels);
+    len = opus_projection_encode(
+      st_enc, buffer_in, BUFFER_SIZE, data, MAX_DATA_BYTES);
+    if (len <= 0 || len > MAX_DATA_BYTES)
+      test_failed();
+
+    /* Decode, then FEC, then a lost packet. */
+    mode = i % 3;
+    runs = executor_runs;
+    tasks = executor_tasks;
+    for (c = 0; c < 2; c++)
+    {
+      out_samples[c] = opus_projection_decode(st_dec[c],
+        mode == 2 ? NULL : data, mode == 2 ? 0 : len, buffer_out[c],
+        BUFFER_SIZE, mode == 1);
+      if (out_samples[c] != BUFFER_SIZE)
+        test_failed();
+    }
+    if (memcmp(buffer_out[0], buffer_out[1],
+      sizeof(short) * BUFFER_SIZE * channels) != 0)
+      test_failed();
+    if (executor_runs != runs + EXECUTOR_USED
+      || executor_tasks != tasks + streams * EXECUTOR_USED)
+      test_failed();
+  }
+
+  opus_projection_decoder_destroy(st_dec[0]);
+  opus_projection_decoder_destroy(st_dec[1]);
+  opus_projection_encoder_destroy(st_enc);
+  free(buffer_in);
+  free(buffer_out[0]);
+  free(buffer_out[1]);
+}
+
 int main(int _argc, char **_argv)
 {
   unsigned int i;
+  /* The matrix kernels called below take their scratch space from the
+     pseudostack, if there is one */
+  ALLOC_STACK;
+
+  iseed = 42;
+  Rw = Rz = iseed;
 
-  (void)_argc;
-  (void)_argv;
+  if (_argc > 1 && strcmp(_argv[1], "-bench") == 0)
+  {
+    bench_matrix_kernels();
+    RESTORE_STACK;
+    return 0;
+  }
 
   /* Test simple matrix multiplication routines. */
   test_simple_matrix();
 
+  /* Test the optimized matrix kernels against the C versions. */
+  test_matrix_kernels();
+
   /* Test full range of channels in creation arguments. */
   for (i = 0; i < 255; i++)
     test_creation_arguments(i, 3);
@@ -388,7 +742,11 @@ int main(int _argc, char **_argv)
   /* Test encode/decode pipeline. */
   test_encode_decode(64 * 18, 18, 3);
 
+  /* Test decoding through an executor. */
+  test_decode_executor(18, 3);
+
   fprintf(stderr, "All projection tests passed.\n");
+  RESTORE_STACK;
   return 0;
 }
 
@@ -0,0 +1,148 @@
+#ifndef _AUDIO_PACKET_H_
+#define _AUDIO_PACKET_H_
+
+#include <stdint.h>
+#include "i2s_if.h"
+
+/* Stream format, shared by the sender and the receiver */
+#define AUDIO_SAMPLE_RATE       (16000)
+#define AUDIO_CHANNELS          (2)
+#define AUDIO_FRAME_SIZE        (BUFSIZE / (AUDIO_CHANNELS * sizeof(int16_t)))
+
+/* UDP port used for the audio stream */
+#define AUDIO_UDP_PORT          (5050)
+
+/* Packet loss the encoder adds in-band FEC for, in percent, until the
+   receiver reports the real one */
+#define AUDIO_FEC_LOSS_PERC     (10)
+
+/* Most frames the sender puts in one packet */
+#define AUDIO_MAX_PACKET_FRAMES (6)
+
+/*
+ * Every datagram carries one Opus packet behind a small RTP-like header,
+ * all fields in network byte order:
+ *
+ *   0      2      4             8
+ *   +------+------+-------------+-----------------+
+ *   | seq  | len  |  timestamp  |  Opus payload   |
+ *   +------+------+-------------+-----------------+
+ *
+ * seq is the position of the first frame of the packet, so it goes up by
+ * the number of frames the packet holds.  len is the number of payload
+ * bytes and timestamp counts samples at 48 kHz like RFC 7587, whatever the
+ * sample rate of the stream.
+ */
+#define AUDIO_PKT_HEADER_SIZE   (8)
+#define AUDIO_PKT_MAX_PAYLOAD   (1276)
+#define AUDIO_PKT_MAX_SIZE      (AUDIO_PKT_HEADER_SIZE + AUDIO_PKT_MAX_PAYLOAD)
+#define AUDIO_PKT_TS_PER_FRAME  (AUDIO_FRAME_SIZE * (48000 / AUDIO_SAMPLE_RATE))
+
+typedef struct AudioPacketHeader
+{
+    uint16_t seq;
+    uint16_t len;
+    uint32_t timestamp;
+}tAudioPacketHeader;
+
+static inline void AudioPacket_WriteHeader(unsigned char *buf,
+                                           const tAudioPacketHeader *hdr)
+{
+    buf[0] = (unsigned char)(hdr->seq >> 8);
+    buf[1] = (unsigned char)(hdr->seq);
+    buf[2] = (unsigned char)(hdr->len >> 8);
+    buf[3] = (unsigned char)(hdr->len);
+    buf[4] = (unsigned char)(hdr->timestamp >> 24);
+    buf[5] = (unsigned char)(hdr->timestamp >> 16);
+    buf[6] = (unsigned char)(hdr->timestamp >> 8);
+    buf[7] = (unsigned char)(hdr->timestamp);
+}
+
+static inline void AudioPacket_ReadHeader(const unsigned char *buf,
+                                          tAudioPacketHeader *hdr)
+{
+    hdr->seq = (uint16_t)((buf[0] << 8) | buf[1]);
+    hdr->len = (uint16_t)((buf[2] << 8) | buf[3]);
+    hdr->timestamp = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) |
+                     ((uint32_t)buf[6] << 8) | (uint32_t)buf[7];
+}
+
+/* The receiver reports how the stream is doing this often */
+#define AUDIO_FEEDBACK_MS       (200)
+
+/*
+ * Feedback from the receiver to the sender, sent back on the same socket:
+ *
+ *   0      2      4             8             12            16            20
+ *   +------+------+-------------+-------------+-------------+-------------+
+ *   | 'FB' | seq  |  received   |    bytes    |   jitter    |   transit   |
+ *   +------+------+-------------+-------------+-------------+-------------+
+ *
+ * seq is the end of the newest packet received, the position of the frame
+ * after it.  received is the number of frames that arrived in time to be
+ * played and bytes the number of datagram bytes that arrived, both counted
+ * from the start of the stream.  jitter is the interarrival jitter in 48 kHz
+ * samples.  transit is the shortest arrival time less timestamp of the
+ * packets since the last report, on the receiver's clock in 48 kHz samples.
+ * The clocks are not synced so only its changes mean anything: they are
+ * the queueing delay on the way.  The sender works out loss and throughput
+ * from two reports, so a lost report only makes the next one cover a
+ * longer time.
+ */
+#define AUDIO_FB_SIZE           (20)
+#define AUDIO_FB_MAGIC          (0x4642)
+
+typedef struct AudioFeedback
+{
+    uint16_t seq;
+    uint32_t received;
+    uint32_t bytes;
+    uint32_t jitter;
+    uint32_t transit;
+}tAudioFeedback;
+
+static inline void AudioPacket_Write32(unsigned char *buf, uint32_t val)
+{
+    buf[0] = (unsigned char)(val >> 24);
+    buf[1] = (unsigned char)(val >> 16);
+    buf[2] = (unsigned char)(val >> 8);
+    buf[3] = (unsigned char)(val);
+}
+
+static inline uint32_t AudioPacket_Read32(const unsigned char *buf)
+{
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+           ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static inline void AudioFeedback_Write(unsigned char *buf,
+                                       const tAudioFeedback *fb)
+{
+    buf[0] = (unsigned char)(AUDIO_FB_MAGIC >> 8);
+    buf[1] = (unsigned char)(AUDIO_FB_MAGIC);
+    buf[2] = (unsigned char)(fb->seq >> 8);
+    buf[3] = (unsigned char)(fb->seq);
+    AudioPacket_Write32(buf + 4, fb->received);
+    AudioPacket_Write32(buf + 8, fb->bytes);
+    AudioPacket_Write32(buf + 12, fb->jitter);
+    AudioPacket_Write32(buf + 16, fb->transit);
+}
+
+/* Returns 0, or -1 if buf does not hold a report */
+static inline int AudioFeedback_Read(const unsigned char *buf, int len,
+                                     tAudioFeedback *fb)
+{
+    if(len != AUDIO_FB_SIZE ||
+       ((buf[0] << 8) | buf[1]) != AUDIO_FB_MAGIC)
+    {
+        return -1;
+    }
+    fb->seq = (uint16_t)((buf[2] << 8) | buf[3]);
+    fb->received = AudioPacket_Read32(buf + 4);
+    fb->bytes = AudioPacket_Read32(buf + 8);
+    fb->jitter = AudioPacket_Read32(buf + 12);
+    fb->transit = AudioPacket_Read32(buf + 16);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,342 @@
+//*****************************************************************************
+// audio_rate.c
+//
+//*****************************************************************************
+#include <string.h>
+#include "audio_rate.h"
+
+/*
+ * Steps of quality, best first.  Longer packets cut the packet rate, and on
+ * Wi-Fi each packet costs airtime for the preamble, the MAC header and the
+ * acknowledgement whatever its size, so the lower steps trade latency for
+ * far less airtime as well as for bits.
+ */
+static const struct
+{
+    int frames;
+    opus_int32 bitrate;
+}ladder[] =
+{
+    {1, 40000},             /* 100 packets/s */
+    {2, 32000},             /*  50 packets/s */
+    {2, 24000},             /*  50 packets/s */
+    {4, 16000},             /*  25 packets/s */
+    {4, 12000},             /*  25 packets/s */
+};
+
+#define AUDIO_RATE_RUNGS    (sizeof(ladder) / sizeof(ladder[0]))
+
+/* Bits per second a step puts in datagrams, like the receiver counts them */
+static uint32_t AudioRate_Datagrams(int rung)
+{
+    uint32_t packetsPerSec = AUDIO_SAMPLE_RATE /
+                             (AUDIO_FRAME_SIZE * ladder[rung].frames);
+
+    return ladder[rung].bitrate + AUDIO_PKT_HEADER_SIZE * 8 * packetsPerSec;
+}
+
+/* The step's frames per packet, or more if the latency budget allows */
+static void AudioRate_SetFrames(tAudioRate *rc)
+{
+    int frames = ladder[rc->rung].frames;
+
+    if(rc->budgetFrames > frames)
+    {
+        frames = rc->budgetFrames;
+    }
+    if(rc->cur.frames != frames)
+    {
+        rc->cur.frames = frames;
+        rc->changes++;
+    }
+}
+
+static void AudioRate_SetRung(tAudioRate *rc, int rung)
+{
+    if(rung < 0 || rung >= (int)AUDIO_RATE_RUNGS || rung == rc->rung)
+    {
+        return;
+    }
+    rc->rung = rung;
+    rc->cur.bitrate = ladder[rung].bitrate;
+    AudioRate_SetFrames(rc);
+    rc->changes++;
+    rc->settle = AUDIO_RATE_SETTLE;
+    rc->good = 0;
+}
+
+//*****************************************************************************
+//
+// Follows the frames per packet the latency budget leaves room for.  Each
+// frame more costs about two frames of latency: the sender waits for it, and
+// the receiver buffers a whole packet ahead.  What is left of the budget
+// after a frame of buffering, three times the jitter and the queueing delay
+// goes to frames.  The count drops at once and grows a frame per interval.
+// The FEC of a packet only covers as much as one of its Opus frames, so
+// losses above AUDIO_RATE_LOSS_DOWN bring packets back to a single frame.
+//
+//*****************************************************************************
+static void AudioRate_Budget(tAudioRate *rc, int32_t queueMs, uint32_t jitterMs)
+{
+    int32_t spare;
+    int frames;
+
+    if(rc->budgetMs <= 0)
+    {
+        return;
+    }
+    spare = rc->budgetMs - AUDIO_RATE_FRAME_MS - 3 * (int32_t)jitterMs -
+            (queueMs > 0 ? queueMs : 0);
+    frames = (spare > 0) ? 1 + spare / (2 * AUDIO_RATE_FRAME_MS) : 1;
+    if(rc->lossQ8 > AUDIO_RATE_LOSS_DOWN * 256)
+    {
+        frames = 1;
+    }
+    else if(frames > AUDIO_MAX_PACKET_FRAMES)
+    {
+        frames = AUDIO_MAX_PACKET_FRAMES;
+    }
+
+    if(frames < rc->budgetFrames)
+    {
+        rc->budgetFrames = frames;
+    }
+    else if(frames > rc->budgetFrames)
+    {
+        rc->budgetFrames++;
+    }
+    AudioRate_SetFrames(rc);
+}
+
+/* The link got worse, a step up made just before is not tried again soon */
+static void AudioRate_StepDown(tAudioRate *rc)
+{
+    if(rc->probe > 0)
+    {
+        rc->probe = 0;
+        rc->upIntervals *= 2;
+        if(rc->upIntervals > AUDIO_RATE_MAX_UP)
+        {
+            rc->upIntervals = AUDIO_RATE_MAX_UP;
+        }
+    }
+    AudioRate_SetRung(rc, rc->rung + 1);
+}
+
+static void AudioRate_SetFec(tAudioRate *rc, bool fec, int lossPerc)
+{
+    if(rc->cur.fec != fec || rc->cur.lossPerc != lossPerc)
+    {
+        rc->cur.fec = fec;
+        rc->cur.lossPerc = lossPerc;
+        rc->changes++;
+    }
+}
+
+void AudioRate_Init(tAudioRate *rc, int budgetMs)
+{
+    memset(rc, 0, sizeof(*rc));
+    pthread_mutex_init(&rc->lock, NULL);
+    rc->cur.frames = ladder[0].frames;
+    rc->cur.bitrate = ladder[0].bitrate;
+
+    /* Packets grow from one frame as the reports show the link */
+    rc->budgetMs = budgetMs;
+    rc->budgetFrames = 1;
+
+    /* Nothing is known about the link yet */
+    rc->cur.fec = true;
+    rc->cur.lossPerc = AUDIO_FEC_LOSS_PERC;
+    rc->changes = 1;
+    rc->upIntervals = AUDIO_RATE_UP;
+}
+
+//*****************************************************************************
+//
+// Takes a report from the receiver, received at nowMs.  The link is judged
+// once per interval of AUDIO_RATE_MIN_FRAMES frames, fewer frames give too
+// coarse a loss rate once packets hold several.
+//
+//*****************************************************************************
+void AudioRate_Feedback(tAudioRate *rc, const tAudioFeedback *fb,
+                        uint32_t nowMs)
+{
+    uint16_t expected;
+    uint32_t received;
+    uint32_t jitterMs;
+    uint32_t rate;
+    uint32_t base;
+    int32_t queueMs;
+    int32_t loss = 0;
+    int lossPerc;
+
+    pthread_mutex_lock(&rc->lock);
+    if(!rc->havePrev)
+    {
+        rc->prev = *fb;
+        rc->prevMs = nowMs;
+        rc->lastMs = nowMs;
+        rc->transit = fb->transit;
+        rc->baseTransit = fb->transit;
+        rc->havePrev = true;
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+
+    /* Reports that were overtaken by a later one are of no use, and the
+       interval goes on until it is long enough to count the loss in */
+    expected = (uint16_t)(fb->seq - rc->prev.seq);
+    if((int16_t)expected < 0)
+    {
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+    rc->lastMs = nowMs;
+    if((int32_t)(fb->transit - rc->transit) < 0)
+    {
+        rc->transit = fb->transit;
+    }
+    if(expected < AUDIO_RATE_MIN_FRAMES &&
+       nowMs - rc->prevMs < AUDIO_RATE_TIMEOUT_MS)
+    {
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+
+    /* Loss over the time between the two reports.  Packets that filled in
+       for earlier losses can make more frames received than expected */
+    received = fb->received - rc->prev.received;
+    if(expected == 0)
+    {
+        loss = (received == 0) ? 100 * 256 : 0;
+    }
+    else if(received < expected)
+    {
+        loss = (int32_t)((expected - received) * 100 * 256 / expected);
+    }
+    rc->lossQ8 += (loss - rc->lossQ8) / 4;
+
+    rate = (uint32_t)((uint64_t)(fb->bytes - rc->prev.bytes) * 8 * 1000 /
+                      (nowMs - rc->prevMs));
+    rc->throughput = (rc->throughput == 0) ? rate :
+                     rc->throughput - rc->throughput / 4 + rate / 4;
+    jitterMs = fb->jitter / 48;
+
+    /* Queueing delay, over the shortest transit of the last two windows */
+    if(rc->windowIntervals == 0 ||
+       (int32_t)(rc->transit - rc->windowTransit) < 0)
+    {
+        rc->windowTransit = rc->transit;
+    }
+    base = ((int32_t)(rc->windowTransit - rc->baseTransit) < 0) ?
+           rc->windowTransit : rc->baseTransit;
+    queueMs = (int32_t)(rc->transit - base) / 48;
+    if(++rc->windowIntervals >= AUDIO_RATE_BASE_INTERVALS)
+    {
+        rc->baseTransit = rc->windowTransit;
+        rc->windowIntervals = 0;
+    }
+
+    rc->prev = *fb;
+    rc->prevMs = nowMs;
+    rc->transit = fb->transit;
+    AudioRate_Budget(rc, queueMs, jitterMs);
+
+    /* FEC comes on with the first loss and goes off after a long time
+       without any, the loss it is sized for follows the measured one */
+    rc->clean = (loss == 0) ? rc->clean + 1 : 0;
+    if(rc->lossQ8 >= 256 || (loss > 0 && rc->cur.fec))
+    {
+        lossPerc = (rc->lossQ8 + 255) >> 8;
+        if(lossPerc < 1)
+        {
+            lossPerc = 1;
+        }
+        else if(lossPerc > AUDIO_RATE_MAX_LOSS_PERC)
+        {
+            lossPerc = AUDIO_RATE_MAX_LOSS_PERC;
+        }
+        AudioRate_SetFec(rc, true, lossPerc);
+    }
+    else if(rc->clean >= AUDIO_RATE_FEC_OFF)
+    {
+        AudioRate_SetFec(rc, false, 0);
+    }
+
+    if(rc->probe > 0 && --rc->probe == 0)
+    {
+        /* The last step up held */
+        rc->upIntervals = AUDIO_RATE_UP;
+    }
+
+    if(rc->settle > 0)
+    {
+        /* The last change has not shown in the reports yet */
+        rc->settle--;
+    }
+    else if(queueMs > AUDIO_RATE_QUEUE_DOWN_MS ||
+            jitterMs > AUDIO_RATE_JITTER_DOWN_MS ||
+            (rc->lossQ8 > AUDIO_RATE_LOSS_DOWN * 256 &&
+             queueMs > AUDIO_RATE_QUEUE_UP_MS) ||
+            rc->lossQ8 > AUDIO_RATE_LOSS_HEAVY * 256)
+    {
+        /* A queue building up, or losses with one, the link is full.
+           What got through is about what it carries */
+        rc->capacity = rc->throughput;
+        AudioRate_StepDown(rc);
+    }
+    else if(queueMs < AUDIO_RATE_QUEUE_UP_MS &&
+            jitterMs < AUDIO_RATE_JITTER_UP_MS &&
+            rc->lossQ8 < AUDIO_RATE_LOSS_DOWN * 256)
+    {
+        if(rc->rung > 0 && ++rc->good >= rc->upIntervals)
+        {
+            if(rc->capacity == 0 ||
+               AudioRate_Datagrams(rc->rung - 1) <= rc->capacity)
+            {
+                AudioRate_SetRung(rc, rc->rung - 1);
+                rc->probe = AUDIO_RATE_PROBE;
+            }
+            else if(rc->good >= 4 * rc->upIntervals)
+            {
+                /* Calm for long enough, the link may carry more now */
+                rc->capacity = 0;
+            }
+        }
+    }
+    else
+    {
+        rc->good = 0;
+    }
+    pthread_mutex_unlock(&rc->lock);
+}
+
+//*****************************************************************************
+//
+// Gives the settings to encode the next packet with.  Returns a count that
+// changes whenever they do.
+//
+//*****************************************************************************
+uint32_t AudioRate_Get(tAudioRate *rc, uint32_t nowMs,
+                       tAudioRateSettings *settings)
+{
+    uint32_t changes;
+
+    pthread_mutex_lock(&rc->lock);
+    if(rc->havePrev && nowMs - rc->lastMs >= AUDIO_RATE_TIMEOUT_MS)
+    {
+        /* Nothing heard back, the link is failing one way or the other.
+           Send less, and protect what gets through */
+        rc->lastMs = nowMs;
+        AudioRate_StepDown(rc);
+        if(!rc->cur.fec || rc->cur.lossPerc < AUDIO_FEC_LOSS_PERC)
+        {
+            AudioRate_SetFec(rc, true, AUDIO_FEC_LOSS_PERC);
+        }
+        rc->clean = 0;
+    }
+    *settings = rc->cur;
+    changes = rc->changes;
+    pthread_mutex_unlock(&rc->lock);
+    return changes;
+}
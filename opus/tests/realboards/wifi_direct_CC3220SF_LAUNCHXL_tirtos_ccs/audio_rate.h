@@ -0,0 +1,97 @@
+//*****************************************************************************
+// audio_rate.h
+//
+// Sender side rate control.  The receiver's reports of audio_packet.h give
+// the loss, jitter, queueing delay and throughput of the link, and the
+// controller picks the bitrate, frames per packet and FEC of the encoder
+// from them.  Losses on their own are left to FEC.  Losses with a queue
+// building up mean the link is full, and the stream steps down at once and
+// back up slowly, so that it stays within what the link carries and the
+// quality drops in steps rather than the link collapsing.  Given a latency
+// budget, packets also hold as many frames as it leaves room for, which
+// saves airtime and radio power at the cost of that latency.
+//
+//*****************************************************************************
+#ifndef _AUDIO_RATE_H_
+#define _AUDIO_RATE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "opus.h"
+#include "audio_packet.h"
+
+/* The link is judged over intervals holding at least this many frames, a
+   report can cover less */
+#define AUDIO_RATE_MIN_FRAMES       (50)
+/* Smoothed loss in percent that steps down with a queue, and without */
+#define AUDIO_RATE_LOSS_DOWN        (8)
+#define AUDIO_RATE_LOSS_HEAVY       (25)
+/* Queueing delay and jitter in ms above which the stream steps down, and
+   below which it may step up */
+#define AUDIO_RATE_QUEUE_DOWN_MS    (40)
+#define AUDIO_RATE_QUEUE_UP_MS      (10)
+#define AUDIO_RATE_JITTER_DOWN_MS   (30)
+#define AUDIO_RATE_JITTER_UP_MS     (10)
+/* Intervals the shortest transit is taken over as the one through an empty
+   queue.  It is renewed so the drift between the clocks is not taken for
+   queueing */
+#define AUDIO_RATE_BASE_INTERVALS   (60)
+/* Intervals to wait after a change before judging the link again */
+#define AUDIO_RATE_SETTLE           (2)
+/* Good intervals in a row before stepping up.  Doubled each time a step up
+   has to be taken back, up to the max */
+#define AUDIO_RATE_UP               (10)
+#define AUDIO_RATE_MAX_UP           (160)
+/* Intervals after a step up during which a step down means it failed */
+#define AUDIO_RATE_PROBE            (6)
+/* Intervals in a row without loss before FEC is turned off */
+#define AUDIO_RATE_FEC_OFF          (20)
+/* Most loss the encoder is told to expect, in percent */
+#define AUDIO_RATE_MAX_LOSS_PERC    (30)
+/* Time without a report after which the link is taken to be failing */
+#define AUDIO_RATE_TIMEOUT_MS       (1000)
+/* Length of a frame of the stream, in ms */
+#define AUDIO_RATE_FRAME_MS         (AUDIO_FRAME_SIZE * 1000 / AUDIO_SAMPLE_RATE)
+
+typedef struct AudioRateSettings
+{
+    int frames;             /* frames per packet */
+    opus_int32 bitrate;     /* bits per second, FEC included */
+    bool fec;
+    int lossPerc;           /* loss the encoder adds FEC for, in percent */
+}tAudioRateSettings;
+
+typedef struct AudioRate
+{
+    pthread_mutex_t lock;
+    tAudioRateSettings cur;
+    uint32_t changes;       /* counts the changes of cur */
+    int rung;               /* step of the ladder in use, 0 is the best */
+    int budgetMs;           /* latency packets may add, 0 for none */
+    int budgetFrames;       /* frames per packet that fit in it */
+    bool havePrev;          /* a report has been received */
+    tAudioFeedback prev;    /* report the current interval started with */
+    uint32_t prevMs;        /* when prev was received */
+    uint32_t lastMs;        /* latest report, or the last timeout */
+    int32_t lossQ8;         /* smoothed loss, percent scaled by 256 */
+    uint32_t transit;       /* shortest transit of the interval */
+    uint32_t baseTransit;   /* shortest of the last window */
+    uint32_t windowTransit; /* shortest of the current window */
+    int windowIntervals;
+    uint32_t throughput;    /* smoothed bits per second delivered */
+    uint32_t capacity;      /* delivered when the link saturated, 0 if not */
+    int settle;
+    int good;
+    int upIntervals;
+    int probe;
+    int clean;
+}tAudioRate;
+
+extern void AudioRate_Init(tAudioRate *rc, int budgetMs);
+extern void AudioRate_Feedback(tAudioRate *rc, const tAudioFeedback *fb,
+                               uint32_t nowMs);
+extern uint32_t AudioRate_Get(tAudioRate *rc, uint32_t nowMs,
+                              tAudioRateSettings *settings);
+
+#endif
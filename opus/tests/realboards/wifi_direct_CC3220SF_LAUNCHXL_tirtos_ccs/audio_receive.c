@@ -17,45 +17,181 @@
 #include "i2s_if.h"
 #include <ti/drivers/I2S.h>
 
+#include <string.h>
+#include <time.h>
+
+#include "opus.h"
+#include "audio_packet.h"
+#include "jitter_buf.h"
+
+/* RTP-like header followed by the Opus packet, see audio_packet.h */
+static unsigned char packet[AUDIO_PKT_MAX_SIZE];
+
+/* Packets wait here between the network thread and the playout thread */
+static tJitterBuf jitterBuf;
+
+/* Frames between two reports of the jitter buffer statistics */
+#define AUDIO_STATS_FRAMES      (500)
+
+/* Current time in 48 kHz samples, the unit of the packet timestamps */
+static uint32_t Audio_Now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 48000 + (uint32_t)(now.tv_nsec / 20833);
+}
+
+//*****************************************************************************
+//
+// Sends the sender a report on the stream, over the socket it sends from.
+//
+//*****************************************************************************
+static void Audio_Send_Feedback(tAudioFeedback *fb)
+{
+    unsigned char buf[AUDIO_FB_SIZE];
+    tJitterStats stats;
+    long retc;
+
+    JitterBuf_GetStats(&jitterBuf, &stats);
+    fb->jitter = stats.jitter;
+    AudioFeedback_Write(buf, fb);
+    retc = sl_SendTo(g_udpSocket.iSockDesc,
+                     (char*)buf,
+                     sizeof(buf),
+                     0,
+                     (struct SlSockAddr_t *)&(g_udpSocket.Client),
+                     sizeof(g_udpSocket.Client));
+    if(retc < 0)
+    {
+        Report("Unable to send feedback\n\r");
+    }
+}
 
 static void* Audio_Receive_Thread( void *pvParameters )
 {
     long iRetVal = -1;
-    I2S_Transaction* transactionToTreat = (I2S_Transaction*) List_head(&treatmentList);
+    int frames;
+    tAudioPacketHeader hdr;
+    tAudioFeedback fb;
+    bool bFirst = true;
+    bool bTransit = false;
+    uint32_t lastReport = 0;
+    uint32_t now;
+
+    memset(&fb, 0, sizeof(fb));
 
     while(1)
     {
-        char buf[32];
         iRetVal = sl_RecvFrom(g_udpSocket.iSockDesc,
-                                                     buf,
-                                                     14,
-                                                     0,
-                                                     (struct SlSockAddr_t *)&(g_udpSocket.Client),
-                                                     (SlSocklen_t*)&(g_udpSocket.iClientLength));
-        Report("receive: %s \r\n",buf);
-        continue;
-        transactionToTreat = (I2S_Transaction*) List_head(&treatmentList);
-        if(transactionToTreat != NULL){
-            iRetVal = sl_RecvFrom(g_udpSocket.iSockDesc,
-                                 (char*)(transactionToTreat->bufPtr),
-                                 BUFSIZE,
-                                 0,
-                                 (struct SlSockAddr_t *)&(g_udpSocket.Client),
-                                 (SlSocklen_t*)&(g_udpSocket.iClientLength));
-            if(iRetVal>0)
+                              (char*)packet,
+                              sizeof(packet),
+                              0,
+                              (struct SlSockAddr_t *)&(g_udpSocket.Client),
+                              (SlSocklen_t*)&(g_udpSocket.iClientLength));
+        if(iRetVal < AUDIO_PKT_HEADER_SIZE)
+        {
+            continue;
+        }
+        fb.bytes += iRetVal;
+
+        AudioPacket_ReadHeader(packet, &hdr);
+        if((hdr.len == 0) || (hdr.len > iRetVal - AUDIO_PKT_HEADER_SIZE))
+        {
+            Report("bad audio packet, %d bytes\r\n", (int)iRetVal);
+            continue;
+        }
+
+        now = Audio_Now();
+        if(!bTransit || (int32_t)(now - hdr.timestamp - fb.transit) < 0)
+        {
+            fb.transit = now - hdr.timestamp;
+            bTransit = true;
+        }
+        frames = JitterBuf_Put(&jitterBuf, hdr.seq, hdr.timestamp,
+                               packet + AUDIO_PKT_HEADER_SIZE, hdr.len, now);
+        if(frames > 0)
+        {
+            if(fb.received == 0 || (int16_t)(hdr.seq + frames - fb.seq) > 0)
             {
-                /* Place in the write-list the transaction we just treated */
-                List_remove(&treatmentList, (List_Elem*)transactionToTreat);
-                List_put(&i2sWriteList, (List_Elem*)transactionToTreat);
+                fb.seq = (uint16_t)(hdr.seq + frames);
             }
+            fb.received += frames;
+        }
+
+        /* Reports go back as long as packets come in, the sender backs off
+           on its own when they stop */
+        if(bFirst || now - lastReport >= AUDIO_FEEDBACK_MS * 48)
+        {
+            bFirst = false;
+            lastReport = now;
+            Audio_Send_Feedback(&fb);
+            bTransit = false;
         }
     }
     pthread_exit(0);
     return NULL;
 }
 
+static void* Audio_Play_Thread( void *pvParameters )
+{
+    long retc = -1;
+    unsigned long frames = 0;
+    tJitterStats stats;
+    I2S_Transaction* transactionToTreat;
 
-void Audio_Receive_Init(void)
+    /* Recorded transactions are only used as buffers to decode into */
+    I2S_startRead(i2sHandle);
+    I2S_startWrite(i2sHandle);
+
+    while(1)
+    {
+        /* One transaction is recorded per frame, it paces the playout */
+        retc = sem_wait(&semDataReadyForTreatment);
+        if (retc == -1) {
+            while (1);
+        }
+
+        transactionToTreat = (I2S_Transaction*) List_head(&treatmentList);
+        if(transactionToTreat == NULL)
+        {
+            continue;
+        }
+
+        retc = JitterBuf_Get(&jitterBuf, (opus_int16 *)(transactionToTreat->bufPtr));
+        if(retc != AUDIO_FRAME_SIZE)
+        {
+            UART_PRINT("opus_decode fail 0x%02x\n", (int)retc);
+            memset(transactionToTreat->bufPtr, 0, BUFSIZE);
+        }
+
+        /* Place in the write-list the transaction we just treated */
+        List_remove(&treatmentList, (List_Elem*)transactionToTreat);
+        List_put(&i2sWriteList, (List_Elem*)transactionToTreat);
+
+        if(++frames % AUDIO_STATS_FRAMES == 0)
+        {
+            JitterBuf_GetStats(&jitterBuf, &stats);
+            Report("delay %d/%d frames, jitter %lu us, late %lu, "
+                   "fec %lu, plc %lu, stretched %lu, skipped %lu\r\n",
+                   stats.delay, stats.target,
+                   (unsigned long)stats.jitter * 1000 / 48,
+                   (unsigned long)stats.late, (unsigned long)stats.fec,
+                   (unsigned long)stats.plc, (unsigned long)stats.stretched,
+                   (unsigned long)stats.skipped);
+        }
+    }
+    pthread_exit(0);
+    return NULL;
+}
+
+void Audio_Receive_GetStats(tJitterStats *stats)
+{
+    JitterBuf_GetStats(&jitterBuf, stats);
+}
+
+static void Audio_Receive_Create(void *(*fxn)(void *), int priority,
+                                 size_t stackSize)
 {
     pthread_t thread;
     pthread_attr_t pAttrs;
@@ -65,7 +201,7 @@ void Audio_Receive_Init(void)
 
     /* Set priority and stack size attributes */
     pthread_attr_init(&pAttrs);
-    priParam.sched_priority = 1;
+    priParam.sched_priority = priority;
 
     detachState = PTHREAD_CREATE_DETACHED;
     retc = pthread_attr_setdetachstate(&pAttrs, detachState);
@@ -78,7 +214,7 @@ void Audio_Receive_Init(void)
 
     pthread_attr_setschedparam(&pAttrs, &priParam);
 
-    retc |= pthread_attr_setstacksize(&pAttrs, 4096);
+    retc |= pthread_attr_setstacksize(&pAttrs, stackSize);
     if(retc != 0)
     {
        /* pthread_attr_setstacksize() failed */
@@ -86,11 +222,36 @@ void Audio_Receive_Init(void)
        while(1);
     }
 
-    retc = pthread_create(&thread, &pAttrs, Audio_Receive_Thread, NULL);
+    retc = pthread_create(&thread, &pAttrs, fxn, NULL);
     if(retc != 0)
     {
        /* pthread_create() failed */
-       Report("Audio_Receive_Thread create failed. \r\n");
+       Report("Audio_Receive thread create failed. \r\n");
        while(1);
     }
 }
+
+void Audio_Receive_Init(void)
+{
+    int err = OPUS_OK;
+
+    OpusDecoder *dec = opus_decoder_create(AUDIO_SAMPLE_RATE, AUDIO_CHANNELS, &err);
+    if (err != OPUS_OK || !dec)
+    {
+        UART_PRINT("opus_decoder_create fail error 0x%02x\n", err);
+        while(1);
+    }
+    UART_PRINT("opus_decoder_create OK\n");
+
+    if(JitterBuf_Init(&jitterBuf, dec, AUDIO_CHANNELS, AUDIO_FRAME_SIZE,
+                      AUDIO_PKT_TS_PER_FRAME) != 0)
+    {
+        Report("JitterBuf_Init failed. \r\n");
+        while(1);
+    }
+
+    /* The playout runs at the pace of I2S, ahead of the network. It
+       decodes, and opus_decode() allocates its scratch buffers on the stack */
+    Audio_Receive_Create(Audio_Play_Thread, 8, 1024 * 10);
+    Audio_Receive_Create(Audio_Receive_Thread, 1, 4096);
+}
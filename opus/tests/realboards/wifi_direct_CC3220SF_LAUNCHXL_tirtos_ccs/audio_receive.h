@@ -1,7 +1,10 @@
 #ifndef _AUDIO_RECEIVE_H_
 #define _AUDIO_RECEIVE_H_
 
+#include "jitter_buf.h"
+
 extern void Audio_Receive_Init(void);
+extern void Audio_Receive_GetStats(tJitterStats *stats);
 extern unsigned int checksum(const unsigned char *data, unsigned int len);
 
 #endif
@@ -24,40 +24,363 @@
 #include "opus.h"
 #include "opus_private.h"
 #include "test_opus_common.h"
+#include "audio_packet.h"
+#include "audio_rate.h"
+#include "pkt_queue.h"
+
+#include <string.h>
+#include <time.h>
 
 opus_int32 test_dec_api(void);
 opus_int32 test_enc_api(void);
 
 
 
-static unsigned char packet[1276];
-static short sbuf[160 * 2];
+/* Packets go from the encoder to the stage that sends or plays them */
+static tPktQueue pktQueue;
+
+/* Frames of a packet that do not follow each other in the pool are copied
+   together here */
+static opus_int16 pcm[AUDIO_MAX_PACKET_FRAMES * AUDIO_FRAME_SIZE * AUDIO_CHANNELS];
+
+/* A packet encoded while the queue is full still goes through the encoder,
+   so its state follows the signal, and ends here */
+static unsigned char scratch[PKTQ_MAX_DATA];
+
+/* Frames encoded one at a time until the repacketizer joins them */
+static unsigned char frameData[PKTQ_MAX_DATA];
+
+static int latencyBudgetMs = AUDIO_LATENCY_BUDGET_MS;
+
+/* Settings of the encoder, following the receiver's reports */
+static tAudioRate rateCtl;
+
+/* Updated by the stages without a lock, a reader may be a packet behind */
+static tAudioSendStats sendStats;
+
+/* Opus payload that fits a queue slot after the header */
+#define AUDIO_SEND_MAX_PAYLOAD  (PKTQ_MAX_DATA - AUDIO_PKT_HEADER_SIZE)
+
+/* Largest frame to join, so that a packet of the most frames still fits:
+   a code 3 packet adds two bytes, and up to two per frame for its length */
+#define AUDIO_SEND_MAX_FRAME    ((AUDIO_SEND_MAX_PAYLOAD - 2) / \
+                                 AUDIO_MAX_PACKET_FRAMES - 2)
+
+/* Packets between two reports of the stage timings */
+#define AUDIO_SEND_REPORT       (500)
+
+static uint32_t Audio_NowMs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000 + (uint32_t)(now.tv_nsec / 1000000);
+}
 
-static void* Audio_Send_Thread( void *pvParameters )
+/* Stage timings only need differences, so wrapping is fine.  The TI-RTOS
+   clock moves by the system tick, a single encode may read as 0 or one
+   tick: the totals are what to look at */
+static uint32_t Audio_NowUs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)now.tv_sec * 1000000 + (uint32_t)(now.tv_nsec / 1000);
+}
+
+static void Audio_Stage_Time(tAudioStageTime *stage, uint32_t us)
+{
+    if(us > stage->maxUs)
+    {
+        stage->maxUs = us;
+    }
+    stage->totalUs += us;
+}
+
+static void Audio_Stage_Report(void)
+{
+    uint32_t n = sendStats.sent;
+
+    if(n == 0 || n % AUDIO_SEND_REPORT != 0)
+    {
+        return;
+    }
+    UART_PRINT("send: %lu packets, %lu dropped, %lu gathered, depth %lu\n",
+               (unsigned long)sendStats.packets,
+               (unsigned long)sendStats.dropped,
+               (unsigned long)sendStats.gathered,
+               (unsigned long)sendStats.depth);
+    UART_PRINT("  encode %lu/%lu us, queue %lu/%lu us, %s %lu/%lu us (mean/max)\n",
+               (unsigned long)(sendStats.encode.totalUs / sendStats.packets),
+               (unsigned long)sendStats.encode.maxUs,
+               (unsigned long)(sendStats.queue.totalUs / n),
+               (unsigned long)sendStats.queue.maxUs,
+               (true == g_playBack) ? "decode" : "send",
+               (unsigned long)(sendStats.send.totalUs / n),
+               (unsigned long)sendStats.send.maxUs);
+}
+
+/* The frames of a packet.  Transactions are handed back to the pool in the
+   order they were taken, so their buffers usually follow each other and
+   Opus reads them in place; only when the lists have wrapped around the
+   pool are they copied together */
+static const opus_int16 *Audio_Gather(I2S_Transaction **held, int frames)
+{
+    int i;
+
+    for(i = 1; i < frames; i++)
+    {
+        if((uint8_t *)held[i]->bufPtr != (uint8_t *)held[0]->bufPtr + i * BUFSIZE)
+        {
+            break;
+        }
+    }
+    if(i == frames)
+    {
+        return (const opus_int16 *)held[0]->bufPtr;
+    }
+
+    for(i = 0; i < frames; i++)
+    {
+        memcpy(pcm + i * AUDIO_FRAME_SIZE * AUDIO_CHANNELS, held[i]->bufPtr,
+               BUFSIZE);
+    }
+    sendStats.gathered++;
+    return pcm;
+}
+
+//*****************************************************************************
+//
+// Queues a packet of frames frames, len bytes of Opus behind the header.  It
+// lies in slot, or in scratch when the queue was full.
+//
+//*****************************************************************************
+static void Audio_Commit(tPktQueueSlot *slot, tAudioPacketHeader *hdr,
+                         opus_int32 len, int frames, uint32_t encodeUs)
+{
+    uint32_t depth;
+
+    Audio_Stage_Time(&sendStats.encode, encodeUs);
+    sendStats.packets++;
+
+    hdr->len = (uint16_t)len;
+    AudioPacket_WriteHeader((slot != NULL) ? slot->data : scratch, hdr);
+    hdr->seq += frames;
+    hdr->timestamp += frames * AUDIO_PKT_TS_PER_FRAME;
+
+    if(slot == NULL)
+    {
+        sendStats.dropped++;
+        return;
+    }
+    slot->len = AUDIO_PKT_HEADER_SIZE + len;
+    slot->time = Audio_NowUs();
+    PktQueue_Commit(&pktQueue);
+    depth = PktQueue_Depth(&pktQueue);
+    if(depth > sendStats.depth)
+    {
+        sendStats.depth = depth;
+    }
+}
+
+/* Joins the frames the repacketizer holds into one packet and queues it */
+static void Audio_Flush(OpusRepacketizer *rp, tAudioPacketHeader *hdr,
+                        uint32_t encodeUs)
+{
+    tPktQueueSlot *slot = PktQueue_Reserve(&pktQueue);
+    unsigned char *out = (slot != NULL) ? slot->data : scratch;
+    int frames = opus_repacketizer_get_nb_frames(rp);
+    opus_int32 ret;
+
+    ret = opus_repacketizer_out(rp, out + AUDIO_PKT_HEADER_SIZE,
+                                AUDIO_SEND_MAX_PAYLOAD);
+    if (ret < 1) {
+        UART_PRINT("opus_repacketizer_out fail 0x%02x\n", ret);
+        while(1);
+    }
+    opus_repacketizer_init(rp);
+    Audio_Commit(slot, hdr, ret, frames, encodeUs);
+}
+
+static void* Audio_Feedback_Thread( void *pvParameters )
+{
+    unsigned char buf[AUDIO_FB_SIZE * 2];
+    struct SlSockAddrIn_t from;
+    SlSocklen_t fromLen;
+    tAudioFeedback fb;
+    long iRetVal;
+
+    while(1)
+    {
+        fromLen = sizeof(from);
+        iRetVal = sl_RecvFrom(g_udpSocket.iSockDesc,
+                              (char*)buf,
+                              sizeof(buf),
+                              0,
+                              (struct SlSockAddr_t *)&from,
+                              &fromLen);
+        if(iRetVal < 0)
+        {
+            /* The socket gets its port with the first packet sent */
+            usleep(100000);
+            continue;
+        }
+
+        if(AudioFeedback_Read(buf, iRetVal, &fb) == 0)
+        {
+            AudioRate_Feedback(&rateCtl, &fb, Audio_NowMs());
+        }
+    }
+    pthread_exit(0);
+    return NULL;
+}
+
+/* Second stage over the air: sends the packets the encoder queued.  A send
+   that blocks only fills the queue, capture and encoding go on */
+static void* Audio_Net_Thread( void *pvParameters )
+{
+    tPktQueueSlot *slot;
+    uint32_t start;
+    long retc;
+
+    while(1)
+    {
+        slot = PktQueue_Wait(&pktQueue);
+        start = Audio_NowUs();
+        Audio_Stage_Time(&sendStats.queue, start - slot->time);
+
+        retc = sl_SendTo(g_udpSocket.iSockDesc,
+                          (char*)slot->data,
+                          slot->len,
+                          0,
+                          (struct SlSockAddr_t*)&(g_udpSocket.Client),
+                          sizeof(g_udpSocket.Client));
+        PktQueue_Release(&pktQueue);
+        if(retc < 0)
+        {
+            Report("Unable to send data\n\r");
+        }
+
+        Audio_Stage_Time(&sendStats.send, Audio_NowUs() - start);
+        sendStats.sent++;
+        Audio_Stage_Report();
+    }
+    pthread_exit(0);
+    return NULL;
+}
+
+/* Second stage when playing back locally: decodes each packet into the
+   transaction it was recorded in and queues it for playing */
+static void* Audio_Monitor_Thread( void *pvParameters )
+{
+    I2S_Transaction *transaction;
+    tPktQueueSlot *slot;
+    opus_int32 ret;
+    uint32_t start;
+    int err = OPUS_OK;
+
+    OpusDecoder *dec = opus_decoder_create(AUDIO_SAMPLE_RATE, AUDIO_CHANNELS, &err);
+    if (err != OPUS_OK || !dec)
+    {
+        UART_PRINT("opus_decoder_create fail error 0x%02x\n", err);
+        while(1);
+    }
+    UART_PRINT("opus_decoder_create OK\n");
+
+    while(1)
+    {
+        slot = PktQueue_Wait(&pktQueue);
+        start = Audio_NowUs();
+        Audio_Stage_Time(&sendStats.queue, start - slot->time);
+
+        /* Play back what the far end would hear */
+        transaction = (I2S_Transaction *)slot->ctx;
+        ret = opus_decode(dec, slot->data + AUDIO_PKT_HEADER_SIZE,
+                          slot->len - AUDIO_PKT_HEADER_SIZE,
+                          (opus_int16 *)(transaction->bufPtr),
+                          AUDIO_FRAME_SIZE, 0);
+        PktQueue_Release(&pktQueue);
+        if (ret < 0)
+        {
+            UART_PRINT("opus_decode fail 0x%02x\n", ret);
+            memset(transaction->bufPtr, 0, BUFSIZE);
+        }
+        List_put(&i2sWriteList, (List_Elem*)transaction);
+
+        Audio_Stage_Time(&sendStats.send, Audio_NowUs() - start);
+        sendStats.sent++;
+        Audio_Stage_Report();
+    }
+    pthread_exit(0);
+    return NULL;
+}
+
+/* First stage: encodes the recorded frames straight into a queue slot and
+   hands the transactions back to the driver */
+static void* Audio_Encode_Thread( void *pvParameters )
 {
     long retc = -1;
     opus_int32 ret = 0;
+    int frames = 0;
+    int i;
+    tAudioRateSettings settings;
+    uint32_t changes;
+    uint32_t applied = 0;
+    uint32_t start;
+    uint32_t frameUs;
+    uint32_t encodeUs = 0;
+    int frameLen = 0;
+    I2S_Transaction *held[AUDIO_MAX_PACKET_FRAMES];
+    OpusRepacketizer *rp = NULL;
+    tPktQueueSlot *slot;
+    unsigned char *out;
 
 //    test_dec_api();
 //    test_enc_api();
 
     int err = OPUS_OK;
-    OpusEncoder *enc = opus_encoder_create(16000, 2, OPUS_APPLICATION_VOIP, &err);
+    OpusEncoder *enc = opus_encoder_create(AUDIO_SAMPLE_RATE, AUDIO_CHANNELS,
+                                           OPUS_APPLICATION_VOIP, &err);
     if (err != OPUS_OK || enc == NULL)
-        UART_PRINT("opus_encoder_create fail\n");
+    {
+        UART_PRINT("opus_encoder_create fail error 0x%02x\n", err);
+        while(1);
+    }
     UART_PRINT("opus_encoder_create OK\n");
 
-    OpusDecoder *dec = opus_decoder_create(16000, 2, &err);
-    if (err != OPUS_OK || !dec)
+    /* Let the receiver rebuild a lost packet from the one after it */
+    opus_encoder_ctl(enc, OPUS_SET_INBAND_FEC(1));
+    opus_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(AUDIO_FEC_LOSS_PERC));
+
+    /* With a latency budget packets can hold any number of frames, more than
+       the 10, 20, 40 and 60 ms opus_encode() makes */
+    if(false == g_playBack && latencyBudgetMs > 0)
     {
-        UART_PRINT("opus_decoder_create fail error 0x%02x\n", err);
-        while(1);
+        rp = opus_repacketizer_create();
+        if (rp == NULL)
+        {
+            UART_PRINT("opus_repacketizer_create fail\n");
+            while(1);
+        }
+    }
+
+    tAudioPacketHeader hdr;
+    hdr.seq = 0;
+    hdr.timestamp = 0;
+    settings.frames = 1;
+
+    if(false == g_playBack)
+    {
+        /* Sending over the air plays nothing locally */
+        I2s_CaptureOnly();
     }
-    UART_PRINT("opus_decoder_create OK\n");
 
     /* note : fire I2S read/write process immediately after bring up I2S module */
     I2S_startRead(i2sHandle);
-    I2S_startWrite(i2sHandle);
+    if(true == g_playBack)
+    {
+        I2S_startWrite(i2sHandle);
+    }
 
     I2S_Transaction* transactionToTreat;
     while(1)
@@ -69,52 +392,117 @@ static void* Audio_Send_Thread( void *pvParameters )
         }
 
         transactionToTreat = (I2S_Transaction*) List_head(&treatmentList);
+        if(transactionToTreat == NULL)
+        {
+            continue;
+        }
 
-        ret = opus_encode(enc,
-                          (opus_int16 *)(transactionToTreat->bufPtr),
-                          transactionToTreat->bufSize / (2 * sizeof(opus_int16)),
-                          packet,
-                          sizeof(packet));
+        List_remove(&treatmentList, (List_Elem*)transactionToTreat);
+        if(rp != NULL)
+        {
+            /* Encode 10 ms in place and hand the transaction back at once */
+            start = Audio_NowUs();
+            ret = opus_encode(enc,
+                              (opus_int16 *)(transactionToTreat->bufPtr),
+                              AUDIO_FRAME_SIZE,
+                              frameData + frameLen,
+                              AUDIO_SEND_MAX_FRAME);
+            if (ret < 1 || ret > AUDIO_SEND_MAX_FRAME) {
+                UART_PRINT("opus_encode fail 0x%02x\n", ret);
+                while(1);
+            }
+            frameUs = Audio_NowUs() - start;
+            List_put(&i2sReadList, (List_Elem*)transactionToTreat);
 
-        if (ret < 1 || ret > (opus_int32)sizeof(packet)) {
-            UART_PRINT("opus_encode fail 0x%02x\n", ret);
-            while(1);
+            /* Frames of another mode, bandwidth or channel count can not
+               join the ones before, they start the next packet */
+            if(opus_repacketizer_cat(rp, frameData + frameLen, ret) != OPUS_OK)
+            {
+                Audio_Flush(rp, &hdr, encodeUs);
+                memmove(frameData, frameData + frameLen, ret);
+                frameLen = 0;
+                encodeUs = 0;
+                opus_repacketizer_cat(rp, frameData, ret);
+            }
+            frameLen += ret;
+            encodeUs += frameUs;
+            if(opus_repacketizer_get_nb_frames(rp) < settings.frames)
+            {
+                continue;
+            }
+            Audio_Flush(rp, &hdr, encodeUs);
+            frameLen = 0;
+            encodeUs = 0;
         }
+        else
+        {
+            /* The transaction stays out of the pool until its frame is
+               encoded */
+            held[frames] = transactionToTreat;
+            if(++frames < settings.frames)
+            {
+                continue;
+            }
 
-        ret = opus_decode(dec, packet, sizeof(packet), sbuf, 160, 0);
-        if (ret == OPUS_INVALID_PACKET)
-            UART_PRINT("opus_decode fail 0x%02x\n", ret);
+            slot = PktQueue_Reserve(&pktQueue);
+            out = (slot != NULL) ? slot->data : scratch;
 
-        if(transactionToTreat != NULL)
-        {
-            /* Place in the write-list the transaction we just treated */
-            List_remove(&treatmentList, (List_Elem*)transactionToTreat);
-            if(true == g_playBack)
+            start = Audio_NowUs();
+            ret = opus_encode(enc,
+                              Audio_Gather(held, frames),
+                              frames * AUDIO_FRAME_SIZE,
+                              out + AUDIO_PKT_HEADER_SIZE,
+                              AUDIO_SEND_MAX_PAYLOAD);
+            if (ret < 1 || ret > AUDIO_SEND_MAX_PAYLOAD) {
+                UART_PRINT("opus_encode fail 0x%02x\n", ret);
+                while(1);
+            }
+            frameUs = Audio_NowUs() - start;
+
+            if(true == g_playBack && slot != NULL)
             {
-                List_put(&i2sWriteList, (List_Elem*)transactionToTreat);
+                /* A frame at a time: the monitor stage decodes into the
+                   transaction and plays it */
+                slot->ctx = held[0];
             }
             else
             {
-                retc = sl_SendTo(g_udpSocket.iSockDesc,
-                                  (char*)(transactionToTreat->bufSize),
-                                  BUFSIZE,
-                                  0,
-                                  (struct SlSockAddr_t*)&(g_udpSocket.Client),
-                                  sizeof(g_udpSocket.Client));
-                List_put(&i2sReadList, (List_Elem*)transactionToTreat);
-                if(retc < 0)
+                /* The PCM is no longer needed once it has been encoded */
+                for(i = 0; i < frames; i++)
                 {
-                    Report("Unable to send data\n\r");
+                    List_put(&i2sReadList, (List_Elem*)held[i]);
                 }
-
             }
+            Audio_Commit(slot, &hdr, ret, frames, frameUs);
+            frames = 0;
+        }
+
+        if(true == g_playBack)
+        {
+            continue;
+        }
+
+        /* The settings only change between packets */
+        changes = AudioRate_Get(&rateCtl, Audio_NowMs(), &settings);
+        if(changes != applied)
+        {
+            applied = changes;
+            opus_encoder_ctl(enc, OPUS_SET_BITRATE(settings.bitrate));
+            opus_encoder_ctl(enc, OPUS_SET_INBAND_FEC(settings.fec));
+            opus_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(settings.lossPerc));
+            UART_PRINT("%ld bps, %d ms packets, fec %d, loss %d%%\n",
+                       (long)settings.bitrate,
+                       (int)(settings.frames * AUDIO_FRAME_SIZE * 1000 /
+                             AUDIO_SAMPLE_RATE),
+                       (int)settings.fec, settings.lossPerc);
         }
     }
     pthread_exit(0);
     return NULL;
 }
 
-void Audio_Send_Init(void)
+static void Audio_Send_Create(void *(*fxn)(void *), int priority,
+                              size_t stackSize)
 {
     pthread_t thread;
     pthread_attr_t pAttrs;
@@ -124,7 +512,7 @@ void Audio_Send_Init(void)
 
     /* Set priority and stack size attributes */
     pthread_attr_init(&pAttrs);
-    priParam.sched_priority = 8;
+    priParam.sched_priority = priority;
 
     detachState = PTHREAD_CREATE_DETACHED;
     retc = pthread_attr_setdetachstate(&pAttrs, detachState);
@@ -137,7 +525,7 @@ void Audio_Send_Init(void)
 
     pthread_attr_setschedparam(&pAttrs, &priParam);
 
-    retc |= pthread_attr_setstacksize(&pAttrs, 1024 * 10);
+    retc |= pthread_attr_setstacksize(&pAttrs, stackSize);
     if(retc != 0)
     {
        /* pthread_attr_setstacksize() failed */
@@ -145,13 +533,48 @@ void Audio_Send_Init(void)
        while(1);
     }
 
-    retc = pthread_create(&thread, &pAttrs, Audio_Send_Thread, NULL);
+    retc = pthread_create(&thread, &pAttrs, fxn, NULL);
     if(retc != 0)
     {
        /* pthread_create() failed */
-       Report("Audio_Send_Thread create failed. \r\n");
+       Report("Audio_Send thread create failed. \r\n");
        while(1);
     }
 }
 
+void Audio_Send_Init(void)
+{
+    AudioRate_Init(&rateCtl, latencyBudgetMs);
+    if(PktQueue_Init(&pktQueue) != 0)
+    {
+        Report("PktQueue_Init failed. \r\n");
+        while(1);
+    }
 
+    /* The encoder runs above the stage it feeds, so that stage can fall
+       behind without capture doing so */
+    Audio_Send_Create(Audio_Encode_Thread, 8, 1024 * 10);
+    if(true == g_playBack)
+    {
+        Audio_Send_Create(Audio_Monitor_Thread, 7, 1024 * 10);
+    }
+    else
+    {
+        Audio_Send_Create(Audio_Net_Thread, 7, 2048);
+
+        /* The receiver's reports come back on the socket the stream goes out
+           on */
+        Audio_Send_Create(Audio_Feedback_Thread, 1, 2048);
+    }
+}
+
+/* Before Audio_Send_Init(), overrides AUDIO_LATENCY_BUDGET_MS */
+void Audio_Send_SetLatencyBudget(int ms)
+{
+    latencyBudgetMs = ms;
+}
+
+void Audio_Send_GetStats(tAudioSendStats *stats)
+{
+    *stats = sendStats;
+}
@@ -1,7 +1,38 @@
 
-#ifndef _AUDIO_SNED_H_
+#ifndef _AUDIO_SEND_H_
 #define _AUDIO_SEND_H_
 
+/* 1: encode, decode and play back on this board without the Wi-Fi link */
+#define AUDIO_LOOPBACK  (0)
+
+/* Latency in ms that packets of several frames may add to save airtime and
+   radio power, see audio_rate.h.  With a budget, frames are encoded 10 ms
+   at a time and joined by the repacketizer.  0 for none */
+#define AUDIO_LATENCY_BUDGET_MS (0)
+
+#include <stdint.h>
+
+typedef struct AudioStageTime
+{
+    uint32_t maxUs;
+    uint64_t totalUs;
+}tAudioStageTime;
+
+/* What the send path has done so far, see Audio_Send_GetStats() */
+typedef struct AudioSendStats
+{
+    uint32_t packets;           /* packets encoded */
+    uint32_t sent;              /* packets sent, or decoded to play back */
+    uint32_t dropped;           /* packets lost to a full queue */
+    uint32_t gathered;          /* packets whose frames had to be copied */
+    uint32_t depth;             /* most packets queued at once */
+    tAudioStageTime encode;
+    tAudioStageTime queue;      /* time spent queued */
+    tAudioStageTime send;       /* sl_SendTo(), or the monitor decode */
+}tAudioSendStats;
+
+extern void Audio_Send_SetLatencyBudget(int ms);
 extern void Audio_Send_Init(void);
+extern void Audio_Send_GetStats(tAudioSendStats *stats);
 
 #endif
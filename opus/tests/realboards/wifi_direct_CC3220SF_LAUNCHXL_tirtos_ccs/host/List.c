@@ -0,0 +1,120 @@
+//*****************************************************************************
+// List.c
+//
+// Host version of the TI driver utility list, see include/List.h.
+//
+//*****************************************************************************
+#include <stddef.h>
+#include "List.h"
+#include "host.h"
+
+void List_clearList(List_List *list)
+{
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+bool List_empty(List_List *list)
+{
+    return list->head == NULL;
+}
+
+List_Elem *List_head(List_List *list)
+{
+    return list->head;
+}
+
+List_Elem *List_tail(List_List *list)
+{
+    return list->tail;
+}
+
+List_Elem *List_next(List_Elem *elem)
+{
+    return elem->next;
+}
+
+List_Elem *List_prev(List_Elem *elem)
+{
+    return elem->prev;
+}
+
+List_Elem *List_get(List_List *list)
+{
+    List_Elem *elem;
+
+    pthread_mutex_lock(&g_hostIrqLock);
+    elem = list->head;
+    if(elem != NULL)
+    {
+        list->head = elem->next;
+        if(elem->next != NULL)
+        {
+            elem->next->prev = NULL;
+        }
+        else
+        {
+            list->tail = NULL;
+        }
+    }
+    pthread_mutex_unlock(&g_hostIrqLock);
+    return elem;
+}
+
+void List_put(List_List *list, List_Elem *elem)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    elem->next = NULL;
+    elem->prev = list->tail;
+    if(list->tail != NULL)
+    {
+        list->tail->next = elem;
+    }
+    else
+    {
+        list->head = elem;
+    }
+    list->tail = elem;
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+void List_putHead(List_List *list, List_Elem *elem)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    elem->next = list->head;
+    elem->prev = NULL;
+    if(list->head != NULL)
+    {
+        list->head->prev = elem;
+    }
+    else
+    {
+        list->tail = elem;
+    }
+    list->head = elem;
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+void List_remove(List_List *list, List_Elem *elem)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    if(elem->prev != NULL)
+    {
+        elem->prev->next = elem->next;
+    }
+    else
+    {
+        list->head = elem->next;
+    }
+    if(elem->next != NULL)
+    {
+        elem->next->prev = elem->prev;
+    }
+    else
+    {
+        list->tail = elem->prev;
+    }
+    elem->next = NULL;
+    elem->prev = NULL;
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
@@ -0,0 +1,65 @@
+//*****************************************************************************
+// host.h
+//
+// Interfaces between the host loopback harness and its stand-ins for the
+// CC3220 drivers.
+//
+//*****************************************************************************
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+/* Held by the emulated I2S interrupt, and by the list functions in place of
+   masking interrupts */
+extern pthread_mutex_t g_hostIrqLock;
+
+/* Fills or takes one frame of interleaved stereo samples.  sample is the
+   position of the first one on the sample clock shared by both sides,
+   which starts at the epoch given to HostI2S_Config() */
+typedef void (*tHostSource)(int16_t *pcm, int frames, uint64_t sample);
+typedef void (*tHostSink)(const int16_t *pcm, int frames, uint64_t sample);
+
+typedef struct HostI2SStats
+{
+    unsigned long ticks;
+    unsigned long overruns;     /* recorded frames lost, no free transaction */
+    unsigned long underruns;    /* frames of silence, nothing queued to play */
+}tHostI2SStats;
+
+extern void HostI2S_Config(uint64_t epochNs, tHostSource source,
+                           tHostSink sink);
+extern void HostI2S_GetStats(tHostI2SStats *stats);
+
+typedef struct HostNetParams
+{
+    double loss;                /* percent of datagrams dropped */
+    double delayMs;             /* fixed one way delay */
+    double jitterMs;            /* mean of the exponential extra delay */
+    double reorder;             /* percent of datagrams held back */
+    double reorderMs;           /* how long they are held back */
+    double rateKbps;            /* link rate, 0 for no limit */
+    double packetUs;            /* airtime each datagram costs on top */
+    double queueMs;             /* longest queue before the link drops */
+    double stallMs;             /* a send blocks this long once a second */
+    unsigned seed;
+}tHostNetParams;
+
+typedef struct HostNetStats
+{
+    unsigned long sent;
+    unsigned long dropped;      /* lost, or the queue was full */
+    unsigned long reordered;
+    unsigned long bytes;
+}tHostNetStats;
+
+extern int HostNet_Init(int fd, const tHostNetParams *params);
+extern void HostNet_GetStats(tHostNetStats *stats);
+
+extern void HostTerm_SetName(const char *name);
+
+extern uint64_t Host_NowNs(void);
+
+#endif
@@ -0,0 +1,267 @@
+//*****************************************************************************
+// host_i2s.c
+//
+// Emulation of the CC32xx I2S driver and of the audio codec for the host
+// harness.  A thread ticks once per frame period on CLOCK_MONOTONIC.  On
+// each tick it completes the current read and write transactions, starts the
+// next ones and calls the application's callbacks, just as the driver does
+// from its interrupt.  Recorded frames come from the harness source and
+// played frames go to its sink.
+//
+//*****************************************************************************
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <ti/drivers/I2S.h>
+#include "AudioCodec.h"
+#include "host.h"
+
+pthread_mutex_t g_hostIrqLock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static I2S_Params sParams;
+static bool sOpen;
+static bool sClocks;
+static bool sReading;
+static bool sWriting;
+static bool sWriteFirst;
+static I2S_Transaction *sReadCur;
+static I2S_Transaction *sWriteCur;
+static uint64_t sEpochNs;
+static tHostSource sSource;
+static tHostSink sSink;
+static tHostI2SStats sStats;
+static int16_t sSilence[4096];
+
+uint64_t Host_NowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void HostI2S_Config(uint64_t epochNs, tHostSource source, tHostSink sink)
+{
+    sEpochNs = epochNs;
+    sSource = source;
+    sSink = sink;
+}
+
+void HostI2S_GetStats(tHostI2SStats *stats)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    *stats = sStats;
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+static void HostI2S_Tick(uint64_t tick)
+{
+    int frames = sParams.fixedBufferLength / (2 * sizeof(int16_t));
+    I2S_Transaction *next;
+
+    pthread_mutex_lock(&g_hostIrqLock);
+    sStats.ticks++;
+
+    /* The current read transaction recorded the frame period that just
+       ended */
+    if(sReading && tick > 0)
+    {
+        if(sSource)
+        {
+            sSource((int16_t *)sReadCur->bufPtr, frames, (tick - 1) * frames);
+        }
+        next = (I2S_Transaction *)List_next(&sReadCur->queueElement);
+        if(next != NULL)
+        {
+            sReadCur = next;
+            sParams.readCallback((I2S_Handle)&sParams,
+                                 I2S_ALL_TRANSACTIONS_SUCCESS, next);
+        }
+        else
+        {
+            /* Recorded again into the same buffer next time */
+            sStats.overruns++;
+        }
+    }
+
+    /* The next write transaction plays during the frame period starting */
+    if(sWriting)
+    {
+        if(sWriteFirst)
+        {
+            sWriteFirst = false;
+            next = sWriteCur;
+        }
+        else
+        {
+            next = (I2S_Transaction *)List_next(&sWriteCur->queueElement);
+            if(next != NULL)
+            {
+                sWriteCur = next;
+                sParams.writeCallback((I2S_Handle)&sParams,
+                                      I2S_ALL_TRANSACTIONS_SUCCESS, next);
+            }
+            else
+            {
+                sStats.underruns++;
+            }
+        }
+        if(sSink)
+        {
+            sSink(next ? (const int16_t *)next->bufPtr : sSilence, frames,
+                  tick * frames);
+        }
+    }
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+static void *HostI2S_Thread(void *pvParameters)
+{
+    int frames = sParams.fixedBufferLength / (2 * sizeof(int16_t));
+    uint64_t periodNs = (uint64_t)frames * 1000000000u /
+                        sParams.samplingFrequency;
+    uint64_t tick = 0;
+    uint64_t now = Host_NowNs();
+    struct timespec due;
+
+    /* Join the shared clock where it is now */
+    if(now > sEpochNs)
+    {
+        tick = (now - sEpochNs) / periodNs + 1;
+    }
+
+    while(sClocks)
+    {
+        uint64_t dueNs = sEpochNs + tick * periodNs;
+
+        due.tv_sec = dueNs / 1000000000u;
+        due.tv_nsec = dueNs % 1000000000u;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+        HostI2S_Tick(tick);
+        tick++;
+    }
+    return NULL;
+}
+
+void I2S_init(void)
+{
+}
+
+void I2S_Params_init(I2S_Params *params)
+{
+    memset(params, 0, sizeof(*params));
+}
+
+void I2S_Transaction_init(I2S_Transaction *transaction)
+{
+    memset(transaction, 0, sizeof(*transaction));
+}
+
+I2S_Handle I2S_open(uint_least8_t index, I2S_Params *params)
+{
+    if(sOpen || params->fixedBufferLength > sizeof(sSilence))
+    {
+        return NULL;
+    }
+    sParams = *params;
+    sOpen = true;
+    return (I2S_Handle)&sParams;
+}
+
+void I2S_close(I2S_Handle handle)
+{
+    sOpen = false;
+}
+
+void I2S_setReadQueueHead(I2S_Handle handle, I2S_Transaction *transaction)
+{
+    sReadCur = transaction;
+}
+
+void I2S_setWriteQueueHead(I2S_Handle handle, I2S_Transaction *transaction)
+{
+    sWriteCur = transaction;
+}
+
+void I2S_startClocks(I2S_Handle handle)
+{
+    pthread_t thread;
+
+    if(!sClocks)
+    {
+        sClocks = true;
+        pthread_create(&thread, NULL, HostI2S_Thread, NULL);
+        pthread_detach(thread);
+    }
+}
+
+void I2S_stopClocks(I2S_Handle handle)
+{
+    sClocks = false;
+}
+
+void I2S_startRead(I2S_Handle handle)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    if(!sReading && sReadCur != NULL)
+    {
+        sReading = true;
+        sParams.readCallback(handle, I2S_ALL_TRANSACTIONS_SUCCESS, sReadCur);
+    }
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+void I2S_stopRead(I2S_Handle handle)
+{
+    sReading = false;
+}
+
+void I2S_startWrite(I2S_Handle handle)
+{
+    pthread_mutex_lock(&g_hostIrqLock);
+    if(!sWriting && sWriteCur != NULL)
+    {
+        sWriting = true;
+        sWriteFirst = true;
+        sParams.writeCallback(handle, I2S_ALL_TRANSACTIONS_SUCCESS, sWriteCur);
+    }
+    pthread_mutex_unlock(&g_hostIrqLock);
+}
+
+void I2S_stopWrite(I2S_Handle handle)
+{
+    sWriting = false;
+}
+
+//*****************************************************************************
+//
+// The TLV320AIC3254 needs no setting up on the host.
+//
+//*****************************************************************************
+uint8_t AudioCodec_open()
+{
+    return AudioCodec_STATUS_SUCCESS;
+}
+
+void AudioCodec_close()
+{
+}
+
+int AudioCodec_config(unsigned char codecId, unsigned char bitsPerSample,
+                      unsigned short bitRate, unsigned char noOfChannels,
+                      unsigned char speaker, unsigned char mic)
+{
+    return AudioCodec_STATUS_SUCCESS;
+}
+
+int AudioCodec_speakerVolCtrl(unsigned char codecId, unsigned char speaker,
+                              signed char volumeLevel)
+{
+    return AudioCodec_STATUS_SUCCESS;
+}
+
+int AudioCodec_micVolCtrl(unsigned char codecId, unsigned char mic,
+                          signed char volumeLevel)
+{
+    return AudioCodec_STATUS_SUCCESS;
+}
@@ -0,0 +1,216 @@
+//*****************************************************************************
+// host_net.c
+//
+// SimpleLink socket calls on the host.  Datagrams go over UDP on the
+// loopback interface.  On the way out they pass an emulated link, which
+// queues them behind its rate limit and drops, delays and reorders them as
+// set by HostNet_Init().  A send can also block for a while, as it does on
+// the board when the network processor is busy.
+//
+//*****************************************************************************
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "simplelink.h"
+#include "host.h"
+
+/* Datagrams that can be in flight on the emulated link */
+#define HOST_NET_SLOTS      (256)
+#define HOST_NET_MTU        (1500)
+
+typedef struct HostNetSlot
+{
+    bool used;
+    uint64_t dueNs;
+    struct sockaddr_in to;
+    int len;
+    unsigned char data[HOST_NET_MTU];
+}tHostNetSlot;
+
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sCond;
+static tHostNetSlot sSlot[HOST_NET_SLOTS];
+static tHostNetParams sParams;
+static tHostNetStats sStats;
+static uint64_t sLinkFreeNs;
+static uint64_t sStallNs;
+static int sFd = -1;
+
+static double HostNet_Random(void)
+{
+    return (rand_r(&sParams.seed) + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+static void *HostNet_Thread(void *pvParameters)
+{
+    struct timespec due;
+    tHostNetSlot *first;
+    int i;
+
+    pthread_mutex_lock(&sLock);
+    while(1)
+    {
+        first = NULL;
+        for(i = 0; i < HOST_NET_SLOTS; i++)
+        {
+            if(sSlot[i].used && (first == NULL || sSlot[i].dueNs < first->dueNs))
+            {
+                first = &sSlot[i];
+            }
+        }
+
+        if(first == NULL)
+        {
+            pthread_cond_wait(&sCond, &sLock);
+        }
+        else if(first->dueNs > Host_NowNs())
+        {
+            due.tv_sec = first->dueNs / 1000000000u;
+            due.tv_nsec = first->dueNs % 1000000000u;
+            pthread_cond_timedwait(&sCond, &sLock, &due);
+        }
+        else
+        {
+            sendto(sFd, first->data, first->len, 0,
+                   (const struct sockaddr *)&first->to, sizeof(first->to));
+            first->used = false;
+        }
+    }
+    return NULL;
+}
+
+int HostNet_Init(int fd, const tHostNetParams *params)
+{
+    pthread_condattr_t attr;
+    pthread_t thread;
+
+    sFd = fd;
+    sParams = *params;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sCond, &attr);
+    if(pthread_create(&thread, NULL, HostNet_Thread, NULL) != 0)
+    {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+void HostNet_GetStats(tHostNetStats *stats)
+{
+    pthread_mutex_lock(&sLock);
+    *stats = sStats;
+    pthread_mutex_unlock(&sLock);
+}
+
+_i16 sl_SendTo(_i16 sd, const void *buf, _i16 len, _i16 flags,
+               const SlSockAddr_t *to, SlSocklen_t tolen)
+{
+    uint64_t now = Host_NowNs();
+    uint64_t start;
+    double delayMs;
+    int i;
+
+    if(len <= 0 || len > HOST_NET_MTU || to == NULL ||
+       tolen < (SlSocklen_t)sizeof(struct sockaddr_in))
+    {
+        return -1;
+    }
+
+    /* Only the thread that sends the stream gets here often enough to
+       stall, the other side's reports rarely do */
+    if(sParams.stallMs > 0 && now >= sStallNs)
+    {
+        if(sStallNs != 0)
+        {
+            usleep((useconds_t)(sParams.stallMs * 1000.0));
+            now = Host_NowNs();
+        }
+        sStallNs = now + 1000000000u;
+    }
+
+    pthread_mutex_lock(&sLock);
+    sStats.sent++;
+    sStats.bytes += len;
+
+    /* A rate limited link sends one datagram at a time and drops when its
+       queue gets too long.  Each datagram costs its bytes and a fixed
+       airtime, like a Wi-Fi frame does */
+    delayMs = 0;
+    if(sParams.rateKbps > 0)
+    {
+        start = (sLinkFreeNs > now) ? sLinkFreeNs : now;
+        if(start - now > (uint64_t)(sParams.queueMs * 1000000.0))
+        {
+            sStats.dropped++;
+            pthread_mutex_unlock(&sLock);
+            return len;
+        }
+        sLinkFreeNs = start + (uint64_t)((len * 8 / sParams.rateKbps +
+                                          sParams.packetUs / 1000.0) * 1000000.0);
+        delayMs = (sLinkFreeNs - now) / 1000000.0;
+    }
+
+    if(HostNet_Random() * 100.0 < sParams.loss)
+    {
+        sStats.dropped++;
+        pthread_mutex_unlock(&sLock);
+        return len;
+    }
+
+    /* Wi-Fi delays have a long tail, so the extra delay is exponential,
+       capped at ten times its mean */
+    delayMs += sParams.delayMs;
+    if(sParams.jitterMs > 0)
+    {
+        double extra = -log(HostNet_Random()) * sParams.jitterMs;
+
+        delayMs += (extra < 10 * sParams.jitterMs) ? extra : 10 * sParams.jitterMs;
+    }
+    if(HostNet_Random() * 100.0 < sParams.reorder)
+    {
+        delayMs += sParams.reorderMs;
+        sStats.reordered++;
+    }
+
+    for(i = 0; i < HOST_NET_SLOTS && sSlot[i].used; i++)
+    {
+    }
+    if(i == HOST_NET_SLOTS)
+    {
+        /* The link is full, it drops */
+        sStats.dropped++;
+        pthread_mutex_unlock(&sLock);
+        return len;
+    }
+    sSlot[i].used = true;
+    sSlot[i].dueNs = now + (uint64_t)(delayMs * 1000000.0);
+    memcpy(&sSlot[i].to, to, sizeof(sSlot[i].to));
+    sSlot[i].len = len;
+    memcpy(sSlot[i].data, buf, len);
+    pthread_cond_signal(&sCond);
+    pthread_mutex_unlock(&sLock);
+    return len;
+}
+
+_i16 sl_RecvFrom(_i16 sd, void *buf, _i16 len, _i16 flags,
+                 SlSockAddr_t *from, SlSocklen_t *fromlen)
+{
+    socklen_t addrLen = (fromlen != NULL) ? (socklen_t)*fromlen : 0;
+    _i16 ret;
+
+    /* SlSockAddrIn_t is laid out like sockaddr_in */
+    ret = (_i16)recvfrom(sd, buf, len, 0, (struct sockaddr *)from,
+                         (from != NULL) ? &addrLen : NULL);
+    if(ret >= 0 && fromlen != NULL)
+    {
+        *fromlen = (SlSocklen_t)addrLen;
+    }
+    return ret;
+}
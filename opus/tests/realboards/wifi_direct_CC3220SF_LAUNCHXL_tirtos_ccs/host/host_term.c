@@ -0,0 +1,38 @@
+//*****************************************************************************
+// host_term.c
+//
+// The UART terminal of the board, on stdout.  Each line gets the name of the
+// side that printed it.
+//
+//*****************************************************************************
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "host.h"
+
+static const char *sName = "";
+
+void HostTerm_SetName(const char *name)
+{
+    sName = name;
+}
+
+int Report(const char *pcFormat, ...)
+{
+    char line[256];
+    va_list args;
+    int len;
+
+    va_start(args, pcFormat);
+    len = vsnprintf(line, sizeof(line), pcFormat, args);
+    va_end(args);
+
+    /* Lines end with \r\n or \n\r on the board */
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] != '\0')
+    {
+        printf("[%s] %s\n", sName, line);
+        fflush(stdout);
+    }
+    return len;
+}
@@ -0,0 +1,37 @@
+//*****************************************************************************
+// List.h
+//
+// Host version of the TI driver utility list.  The target functions mask
+// interrupts around each change; here they take the lock that the emulated
+// I2S interrupt holds while it runs its callbacks, see host_i2s.c.
+//
+//*****************************************************************************
+#ifndef _HOST_LIST_H_
+#define _HOST_LIST_H_
+
+#include <stdbool.h>
+
+typedef struct List_Elem
+{
+    struct List_Elem *next;
+    struct List_Elem *prev;
+}List_Elem;
+
+typedef struct List_List
+{
+    List_Elem *head;
+    List_Elem *tail;
+}List_List;
+
+extern void List_clearList(List_List *list);
+extern bool List_empty(List_List *list);
+extern List_Elem *List_get(List_List *list);
+extern List_Elem *List_head(List_List *list);
+extern List_Elem *List_tail(List_List *list);
+extern List_Elem *List_next(List_Elem *elem);
+extern List_Elem *List_prev(List_Elem *elem);
+extern void List_put(List_List *list, List_Elem *elem);
+extern void List_putHead(List_List *list, List_Elem *elem);
+extern void List_remove(List_List *list, List_Elem *elem);
+
+#endif
@@ -0,0 +1,3 @@
+// netcfg.h
+//
+// Empty on the host, everything used is in simplelink.h.
@@ -0,0 +1,55 @@
+//*****************************************************************************
+// simplelink.h
+//
+// Host stand-in for the SimpleLink socket API used by the audio threads.
+// Sockets are plain UDP sockets on the loopback interface, see host_net.c.
+//
+//*****************************************************************************
+#ifndef _HOST_SIMPLELINK_H_
+#define _HOST_SIMPLELINK_H_
+
+#include <stdint.h>
+
+typedef uint8_t  _u8;
+typedef uint16_t _u16;
+typedef uint32_t _u32;
+typedef int8_t   _i8;
+typedef int16_t  _i16;
+typedef int32_t  _i32;
+
+typedef _i32 SlSocklen_t;
+
+typedef struct SlSockAddr_t
+{
+    _u16 sa_family;
+    _u8 sa_data[14];
+}SlSockAddr_t;
+
+typedef struct SlInAddr_t
+{
+    _u32 s_addr;
+}SlInAddr_t;
+
+typedef struct SlSockAddrIn_t
+{
+    _u16 sin_family;
+    _u16 sin_port;
+    SlInAddr_t sin_addr;
+    _i8 sin_zero[8];
+}SlSockAddrIn_t;
+
+typedef struct SlWlanSecParams_t
+{
+    _u8 Type;
+    _i8 *Key;
+    _u8 KeyLen;
+}SlWlanSecParams_t;
+
+#define SL_AF_INET      (2)
+
+extern _i16 sl_SendTo(_i16 sd, const void *buf, _i16 len, _i16 flags,
+                      const SlSockAddr_t *to, SlSocklen_t tolen);
+extern _i16 sl_RecvFrom(_i16 sd, void *buf, _i16 len, _i16 flags,
+                        SlSockAddr_t *from, SlSocklen_t *fromlen);
+
+#endif
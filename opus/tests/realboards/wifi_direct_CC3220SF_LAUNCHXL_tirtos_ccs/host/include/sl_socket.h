@@ -0,0 +1,3 @@
+// sl_socket.h
+//
+// Empty on the host, everything used is in simplelink.h.
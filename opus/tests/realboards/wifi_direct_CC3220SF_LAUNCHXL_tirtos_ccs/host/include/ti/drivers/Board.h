@@ -0,0 +1,3 @@
+// Board.h
+//
+// Empty on the host.
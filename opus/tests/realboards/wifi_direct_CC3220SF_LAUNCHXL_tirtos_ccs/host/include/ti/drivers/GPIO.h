@@ -0,0 +1,3 @@
+// GPIO.h
+//
+// Empty on the host.
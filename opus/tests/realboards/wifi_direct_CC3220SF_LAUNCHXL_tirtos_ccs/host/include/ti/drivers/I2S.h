@@ -0,0 +1,92 @@
+//*****************************************************************************
+// I2S.h
+//
+// Host version of the TI I2S driver interface.  The driver is emulated by a
+// thread that completes one transaction per frame period on each side, from
+// a source and into a sink set by the harness, see host_i2s.c.
+//
+//*****************************************************************************
+#ifndef _HOST_I2S_H_
+#define _HOST_I2S_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "List.h"
+
+#define I2S_ALL_TRANSACTIONS_SUCCESS    (0x0001)
+
+typedef struct I2S_Params_ *I2S_Handle;
+
+typedef struct I2S_Transaction
+{
+    List_Elem queueElement;
+    void *bufPtr;
+    size_t bufSize;
+    size_t bufPointer;
+    size_t untransferredBytes;
+    uint16_t numberOfCompletions;
+    uintptr_t arg;
+}I2S_Transaction;
+
+typedef void (*I2S_Callback)(I2S_Handle handle, int_fast16_t status,
+                             I2S_Transaction *transactionPtr);
+
+typedef enum
+{
+    I2S_MEMORY_LENGTH_8BITS = 8,
+    I2S_MEMORY_LENGTH_16BITS = 16,
+    I2S_MEMORY_LENGTH_24BITS = 24,
+    I2S_MEMORY_LENGTH_32BITS = 32
+}I2S_MemorySlotLength;
+
+typedef enum { I2S_SLAVE, I2S_MASTER } I2S_Role;
+typedef enum { I2S_SAMPLING_EDGE_FALLING, I2S_SAMPLING_EDGE_RISING } I2S_SamplingEdge;
+typedef enum { I2S_SD0_DISABLED, I2S_SD0_INPUT, I2S_SD0_OUTPUT } I2S_SD0Use;
+typedef enum { I2S_SD1_DISABLED, I2S_SD1_INPUT, I2S_SD1_OUTPUT } I2S_SD1Use;
+typedef enum { I2S_CHANNELS_NONE, I2S_CHANNELS_MONO, I2S_CHANNELS_MONO_INV,
+               I2S_CHANNELS_STEREO } I2S_ChannelConfig;
+typedef enum { I2S_PHASE_TYPE_SINGLE, I2S_PHASE_TYPE_DUAL } I2S_PhaseType;
+
+typedef struct I2S_Params_
+{
+    bool trueI2sFormat;
+    bool invertWS;
+    bool isMSBFirst;
+    bool isDMAUnused;
+    I2S_MemorySlotLength memorySlotLength;
+    uint8_t beforeWordPadding;
+    uint8_t afterWordPadding;
+    uint8_t bitsPerWord;
+    I2S_Role moduleRole;
+    I2S_SamplingEdge samplingEdge;
+    I2S_SD0Use SD0Use;
+    I2S_SD1Use SD1Use;
+    I2S_ChannelConfig SD0Channels;
+    I2S_ChannelConfig SD1Channels;
+    I2S_PhaseType phaseType;
+    uint16_t fixedBufferLength;
+    uint16_t startUpDelay;
+    uint16_t MCLKDivider;
+    uint32_t samplingFrequency;
+    I2S_Callback readCallback;
+    I2S_Callback writeCallback;
+    I2S_Callback errorCallback;
+    void *custom;
+}I2S_Params;
+
+extern void I2S_init(void);
+extern void I2S_Params_init(I2S_Params *params);
+extern void I2S_Transaction_init(I2S_Transaction *transaction);
+extern I2S_Handle I2S_open(uint_least8_t index, I2S_Params *params);
+extern void I2S_close(I2S_Handle handle);
+extern void I2S_setReadQueueHead(I2S_Handle handle, I2S_Transaction *transaction);
+extern void I2S_setWriteQueueHead(I2S_Handle handle, I2S_Transaction *transaction);
+extern void I2S_startClocks(I2S_Handle handle);
+extern void I2S_stopClocks(I2S_Handle handle);
+extern void I2S_startRead(I2S_Handle handle);
+extern void I2S_stopRead(I2S_Handle handle);
+extern void I2S_startWrite(I2S_Handle handle);
+extern void I2S_stopWrite(I2S_Handle handle);
+
+#endif
@@ -0,0 +1,9 @@
+// UART.h
+//
+// Host stand-in, Report() prints to stdout, see host_term.c.
+#ifndef _HOST_UART_H_
+#define _HOST_UART_H_
+
+typedef void *UART_Handle;
+
+#endif
@@ -0,0 +1 @@
+#include <simplelink.h>
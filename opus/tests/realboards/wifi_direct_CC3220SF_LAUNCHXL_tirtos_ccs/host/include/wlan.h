@@ -0,0 +1,3 @@
+// wlan.h
+//
+// Empty on the host, everything used is in simplelink.h.
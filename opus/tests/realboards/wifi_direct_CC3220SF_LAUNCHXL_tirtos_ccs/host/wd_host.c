@@ -0,0 +1,441 @@
+//*****************************************************************************
+// wd_host.c
+//
+// Loopback harness for the Wi-Fi Direct audio link.  The sender and the
+// receiver run as two processes on this host.  Each runs i2s_if.c and its
+// audio thread unchanged, on top of the emulated I2S driver of host_i2s.c and
+// the emulated link of host_net.c.  Both share one sample clock, so a tone
+// burst recorded by the sender can be timed when the receiver plays it.
+// That time is the mouth-to-ear latency, including the I2S buffering.
+//
+//*****************************************************************************
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "simplelink.h"
+#include "p2p.h"
+#include "i2s_if.h"
+#include "audio_send.h"
+#include "audio_receive.h"
+#include "audio_packet.h"
+#include "host.h"
+
+/* Tone burst recorded by the sender once per period */
+#define BURST_MS            (20)
+#define BURST_LEVEL         (16000)
+#define BURST_THRESHOLD     (6000)
+#define NOISE_LEVEL         (2000)
+#define VOICE_LEVEL         (3000)
+
+/* Longest a run can last, it bounds the latencies kept */
+#define MAX_BURSTS          (4096)
+
+/* The application threads are created after this is set, for their times */
+#define MAX_APP_THREADS     (4)
+
+tUDPSocket g_udpSocket;
+
+static struct
+{
+    int seconds;
+    int periodMs;
+    int port;
+    int budgetMs;
+    const char *input;
+    const char *output;
+    tHostNetParams net;
+}sOpts;
+
+static uint64_t sPeriod;
+static FILE *sIn;
+static FILE *sOut;
+static unsigned sNoiseSeed = 1;
+static uint64_t sLastOnset;
+static uint32_t sLatency[MAX_BURSTS];
+static int sNumLatency;
+static unsigned long sFrames;
+
+static bool sTrackThreads;
+static pthread_t sAppThread[MAX_APP_THREADS];
+static int sNumAppThreads;
+
+//*****************************************************************************
+//
+// Stack sizes are set for the target and are below the host's minimum, and
+// the host stack use says nothing about the target anyway.
+//
+//*****************************************************************************
+int __real_pthread_attr_setstacksize(pthread_attr_t *attr, size_t size);
+int __wrap_pthread_attr_setstacksize(pthread_attr_t *attr, size_t size)
+{
+    return __real_pthread_attr_setstacksize(attr, size < 256 * 1024 ?
+                                            256 * 1024 : size);
+}
+
+int __real_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                          void *(*fxn)(void *), void *arg);
+int __wrap_pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                          void *(*fxn)(void *), void *arg)
+{
+    int ret = __real_pthread_create(thread, attr, fxn, arg);
+
+    if(ret == 0 && sTrackThreads && sNumAppThreads < MAX_APP_THREADS)
+    {
+        sAppThread[sNumAppThreads++] = *thread;
+    }
+    return ret;
+}
+
+//*****************************************************************************
+//
+// Sender side: a file, or a voice-like background with a tone burst at the
+// start of every period.  The background keeps the encoder in SILK, which is
+// where in-band FEC is sent, and stays under the burst detection threshold.
+//
+//*****************************************************************************
+static void Source(int16_t *pcm, int frames, uint64_t sample)
+{
+    int i;
+
+    if(sIn != NULL)
+    {
+        int got = fread(pcm, 2 * sizeof(int16_t), frames, sIn);
+
+        if(got < frames)
+        {
+            rewind(sIn);
+            got += fread(pcm + 2 * got, 2 * sizeof(int16_t), frames - got, sIn);
+            memset(pcm + 2 * got, 0, (frames - got) * 2 * sizeof(int16_t));
+        }
+        return;
+    }
+
+    for(i = 0; i < frames; i++, sample++)
+    {
+        uint64_t pos = sample % sPeriod;
+        double t = (double)sample / AUDIO_SAMPLE_RATE;
+        int16_t s;
+
+        /* A 125 Hz voice plus breath noise, in 3 Hz syllables */
+        s = (int16_t)((VOICE_LEVEL * sin(2 * M_PI * 125 * t) +
+                       rand_r(&sNoiseSeed) % (2 * NOISE_LEVEL + 1) -
+                       NOISE_LEVEL) * (0.5 + 0.5 * sin(2 * M_PI * 3 * t)));
+
+        if(pos < (uint64_t)AUDIO_SAMPLE_RATE * BURST_MS / 1000)
+        {
+            s += (int16_t)(BURST_LEVEL * sin(2 * M_PI * 1000 * pos /
+                                             AUDIO_SAMPLE_RATE));
+        }
+        pcm[2 * i] = s;
+        pcm[2 * i + 1] = s;
+    }
+}
+
+//*****************************************************************************
+//
+// Receiver side: times the start of each burst against the period it was
+// recorded in.
+//
+//*****************************************************************************
+static void Sink(const int16_t *pcm, int frames, uint64_t sample)
+{
+    int i;
+
+    sFrames++;
+    if(sOut != NULL)
+    {
+        fwrite(pcm, 2 * sizeof(int16_t), frames, sOut);
+    }
+    if(sIn != NULL)
+    {
+        return;
+    }
+
+    for(i = 0; i < frames; i++, sample++)
+    {
+        if(abs(pcm[2 * i]) > BURST_THRESHOLD &&
+           (sNumLatency == 0 || sample - sLastOnset > sPeriod / 2))
+        {
+            sLastOnset = sample;
+            if(sNumLatency < MAX_BURSTS)
+            {
+                sLatency[sNumLatency++] = (uint32_t)(sample % sPeriod);
+            }
+        }
+    }
+}
+
+static int CompareU32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double AppCpuUs(void)
+{
+    struct timespec ts;
+    clockid_t cid;
+    double us = 0;
+    int i;
+
+    for(i = 0; i < sNumAppThreads; i++)
+    {
+        if(pthread_getcpuclockid(sAppThread[i], &cid) == 0 &&
+           clock_gettime(cid, &ts) == 0)
+        {
+            us += ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+        }
+    }
+    return us;
+}
+
+static void SleepUntil(uint64_t ns)
+{
+    struct timespec due;
+
+    due.tv_sec = ns / 1000000000u;
+    due.tv_nsec = ns % 1000000000u;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+    {
+    }
+}
+
+static void RunSender(int fd, uint64_t epoch)
+{
+    struct sockaddr_in peer;
+    tHostI2SStats i2s;
+    tHostNetStats net;
+    tAudioSendStats send;
+
+    HostTerm_SetName("send");
+    memset(&peer, 0, sizeof(peer));
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(sOpts.port);
+    peer.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_udpSocket.iSockDesc = fd;
+    g_udpSocket.Client.sin_family = SL_AF_INET;
+    g_udpSocket.Client.sin_port = peer.sin_port;
+    g_udpSocket.Client.sin_addr.s_addr = peer.sin_addr.s_addr;
+    g_udpSocket.iClientLength = sizeof(g_udpSocket.Client);
+    HostNet_Init(fd, &sOpts.net);
+
+    HostI2S_Config(epoch, Source, NULL);
+    I2s_Init();
+    g_playBack = false;
+    sTrackThreads = true;
+    Audio_Send_SetLatencyBudget(sOpts.budgetMs);
+    Audio_Send_Init();
+    sTrackThreads = false;
+
+    SleepUntil(epoch + (uint64_t)sOpts.seconds * 1000000000u);
+    HostI2S_GetStats(&i2s);
+    HostNet_GetStats(&net);
+    Audio_Send_GetStats(&send);
+    printf("Sender      %lu frames, %lu overruns, %.1f us CPU per frame\n",
+           i2s.ticks, i2s.overruns, AppCpuUs() / (i2s.ticks ? i2s.ticks : 1));
+    printf("Stages      %lu packets, %lu dropped, %lu gathered, depth %lu\n",
+           (unsigned long)send.packets, (unsigned long)send.dropped,
+           (unsigned long)send.gathered, (unsigned long)send.depth);
+    printf("            encode %.0f/%lu us, queue %.0f/%lu us, send %.0f/%lu us (mean/max)\n",
+           (double)send.encode.totalUs / (send.packets ? send.packets : 1),
+           (unsigned long)send.encode.maxUs,
+           (double)send.queue.totalUs / (send.sent ? send.sent : 1),
+           (unsigned long)send.queue.maxUs,
+           (double)send.send.totalUs / (send.sent ? send.sent : 1),
+           (unsigned long)send.send.maxUs);
+    printf("Link        %lu packets, %lu dropped, %lu held back, %.1f kbit/s, %.1f packets/s\n",
+           net.sent, net.dropped, net.reordered,
+           net.bytes * 8.0 / 1000 / sOpts.seconds,
+           (double)net.sent / sOpts.seconds);
+    fflush(stdout);
+}
+
+static void RunReceiver(int fd, uint64_t epoch)
+{
+    tHostI2SStats i2s;
+    tHostNetStats net;
+    tJitterStats jb;
+    double frames;
+    int n;
+
+    HostTerm_SetName("recv");
+    g_udpSocket.iSockDesc = fd;
+    g_udpSocket.iClientLength = sizeof(g_udpSocket.Client);
+    HostNet_Init(fd, &sOpts.net);
+
+    HostI2S_Config(epoch, NULL, Sink);
+    I2s_Init();
+    g_playBack = false;
+    sTrackThreads = true;
+    Audio_Receive_Init();
+    sTrackThreads = false;
+
+    /* Play out what is still in flight */
+    SleepUntil(epoch + (uint64_t)sOpts.seconds * 1000000000u + 500000000u);
+    HostI2S_GetStats(&i2s);
+    HostNet_GetStats(&net);
+    Audio_Receive_GetStats(&jb);
+    frames = jb.decoded + jb.fec + jb.plc + jb.stretched;
+    if(frames == 0)
+    {
+        frames = 1;
+    }
+
+    printf("Receiver    %lu frames, %lu underruns, %.1f us CPU per frame\n",
+           i2s.ticks, i2s.underruns, AppCpuUs() / (i2s.ticks ? i2s.ticks : 1));
+    printf("Feedback    %lu reports, %lu dropped\n", net.sent, net.dropped);
+    printf("Jitter      %u/%u frames delay, %.2f ms jitter, %u late, "
+           "%u duplicate, %u rebuffers\n", jb.delay, jb.target,
+           jb.jitter / 48.0, jb.late, jb.duplicate, jb.rebuffers);
+    printf("Concealed   %.2f%% (FEC %.2f%%, PLC %.2f%%, stretched %.2f%%), "
+           "%u skipped\n", 100.0 * (jb.fec + jb.plc + jb.stretched) / frames,
+           100.0 * jb.fec / frames, 100.0 * jb.plc / frames,
+           100.0 * jb.stretched / frames, jb.skipped);
+
+    /* The first bursts go through the start-up of both sides */
+    n = sNumLatency;
+    if(n > 2)
+    {
+        uint32_t *lat = sLatency + 2;
+
+        n -= 2;
+        qsort(lat, n, sizeof(lat[0]), CompareU32);
+        printf("Latency     %d bursts, ms p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+               n, lat[n / 2] * 1000.0 / AUDIO_SAMPLE_RATE,
+               lat[n * 9 / 10] * 1000.0 / AUDIO_SAMPLE_RATE,
+               lat[n * 99 / 100] * 1000.0 / AUDIO_SAMPLE_RATE,
+               lat[n - 1] * 1000.0 / AUDIO_SAMPLE_RATE);
+    }
+    else if(sIn == NULL)
+    {
+        printf("Latency     no bursts heard\n");
+    }
+    fflush(stdout);
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -t seconds    length of the run (10)\n"
+            "  -l percent    packets lost (0)\n"
+            "  -d ms         one way delay (1)\n"
+            "  -j ms         mean extra delay, exponential (0)\n"
+            "  -r percent    packets held back (0)\n"
+            "  -R ms         how long they are held back (15)\n"
+            "  -b kbit/s     link rate, both ways (no limit)\n"
+            "  -a us         airtime each packet costs on top (0)\n"
+            "  -q ms         longest queue before the link drops (100)\n"
+            "  -S ms         a send blocks this long once a second (0)\n"
+            "  -L ms         latency budget to join frames into packets (0)\n"
+            "  -s seed       for the link emulation (1)\n"
+            "  -p ms         period of the latency bursts (1000)\n"
+            "  -i file       record raw 16 bit stereo from a file, no latency\n"
+            "  -o file       write what the receiver plays\n"
+            "  -P port       UDP port (%d)\n", name, AUDIO_UDP_PORT);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    int sendFd, recvFd;
+    uint64_t epoch;
+    pid_t pid;
+    int status;
+    int opt;
+
+    sOpts.seconds = 10;
+    sOpts.periodMs = 1000;
+    sOpts.port = AUDIO_UDP_PORT;
+    sOpts.net.delayMs = 1;
+    sOpts.net.reorderMs = 15;
+    sOpts.net.queueMs = 100;
+    sOpts.net.seed = 1;
+    while((opt = getopt(argc, argv, "t:l:d:j:r:R:b:a:q:S:L:s:p:i:o:P:")) != -1)
+    {
+        switch(opt)
+        {
+            case 't': sOpts.seconds = atoi(optarg); break;
+            case 'l': sOpts.net.loss = atof(optarg); break;
+            case 'd': sOpts.net.delayMs = atof(optarg); break;
+            case 'j': sOpts.net.jitterMs = atof(optarg); break;
+            case 'r': sOpts.net.reorder = atof(optarg); break;
+            case 'R': sOpts.net.reorderMs = atof(optarg); break;
+            case 'b': sOpts.net.rateKbps = atof(optarg); break;
+            case 'a': sOpts.net.packetUs = atof(optarg); break;
+            case 'q': sOpts.net.queueMs = atof(optarg); break;
+            case 'S': sOpts.net.stallMs = atof(optarg); break;
+            case 'L': sOpts.budgetMs = atoi(optarg); break;
+            case 's': sOpts.net.seed = atoi(optarg); break;
+            case 'p': sOpts.periodMs = atoi(optarg); break;
+            case 'i': sOpts.input = optarg; break;
+            case 'o': sOpts.output = optarg; break;
+            case 'P': sOpts.port = atoi(optarg); break;
+            default: Usage(argv[0]);
+        }
+    }
+    if(optind != argc || sOpts.seconds <= 0 || sOpts.periodMs <= BURST_MS)
+    {
+        Usage(argv[0]);
+    }
+    sPeriod = (uint64_t)AUDIO_SAMPLE_RATE * sOpts.periodMs / 1000;
+
+    if(sOpts.input != NULL && (sIn = fopen(sOpts.input, "rb")) == NULL)
+    {
+        fprintf(stderr, "Cannot open %s\n", sOpts.input);
+        return 1;
+    }
+    if(sOpts.output != NULL && (sOut = fopen(sOpts.output, "wb")) == NULL)
+    {
+        fprintf(stderr, "Cannot create %s\n", sOpts.output);
+        return 1;
+    }
+
+    recvFd = socket(AF_INET, SOCK_DGRAM, 0);
+    sendFd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(sOpts.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(recvFd < 0 || sendFd < 0 ||
+       bind(recvFd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        fprintf(stderr, "Cannot bind UDP port %d\n", sOpts.port);
+        return 1;
+    }
+
+    /* Both sides start their sample clock together, once they are set up */
+    epoch = Host_NowNs() + 200000000u;
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0)
+    {
+        fprintf(stderr, "fork failed\n");
+        return 1;
+    }
+    if(pid == 0)
+    {
+        close(sendFd);
+        RunReceiver(recvFd, epoch);
+        _exit(0);
+    }
+
+    close(recvFd);
+    if(sOut != NULL)
+    {
+        fclose(sOut);
+        sOut = NULL;
+    }
+    RunSender(sendFd, epoch);
+    waitpid(pid, &status, 0);
+    return 0;
+}
@@ -68,12 +68,7 @@ static void writeCallbackFxn(I2S_Handle handle, int_fast16_t status, I2S_Transac
         /* Remove the finished transaction from the write queue and
          * feed the read queue (we do not need anymore the data of this transaction)*/
         List_remove(&i2sWriteList, (List_Elem*)transactionFinished);
-        if(true == g_playBack)
-        {
-            List_put(&i2sReadList, (List_Elem*)transactionFinished);
-        }else{
-            List_put(&treatmentList, (List_Elem*)transactionFinished);
-        }
+        List_put(&i2sReadList, (List_Elem*)transactionFinished);
 
         /* We do not need to queue transaction here: treatment-function takes care of this :) */
     }
@@ -211,3 +206,15 @@ void I2s_Init(void)
 //    I2S_startWrite(i2sHandle);
 }
 
+/* When nothing is played, the transactions of the write queue go to the read
+ * queue, so capture has all the buffers to wait in. Call it before
+ * I2S_startRead(). */
+void I2s_CaptureOnly(void)
+{
+    List_Elem *elem;
+
+    while((elem = List_get(&i2sWriteList)) != NULL) {
+        List_put(&i2sReadList, elem);
+    }
+}
+
@@ -20,6 +20,7 @@ extern bool g_playBack;
 extern I2S_Handle i2sHandle;
 
 extern void I2s_Init(void);
+extern void I2s_CaptureOnly(void);
 
 #endif
 
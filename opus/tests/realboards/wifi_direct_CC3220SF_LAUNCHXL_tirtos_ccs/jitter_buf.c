@@ -0,0 +1,498 @@
+//*****************************************************************************
+// jitter_buf.c
+//
+//*****************************************************************************
+#include <string.h>
+#include "jitter_buf.h"
+
+static tJitterSlot *JitterBuf_Find(tJitterBuf *jb, uint16_t seq)
+{
+    tJitterSlot *s = &jb->slot[seq & (JB_SLOTS - 1)];
+
+    return (s->used && s->seq == seq) ? s : NULL;
+}
+
+/* Frames from the next one to play up to the end of the newest packet.
+   Playout runs past it while the link stalls */
+static int JitterBuf_Level(tJitterBuf *jb)
+{
+    int level = (int16_t)(jb->newestSeq + jb->newestFrames - jb->nextSeq);
+
+    return (jb->synced && level > 0) ? level : 0;
+}
+
+/* First packet after the missing frame to play, if one has been received */
+static tJitterSlot *JitterBuf_FindNext(tJitterBuf *jb)
+{
+    tJitterSlot *s;
+    int level = JitterBuf_Level(jb);
+    int i;
+
+    for(i = 1; i < level; i++)
+    {
+        s = JitterBuf_Find(jb, (uint16_t)(jb->nextSeq + i));
+        if(s != NULL)
+        {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+//*****************************************************************************
+//
+// Splits the packet of a slot into its Opus frames.  Each of them is decoded
+// later as a packet of its own, made by writing a TOC byte over the byte
+// before it: the framing that byte belonged to has been read here.  Returns
+// -1 if the packet is not valid or its Opus frames are not made of whole
+// frames of the stream.
+//
+//*****************************************************************************
+static int JitterBuf_Split(tJitterBuf *jb, tJitterSlot *s)
+{
+    const unsigned char *frames[48];
+    opus_int16 size[48];
+    unsigned char toc;
+    int samples;
+    int silkFrames = 1;
+    int count;
+    int i;
+
+    count = opus_packet_parse(s->data, s->len, &toc, frames, size, NULL);
+    samples = opus_packet_get_samples_per_frame(s->data, 48000);
+    if(count <= 0 || samples % jb->tsPerFrame != 0 ||
+       count * (samples / (int)jb->tsPerFrame) != s->frames)
+    {
+        return -1;
+    }
+    s->count = (uint8_t)count;
+    s->next = 0;
+    s->toc = toc & 0xFC;
+    for(i = 0; i < count; i++)
+    {
+        s->offset[i] = (uint16_t)(frames[i] - s->data);
+        s->size[i] = size[i];
+    }
+
+    /* Whether it carries LBRR (FEC) data.  The VAD and LBRR flags are the
+       first symbols of the range coder, one bit each, so they are the top
+       bits of the first byte.  CELT only packets have no SILK layer */
+    s->lbrr = false;
+    if(!(toc & 0x80) && size[0] > 0)
+    {
+        if(samples > 960)
+        {
+            silkFrames = samples / 960;
+        }
+        s->lbrr = (frames[0][0] >> (7 - silkFrames)) & 1;
+        if(opus_packet_get_nb_channels(s->data) == 2)
+        {
+            s->lbrr = s->lbrr || ((frames[0][0] >> (6 - 2 * silkFrames)) & 1);
+        }
+    }
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Works out the delay the buffer should aim for.  It goes up as soon as the
+// link gets worse, but only comes down one frame at a time when bStepDown is
+// set, so that a target hovering between two values does not stretch and
+// skip frames in turn.
+//
+//*****************************************************************************
+static void JitterBuf_UpdateTarget(tJitterBuf *jb, bool bStepDown)
+{
+    uint32_t jitter = jb->jitterQ4 >> 4;
+    uint32_t target;
+
+    /* Cover three times the mean deviation, plus what losses and late
+       packets asked for.  A packet of several frames must have arrived
+       before its first frame plays */
+    target = JB_MIN_DELAY + (3 * jitter + jb->tsPerFrame - 1) / jb->tsPerFrame +
+             jb->lateBoost + jb->lossBoost + jb->newestFrames - 1;
+    if(target > JB_MAX_DELAY)
+    {
+        target = JB_MAX_DELAY;
+    }
+
+    if(target > jb->stats.target)
+    {
+        if(jb->playing)
+        {
+            jb->grow += target - jb->stats.target;
+        }
+        jb->stats.target = (uint16_t)target;
+    }
+    else if(target < jb->stats.target && bStepDown)
+    {
+        jb->stats.target--;
+        if(jb->grow > 0)
+        {
+            jb->grow--;
+        }
+    }
+}
+
+int JitterBuf_Init(tJitterBuf *jb, OpusDecoder *dec, int channels,
+                   int frameSize, uint32_t tsPerFrame)
+{
+    memset(jb, 0, sizeof(*jb));
+    if(channels * frameSize * JB_MAX_PACKET_FRAMES > JB_STAGE_SAMPLES ||
+       pthread_mutex_init(&jb->lock, NULL) != 0)
+    {
+        return -1;
+    }
+    jb->dec = dec;
+    jb->channels = channels;
+    jb->frameSize = frameSize;
+    jb->newestFrames = 1;
+    jb->tsPerFrame = tsPerFrame;
+
+    /* Nothing is known about the link yet, assume half a frame of jitter */
+    jb->jitterQ4 = (int32_t)(tsPerFrame * 16 / 2);
+    JitterBuf_UpdateTarget(jb, false);
+    return 0;
+}
+
+//*****************************************************************************
+//
+// Stores a packet received from the network.  arrival is the time it was
+// received, in 48 kHz samples like the timestamp.  Returns the number of
+// frames in the packet if it was kept, or -1 if it was late, a duplicate or
+// could not be stored.
+//
+//*****************************************************************************
+int JitterBuf_Put(tJitterBuf *jb, uint16_t seq, uint32_t ts,
+                  const unsigned char *data, int len, uint32_t arrival)
+{
+    tJitterSlot *s;
+    int16_t delta;
+    int frames = 0;
+
+    if(len > 0)
+    {
+        frames = opus_packet_get_nb_samples(data, len, 48000);
+    }
+
+    pthread_mutex_lock(&jb->lock);
+    if(len <= 0 || len > JB_MAX_PAYLOAD || frames <= 0 ||
+       frames % jb->tsPerFrame != 0 ||
+       frames / jb->tsPerFrame > JB_MAX_PACKET_FRAMES)
+    {
+        jb->stats.dropped++;
+        pthread_mutex_unlock(&jb->lock);
+        return -1;
+    }
+    frames /= jb->tsPerFrame;
+
+    if(!jb->synced)
+    {
+        memset(jb->slot, 0, sizeof(jb->slot));
+        jb->nextSeq = seq;
+        jb->newestSeq = seq;
+        jb->newestFrames = (uint16_t)frames;
+        jb->cur = NULL;
+        jb->staged = 0;
+        jb->lastArrival = arrival;
+        jb->lastTs = ts;
+        jb->synced = true;
+    }
+
+    delta = (int16_t)(seq - jb->nextSeq);
+    if(delta < 0)
+    {
+        if(jb->playing ||
+           (int16_t)(jb->newestSeq - seq) >= JB_SLOTS)
+        {
+            /* Its frame has gone, play later from now on */
+            jb->stats.late++;
+            if(jb->lateBoost < JB_MAX_DELAY)
+            {
+                jb->lateBoost++;
+            }
+            jb->calm = 0;
+            JitterBuf_UpdateTarget(jb, false);
+            pthread_mutex_unlock(&jb->lock);
+            return -1;
+        }
+
+        /* Still buffering, start from this one */
+        jb->nextSeq = seq;
+    }
+    else if(delta >= JB_SLOTS)
+    {
+        /* Far ahead of playout, the sender restarted or the link was down */
+        memset(jb->slot, 0, sizeof(jb->slot));
+        jb->nextSeq = seq;
+        jb->newestSeq = seq;
+        jb->newestFrames = (uint16_t)frames;
+        jb->cur = NULL;
+        jb->staged = 0;
+        jb->lastArrival = arrival;
+        jb->lastTs = ts;
+        if(jb->playing)
+        {
+            jb->playing = false;
+            jb->stats.rebuffers++;
+        }
+    }
+
+    /* A slot still used by another packet holds one whose frames were
+       passed without it, it is stale.  Unless it is being played */
+    s = &jb->slot[seq & (JB_SLOTS - 1)];
+    if(s->used && s->seq == seq)
+    {
+        jb->stats.duplicate++;
+        pthread_mutex_unlock(&jb->lock);
+        return -1;
+    }
+    if(s == jb->cur)
+    {
+        jb->stats.dropped++;
+        pthread_mutex_unlock(&jb->lock);
+        return -1;
+    }
+    s->seq = seq;
+    s->len = (uint16_t)len;
+    s->frames = (uint8_t)frames;
+    memcpy(s->data, data, len);
+    s->used = (JitterBuf_Split(jb, s) == 0);
+    if(!s->used)
+    {
+        jb->stats.dropped++;
+        pthread_mutex_unlock(&jb->lock);
+        return -1;
+    }
+    jb->stats.received++;
+
+    /* Interarrival jitter of the packets received in order, RFC 3550 6.4.1 */
+    if((int16_t)(seq - jb->newestSeq) > 0)
+    {
+        /* After a loss, wait long enough for this packet to carry the FEC of
+           the next one */
+        if((int16_t)(seq - jb->newestSeq - jb->newestFrames) > 0 && s->lbrr)
+        {
+            jb->lossBoost = (uint16_t)frames;
+            jb->lossCalm = 0;
+        }
+
+        int32_t d = (int32_t)((arrival - jb->lastArrival) - (ts - jb->lastTs));
+
+        if(d < 0)
+        {
+            d = -d;
+        }
+        jb->jitterQ4 += d - ((jb->jitterQ4 + 8) >> 4);
+        jb->lastArrival = arrival;
+        jb->lastTs = ts;
+        jb->newestSeq = seq;
+        jb->newestFrames = (uint16_t)frames;
+        JitterBuf_UpdateTarget(jb, false);
+    }
+    jb->stats.delay = (uint16_t)JitterBuf_Level(jb);
+    pthread_mutex_unlock(&jb->lock);
+    return frames;
+}
+
+//*****************************************************************************
+//
+// Decodes Opus frame i of a packet where it lies, or the FEC data it carries
+// for the frames before it when fec is set.  An Opus frame of one frame of
+// the stream goes straight to pcm, a longer one is staged and its first
+// frame copied to pcm.
+//
+//*****************************************************************************
+static int JitterBuf_Decode(tJitterBuf *jb, tJitterSlot *s, int i, int fec,
+                            opus_int16 *pcm)
+{
+    int frames = s->frames / s->count;
+    opus_int16 *out = (frames > 1) ? jb->stage : pcm;
+    unsigned char *pkt = s->data + s->offset[i] - 1;
+    int n = frames * jb->frameSize;
+    int ret;
+
+    *pkt = s->toc;
+    ret = opus_decode(jb->dec, pkt, s->size[i] + 1, out, n, fec);
+    if(ret < 0)
+    {
+        ret = opus_decode(jb->dec, NULL, 0, out, n, 0);
+    }
+    if(ret > 0 && frames > 1)
+    {
+        memcpy(pcm, out, jb->frameSize * jb->channels * sizeof(opus_int16));
+        jb->staged = (uint16_t)(frames - 1);
+        jb->stagePos = 1;
+        ret = jb->frameSize;
+    }
+    return ret;
+}
+
+//*****************************************************************************
+//
+// Decodes the next frame into pcm, which must hold frameSize samples per
+// channel.  Returns the number of samples per channel, or a negative Opus
+// error code.  Packets are decoded in their slot, so under the lock: the
+// network thread waits for one frame at most.
+//
+//*****************************************************************************
+int JitterBuf_Get(tJitterBuf *jb, opus_int16 *pcm)
+{
+    tJitterSlot *s = NULL;
+    int level;
+    int ret;
+    int n;
+
+    pthread_mutex_lock(&jb->lock);
+    level = JitterBuf_Level(jb);
+    if(!jb->playing)
+    {
+        if(level < jb->stats.target)
+        {
+            /* Buffering, the decoder fades out whatever played last */
+            pthread_mutex_unlock(&jb->lock);
+            return opus_decode(jb->dec, NULL, 0, pcm, jb->frameSize, 0);
+        }
+        jb->playing = true;
+        jb->grow = 0;
+        jb->deep = 0;
+        jb->conceal = 0;
+        jb->cur = NULL;
+        jb->staged = 0;
+    }
+
+    if(++jb->lossCalm >= JB_LOSS_CALM_FRAMES)
+    {
+        jb->lossCalm = 0;
+        jb->lossBoost = 0;
+    }
+    if(++jb->calm >= JB_CALM_FRAMES)
+    {
+        jb->calm = 0;
+        if(jb->lateBoost > 0)
+        {
+            jb->lateBoost--;
+        }
+        JitterBuf_UpdateTarget(jb, true);
+    }
+
+    if(jb->staged > 0)
+    {
+        /* The rest of an Opus frame decoded earlier */
+        n = jb->frameSize * jb->channels;
+        memcpy(pcm, jb->stage + n * jb->stagePos, n * sizeof(opus_int16));
+        jb->stagePos++;
+        jb->staged--;
+        jb->nextSeq++;
+        jb->stats.delay = (uint16_t)JitterBuf_Level(jb);
+        pthread_mutex_unlock(&jb->lock);
+        return jb->frameSize;
+    }
+
+    /* Stretching and skipping wait for the end of a packet, so the decoder
+       output stays continuous */
+    if(jb->cur == NULL && jb->grow > 0)
+    {
+        /* Conceal a frame without moving on, the delay grows by one frame */
+        jb->grow--;
+        jb->stats.stretched++;
+        pthread_mutex_unlock(&jb->lock);
+        return opus_decode(jb->dec, NULL, 0, pcm, jb->frameSize, 0);
+    }
+
+    if(jb->cur == NULL)
+    {
+        if(level > jb->stats.target + 1)
+        {
+            if(++jb->deep >= JB_SHRINK_FRAMES)
+            {
+                /* Too much delay for this link, drop a packet.  The decoder
+                   overlaps the frames on each side of the gap */
+                s = JitterBuf_Find(jb, jb->nextSeq);
+                if(s != NULL)
+                {
+                    s->used = false;
+                    jb->nextSeq += s->frames;
+                }
+                else
+                {
+                    jb->nextSeq++;
+                }
+                jb->stats.skipped++;
+                jb->deep = 0;
+            }
+        }
+        else
+        {
+            jb->deep = 0;
+        }
+
+        s = JitterBuf_Find(jb, jb->nextSeq);
+        if(s != NULL)
+        {
+            jb->cur = s;
+            jb->stats.decoded += s->frames;
+            jb->conceal = 0;
+        }
+        else if((s = JitterBuf_FindNext(jb)) == NULL)
+        {
+            /* Nothing to play, the link stalled */
+            jb->stats.plc++;
+            if(++jb->conceal >= JB_MAX_CONCEAL)
+            {
+                jb->playing = false;
+                jb->synced = false;
+                jb->stats.rebuffers++;
+            }
+        }
+        else
+        {
+            /* Frames are missing.  The packet after them may carry FEC for
+               as many frames as its first Opus frame holds, the ones before
+               that are concealed one at a time */
+            n = s->frames / s->count;
+            if((uint16_t)(s->seq - jb->nextSeq) != n || !s->lbrr)
+            {
+                s = NULL;
+                jb->stats.plc++;
+            }
+            else
+            {
+                jb->stats.fec += n;
+            }
+            jb->conceal = 0;
+        }
+    }
+
+    if(jb->cur != NULL)
+    {
+        /* The next Opus frame of the packet being played */
+        s = jb->cur;
+        ret = JitterBuf_Decode(jb, s, s->next, 0, pcm);
+        if(++s->next == s->count)
+        {
+            s->used = false;
+            jb->cur = NULL;
+        }
+    }
+    else if(s != NULL)
+    {
+        ret = JitterBuf_Decode(jb, s, 0, 1, pcm);
+    }
+    else
+    {
+        ret = opus_decode(jb->dec, NULL, 0, pcm, jb->frameSize, 0);
+    }
+    jb->nextSeq++;
+    jb->stats.delay = (uint16_t)JitterBuf_Level(jb);
+    pthread_mutex_unlock(&jb->lock);
+    return ret;
+}
+
+void JitterBuf_GetStats(tJitterBuf *jb, tJitterStats *stats)
+{
+    pthread_mutex_lock(&jb->lock);
+    *stats = jb->stats;
+    stats->jitter = (uint32_t)(jb->jitterQ4 >> 4);
+    pthread_mutex_unlock(&jb->lock);
+}
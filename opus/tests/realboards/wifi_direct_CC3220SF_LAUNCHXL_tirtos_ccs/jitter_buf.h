@@ -0,0 +1,113 @@
+//*****************************************************************************
+// jitter_buf.h
+//
+// Receive side jitter buffer for the Opus packets of audio_packet.h.  The
+// network thread puts packets in as they arrive and the playout thread gets
+// one decoded frame per I2S transaction.  A packet may hold several frames,
+// its sequence number is the position of its first frame.  Packets are
+// split into their Opus frames once, when they arrive, and each frame is
+// decoded where it lies in the buffer when its turn comes.  A missing packet
+// is rebuilt from the FEC data of the packet after it when there is some, or
+// concealed by the decoder otherwise.  The playout delay follows the measured
+// jitter.
+//
+//*****************************************************************************
+#ifndef _JITTER_BUF_H_
+#define _JITTER_BUF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "opus.h"
+
+/* Packets the buffer can hold, a power of two */
+#define JB_SLOTS            (16)
+/* Largest Opus packet kept, larger ones are dropped */
+#define JB_MAX_PAYLOAD      (400)
+/* Most frames in one packet */
+#define JB_MAX_PACKET_FRAMES (6)
+/* Room to decode the longest Opus frame, in samples of all channels: 60 ms
+   of stereo at 16 kHz */
+#define JB_STAGE_SAMPLES    (1920)
+/* Bounds of the playout delay, in frames */
+#define JB_MIN_DELAY        (1)
+#define JB_MAX_DELAY        (JB_SLOTS - 2)
+/* Frames in a row deeper than the target before one is skipped */
+#define JB_SHRINK_FRAMES    (50)
+/* Frames between two steps down of the target delay */
+#define JB_CALM_FRAMES      (200)
+/* Frames without a lost packet before the frame kept for FEC is given up */
+#define JB_LOSS_CALM_FRAMES (1000)
+/* Frames concealed in a row with nothing buffered before buffering again */
+#define JB_MAX_CONCEAL      (10)
+
+typedef struct JitterSlot
+{
+    uint16_t seq;
+    uint16_t len;
+    uint8_t frames;         /* frames of the stream the packet holds */
+    uint8_t count;          /* Opus frames it holds, each frames / count */
+    uint8_t next;           /* next Opus frame to play */
+    bool used;
+    bool lbrr;              /* it carries FEC for the frames before it */
+    unsigned char toc;      /* TOC of a packet of one of its Opus frames */
+    uint16_t offset[JB_MAX_PACKET_FRAMES];
+    opus_int16 size[JB_MAX_PACKET_FRAMES];
+    unsigned char data[JB_MAX_PAYLOAD];
+}tJitterSlot;
+
+typedef struct JitterStats
+{
+    uint32_t received;      /* packets put in the buffer */
+    uint32_t late;          /* packets that arrived after their frame played */
+    uint32_t duplicate;     /* packets received twice */
+    uint32_t dropped;       /* packets too large or too far ahead */
+    uint32_t decoded;       /* frames played from their own packet */
+    uint32_t fec;           /* frames rebuilt from the next packet's FEC */
+    uint32_t plc;           /* frames concealed by the decoder */
+    uint32_t stretched;     /* frames concealed to grow the delay */
+    uint32_t skipped;       /* packets thrown away to shrink the delay */
+    uint32_t rebuffers;     /* times playout stopped to buffer again */
+    uint16_t delay;         /* frames buffered ahead of playout */
+    uint16_t target;        /* delay the buffer aims for, in frames */
+    uint32_t jitter;        /* interarrival jitter, in 48 kHz samples */
+}tJitterStats;
+
+typedef struct JitterBuf
+{
+    pthread_mutex_t lock;
+    OpusDecoder *dec;
+    int channels;
+    int frameSize;
+    uint32_t tsPerFrame;
+    tJitterSlot slot[JB_SLOTS];
+    bool synced;            /* nextSeq and newestSeq are valid */
+    bool playing;           /* target reached, frames are being played */
+    uint16_t nextSeq;       /* position of the next frame to play */
+    uint16_t newestSeq;     /* latest packet received */
+    uint16_t newestFrames;  /* and the frames it holds */
+    uint32_t lastArrival;
+    uint32_t lastTs;
+    int32_t jitterQ4;       /* RFC 3550 jitter estimate scaled by 16 */
+    uint16_t lateBoost;     /* frames of delay added by late packets */
+    uint16_t lossBoost;     /* delay to wait for the FEC of a loss, a packet */
+    uint16_t grow;          /* frames to stretch to reach the target */
+    uint16_t calm;
+    uint16_t lossCalm;
+    uint16_t deep;
+    uint16_t conceal;
+    tJitterSlot *cur;       /* packet being played, NULL between packets */
+    uint16_t staged;        /* frames of the last Opus frame still to play */
+    uint16_t stagePos;      /* and the next one of them */
+    opus_int16 stage[JB_STAGE_SAMPLES];
+    tJitterStats stats;
+}tJitterBuf;
+
+extern int JitterBuf_Init(tJitterBuf *jb, OpusDecoder *dec, int channels,
+                          int frameSize, uint32_t tsPerFrame);
+extern int JitterBuf_Put(tJitterBuf *jb, uint16_t seq, uint32_t ts,
+                         const unsigned char *data, int len, uint32_t arrival);
+extern int JitterBuf_Get(tJitterBuf *jb, opus_int16 *pcm);
+extern void JitterBuf_GetStats(tJitterBuf *jb, tJitterStats *stats);
+
+#endif
@@ -34,6 +34,8 @@
 #include "unistd.h"
 #include "audio_send.h"
 #include "audio_receive.h"
+#include "audio_packet.h"
+#include "i2s_if.h"
 
 #define P2P_DEVICE_TYPE  "1-0050F204-1"
 #define P2P_DEVICE_CL_NAME "P2P-CL"
@@ -71,7 +73,7 @@ long CreateUdpServer(tUDPSocket *pSock)
         Report("sl socket create udp id failed.\r\n");
     }
     pSock->Server.sin_family = SL_AF_INET;
-    pSock->Server.sin_port = sl_Htons(5050);
+    pSock->Server.sin_port = sl_Htons(AUDIO_UDP_PORT);
     pSock->Server.sin_addr.s_addr = SL_INADDR_ANY;
     pSock->iServerLength = sizeof(pSock->Server);
     Status = sl_Bind(pSock->iSockDesc, ( SlSockAddr_t *)&pSock->Server, pSock->iServerLength);
@@ -83,7 +85,7 @@ long CreateUdpServer(tUDPSocket *pSock)
 
     pSock->Client.sin_family = SL_AF_INET;
     pSock->Client.sin_addr.s_addr = sl_Htonl(SL_IPV4_VAL(0,0,0,0));
-    pSock->Client.sin_port = sl_Htons(5050);
+    pSock->Client.sin_port = sl_Htons(AUDIO_UDP_PORT);
     pSock->iClientLength = sizeof(pSock->Client);
 
     Report("udp server create. iSockDesc = %d, port = %d, s_addr = %x\r\n",
@@ -113,7 +115,7 @@ long CreateUdpClient(tUDPSocket *pSock)
     pSock->Client.sin_family = SL_AF_INET;
     //pSock->Client.sin_addr.s_addr = sl_Htonl(SL_IPV4_VAL(10,123,45,1));
     pSock->Client.sin_addr.s_addr = sl_Htonl(ipV4.IpGateway);
-    pSock->Client.sin_port = sl_Htons((_u16)5050);
+    pSock->Client.sin_port = sl_Htons((_u16)AUDIO_UDP_PORT);
     pSock->iClientLength = sizeof(SlSockAddrIn_t);
 
     Report("udp client created. iSockDesc = %d, port = %d, s_addr = %x\r\n",
@@ -752,30 +754,33 @@ void* p2p_task(void *pvParameters)
         // create udp client
         CreateUdpClient(&g_udpSocket);
     }
-//    else if(P2P_GROUP_OWNER_ENABLE==g_p2pWorkMode)
-//    {
-//        Report("waiting to LEASED the ip\r\n");
-//        while(!(IS_CONNECTED(g_ulStatus)) || !IS_IP_LEASED(g_ulStatus))
-//        {
-//            usleep(100);
-//            if(IS_CONNECT_FAILED(g_ulStatus))
-//            {
-//                // Error, connection is failed
-//                Report("p2p connect failed.\r\n");
-//                while(1);
-//            }
-//        }
-//        //Cread UDP Socket and Bind to Local IP Address
-//        CreateUdpServer(&g_udpSocket);
-//    }
-//    if(P2P_GROUP_CLIENT_ENABLE==g_p2pWorkMode)
+    else if(P2P_GROUP_OWNER_ENABLE==g_p2pWorkMode)
+    {
+        Report("waiting to LEASED the ip\r\n");
+        while(!(IS_CONNECTED(g_ulStatus)) || !IS_IP_LEASED(g_ulStatus))
+        {
+            usleep(100);
+            if(IS_CONNECT_FAILED(g_ulStatus))
+            {
+                // Error, connection is failed
+                Report("p2p connect failed.\r\n");
+                while(1);
+            }
+        }
+        //Cread UDP Socket and Bind to Local IP Address
+        CreateUdpServer(&g_udpSocket);
+    }
+
+    // the client sends the microphone, the group owner plays what it receives
+    g_playBack = false;
+    if(P2P_GROUP_CLIENT_ENABLE==g_p2pWorkMode)
     {
        Audio_Send_Init();
     }
-//    else if(P2P_GROUP_OWNER_ENABLE==g_p2pWorkMode)
-//    {
-//       Audio_Receive_Init();
-//    }
+    else if(P2P_GROUP_OWNER_ENABLE==g_p2pWorkMode)
+    {
+       Audio_Receive_Init();
+    }
     Report("p2p_task pthread_exit.\r\n");
     //Delete the Networking Task as Service Discovery is not needed
     pthread_exit(0);
@@ -0,0 +1,70 @@
+//*****************************************************************************
+// pkt_queue.c
+//
+//*****************************************************************************
+#include <string.h>
+#include "pkt_queue.h"
+
+/* Makes the writes to a slot visible before the index that hands it over.
+   The CC3220 has a single core, where this only has to stop the compiler
+   moving the writes */
+#if defined(__GNUC__)
+#define PKTQ_BARRIER()      __sync_synchronize()
+#else
+#define PKTQ_BARRIER()      __asm(" dmb")
+#endif
+
+int PktQueue_Init(tPktQueue *q)
+{
+    memset(q, 0, sizeof(*q));
+    return sem_init(&q->ready, 0, 0);
+}
+
+//*****************************************************************************
+//
+// Producer side.  Returns the slot to write the next packet into, or NULL if
+// the queue is full.  The packet is only seen by the consumer once
+// PktQueue_Commit() is called.
+//
+//*****************************************************************************
+tPktQueueSlot *PktQueue_Reserve(tPktQueue *q)
+{
+    if(q->head - q->tail >= PKTQ_SLOTS)
+    {
+        return NULL;
+    }
+    return &q->slot[q->head & (PKTQ_SLOTS - 1)];
+}
+
+void PktQueue_Commit(tPktQueue *q)
+{
+    PKTQ_BARRIER();
+    q->head++;
+    sem_post(&q->ready);
+}
+
+//*****************************************************************************
+//
+// Consumer side.  Waits for the oldest packet, which stays in its slot until
+// PktQueue_Release() is called.
+//
+//*****************************************************************************
+tPktQueueSlot *PktQueue_Wait(tPktQueue *q)
+{
+    while(sem_wait(&q->ready) != 0)
+    {
+    }
+    PKTQ_BARRIER();
+    return &q->slot[q->tail & (PKTQ_SLOTS - 1)];
+}
+
+void PktQueue_Release(tPktQueue *q)
+{
+    PKTQ_BARRIER();
+    q->tail++;
+}
+
+uint32_t PktQueue_Depth(tPktQueue *q)
+{
+    return q->head - q->tail;
+}
@@ -0,0 +1,47 @@
+//*****************************************************************************
+// pkt_queue.h
+//
+// Single producer, single consumer queue of packets between two threads.
+// The producer writes a packet straight into a free slot and publishes it,
+// the consumer reads it in place and frees the slot, and neither ever waits
+// on the other's lock: there is none.  A semaphore only wakes the consumer.
+// When the queue is full the producer is told so and goes on, so a slow
+// consumer never holds it up.
+//
+//*****************************************************************************
+#ifndef _PKT_QUEUE_H_
+#define _PKT_QUEUE_H_
+
+#include <stdint.h>
+#include <semaphore.h>
+
+/* Packets the queue holds, a power of two */
+#define PKTQ_SLOTS          (8)
+/* Largest packet a slot holds */
+#define PKTQ_MAX_DATA       (408)
+
+typedef struct PktQueueSlot
+{
+    uint16_t len;
+    uint32_t time;          /* when it was queued, for the producer's use */
+    void *ctx;              /* passed along with the packet */
+    unsigned char data[PKTQ_MAX_DATA];
+}tPktQueueSlot;
+
+typedef struct PktQueue
+{
+    /* Slots written and slots read, each only moved by one side */
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    sem_t ready;
+    tPktQueueSlot slot[PKTQ_SLOTS];
+}tPktQueue;
+
+extern int PktQueue_Init(tPktQueue *q);
+extern tPktQueueSlot *PktQueue_Reserve(tPktQueue *q);
+extern void PktQueue_Commit(tPktQueue *q);
+extern tPktQueueSlot *PktQueue_Wait(tPktQueue *q);
+extern void PktQueue_Release(tPktQueue *q);
+extern uint32_t PktQueue_Depth(tPktQueue *q);
+
+#endif
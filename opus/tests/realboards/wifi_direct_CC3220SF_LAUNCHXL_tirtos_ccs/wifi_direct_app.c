@@ -334,8 +334,11 @@ void* mainThread(void * args)
        g_p2pWorkMode = P2P_GROUP_OWNER_ENABLE;
        Report("P2P_GROUP_OWNER_ENABLE \n\r");
     }
+#if AUDIO_LOOPBACK
     Audio_Send_Init();
-   // p2p_init();
+#else
+    p2p_init();
+#endif
 
     pthread_exit(0);
 
@@ -31,6 +31,7 @@
 #include "opus_types.h"
 #include "opus_private.h"
 #include "opus_multistream.h"
+#include "SigProc_FIX.h"
 #include "inc/hw_ints.h"
 #include "inc/hw_memmap.h"
 #include "inc/hw_types.h"
@@ -51,6 +52,12 @@
 #include "utils/ustdlib.h"
 #include "fatfs/src/ff.h"
 #include "fatfs/src/diskio.h"
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
+#include "opxcode/opxfile.h"
+#include "opxcode/oggfile.h"
+#include "opxcode/oggcrc.h"
+#include "opxcode/upsample.h"
 #include "opxcode/pinout.h"
 #include "tm4c_opus.h"
 
@@ -128,6 +135,21 @@ static FILINFO g_sFileInfo;
 static FIL g_sFileReadObject;
 static FIL g_sFileWriteObject;
 
+//*****************************************************************************
+//
+// The .opx file being written by the encode command or read by the decode
+// command.
+//
+//*****************************************************************************
+static tOpxFile g_sOpxFile;
+
+//*****************************************************************************
+//
+// The .ogg file being written by the encode command.
+//
+//*****************************************************************************
+static tOggFile g_sOggFile;
+
 //*****************************************************************************
 //
 // A structure that holds a mapping between an FRESULT numerical code, and a
@@ -618,11 +640,49 @@ Cmd_del(int argc, char *argv[])
     return(0);
 }
 
+//*****************************************************************************
+//
+// Write a packet to the file being created by the encode command.  The packet
+// starts OPX_RECORD_HEADER_SIZE bytes into pui8Record, leaving room for the
+// .opx record header.
+//
+//*****************************************************************************
+static int
+EncodeWrite(bool bOgg, uint8_t *pui8Record, int32_t i32Len,
+            uint32_t ui32Samples, bool bLast)
+{
+    if(bOgg)
+    {
+        return(OggWrite(&g_sOggFile, pui8Record + OPX_RECORD_HEADER_SIZE,
+                        i32Len, ui32Samples, bLast));
+    }
+
+    return(OpxWrite(&g_sOpxFile, pui8Record, i32Len, ui32Samples, bLast));
+}
+
+//*****************************************************************************
+//
+// Finish and close the file being created by the encode command.  Returns
+// non-zero if the end of the file could not be written.
+//
+//*****************************************************************************
+static int
+EncodeClose(bool bOgg)
+{
+    if(bOgg)
+    {
+        return(OggClose(&g_sOggFile));
+    }
+
+    return(OpxClose(&g_sOpxFile));
+}
+
 //*****************************************************************************
 //
 // This function implements the "enc" command. It is provided with 2 parameters
 // The first parameter is an input wav file and the second parameter is the
-// output opx file compressed with OPUS.
+// output file compressed with OPUS.  The output is an Ogg Opus file if its
+// name ends in .ogg or .opus, and an opx file otherwise.
 //
 //*****************************************************************************
 int
@@ -632,19 +692,26 @@ Cmd_encode(int argc, char *argv[])
     FRESULT  iFWrResult;
     uint8_t  *pui8data;
     uint8_t  ui8ScaleFactor;
-    char     cOpxDelimiter[4];
     char     *pcRdBuf;
     uint32_t ui32BytesRead;
-    uint32_t ui32BytesWrite;
     uint32_t ui32Sizeofpopi16fmtBuffer;
     uint32_t ui32Loop;
     uint32_t ui32EncodedLen=0;
     uint32_t ui32RawLen=0;
     uint32_t ui32SizeOfRdBuf;
+    uint32_t ui32FrameSamples;
+    uint32_t ui32Samples;
+    uint32_t ui32NameLen;
     int32_t  i32error;
     int32_t  i32len;
+    int32_t  i32Lookahead;
+    bool     bOgg;
+    bool     bLast;
+    bool     bFlush;
 
     tWaveHeader sWaveHeader;
+    tOpxHeader sOpxHeader;
+    tOpusHeadContainer sOpusHead;
     opus_int16 *popi16fmtBuffer;
 
     //
@@ -753,21 +820,6 @@ Cmd_encode(int argc, char *argv[])
     //
     strcat(g_pcTmpBuf, argv[2]);
 
-    //
-    // Open the file for writing.
-    //
-    iFWrResult = f_open(&g_sFileWriteObject, g_pcTmpBuf,
-            (FA_WRITE | FA_CREATE_NEW));
-
-    //
-    // If there was some problem opening the file, then return an error.
-    //
-    if(iFWrResult != FR_OK)
-    {
-        f_close(&g_sFileReadObject);
-        return((int)iFWrResult);
-    }
-
     //
     // Create the encoder
     //
@@ -783,7 +835,6 @@ Cmd_encode(int argc, char *argv[])
        UARTprintf("ENC_ERR: Cannot create encoder: %s\n",
                opus_strerror(i32error));
        f_close(&g_sFileReadObject);
-       f_close(&g_sFileWriteObject);
        return(0);
     }
     else
@@ -811,6 +862,60 @@ Cmd_encode(int argc, char *argv[])
     opus_encoder_ctl(sOpusEnc, OPUS_SET_EXPERT_FRAME_DURATION(
             OPUS_FRAMESIZE_ARG));
     opus_encoder_ctl(sOpusEnc, OPUS_SET_FORCE_MODE(MODE_CELT_ONLY));
+    opus_encoder_ctl(sOpusEnc, OPUS_GET_LOOKAHEAD(&i32Lookahead));
+
+    ui32FrameSamples = (sWaveHeader.ui32SampleRate*OPUS_FRAME_SIZE_IN_MS)/1000;
+
+    //
+    // Write an Ogg Opus file if the output file is named as one.
+    //
+    ui32NameLen = strlen(g_pcTmpBuf);
+    bOgg = (((ui32NameLen > 4) &&
+             (ustrncasecmp(g_pcTmpBuf + ui32NameLen - 4, ".ogg", 4) == 0)) ||
+            ((ui32NameLen > 5) &&
+             (ustrncasecmp(g_pcTmpBuf + ui32NameLen - 5, ".opus", 5) == 0)));
+
+    if(bOgg)
+    {
+        //
+        // Create the ogg file.  The decoder skips the lookahead of the
+        // encoder, given in 48 kHz samples, at the start of the stream.
+        //
+        sOpusHead.ui8OpusChannelCount = sWaveHeader.ui16NumChannels;
+        sOpusHead.ui16OpusPreSkipBytes = ((i32Lookahead * 48000) /
+                                          sWaveHeader.ui32SampleRate);
+        sOpusHead.ui32OpusInputSampleRate = sWaveHeader.ui32SampleRate;
+        sOpusHead.ui16OpusOutputGain = 0;
+        iFWrResult = (FRESULT)OggCreate(g_pcTmpBuf, &g_sOggFile, &sOpusHead,
+                                        opus_get_version_string());
+    }
+    else
+    {
+        //
+        // Create the opx file.  The header is completed with the frame count
+        // and seek table when the file is closed.
+        //
+        sOpxHeader.ui16NumChannels = sWaveHeader.ui16NumChannels;
+        sOpxHeader.ui16BitsPerSample = sWaveHeader.ui16BitsPerSample;
+        sOpxHeader.ui32SampleRate = sWaveHeader.ui32SampleRate;
+        sOpxHeader.ui32OrigFileSize = sWaveHeader.ui32SubChunk2Size;
+        sOpxHeader.ui16FrameSamples = ui32FrameSamples;
+        iFWrResult = (FRESULT)OpxCreate(g_pcTmpBuf, &g_sOpxFile, &sOpxHeader);
+    }
+
+    //
+    // If there was some problem opening the file, then return an error.
+    //
+    if(iFWrResult != FR_OK)
+    {
+        if(bOgg)
+        {
+            OggClose(&g_sOggFile);
+        }
+        f_close(&g_sFileReadObject);
+        opus_encoder_destroy(sOpusEnc);
+        return((int)iFWrResult);
+    }
 
     //
     // Dynamic allocation of memory for the sd card read buffer, output from
@@ -818,7 +923,8 @@ Cmd_encode(int argc, char *argv[])
     //
     ui8ScaleFactor = (sWaveHeader.ui16BitsPerSample) >> 3;
 
-    pui8data = (uint8_t *)calloc(OPUS_MAX_PACKET,sizeof(uint8_t));
+    pui8data = (uint8_t *)calloc(OPUS_MAX_PACKET+OPX_RECORD_HEADER_SIZE,
+            sizeof(uint8_t));
     pcRdBuf = (char *)calloc((((sWaveHeader.ui32SampleRate*
             OPUS_FRAME_SIZE_IN_MS*
             sWaveHeader.ui16NumChannels*
@@ -838,21 +944,6 @@ Cmd_encode(int argc, char *argv[])
             sWaveHeader.ui16NumChannels*
             sizeof(opus_int16))/1000;
 
-    //
-    // Create the opx file header
-    //
-    strcpy(cOpxDelimiter, "HDR\0");
-    iFWrResult = f_write(&g_sFileWriteObject, &cOpxDelimiter[0],
-            4, (UINT *)&ui32BytesWrite);
-    iFWrResult = f_write(&g_sFileWriteObject, &sWaveHeader.ui16NumChannels,
-            2, (UINT *)&ui32BytesWrite);
-    iFWrResult = f_write(&g_sFileWriteObject, &sWaveHeader.ui16BitsPerSample,
-            2, (UINT *)&ui32BytesWrite);
-    iFWrResult = f_write(&g_sFileWriteObject, &sWaveHeader.ui32SampleRate,
-            4, (UINT *)&ui32BytesWrite);
-    iFWrResult = f_write(&g_sFileWriteObject, &sWaveHeader.ui32SubChunk2Size,
-            4, (UINT *)&ui32BytesWrite);
-
     //
     // Enter a loop to repeatedly read the wav data from the file, encode it
     // and then store it in the sd card.
@@ -866,6 +957,16 @@ Cmd_encode(int argc, char *argv[])
         iFRdResult = f_read(&g_sFileReadObject, pcRdBuf, ui32SizeOfRdBuf,
                           (UINT *)&ui32BytesRead);
 
+        //
+        // The last frame is short of a full frame of wav data, so pad it out
+        // with silence.
+        //
+        bLast = (ui32BytesRead != ui32SizeOfRdBuf);
+        if(bLast)
+        {
+            memset(popi16fmtBuffer, 0, ui32Sizeofpopi16fmtBuffer);
+        }
+
         //
         // Process the data as per the scale factor. A scale factor of 1 is
         // applied when the data is 8 bit and a scale factor of 2 is applied
@@ -897,7 +998,7 @@ Cmd_encode(int argc, char *argv[])
             free(pcRdBuf);
             free(popi16fmtBuffer);
             f_close(&g_sFileReadObject);
-            f_close(&g_sFileWriteObject);
+            EncodeClose(bOgg);
             opus_encoder_destroy(sOpusEnc);
             return((int)iFRdResult);
         }
@@ -908,34 +1009,58 @@ Cmd_encode(int argc, char *argv[])
         i32len = opus_encode(sOpusEnc,
                 popi16fmtBuffer,
                 (ui32Sizeofpopi16fmtBuffer/2),
-                pui8data,
+                pui8data+OPX_RECORD_HEADER_SIZE,
                 OPUS_MAX_PACKET);
 
         //
-        // If this is not the last packet then add the 'Mid ' as delimiter
-        // else add 'End ' as the delimiter which will be used during the
-        // decompression process.
+        // The encoder delays the audio by its lookahead.  If the end of the
+        // audio is not in the last packet of an ogg file then a packet of
+        // silence is added after it to carry the rest.
         //
-        if(ui32BytesRead == ui32SizeOfRdBuf)
+        ui32Samples = ui32BytesRead/(sWaveHeader.ui16NumChannels*
+                                     ui8ScaleFactor);
+        bFlush = (bOgg && bLast &&
+                  ((ui32FrameSamples - ui32Samples) < (uint32_t)i32Lookahead));
+
+        //
+        // Store the compressed data as one record.
+        //
+        if((i32len < 0) ||
+           (EncodeWrite(bOgg, pui8data, i32len, ui32Samples,
+                        bLast && !bFlush) != 0))
         {
-            strcpy(cOpxDelimiter, "Mid\0");
+            UARTprintf("\nENC_ERR: Cannot write packet\n");
+            free(pui8data);
+            free(pcRdBuf);
+            free(popi16fmtBuffer);
+            f_close(&g_sFileReadObject);
+            EncodeClose(bOgg);
+            opus_encoder_destroy(sOpusEnc);
+            return(1);
         }
-        else
+
+        if(bFlush)
         {
-            strcpy(cOpxDelimiter, "End\0");
+            memset(popi16fmtBuffer, 0, ui32Sizeofpopi16fmtBuffer);
+            i32len = opus_encode(sOpusEnc, popi16fmtBuffer,
+                                 (ui32Sizeofpopi16fmtBuffer/2),
+                                 pui8data+OPX_RECORD_HEADER_SIZE,
+                                 OPUS_MAX_PACKET);
+            if((i32len < 0) ||
+               (EncodeWrite(bOgg, pui8data, i32len, 0, true) != 0))
+            {
+                UARTprintf("\nENC_ERR: Cannot write packet\n");
+                free(pui8data);
+                free(pcRdBuf);
+                free(popi16fmtBuffer);
+                f_close(&g_sFileReadObject);
+                EncodeClose(bOgg);
+                opus_encoder_destroy(sOpusEnc);
+                return(1);
+            }
+            ui32EncodedLen += i32len;
         }
 
-        //
-        // Store the compressed data with length of data, followed by the
-        // delimiter and then the actual compressed data
-        //
-        iFWrResult = f_write(&g_sFileWriteObject, &cOpxDelimiter[0], 4,
-                              (UINT *)&ui32BytesWrite);
-        iFWrResult = f_write(&g_sFileWriteObject, &i32len, 4,
-                              (UINT *)&ui32BytesWrite);
-        iFWrResult = f_write(&g_sFileWriteObject, pui8data, i32len,
-                              (UINT *)&ui32BytesWrite);
-
         //
         // Add the length of the wav file and the compressed data for printing
         // the statistics
@@ -968,13 +1093,19 @@ Cmd_encode(int argc, char *argv[])
     // Close Read and Write file
     //
     f_close(&g_sFileReadObject);
-    f_close(&g_sFileWriteObject);
+    iFWrResult = (FRESULT)EncodeClose(bOgg);
 
     //
     // free the memory assigned to the encode
     //
     opus_encoder_destroy(sOpusEnc);
 
+    if(iFWrResult != FR_OK)
+    {
+        UARTprintf("\nENC_ERR: Cannot finish file\n");
+        return(1);
+    }
+
     //
     // Return success.
     //
@@ -1325,6 +1456,432 @@ Cmd_testencode(int argc, char *argv[])
     //
     return(0);
 }
+
+//*****************************************************************************
+//
+// This function implements the "testcrc" command. It measures the speed of
+// the CRC that is used to check and generate the pages of an Ogg file, for
+// blocks the size of a small page, a sector and a full read buffer. There is
+// no file used but only statistics.
+//
+//*****************************************************************************
+int
+Cmd_testcrc(int argc, char *argv[])
+{
+    static const uint32_t pui32Sizes[3] = { 64, 512, OGG_READ_BUF_SIZE };
+    uint8_t  *pui8data;
+    uint32_t ui32Loop;
+    uint32_t ui32Pass;
+    uint32_t ui32Passes;
+    uint32_t ui32Crc;
+    uint32_t ui32Bytes;
+    uint32_t ui32TimeStart;
+    uint32_t ui32TimeElapsed;
+    uint32_t ui32Rate;
+
+    //
+    // Allocate the data and fill it with a pattern.
+    //
+    pui8data = (uint8_t *)malloc(OGG_READ_BUF_SIZE);
+    if(pui8data == NULL)
+    {
+        UARTprintf("CRC_ERR: Cannot allocate buffer\n");
+        return(0);
+    }
+
+    for(ui32Loop = 0; ui32Loop < OGG_READ_BUF_SIZE; ui32Loop++)
+    {
+        pui8data[ui32Loop] = (uint8_t)((ui32Loop * 0x9D) ^ (ui32Loop >> 8));
+    }
+
+    //
+    // The first call builds the CRC tables, so do it outside of the timing.
+    //
+    ui32Crc = OggCrc(0, pui8data, OGG_READ_BUF_SIZE);
+
+    //
+    // Reset the timer and wait for the timer to be ready
+    //
+    SysCtlPeripheralDisable(SYSCTL_PERIPH_TIMER2);
+    SysCtlPeripheralReset(SYSCTL_PERIPH_TIMER2);
+    SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER2);
+
+    while(!(SysCtlPeripheralReady(SYSCTL_PERIPH_TIMER2)))
+    {
+    }
+
+    //
+    // Configure the Statistic timer for 32 bit up count mode, counting system
+    // clock cycles.
+    //
+    TimerConfigure(TIMER2_BASE, TIMER_CFG_ONE_SHOT_UP);
+    TimerLoadSet(TIMER2_BASE, TIMER_A, 0xFFFFFFFF);
+
+    //
+    // Print the header for the CRC performance
+    //
+    UARTprintf("\n\n");
+    UARTprintf("*********************OGG CRC STATISTICS*********************\n\n");
+    UARTprintf("BLOCK SIZE | BYTES   | CYCLES     | CYCLES/BYTE | MB/s\n\n");
+
+    for(ui32Loop = 0; ui32Loop < 3; ui32Loop++)
+    {
+        //
+        // Run the CRC over 1 MB of data in blocks of the given size.
+        //
+        ui32Passes = (1024 * 1024) / pui32Sizes[ui32Loop];
+        ui32Bytes = ui32Passes * pui32Sizes[ui32Loop];
+
+        TimerEnable(TIMER2_BASE, TIMER_A);
+        ui32TimeStart = TimerValueGet(TIMER2_BASE, TIMER_A);
+
+        for(ui32Pass = 0; ui32Pass < ui32Passes; ui32Pass++)
+        {
+            ui32Crc = OggCrc(ui32Crc, pui8data, pui32Sizes[ui32Loop]);
+        }
+
+        TimerDisable(TIMER2_BASE, TIMER_A);
+        ui32TimeElapsed = (TimerValueGet(TIMER2_BASE, TIMER_A) -
+                           ui32TimeStart);
+
+        //
+        // Print the statistics, with the throughput in units of 0.01 MB/s.
+        //
+        ui32Rate = (uint32_t)(((uint64_t)ui32Bytes * g_ui32SysClock * 100) /
+                              ((uint64_t)ui32TimeElapsed * 1024 * 1024));
+        UARTprintf("%04d         ", pui32Sizes[ui32Loop]);
+        UARTprintf("%07d   ", ui32Bytes);
+        UARTprintf("%010d   ", ui32TimeElapsed);
+        UARTprintf("%02d.%03d        ", (ui32TimeElapsed / ui32Bytes),
+                   (((ui32TimeElapsed % ui32Bytes) * 1000) / ui32Bytes));
+        UARTprintf("%03d.%02d\n", (ui32Rate / 100), (ui32Rate % 100));
+    }
+
+    UARTprintf("\nCRC 0x%08x\n", ui32Crc);
+
+    free(pui8data);
+
+    //
+    // Return success.
+    //
+    return(0);
+}
+
+//*****************************************************************************
+//
+// The number of frames of each sample rate that the "testups" command runs
+// through the upsamplers, and the methods that it compares.
+//
+//*****************************************************************************
+#define UPS_TEST_FRAMES       100
+#define UPS_TEST_LOOP         0
+#define UPS_TEST_HOLD         1
+#define UPS_TEST_FIR          2
+#define UPS_TEST_SILK         3
+
+//*****************************************************************************
+//
+// The sums that measure how much of an upsampled 1 kHz tone is something
+// other than the tone.
+//
+//*****************************************************************************
+typedef struct
+{
+    double dSS;
+    double dCC;
+    double dSC;
+    double dSY;
+    double dCY;
+    double dYY;
+}
+tUpsTestSnr;
+
+//*****************************************************************************
+//
+// The conversion that the players used before the upsampler, which converts
+// the samples to 11-bit unsigned format and repeats each of them in place.
+//
+//*****************************************************************************
+static void
+UpsTestLoop(int16_t *pi16Buf, uint32_t ui32Samples, uint8_t ui8ScaleFactor)
+{
+    uint32_t ui32Loop;
+    uint8_t  ui8ScaleFactorLoop;
+
+    for(ui32Loop = ui32Samples ; ui32Loop > 0 ; ui32Loop--)
+    {
+        pi16Buf[ui32Loop-1] ^= 0x8000;
+        pi16Buf[ui32Loop-1] = (pi16Buf[ui32Loop-1] >> 5);
+        pi16Buf[ui32Loop-1] &= 0x7FF;
+        for(ui8ScaleFactorLoop = 0 ;
+                ui8ScaleFactorLoop < ui8ScaleFactor ;
+                ui8ScaleFactorLoop++)
+        {
+            pi16Buf[((ui32Loop-1)*ui8ScaleFactor)+ui8ScaleFactorLoop] =
+                    pi16Buf[(ui32Loop-1)];
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Add a frame of 11-bit output samples to the sums.  The tone is fitted to
+// the output with any phase, so the delay of the filter does not matter.
+//
+//*****************************************************************************
+static void
+UpsTestSnrAdd(tUpsTestSnr *psSnr, const uint16_t *pui16Out,
+              uint32_t ui32Samples, uint32_t ui32Pos)
+{
+    uint32_t ui32Loop;
+    float    fSin;
+    float    fCos;
+    float    fY;
+
+    for(ui32Loop = 0; ui32Loop < ui32Samples; ui32Loop++)
+    {
+        fSin = sinf((2.0f * 3.14159265f / 48.0f) *
+                    ((ui32Pos + ui32Loop) % 48));
+        fCos = cosf((2.0f * 3.14159265f / 48.0f) *
+                    ((ui32Pos + ui32Loop) % 48));
+        fY = (float)pui16Out[ui32Loop] - 1024.0f;
+        psSnr->dSS += fSin * fSin;
+        psSnr->dCC += fCos * fCos;
+        psSnr->dSC += fSin * fCos;
+        psSnr->dSY += fSin * fY;
+        psSnr->dCY += fCos * fY;
+        psSnr->dYY += fY * fY;
+    }
+}
+
+//*****************************************************************************
+//
+// Return the ratio of the tone to everything else in the output, in units of
+// 0.1 dB.
+//
+//*****************************************************************************
+static int32_t
+UpsTestSnr(const tUpsTestSnr *psSnr)
+{
+    double dDet;
+    double dA;
+    double dB;
+    double dTone;
+
+    dDet = (psSnr->dSS * psSnr->dCC) - (psSnr->dSC * psSnr->dSC);
+    dA = ((psSnr->dSY * psSnr->dCC) - (psSnr->dCY * psSnr->dSC)) / dDet;
+    dB = ((psSnr->dCY * psSnr->dSS) - (psSnr->dSY * psSnr->dSC)) / dDet;
+    dTone = (dA * psSnr->dSY) + (dB * psSnr->dCY);
+
+    if(dTone >= psSnr->dYY)
+    {
+        return(999);
+    }
+
+    return((int32_t)(100.0 * log10(dTone / (psSnr->dYY - dTone))));
+}
+
+//*****************************************************************************
+//
+// This function implements the "testups" command. It runs a 1 kHz tone at
+// each sample rate below the playback rate through the conversion that the
+// players used to repeat samples, the upsampler with and without its filter
+// and the SILK resampler, and prints the cycles taken for each 20 ms frame,
+// the share of the CPU that is at playback, and how clean the output is.
+// There is no file used but only statistics.
+//
+//*****************************************************************************
+int
+Cmd_testups(int argc, char *argv[])
+{
+    static const uint32_t pui32Rates[4] = { 24000, 16000, 12000, 8000 };
+    static const char * const ppcMethods[4] = { "LOOP", "HOLD", "FIR ",
+                                                "SILK" };
+    silk_resampler_state_struct sResampler;
+    tUpsampler sUpsampler;
+    tUpsTestSnr sSnr;
+    int16_t  *pi16In;
+    int16_t  *pi16Pcm;
+    uint16_t *pui16Out;
+    uint32_t ui32Rate;
+    uint32_t ui32Method;
+    uint32_t ui32Frame;
+    uint32_t ui32Loop;
+    uint32_t ui32Samples;
+    uint32_t ui32OutSamples;
+    uint32_t ui32TimeStart;
+    uint32_t ui32TimeElapsed;
+    uint32_t ui32Cpu;
+    uint8_t  ui8ScaleFactor;
+    int32_t  i32Snr;
+
+    //
+    // Allocate the input frame, with space in front of it for the
+    // upsampler, and the output frame at the playback rate.
+    //
+    pi16In = (int16_t *)malloc((UPSAMPLE_HISTORY + 960) * sizeof(int16_t));
+    pi16Pcm = (int16_t *)malloc(960 * sizeof(int16_t));
+    if((pi16In == NULL) || (pi16Pcm == NULL))
+    {
+        UARTprintf("UPS_ERR: Cannot allocate buffer\n");
+        free(pi16In);
+        free(pi16Pcm);
+        return(0);
+    }
+    pi16In += UPSAMPLE_HISTORY;
+    pui16Out = (uint16_t *)pi16Pcm;
+
+    //
+    // Reset the timer and wait for the timer to be ready
+    //
+    SysCtlPeripheralDisable(SYSCTL_PERIPH_TIMER2);
+    SysCtlPeripheralReset(SYSCTL_PERIPH_TIMER2);
+    SysCtlPeripheralEnable(SYSCTL_PERIPH_TIMER2);
+
+    while(!(SysCtlPeripheralReady(SYSCTL_PERIPH_TIMER2)))
+    {
+    }
+
+    //
+    // Configure the Statistic timer for 32 bit up count mode, counting system
+    // clock cycles.
+    //
+    TimerConfigure(TIMER2_BASE, TIMER_CFG_ONE_SHOT_UP);
+    TimerLoadSet(TIMER2_BASE, TIMER_A, 0xFFFFFFFF);
+
+    //
+    // Print the header for the upsampler performance
+    //
+    UARTprintf("\n\n");
+    UARTprintf("INPUT STREAM SIZE %d ms, OUTPUT RATE 48000 Hz\n\n",
+               OPUS_FRAME_SIZE_IN_MS);
+    UARTprintf("**********************UPSAMPLER STATISTICS*********************\n\n");
+    UARTprintf("INPUT RATE | METHOD | CYCLES/FRAME | CPU (%%) | SNR (dB)\n\n");
+
+    for(ui32Rate = 0; ui32Rate < 4; ui32Rate++)
+    {
+        ui8ScaleFactor = 48000 / pui32Rates[ui32Rate];
+        ui32Samples = (pui32Rates[ui32Rate] * OPUS_FRAME_SIZE_IN_MS) / 1000;
+
+        for(ui32Method = 0; ui32Method < 4; ui32Method++)
+        {
+            //
+            // The SILK resampler of the decoder only takes rates of up to
+            // 16 kHz.
+            //
+            if(ui32Method == UPS_TEST_SILK)
+            {
+                if((pui32Rates[ui32Rate] > 16000) ||
+                   (silk_resampler_init(&sResampler, pui32Rates[ui32Rate],
+                                        48000, 0) != 0))
+                {
+                    UARTprintf("%05d        %s     n/a\n",
+                               pui32Rates[ui32Rate], ppcMethods[ui32Method]);
+                    continue;
+                }
+            }
+            else
+            {
+                UpsampleInit(&sUpsampler, ui8ScaleFactor,
+                             (ui32Method == UPS_TEST_FIR));
+            }
+
+            memset(&sSnr, 0, sizeof(sSnr));
+            ui32TimeElapsed = 0;
+
+            for(ui32Frame = 0; ui32Frame < UPS_TEST_FRAMES; ui32Frame++)
+            {
+                //
+                // Make the next frame of the tone, which has a whole number
+                // of periods in a frame at each of the rates.
+                //
+                for(ui32Loop = 0; ui32Loop < ui32Samples; ui32Loop++)
+                {
+                    pi16In[ui32Loop] = (int16_t)(16000.0f *
+                            sinf((2.0f * 3.14159265f * 1000.0f * ui32Loop) /
+                                 pui32Rates[ui32Rate]));
+                }
+
+                //
+                // The old conversion works in place on the decoded frame.
+                //
+                if(ui32Method == UPS_TEST_LOOP)
+                {
+                    memcpy(pi16Pcm, pi16In, ui32Samples * sizeof(int16_t));
+                }
+
+                TimerEnable(TIMER2_BASE, TIMER_A);
+                ui32TimeStart = TimerValueGet(TIMER2_BASE, TIMER_A);
+
+                switch(ui32Method)
+                {
+                    case UPS_TEST_LOOP:
+                    {
+                        UpsTestLoop(pi16Pcm, ui32Samples, ui8ScaleFactor);
+                        ui32OutSamples = ui32Samples * ui8ScaleFactor;
+                        break;
+                    }
+                    case UPS_TEST_SILK:
+                    {
+                        silk_resampler(&sResampler, pi16Pcm, pi16In,
+                                       ui32Samples);
+                        ui32OutSamples = ui32Samples * ui8ScaleFactor;
+                        for(ui32Loop = 0; ui32Loop < ui32OutSamples; ui32Loop++)
+                        {
+                            pui16Out[ui32Loop] =
+                                    (uint16_t)(pi16Pcm[ui32Loop] + 32768) >> 5;
+                        }
+                        break;
+                    }
+                    default:
+                    {
+                        ui32OutSamples = UpsampleProcess(&sUpsampler, pi16In,
+                                                         ui32Samples,
+                                                         pui16Out, 5);
+                        break;
+                    }
+                }
+
+                TimerDisable(TIMER2_BASE, TIMER_A);
+                ui32TimeElapsed += (TimerValueGet(TIMER2_BASE, TIMER_A) -
+                                    ui32TimeStart);
+
+                //
+                // Leave out the first frame, while the filters settle.
+                //
+                if(ui32Frame > 0)
+                {
+                    UpsTestSnrAdd(&sSnr, pui16Out, ui32OutSamples,
+                                  ui32Frame * ui32OutSamples);
+                }
+            }
+
+            //
+            // Print the statistics, with the share of the CPU that the method
+            // takes at playback in units of 0.01%.
+            //
+            ui32TimeElapsed /= UPS_TEST_FRAMES;
+            ui32Cpu = (uint32_t)(((uint64_t)ui32TimeElapsed * 1000 * 10000) /
+                                 ((uint64_t)g_ui32SysClock *
+                                  OPUS_FRAME_SIZE_IN_MS));
+            i32Snr = UpsTestSnr(&sSnr);
+            UARTprintf("%05d        %s     ", pui32Rates[ui32Rate],
+                       ppcMethods[ui32Method]);
+            UARTprintf("%07d        ", ui32TimeElapsed);
+            UARTprintf("%02d.%02d     ", (ui32Cpu / 100), (ui32Cpu % 100));
+            UARTprintf("%02d.%d\n", (i32Snr / 10), (i32Snr % 10));
+        }
+        UARTprintf("\n");
+    }
+
+    free(pi16In - UPSAMPLE_HISTORY);
+    free(pi16Pcm);
+
+    //
+    // Return success.
+    //
+    return(0);
+}
 #endif // PERFORMANCE_TEST
 
 //*****************************************************************************
@@ -1337,14 +1894,12 @@ Cmd_testencode(int argc, char *argv[])
 int
 Cmd_decode(int argc, char *argv[])
 {
-    FRESULT  iFRdResult;
     FRESULT  iFWrResult;
     uint8_t  *pcRdBuf;
     uint8_t  ui8ProgressDisplay=0;
-    char     cOpxDelimiter[4];
+    uint16_t ui16Status;
     uint16_t ui32BitsPerSample;
     uint16_t ui32Channel;
-    uint32_t ui32BytesRead;
     uint32_t ui32BytesWrite;
     uint32_t ui32SizeOfOutBuf;
     uint32_t ui32Loop;
@@ -1356,6 +1911,7 @@ Cmd_decode(int argc, char *argv[])
     int32_t  i32len;
     int32_t  i32OutSamples;
     tWaveHeader sWaveHeader;
+    tOpxHeader sOpxHeader;
     opus_int16 *pcop16OutBuf;
 
     //
@@ -1389,16 +1945,14 @@ Cmd_decode(int argc, char *argv[])
     strcat(g_pcTmpBuf, argv[1]);
 
     //
-    // Open the file for reading.
-    //
-    iFRdResult = f_open(&g_sFileReadObject, g_pcTmpBuf, FA_READ);
-
+    // Open the file for reading.  Both the original and version 2 opx files
+    // are handled by the opx file reader.
     //
-    // If there was some problem opening the file, then return an error.
-    //
-    if(iFRdResult != FR_OK)
+    if(OpxOpen(g_pcTmpBuf, &g_sOpxFile) != 0)
     {
-        return((int)iFRdResult);
+        UARTprintf("DEC_ERR: OPX file is invalid\n");
+        OpxClose(&g_sOpxFile);
+        return(0);
     }
 
     //
@@ -1431,39 +1985,20 @@ Cmd_decode(int argc, char *argv[])
     //
     if(iFWrResult != FR_OK)
     {
-        f_close(&g_sFileReadObject);
+        OpxClose(&g_sOpxFile);
         return((int)iFWrResult);
     }
 
     //
-    // Read the opx file for header information
+    // Get the header information of the opx file
     //
-    iFRdResult = f_read(&g_sFileReadObject, &cOpxDelimiter, 4,
-                      (UINT *)&ui32BytesRead);
-    iFRdResult = f_read(&g_sFileReadObject, &ui32Channel, 2,
-                      (UINT *)&ui32BytesRead);
-    iFRdResult = f_read(&g_sFileReadObject, &ui32BitsPerSample, 2,
-                      (UINT *)&ui32BytesRead);
-    iFRdResult = f_read(&g_sFileReadObject, &ui32SamplingRate, 4,
-                      (UINT *)&ui32BytesRead);
-    iFRdResult = f_read(&g_sFileReadObject, &ui32WavFileSize, 4,
-                      (UINT *)&ui32BytesRead);
+    OpxGetFormat(&g_sOpxFile, &sOpxHeader);
+    ui32Channel = sOpxHeader.ui16NumChannels;
+    ui32BitsPerSample = sOpxHeader.ui16BitsPerSample;
+    ui32SamplingRate = sOpxHeader.ui32SampleRate;
+    ui32WavFileSize = sOpxHeader.ui32OrigFileSize;
 
-    //
-    // If the ASCII string 'HDR' is not found then this may not b a valid opx
-    // file and close the file handlers
-    //
-    if(ustrncasecmp(&cOpxDelimiter[0],"HDR",3) != 0)
-    {
-        UARTprintf("DEC_ERR: OPX file is invalid\n");
-        f_close(&g_sFileWriteObject);
-        f_close(&g_sFileReadObject);
-        return(0);
-    }
-    else
-    {
-        UARTprintf("DEC: Original File is %d bytes\n",ui32WavFileSize);
-    }
+    UARTprintf("DEC: Original File is %d bytes\n",ui32WavFileSize);
 
     //
     // Create the WAV file header using information collected during the
@@ -1504,7 +2039,7 @@ Cmd_decode(int argc, char *argv[])
     {
        UARTprintf("DEC_ERR: Cannot create decoder: %s\n", opus_strerror(i32error));
        f_close(&g_sFileWriteObject);
-       f_close(&g_sFileReadObject);
+       OpxClose(&g_sOpxFile);
        return((int)i32error);
     }
     else
@@ -1528,7 +2063,8 @@ Cmd_decode(int argc, char *argv[])
     pcop16OutBuf     = (int16_t*)calloc((
             (ui32SizeOfOutBuf/OPUS_DATA_SCALER)+1),
             sizeof(int16_t));
-    pcRdBuf          = (uint8_t *)calloc(OPUS_MAX_PACKET,sizeof(uint8_t));
+    pcRdBuf          = (uint8_t *)calloc(OPUS_MAX_PACKET+OPX_RECORD_HEADER_SIZE,
+            sizeof(uint8_t));
 
     //
     // Enter a loop to repeatedly read data from the file and display it, until
@@ -1537,24 +2073,15 @@ Cmd_decode(int argc, char *argv[])
     do
     {
         //
-        // Read the delimiter and length first
-        //
-        iFRdResult = f_read(&g_sFileReadObject, &cOpxDelimiter, 4,
-                          (UINT *)&ui32BytesRead);
-        iFRdResult = f_read(&g_sFileReadObject, &i32len, 4,
-                          (UINT *)&ui32BytesRead);
-
+        // Read the next packet from the file.
         //
-        // Read a block of data from the file as specified by the length.
-        //
-        iFRdResult = f_read(&g_sFileReadObject, pcRdBuf, i32len,
-                          (UINT *)&ui32BytesRead);
+        ui16Status = OpxRead(&g_sOpxFile, pcRdBuf, &i32len);
 
         //
         // If there was an error reading, then print a newline and return the
         // error to the user.
         //
-        if(iFRdResult != FR_OK)
+        if(ui16Status == 0)
         {
             UARTprintf("DEC_ERR: File Processing Error\n");
 
@@ -1567,7 +2094,7 @@ Cmd_decode(int argc, char *argv[])
             //
             // Close Write file
             //
-            f_close(&g_sFileReadObject);
+            OpxClose(&g_sOpxFile);
             f_close(&g_sFileWriteObject);
 
             //
@@ -1575,7 +2102,7 @@ Cmd_decode(int argc, char *argv[])
             //
             opus_decoder_destroy(sOpusDec);
 
-            return((int)iFRdResult);
+            return(1);
 
         }
 
@@ -1599,7 +2126,7 @@ Cmd_decode(int argc, char *argv[])
            free(pcop16OutBuf);
            free(pcRdBuf);
 
-           f_close(&g_sFileReadObject);
+           OpxClose(&g_sOpxFile);
            f_close(&g_sFileWriteObject);
 
            opus_decoder_destroy(sOpusDec);
@@ -1667,7 +2194,7 @@ Cmd_decode(int argc, char *argv[])
             UARTprintf(".");
         }
     }
-    while(ustrncasecmp(&cOpxDelimiter[0],"End",3) != 0);
+    while(ui16Status != 2);
 
     UARTprintf("\r");
 
@@ -1700,7 +2227,7 @@ Cmd_decode(int argc, char *argv[])
     //
     // Close Write file
     //
-    f_close(&g_sFileReadObject);
+    OpxClose(&g_sOpxFile);
     f_close(&g_sFileWriteObject);
 
     //
@@ -1784,6 +2311,8 @@ tCmdLineEntry g_psCmdTable[] =
     { "enc",    Cmd_encode, "Encode WAV PCM to Opus" },
 #ifdef PERFORMANCE_TEST
     { "testenc",Cmd_testencode, "Run Test on OPUS Encoder" },
+    { "testcrc",Cmd_testcrc, "Run Test on Ogg page CRC" },
+    { "testups",Cmd_testups, "Run Test on playback upsampling" },
 #endif
     { 0, 0, 0 }
 };
@@ -0,0 +1,792 @@
+//*****************************************************************************
+//
+// opus_encpar.c - A workstation encoder that encodes one long WAV file to an
+// Ogg Opus file on several cores at once.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+//
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+//
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+//
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "opus.h"
+#include "opus_private.h"
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
+#include "opxcode/oggfile.h"
+#include "tm4c_opus.h"
+
+//*****************************************************************************
+//
+// The encoder splits the audio into segments of a few seconds, each a whole
+// number of frames, and hands them out to a pool of threads.  Each thread
+// encodes its segment with an encoder of its own, which first encodes the
+// pre-roll, the audio just before the segment, and throws those packets
+// away.  By the start of the segment the state of the encoder, the energy
+// of the bands that the next frame is predicted from and the signal that it
+// overlaps with, is close to the one that a single encoder would have had
+// there, so the decoder, which sees one stream, hears no join.
+//
+// Every encoder is fed frames on the same grid from the start of the file,
+// so packet n codes the same audio whichever encoder made it, and the one
+// pre-skip of the first encoder holds for the whole stream.  The packets are
+// written out in order as the segments are done, which gives the granule
+// positions of a file that was encoded in one go.
+//
+// The encoder is set up as the enc command of opus_enc_dec sets it up.  With
+// -j 1 and -s 0 the file is encoded in one segment by one encoder, as the enc
+// command would encode it.  How much the joins cost is measured by decoding
+// a file encoded that way and one encoded in segments with -d, and comparing
+// the two with opus_compare, with the serial one as the reference:
+//
+//     opus_encpar -j 1 -s 0 -d serial.sw in.wav serial.opus
+//     opus_encpar -d par.sw in.wav par.opus
+//     opus_compare -s serial.sw par.sw
+//
+// The decoded files are in stereo at 48 kHz, which is what opus_compare
+// expects of its reference.
+//
+//*****************************************************************************
+
+//*****************************************************************************
+//
+// The defaults of the options, the longest segment, and the most threads.
+//
+//*****************************************************************************
+#define ENCPAR_SEGMENT_MS       10000
+#define ENCPAR_PREROLL_MS       1000
+#define ENCPAR_MAX_THREADS      256
+
+//*****************************************************************************
+//
+// A segment of the file and the packets that it was encoded to.  The
+// packets are stored one after the other in pui8Data, with their lengths in
+// pi16Len.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The first frame of the segment and the one after its last.
+    //
+    uint32_t ui32Start;
+    uint32_t ui32End;
+
+    //
+    // The packets, and an error from the encoder, which is 0 if there was
+    // none.
+    //
+    uint8_t *pui8Data;
+    int16_t *pi16Len;
+    int32_t i32Error;
+
+    //
+    // The processor time that it took to encode the segment, including its
+    // pre-roll.
+    //
+    uint64_t ui64EncodeNs;
+
+    //
+    // True once the segment has been encoded.
+    //
+    bool bDone;
+}
+tSegment;
+
+//*****************************************************************************
+//
+// The options of the encoder.
+//
+//*****************************************************************************
+static uint32_t g_ui32Threads;
+static uint32_t g_ui32SegmentMs = ENCPAR_SEGMENT_MS;
+static uint32_t g_ui32PrerollMs = ENCPAR_PREROLL_MS;
+static int32_t g_i32Bitrate;
+static int32_t g_i32Complexity;
+
+//*****************************************************************************
+//
+// The input audio, interleaved, and its format.
+//
+//*****************************************************************************
+static tWaveHeader g_sWaveHeader;
+static int16_t *g_pi16Audio;
+static uint32_t g_ui32Samples;
+static uint32_t g_ui32Channels;
+static uint32_t g_ui32FrameSamples;
+static uint32_t g_ui32Frames;
+static uint32_t g_ui32PrerollFrames;
+
+//*****************************************************************************
+//
+// The segments, the next one to be handed out, and the lock and condition
+// that the threads and the writer share.
+//
+//*****************************************************************************
+static tSegment *g_psSegments;
+static uint32_t g_ui32NumSegments;
+static uint32_t g_ui32NextSegment;
+static pthread_mutex_t g_sLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_sDone = PTHREAD_COND_INITIALIZER;
+
+//*****************************************************************************
+//
+// Returns the time on a clock in nanoseconds.
+//
+//*****************************************************************************
+static uint64_t
+NowNs(clockid_t iClock)
+{
+    struct timespec sTime;
+
+    clock_gettime(iClock, &sTime);
+    return((uint64_t)sTime.tv_sec * 1000000000u + sTime.tv_nsec);
+}
+
+//*****************************************************************************
+//
+// Creates an encoder set up as the enc command of opus_enc_dec sets it up,
+// with the bitrate and complexity of the options.
+//
+//*****************************************************************************
+static OpusEncoder *
+EncoderCreate(void)
+{
+    OpusEncoder *psEnc;
+    int32_t i32Error;
+
+    psEnc = opus_encoder_create(g_sWaveHeader.ui32SampleRate, g_ui32Channels,
+                                OPUS_APPLICATION_AUDIO, &i32Error);
+    if(i32Error != OPUS_OK)
+    {
+        return(0);
+    }
+
+    opus_encoder_ctl(psEnc, OPUS_SET_BITRATE(g_i32Bitrate));
+    opus_encoder_ctl(psEnc, OPUS_SET_BANDWIDTH(OPUS_AUTO));
+    opus_encoder_ctl(psEnc, OPUS_SET_VBR(1));
+    opus_encoder_ctl(psEnc, OPUS_SET_VBR_CONSTRAINT(0));
+    opus_encoder_ctl(psEnc, OPUS_SET_COMPLEXITY(g_i32Complexity));
+    opus_encoder_ctl(psEnc, OPUS_SET_INBAND_FEC(0));
+    opus_encoder_ctl(psEnc, OPUS_SET_FORCE_CHANNELS(OPUS_AUTO));
+    opus_encoder_ctl(psEnc, OPUS_SET_DTX(0));
+    opus_encoder_ctl(psEnc, OPUS_SET_PACKET_LOSS_PERC(0));
+    opus_encoder_ctl(psEnc, OPUS_SET_LSB_DEPTH(16));
+    opus_encoder_ctl(psEnc, OPUS_SET_EXPERT_FRAME_DURATION(
+            OPUS_FRAMESIZE_ARG));
+    opus_encoder_ctl(psEnc, OPUS_SET_FORCE_MODE(MODE_CELT_ONLY));
+
+    return(psEnc);
+}
+
+//*****************************************************************************
+//
+// Encodes a segment with psEnc, after its pre-roll.  The frames past the end
+// of the audio, which carry the lookahead of the encoder out, are silence.
+//
+//*****************************************************************************
+static void
+EncodeSegment(OpusEncoder *psEnc, tSegment *psSeg, int16_t *pi16Pad)
+{
+    const int16_t *pi16In;
+    uint8_t pui8Drop[OPUS_MAX_PACKET];
+    uint8_t *pui8Out;
+    uint32_t ui32Frame;
+    uint32_t ui32Offset;
+    uint32_t ui32Left;
+    uint64_t ui64Start;
+    int32_t i32Len;
+
+    ui64Start = NowNs(CLOCK_THREAD_CPUTIME_ID);
+    opus_encoder_ctl(psEnc, OPUS_RESET_STATE);
+
+    ui32Frame = ((psSeg->ui32Start > g_ui32PrerollFrames) ?
+                 (psSeg->ui32Start - g_ui32PrerollFrames) : 0);
+    pui8Out = psSeg->pui8Data;
+
+    for(; ui32Frame < psSeg->ui32End; ui32Frame++)
+    {
+        ui32Offset = ui32Frame * g_ui32FrameSamples;
+        if(ui32Offset + g_ui32FrameSamples <= g_ui32Samples)
+        {
+            pi16In = g_pi16Audio + (ui32Offset * g_ui32Channels);
+        }
+        else
+        {
+            ui32Left = ((ui32Offset < g_ui32Samples) ?
+                        (g_ui32Samples - ui32Offset) : 0);
+            memset(pi16Pad, 0,
+                   g_ui32FrameSamples * g_ui32Channels * sizeof(int16_t));
+            memcpy(pi16Pad, g_pi16Audio + (ui32Offset * g_ui32Channels),
+                   ui32Left * g_ui32Channels * sizeof(int16_t));
+            pi16In = pi16Pad;
+        }
+
+        //
+        // The packets of the pre-roll are only encoded for the state that
+        // they leave behind.
+        //
+        if(ui32Frame < psSeg->ui32Start)
+        {
+            i32Len = opus_encode(psEnc, pi16In, g_ui32FrameSamples, pui8Drop,
+                                 OPUS_MAX_PACKET);
+        }
+        else
+        {
+            i32Len = opus_encode(psEnc, pi16In, g_ui32FrameSamples, pui8Out,
+                                 OPUS_MAX_PACKET);
+            if(i32Len > 0)
+            {
+                psSeg->pi16Len[ui32Frame - psSeg->ui32Start] = i32Len;
+                pui8Out += i32Len;
+            }
+        }
+
+        if(i32Len <= 0)
+        {
+            psSeg->i32Error = (i32Len < 0) ? i32Len : OPUS_INTERNAL_ERROR;
+            break;
+        }
+    }
+
+    psSeg->ui64EncodeNs = NowNs(CLOCK_THREAD_CPUTIME_ID) - ui64Start;
+}
+
+//*****************************************************************************
+//
+// The threads of the pool, which encode segments until there are none left.
+//
+//*****************************************************************************
+static void *
+EncodeThread(void *pvArg)
+{
+    OpusEncoder *psEnc;
+    tSegment *psSeg;
+    int16_t *pi16Pad;
+    uint32_t ui32Seg;
+
+    //
+    // The segments are shared through the globals, so there is no argument.
+    //
+    (void)pvArg;
+
+    psEnc = EncoderCreate();
+    pi16Pad = malloc(g_ui32FrameSamples * g_ui32Channels * sizeof(int16_t));
+
+    while(1)
+    {
+        pthread_mutex_lock(&g_sLock);
+        ui32Seg = g_ui32NextSegment;
+        if(ui32Seg < g_ui32NumSegments)
+        {
+            g_ui32NextSegment++;
+        }
+        pthread_mutex_unlock(&g_sLock);
+
+        if(ui32Seg >= g_ui32NumSegments)
+        {
+            break;
+        }
+
+        psSeg = &g_psSegments[ui32Seg];
+        psSeg->pui8Data = malloc((size_t)(psSeg->ui32End - psSeg->ui32Start) *
+                                 OPUS_MAX_PACKET);
+        psSeg->pi16Len = malloc((psSeg->ui32End - psSeg->ui32Start) *
+                                sizeof(int16_t));
+        if(!psEnc || !pi16Pad || !psSeg->pui8Data || !psSeg->pi16Len)
+        {
+            psSeg->i32Error = OPUS_ALLOC_FAIL;
+        }
+        else
+        {
+            EncodeSegment(psEnc, psSeg, pi16Pad);
+        }
+
+        pthread_mutex_lock(&g_sLock);
+        psSeg->bDone = true;
+        pthread_cond_broadcast(&g_sDone);
+        pthread_mutex_unlock(&g_sLock);
+    }
+
+    free(pi16Pad);
+    if(psEnc)
+    {
+        opus_encoder_destroy(psEnc);
+    }
+    return(0);
+}
+
+//*****************************************************************************
+//
+// Reads the WAV file into g_pi16Audio.  Only 16 bit linear PCM at the rates
+// that Opus supports is accepted, as by the enc command.
+//
+//*****************************************************************************
+static int
+ReadWave(const char *pcName)
+{
+    FILE *psFile;
+    uint32_t ui32Rate;
+
+    psFile = fopen(pcName, "rb");
+    if(!psFile)
+    {
+        fprintf(stderr, "Cannot open %s\n", pcName);
+        return(-1);
+    }
+
+    if((fread(&g_sWaveHeader, sizeof(g_sWaveHeader), 1, psFile) != 1) ||
+       memcmp(g_sWaveHeader.ui8ChunkID, "RIFF", 4) ||
+       memcmp(g_sWaveHeader.ui8Format, "WAVE", 4) ||
+       memcmp(g_sWaveHeader.ui8SubChunk1ID, "fmt ", 4) ||
+       memcmp(g_sWaveHeader.ui8SubChunk2ID, "data", 4))
+    {
+        fprintf(stderr, "%s is not a valid WAV file\n", pcName);
+        fclose(psFile);
+        return(-1);
+    }
+
+    ui32Rate = g_sWaveHeader.ui32SampleRate;
+    if(((ui32Rate != 8000) && (ui32Rate != 16000) && (ui32Rate != 24000) &&
+        (ui32Rate != 32000) && (ui32Rate != 48000)) ||
+       (g_sWaveHeader.ui16AudioFormat != 0x1) ||
+       (g_sWaveHeader.ui16BitsPerSample != 16) ||
+       (g_sWaveHeader.ui16NumChannels < 1) ||
+       (g_sWaveHeader.ui16NumChannels > 2))
+    {
+        fprintf(stderr, "Only 16 bit mono or stereo PCM at 8k, 16k, 24k, 32k "
+                "or 48k is supported\n");
+        fclose(psFile);
+        return(-1);
+    }
+
+    g_ui32Channels = g_sWaveHeader.ui16NumChannels;
+    g_ui32Samples = g_sWaveHeader.ui32SubChunk2Size / (2 * g_ui32Channels);
+    g_pi16Audio = malloc(((size_t)g_ui32Samples * g_ui32Channels + 1) *
+                         sizeof(int16_t));
+    if(!g_pi16Audio)
+    {
+        fprintf(stderr, "Out of memory\n");
+        fclose(psFile);
+        return(-1);
+    }
+
+    //
+    // A file that was cut short is encoded up to where it ends.
+    //
+    g_ui32Samples = (fread(g_pi16Audio, 2 * g_ui32Channels, g_ui32Samples,
+                           psFile));
+    fclose(psFile);
+
+    return(0);
+}
+
+//*****************************************************************************
+//
+// Decodes the packets of a segment with psDec and writes the audio to
+// psFile, in stereo at 48 kHz, leaving out the pre-skip and the padding after
+// the end.  pui64Skip and pui64Left hold the samples still to be skipped and
+// written.
+//
+//*****************************************************************************
+static void
+DecodeSegment(OpusDecoder *psDec, const tSegment *psSeg, int16_t *pi16Buf,
+              uint64_t *pui64Skip, uint64_t *pui64Left, FILE *psFile)
+{
+    const uint8_t *pui8Packet;
+    uint32_t ui32Frame;
+    uint32_t ui32Skip;
+    int32_t i32Samples;
+
+    pui8Packet = psSeg->pui8Data;
+    for(ui32Frame = 0; ui32Frame < psSeg->ui32End - psSeg->ui32Start;
+        ui32Frame++)
+    {
+        i32Samples = opus_decode(psDec, pui8Packet, psSeg->pi16Len[ui32Frame],
+                                 pi16Buf, OGG_MAX_PACKET_SAMPLES, 0);
+        pui8Packet += psSeg->pi16Len[ui32Frame];
+        if(i32Samples <= 0)
+        {
+            continue;
+        }
+
+        ui32Skip = ((*pui64Skip < (uint64_t)i32Samples) ? *pui64Skip :
+                    (uint64_t)i32Samples);
+        *pui64Skip -= ui32Skip;
+        i32Samples -= ui32Skip;
+        if((uint64_t)i32Samples > *pui64Left)
+        {
+            i32Samples = *pui64Left;
+        }
+        *pui64Left -= i32Samples;
+
+        fwrite(pi16Buf + (ui32Skip * 2), 2 * 2,
+               i32Samples, psFile);
+    }
+}
+
+//*****************************************************************************
+//
+// Prints the options.
+//
+//*****************************************************************************
+static void
+Usage(const char *pcName)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <in.wav> <out.opus>\n"
+            "  -j threads   threads to encode with (default: one per core)\n"
+            "  -s ms        length of a segment, or 0 for one segment "
+            "(default %u)\n"
+            "  -p ms        pre-roll encoded before each segment "
+            "(default %u)\n"
+            "  -b bps       bitrate (default: twice the sample rate)\n"
+            "  -c n         complexity, 0 to 10 (default 0)\n"
+            "  -d file      also decode the output to 16 bit stereo PCM at "
+            "48 kHz,\n"
+            "               for opus_compare\n", pcName, ENCPAR_SEGMENT_MS,
+            ENCPAR_PREROLL_MS);
+}
+
+//*****************************************************************************
+//
+// Encodes the file given on the command line.
+//
+//*****************************************************************************
+int
+main(int argc, char *argv[])
+{
+    static tOggFile sOggFile;
+    tOpusHeadContainer sOpusHead;
+    pthread_t psThreads[ENCPAR_MAX_THREADS];
+    OpusEncoder *psEnc;
+    OpusDecoder *psDec;
+    tSegment *psSeg;
+    const char *pcDecode;
+    const uint8_t *pui8Packet;
+    FILE *psDecode;
+    int16_t *pi16DecodeBuf;
+    uint64_t ui64Start;
+    uint64_t ui64Wall;
+    uint64_t ui64Encode;
+    uint64_t ui64Written;
+    uint64_t ui64Skip;
+    uint64_t ui64Left;
+    uint32_t ui32SegmentFrames;
+    uint32_t ui32Seg;
+    uint32_t ui32Frame;
+    uint32_t ui32Samples;
+    uint32_t ui32Bytes;
+    int32_t i32Lookahead;
+    int32_t i32Error;
+    int iOpt;
+    int iRet;
+
+    g_ui32Threads = sysconf(_SC_NPROCESSORS_ONLN);
+    g_i32Complexity = 0;
+    pcDecode = 0;
+
+    while((iOpt = getopt(argc, argv, "j:s:p:b:c:d:")) != -1)
+    {
+        switch(iOpt)
+        {
+            case 'j':
+            {
+                g_ui32Threads = (uint32_t)atoi(optarg);
+                break;
+            }
+            case 's':
+            {
+                g_ui32SegmentMs = (uint32_t)atoi(optarg);
+                break;
+            }
+            case 'p':
+            {
+                g_ui32PrerollMs = (uint32_t)atoi(optarg);
+                break;
+            }
+            case 'b':
+            {
+                g_i32Bitrate = atoi(optarg);
+                break;
+            }
+            case 'c':
+            {
+                g_i32Complexity = atoi(optarg);
+                break;
+            }
+            case 'd':
+            {
+                pcDecode = optarg;
+                break;
+            }
+            default:
+            {
+                Usage(argv[0]);
+                return(1);
+            }
+        }
+    }
+
+    if((argc - optind != 2) || (g_ui32Threads < 1) ||
+       (g_ui32Threads > ENCPAR_MAX_THREADS) || (g_i32Complexity < 0) ||
+       (g_i32Complexity > 10))
+    {
+        Usage(argv[0]);
+        return(1);
+    }
+
+    if(ReadWave(argv[optind]) != 0)
+    {
+        return(1);
+    }
+
+    //
+    // An encoder is made here for the lookahead, which gives the pre-skip
+    // and the frames needed past the end of the audio to carry it out.
+    //
+    if(g_i32Bitrate == 0)
+    {
+        g_i32Bitrate = g_sWaveHeader.ui32SampleRate * OPUS_BITRATE_SCALER;
+    }
+    psEnc = EncoderCreate();
+    if(!psEnc)
+    {
+        fprintf(stderr, "Cannot create the encoder\n");
+        return(1);
+    }
+    opus_encoder_ctl(psEnc, OPUS_GET_LOOKAHEAD(&i32Lookahead));
+    opus_encoder_destroy(psEnc);
+
+    g_ui32FrameSamples = ((g_sWaveHeader.ui32SampleRate *
+                           OPUS_FRAME_SIZE_IN_MS) / 1000);
+    g_ui32Frames = ((g_ui32Samples + i32Lookahead + g_ui32FrameSamples - 1) /
+                    g_ui32FrameSamples);
+    g_ui32PrerollFrames = ((g_ui32PrerollMs + OPUS_FRAME_SIZE_IN_MS - 1) /
+                           OPUS_FRAME_SIZE_IN_MS);
+    ui32SegmentFrames = g_ui32SegmentMs / OPUS_FRAME_SIZE_IN_MS;
+    if((ui32SegmentFrames == 0) || (ui32SegmentFrames > g_ui32Frames))
+    {
+        ui32SegmentFrames = g_ui32Frames;
+    }
+
+    //
+    // Lay out the segments.  The packets of one can be no longer than
+    // OPUS_MAX_PACKET each.
+    //
+    g_ui32NumSegments = ((g_ui32Frames + ui32SegmentFrames - 1) /
+                         ui32SegmentFrames);
+    g_psSegments = calloc(g_ui32NumSegments, sizeof(tSegment));
+    if(!g_psSegments)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return(1);
+    }
+    for(ui32Seg = 0; ui32Seg < g_ui32NumSegments; ui32Seg++)
+    {
+        psSeg = &g_psSegments[ui32Seg];
+        psSeg->ui32Start = ui32Seg * ui32SegmentFrames;
+        psSeg->ui32End = psSeg->ui32Start + ui32SegmentFrames;
+        if(psSeg->ui32End > g_ui32Frames)
+        {
+            psSeg->ui32End = g_ui32Frames;
+        }
+    }
+
+    if(g_ui32Threads > g_ui32NumSegments)
+    {
+        g_ui32Threads = g_ui32NumSegments;
+    }
+
+    //
+    // Create the file, which must not exist yet.  The decoder skips the
+    // lookahead of the encoder, given in 48 kHz samples, at the start of the
+    // stream.
+    //
+    memset(&sOpusHead, 0, sizeof(sOpusHead));
+    sOpusHead.ui8OpusChannelCount = g_ui32Channels;
+    sOpusHead.ui16OpusPreSkipBytes = ((i32Lookahead * 48000) /
+                                      g_sWaveHeader.ui32SampleRate);
+    sOpusHead.ui32OpusInputSampleRate = g_sWaveHeader.ui32SampleRate;
+    sOpusHead.ui16OpusOutputGain = 0;
+    if(OggCreate(argv[optind + 1], &sOggFile, &sOpusHead,
+                 opus_get_version_string()) != 0)
+    {
+        fprintf(stderr, "Cannot create %s, or it exists\n",
+                argv[optind + 1]);
+        OggClose(&sOggFile);
+        return(1);
+    }
+
+    psDec = 0;
+    psDecode = 0;
+    pi16DecodeBuf = 0;
+    ui64Skip = sOpusHead.ui16OpusPreSkipBytes;
+    ui64Left = (((uint64_t)g_ui32Samples * 48000) /
+                g_sWaveHeader.ui32SampleRate);
+    if(pcDecode)
+    {
+        psDec = opus_decoder_create(48000, 2, &i32Error);
+        psDecode = fopen(pcDecode, "wb");
+        pi16DecodeBuf = malloc(OGG_MAX_PACKET_SAMPLES * 2 * sizeof(int16_t));
+        if(!psDec || !psDecode || !pi16DecodeBuf)
+        {
+            fprintf(stderr, "Cannot decode to %s\n", pcDecode);
+            return(1);
+        }
+    }
+
+    //
+    // Start the pool, then write the segments out in order as they are done.
+    // A segment's packets are allocated when it is taken and freed once it is
+    // written, so only the segments in flight hold memory.
+    //
+    ui64Start = NowNs(CLOCK_MONOTONIC);
+    for(ui32Seg = 0; ui32Seg < g_ui32Threads; ui32Seg++)
+    {
+        if(pthread_create(&psThreads[ui32Seg], 0, EncodeThread, 0) != 0)
+        {
+            fprintf(stderr, "Cannot start thread %u\n", ui32Seg);
+            return(1);
+        }
+    }
+
+    iRet = 0;
+    ui64Encode = 0;
+    ui64Written = 0;
+    ui32Bytes = 0;
+    for(ui32Seg = 0; ui32Seg < g_ui32NumSegments; ui32Seg++)
+    {
+        psSeg = &g_psSegments[ui32Seg];
+
+        pthread_mutex_lock(&g_sLock);
+        while(!psSeg->bDone)
+        {
+            pthread_cond_wait(&g_sDone, &g_sLock);
+        }
+        pthread_mutex_unlock(&g_sLock);
+
+        if(psSeg->i32Error != 0)
+        {
+            fprintf(stderr, "Segment %u failed: %s\n", ui32Seg,
+                    opus_strerror(psSeg->i32Error));
+            iRet = 1;
+            break;
+        }
+        ui64Encode += psSeg->ui64EncodeNs;
+
+        //
+        // Each packet is given the samples of the audio that it holds, so
+        // that the last page trims the padding after the end.
+        //
+        pui8Packet = psSeg->pui8Data;
+        for(ui32Frame = psSeg->ui32Start; ui32Frame < psSeg->ui32End;
+            ui32Frame++)
+        {
+            ui32Samples = g_ui32FrameSamples;
+            if(ui64Written + ui32Samples > g_ui32Samples)
+            {
+                ui32Samples = g_ui32Samples - ui64Written;
+            }
+            ui64Written += ui32Samples;
+
+            if(OggWrite(&sOggFile, pui8Packet,
+                        psSeg->pi16Len[ui32Frame - psSeg->ui32Start],
+                        ui32Samples, (ui32Frame + 1) == g_ui32Frames) != 0)
+            {
+                fprintf(stderr, "Cannot write %s\n", argv[optind + 1]);
+                iRet = 1;
+                break;
+            }
+            ui32Bytes += psSeg->pi16Len[ui32Frame - psSeg->ui32Start];
+            pui8Packet += psSeg->pi16Len[ui32Frame - psSeg->ui32Start];
+        }
+        if(iRet != 0)
+        {
+            break;
+        }
+
+        if(psDec)
+        {
+            DecodeSegment(psDec, psSeg, pi16DecodeBuf, &ui64Skip, &ui64Left,
+                          psDecode);
+        }
+
+        free(psSeg->pui8Data);
+        free(psSeg->pi16Len);
+        psSeg->pui8Data = 0;
+        psSeg->pi16Len = 0;
+    }
+    ui64Wall = NowNs(CLOCK_MONOTONIC) - ui64Start;
+
+    //
+    // On an error the threads are left to the exit.
+    //
+    if(iRet != 0)
+    {
+        return(iRet);
+    }
+    for(ui32Seg = 0; ui32Seg < g_ui32Threads; ui32Seg++)
+    {
+        pthread_join(psThreads[ui32Seg], 0);
+    }
+
+    iRet = OggClose(&sOggFile);
+    if(psDec)
+    {
+        fclose(psDecode);
+        opus_decoder_destroy(psDec);
+        free(pi16DecodeBuf);
+    }
+    if(iRet != 0)
+    {
+        fprintf(stderr, "Cannot finish %s\n", argv[optind + 1]);
+        return(1);
+    }
+
+    //
+    // Print the summary.  The speedup is the processor time that the segments
+    // took to encode, pre-rolls included, over the time that it took to encode
+    // them all.  The cost of the pre-rolls shows as the difference in
+    // processor time to a serial encode.
+    //
+    printf("File            %s (%u Hz, %u channels, %.3f s)\n",
+           argv[optind], g_sWaveHeader.ui32SampleRate, g_ui32Channels,
+           (double)g_ui32Samples / g_sWaveHeader.ui32SampleRate);
+    printf("Segments        %u of %u frames, %u frames pre-roll, "
+           "%u threads\n", g_ui32NumSegments, ui32SegmentFrames,
+           g_ui32PrerollFrames, g_ui32Threads);
+    printf("Output          %s, %u packets, %.1f kbps\n", argv[optind + 1],
+           g_ui32Frames, (ui32Bytes * 8.0 * g_sWaveHeader.ui32SampleRate) /
+           ((double)g_ui32Frames * g_ui32FrameSamples * 1000.0));
+    printf("Time            %.3f s, %.1fx real time\n", ui64Wall / 1e9,
+           ((double)g_ui32Samples / g_sWaveHeader.ui32SampleRate) /
+           (ui64Wall / 1e9));
+    printf("Speedup         %.2fx, %.3f s of processor time\n",
+           (double)ui64Encode / ui64Wall, ui64Encode / 1e9);
+
+    free(g_psSegments);
+    free(g_pi16Audio);
+
+    return(0);
+}
@@ -52,6 +52,11 @@
 #include "utils/ustdlib.h"
 #include "third_party/fatfs/src/ff.h"
 #include "third_party/fatfs/src/diskio.h"
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
+#include "opxcode/bufpool.h"
+#include "opxcode/audioring.h"
+#include "opxcode/upsample.h"
 #include "opxcode/oggfile.h"
 #include "drivers/kentec320x240x16_ssd2119.h"
 #include "drivers/frame.h"
@@ -190,6 +195,25 @@ tOggFile g_sOggFile;
 tOggContainer g_sOggContainer;
 tOpusHeadContainer g_sOpusHeader;
 
+//*****************************************************************************
+//
+// The ring of compressed packets that are read from the file ahead of the
+// decoder.
+//
+//*****************************************************************************
+tPacketRing g_sPacketRing;
+
+//*****************************************************************************
+//
+// The pool that all of the buffers used for playback are taken from.  They
+// are set up once in InitAudio() for each stream, so nothing is allocated
+// from the heap while audio is playing.
+//
+//*****************************************************************************
+static uint64_t g_pui64PoolData[OPUS_PLAYBACK_POOL_SIZE / 8];
+tBufPool g_sBufPool;
+static char g_pcPoolStatus[32];
+
 //*****************************************************************************
 //
 // Widget definitions
@@ -213,6 +237,7 @@ const char *g_ppcDirListStrings[NUM_LIST_STRINGS];
 //*****************************************************************************
 #define MAX_FILENAME_STRING_LEN (4 + 8 + 1 + 3 + 1)
 char g_pcFilenames[NUM_LIST_STRINGS][MAX_FILENAME_STRING_LEN];
+static uint32_t g_ui32NumFilenames;
 
 //*****************************************************************************
 //
@@ -221,8 +246,15 @@ char g_pcFilenames[NUM_LIST_STRINGS][MAX_FILENAME_STRING_LEN];
 //*****************************************************************************
 extern tCanvasWidget g_sOpusInfoBackground;
 
+char g_pcRingStats[32] = "";
+Canvas(g_sOpusInfoRing, &g_sOpusInfoBackground, 0, 0,
+       &g_sKentec320x240x16_SSD2119, BG_MAX_X - 166, BG_MIN_Y + 38, 158, 10,
+       CANVAS_STYLE_FILL | CANVAS_STYLE_TEXT | CANVAS_STYLE_TEXT_RIGHT |
+       CANVAS_STYLE_TEXT_OPAQUE, ClrBlack, ClrWhite, ClrWhite,
+       g_psFontFixed6x8, g_pcRingStats, 0, 0);
+
 char g_pcTime[16] = "";
-Canvas(g_sOpusInfoTime, &g_sOpusInfoBackground, 0, 0,
+Canvas(g_sOpusInfoTime, &g_sOpusInfoBackground, &g_sOpusInfoRing, 0,
        &g_sKentec320x240x16_SSD2119, BG_MAX_X - 166, BG_MIN_Y + 28, 158, 10,
        CANVAS_STYLE_FILL | CANVAS_STYLE_TEXT | CANVAS_STYLE_TEXT_RIGHT |
        CANVAS_STYLE_TEXT_OPAQUE, ClrBlack, ClrWhite, ClrWhite,
@@ -331,18 +363,83 @@ static const char g_pcDirError[] ="Directory Read Error ";
 
 //*****************************************************************************
 //
-// Variable to indicate Ping or Pong Buffer availability
+// The ring of decoded audio buffers that are queued to the output ahead of
+// time, so that the decoder can run several frames ahead of playback.
 //
 //*****************************************************************************
-opus_int16 *g_pcop16PingBuf;
-opus_int16 *g_pcop16PongBuf;
-int32_t  i32PingOutSamples;
-int32_t  i32PongOutSamples;
+tAudioRing g_sAudioRing;
+static tAudioSlot g_psAudioSlots[OPUS_AUDIO_RING_SLOTS];
 uint8_t  g_ui8ScaleFactor;
 uint32_t g_ui32SizeOfOutBuf;
-volatile bool g_bRdPingBufferAvailable;
-volatile bool g_bRdPongBufferAvailable;
-volatile bool g_bPrime;
+
+//*****************************************************************************
+//
+// The upsampler from the rate of the stream to the playback rate, and the
+// buffer that the decoder writes to when the stream is at a lower rate.  The
+// upsampler then writes the output straight into the audio ring.
+//
+//*****************************************************************************
+static tUpsampler g_sUpsampler;
+static int16_t *g_pi16DecodeBuf;
+
+//*****************************************************************************
+//
+// The stream that is set up to be played next by TrackStart(), with its
+// decoder, its format, the number of its samples to play and the number of
+// them that were decoded ahead into the carry buffer.  In playlist mode the
+// next stream has a decoder of its own, so that it can be set up while the
+// current one is still being decoded.  Otherwise the two share one decoder.
+//
+//*****************************************************************************
+static OpusDecoder *g_psOpusDecNext;
+static tOpusHeadContainer g_sOpusHeaderNext;
+static uint32_t g_ui32LeftNext;
+static uint32_t g_ui32CarryNext;
+static int16_t g_i16TrackNext;
+static bool g_bNextReady;
+static int16_t *g_pi16CarryBuf;
+
+//*****************************************************************************
+//
+// The number of samples of the current stream that are still to be played,
+// which ends it at the length given by the granule position of its last
+// page, and the number of them that are waiting in the carry buffer.
+//
+//*****************************************************************************
+static uint32_t g_ui32Left;
+static uint32_t g_ui32Carry;
+
+//*****************************************************************************
+//
+// The files that streams are played from.  The packet ring is read from
+// g_psOggRead, which moves on to the next file of a playlist as soon as the
+// whole of the current one has been read.  g_i16TrackRead is the position of
+// that file in the list, or -1 once no more files are to be played.
+// g_i16TrackPlay is the position of the file being decoded, and
+// g_bTrackChanged is set when the decoder moves on to a new one.
+//
+//*****************************************************************************
+static tOggFile g_sOggFileNext;
+static tOggFile *g_psOggRead;
+static int16_t g_i16TrackRead;
+static int16_t g_i16TrackPlay;
+static bool g_bTrackChanged;
+
+//*****************************************************************************
+//
+// The uDMA control structures of the output channel, which of them hold a
+// buffer from the audio ring, and the one that the uDMA will use next.  The
+// structures are used in turn, so they are always given buffers starting
+// from the next one to keep the buffers in order.
+//
+//*****************************************************************************
+static const uint32_t g_pui32AudioSelect[2] =
+{
+    UDMA_PRI_SELECT,
+    UDMA_ALT_SELECT
+};
+static volatile bool g_pbAudioQueued[2];
+static volatile uint32_t g_ui32AudioNext;
 
 //*****************************************************************************
 //
@@ -360,42 +457,83 @@ uint8_t pui8ControlTable[1024];
 uint8_t pui8ControlTable[1024] __attribute__ ((aligned(1024)));
 #endif
 
+//*****************************************************************************
+//
+// Give the idle uDMA control structures the next buffers from the audio ring
+// and enable the channel.  While playback is paused no more buffers are
+// queued, so the output stops once the queued ones have been played.  This
+// is called from the timer interrupt handler, or with the timer interrupt
+// disabled.
+//
+//*****************************************************************************
+static void
+AudioQueue(void)
+{
+    const tAudioSlot *psSlot;
+    uint32_t ui32Idx;
+    uint32_t ui32Sel;
+
+    for(ui32Idx = 0; ui32Idx < 2; ui32Idx++)
+    {
+        ui32Sel = g_ui32AudioNext ^ ui32Idx;
+
+        if(g_pbAudioQueued[ui32Sel])
+        {
+            continue;
+        }
+
+        if(g_ePlayState == AUDIO_PAUSED)
+        {
+            break;
+        }
+
+        psSlot = AudioRingNext(&g_sAudioRing);
+        if(psSlot == 0)
+        {
+            break;
+        }
+
+        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | g_pui32AudioSelect[ui32Sel],
+                               UDMA_MODE_PINGPONG,
+                               (void *)psSlot->pi16Data,
+                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
+                               psSlot->ui32Samples);
+        g_pbAudioQueued[ui32Sel] = true;
+        uDMAChannelEnable(UDMA_CH8_TIMER5A);
+    }
+}
+
 //*****************************************************************************
 //
 // This is the interrupt handler from the timer when the DMA has completed the
-// transfer of data for Primary or Alternate channel.
+// transfer of data for Primary or Alternate channel.  The buffers that have
+// been played are returned to the audio ring and the idle control structures
+// are given the next ones.
 //
 //*****************************************************************************
 void
 AudioTimerIntHandler(void)
 {
-    uint32_t ui32Mode;
-
     //
     // Clear the Match Interrupt
     //
     TimerIntClear(TIMER_BASE, TIMER_TIMA_DMA);
 
     //
-    // Check if Ping or Pong Buffer is completed
+    // Free the buffers that have been played, in the order that they were
+    // queued.
     //
-    ui32Mode = uDMAChannelModeGet(UDMA_CH8_TIMER5A | UDMA_PRI_SELECT);
-
-    if(ui32Mode == UDMA_MODE_STOP)
+    while(g_pbAudioQueued[g_ui32AudioNext] &&
+          (uDMAChannelModeGet(UDMA_CH8_TIMER5A |
+                              g_pui32AudioSelect[g_ui32AudioNext]) ==
+           UDMA_MODE_STOP))
     {
-        g_bRdPingBufferAvailable = false;
-    }
-
-    //
-    // Check if Ping or Pong Buffer is completed
-    //
-    ui32Mode = uDMAChannelModeGet(UDMA_CH8_TIMER5A | UDMA_ALT_SELECT);
-
-    if(ui32Mode == UDMA_MODE_STOP)
-    {
-        g_bRdPongBufferAvailable = false;
+        g_pbAudioQueued[g_ui32AudioNext] = false;
+        g_ui32AudioNext ^= 1;
+        AudioRingDone(&g_sAudioRing);
     }
 
+    AudioQueue();
 }
 
 //*****************************************************************************
@@ -406,20 +544,46 @@ AudioTimerIntHandler(void)
 int32_t
 InitAudio(void)
 {
+    uint8_t  *pui8PacketData;
+    tPacketDesc *psPacketDesc;
+    int16_t  *pi16AudioData;
+    uint32_t ui32BufSize;
+    uint32_t ui32DecodeSize;
     int32_t  i32error;
 
+    g_ui32BytesPlayed = 0;
+
     //
-    // Initialize the priming variable to true
+    // All of the buffers for the previous stream are free again.
     //
-    g_bPrime = true;
-    g_ui32BytesPlayed = 0;
+    BufPoolReset(&g_sBufPool);
+
+    //
+    // Start with an empty packet ring.
+    //
+    pui8PacketData = BufPoolAlloc(&g_sBufPool, OPUS_PACKET_RING_SIZE);
+    psPacketDesc = BufPoolAlloc(&g_sBufPool,
+                                OPUS_PACKET_RING_DESC * sizeof(tPacketDesc));
+    if((pui8PacketData == 0) || (psPacketDesc == 0))
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    PacketRingInit(&g_sPacketRing, pui8PacketData, OPUS_PACKET_RING_SIZE,
+                   psPacketDesc, OPUS_PACKET_RING_DESC);
 
     //
-    // Create the decoder
+    // Create the decoder in the buffer pool
     //
-    sOpusDec = opus_decoder_create(g_sOpusHeader.ui32OpusInputSampleRate,
-            g_sOpusHeader.ui8OpusChannelCount,
-            &i32error);
+    sOpusDec = BufPoolAlloc(&g_sBufPool,
+            opus_decoder_get_size(g_sOpusHeader.ui8OpusChannelCount));
+    if(sOpusDec == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    i32error = opus_decoder_init(sOpusDec, g_sOpusHeader.ui32OpusInputSampleRate,
+            g_sOpusHeader.ui8OpusChannelCount);
 
     //
     // If there was some problem creating the OPUS decoder, then close the write
@@ -433,6 +597,21 @@ InitAudio(void)
     opus_decoder_ctl(sOpusDec,
             OPUS_SET_LSB_DEPTH(16));
 
+    //
+    // In playlist mode the next stream gets a decoder of its own.  The files
+    // that follow must have the same number of channels as this one.
+    //
+#if OPUS_PLAYLIST
+    g_psOpusDecNext = BufPoolAlloc(&g_sBufPool,
+            opus_decoder_get_size(g_sOpusHeader.ui8OpusChannelCount));
+    if(g_psOpusDecNext == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+#else
+    g_psOpusDecNext = sOpusDec;
+#endif
+
     //
     // Set the scaling factor.
     //
@@ -440,11 +619,84 @@ InitAudio(void)
             OPUS_PLAYBACK_RATE/g_sOpusHeader.ui32OpusInputSampleRate;
 
     //
-    // Get the Size of the Output Buffer and allocate the Ping and Pong Buffer
+    // Get the Size of the Output Buffer and allocate the buffers of the audio
+    // ring
     //
     g_ui32SizeOfOutBuf = (g_sOpusHeader.ui32OpusInputSampleRate *
             g_sOpusHeader.ui8OpusChannelCount*OPUS_FRAME_SIZE_IN_MS *
             OPUS_DATA_SCALER)/1000;
+    ui32BufSize = (((g_ui32SizeOfOutBuf * g_ui8ScaleFactor) /
+                    OPUS_DATA_SCALER) + 1);
+    pi16AudioData = BufPoolAlloc(&g_sBufPool, OPUS_AUDIO_RING_SLOTS *
+                                 ui32BufSize * sizeof(int16_t));
+    if(pi16AudioData == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    AudioRingInit(&g_sAudioRing, g_psAudioSlots, OPUS_AUDIO_RING_SLOTS,
+                  pi16AudioData, ui32BufSize);
+
+    //
+    // Set up the upsampler.  A stream at a lower rate than the playback is
+    // decoded into a separate buffer, with space in front of it for the
+    // samples that the filter keeps from the previous frame.  A stream at the
+    // playback rate is decoded straight into the audio ring.  In playlist mode
+    // the buffer is always needed, at the size for the highest rate that is
+    // upsampled, as the files that follow may be at a lower rate than this
+    // one.
+    //
+    if(!UpsampleInit(&g_sUpsampler, g_ui8ScaleFactor, OPUS_UPSAMPLE_FILTER))
+    {
+        return(OPUS_BAD_ARG);
+    }
+
+#if OPUS_PLAYLIST
+    ui32DecodeSize = (((OPUS_PLAYBACK_RATE / 2) *
+                       g_sOpusHeader.ui8OpusChannelCount *
+                       OPUS_FRAME_SIZE_IN_MS) / 1000);
+#else
+    ui32DecodeSize = ((g_ui8ScaleFactor > 1) ?
+                      (g_ui32SizeOfOutBuf / OPUS_DATA_SCALER) : 0);
+#endif
+
+    g_pi16DecodeBuf = 0;
+    if(ui32DecodeSize != 0)
+    {
+        g_pi16DecodeBuf = BufPoolAlloc(&g_sBufPool,
+                (ui32DecodeSize + UPSAMPLE_HISTORY) * sizeof(int16_t));
+        if(g_pi16DecodeBuf == 0)
+        {
+            return(OPUS_ALLOC_FAIL);
+        }
+        g_pi16DecodeBuf += UPSAMPLE_HISTORY;
+    }
+
+    //
+    // The carry buffer holds the first frame of a stream after its pre-skip,
+    // which is decoded when the stream is set up.  It is sized for the
+    // playback rate, as the frame may be at any rate, and is passed to the
+    // upsampler like the decode buffer.
+    //
+    g_pi16CarryBuf = BufPoolAlloc(&g_sBufPool,
+            ((((OPUS_PLAYBACK_RATE * g_sOpusHeader.ui8OpusChannelCount *
+                OPUS_FRAME_SIZE_IN_MS) / 1000) + UPSAMPLE_HISTORY) *
+             sizeof(int16_t)));
+    if(g_pi16CarryBuf == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+    g_pi16CarryBuf += UPSAMPLE_HISTORY;
+    g_ui32Carry = 0;
+    g_bNextReady = false;
+
+    //
+    // Nothing is queued to the uDMA yet.  The alternate control structure is
+    // selected below, so it is the one that is used first.
+    //
+    g_pbAudioQueued[0] = false;
+    g_pbAudioQueued[1] = false;
+    g_ui32AudioNext = 1;
 
 #if 0
     //
@@ -576,19 +828,17 @@ StopAudio(void)
     ROM_GPIOPinWrite(GPIO_PORTD_BASE, GPIO_PIN_4, 0);
 
     //
-    // Set all flags to false condition
+    // Stop the uDMA channel so that nothing is left queued from this stream.
     //
-    g_bRdPongBufferAvailable = false;
-    g_bRdPongBufferAvailable = false;
-    g_bPrime = false;
+    uDMAChannelDisable(UDMA_CH8_TIMER5A);
 
     //
-    // Free the ping and pong buffers, close the decoder and file handle
+    // Close the file handles, which includes the next file of a playlist if
+    // it has been opened.  The buffers and the decoders stay in the buffer
+    // pool until the next stream is set up.
     //
-    free(g_pcop16PingBuf);
-    free(g_pcop16PongBuf);
-    opus_decoder_destroy(sOpusDec);
     OggClose(&g_sOggFile);
+    OggClose(&g_sOggFileNext);
 
 }
 
@@ -632,9 +882,56 @@ DisplayTime(uint32_t ui32ForceUpdate)
         // Display the updated time on the screen.
         //
         WidgetPaint((tWidget *)&g_sOpusInfoTime);
+
+        //
+        // Show the number of underruns of the audio output, the fewest
+        // buffers that were ready when the output took one, and the longest
+        // time that a buffer took to be filled again after being played.
+        //
+        usprintf(g_pcRingStats, "Underruns %d Fill %d/%d %dms",
+                 g_sAudioRing.ui32Underruns, g_sAudioRing.ui32MinFill,
+                 OPUS_AUDIO_RING_SLOTS,
+                 ((g_sAudioRing.ui32MaxLatency * 1000) / OPUS_PLAYBACK_RATE));
+        WidgetPaint((tWidget *)&g_sOpusInfoRing);
     }
 }
 
+//*****************************************************************************
+//
+// This function sets the format and the length of the stream in
+// g_sOpusHeader to be displayed.
+//
+//*****************************************************************************
+static void
+DisplayFormat(void)
+{
+    //
+    // Print the formatted string so that it can be displayed.
+    //
+    usprintf(g_pcFormat, "%d Hz ", g_sOpusHeader.ui32OpusInputSampleRate);
+
+    //
+    // Concatenate the number of channels.
+    //
+    if(g_sOpusHeader.ui8OpusChannelCount == 1)
+    {
+        strcat(g_pcFormat, "Mono");
+    }
+    else
+    {
+        strcat(g_pcFormat, "Stereo");
+    }
+
+    CanvasTextSet(&g_sOpusInfoSample, g_pcFormat);
+
+    //
+    // Calculate the minutes and seconds in the file.
+    //
+    g_ui16Seconds = g_sOpusHeader.ui32OpusAudioSize[0] / OPUS_PLAYBACK_RATE;
+    g_ui16Minutes = g_ui16Seconds / 60;
+    g_ui16Seconds -= g_ui16Minutes * 60;
+}
+
 //*****************************************************************************
 //
 // This function will handle stopping the play back of audio.  It will not do
@@ -670,7 +967,9 @@ OpusStop(void)
     // Change the play/pause button to say play.
     //
     PushButtonTextSet(&g_sPlayPause, g_pcPlay);
-    CanvasTextSet(&g_sStatusText, " ");
+    usprintf(g_pcPoolStatus, "Buffers used %d of %d bytes",
+             BufPoolHighWater(&g_sBufPool), OPUS_PLAYBACK_POOL_SIZE);
+    CanvasTextSet(&g_sStatusText, g_pcPoolStatus);
     WidgetPaint(WIDGET_ROOT);
 }
 
@@ -828,214 +1127,448 @@ ChangeToDirectory(char *pcDirectory)
 
 //*****************************************************************************
 //
-// Fill the audio buffer with data from the opus file and run the OPUS decoder
-// to decompress the data.
+// Set up the stream of psFile, which has just been opened with the format in
+// psHeader, to be played next.  The decoder for the next stream is reset for
+// its format, and the packets up to the end of the pre-skip given in its
+// OpusHead header are read and decoded.  The audio of the pre-skip is thrown
+// away and the rest of the last of these packets is kept in the carry buffer,
+// so that the stream can go out from its first sample as soon as the decoder
+// switches to it.  i16Track is the position of the file in the list.  Returns
+// false if the stream cannot be decoded.
 //
 //*****************************************************************************
-static uint32_t
-FillAudioBuffer(void)
+static bool
+TrackStart(tOggFile *psFile, tOpusHeadContainer *psHeader, int16_t i16Track)
 {
-    uint8_t  *pcRdBuf;
-    int32_t  i32len;
-    uint8_t  ui8ScaleFactorLoop;
-    uint32_t ui32Loop;
-    uint16_t ui16Ret = 1;
+    const uint8_t *pui8Packet;
+    uint64_t ui64Size;
+    uint32_t ui32Rate;
+    uint32_t ui32Channels;
+    uint32_t ui32Skip;
+    int32_t  i32Len;
+    int32_t  i32OutSamples;
+    int16_t  i16Ret;
+
+    ui32Rate = psHeader->ui32OpusInputSampleRate;
+    ui32Channels = psHeader->ui8OpusChannelCount;
+
+    if(opus_decoder_init(g_psOpusDecNext, ui32Rate, ui32Channels) != OPUS_OK)
+    {
+        return(false);
+    }
+
+    opus_decoder_ctl(g_psOpusDecNext,
+            OPUS_SET_LSB_DEPTH(16));
+
+    g_sOpusHeaderNext = *psHeader;
+    g_i16TrackNext = i16Track;
 
     //
-    // Allocate the buffer to read from sd card and ping-pong buffer for the
-    // uDMA channels. Also this is performed only once for the audio stream.
+    // The pre-skip and the length of the stream are given at 48 kHz.  A
+    // length of zero means that it is not known, so the stream is then
+    // played to the end of the file.
     //
-    if(g_bPrime)
+    ui32Skip = ((psFile->sOpusHeader.ui16OpusPreSkipBytes * ui32Rate) /
+                48000);
+    ui64Size = (((uint64_t)psHeader->ui32OpusAudioSize[1] << 32) |
+                psHeader->ui32OpusAudioSize[0]);
+    g_ui32LeftNext = ((ui64Size != 0) ?
+                      (uint32_t)((ui64Size * ui32Rate) / 48000) : 0xFFFFFFFF);
+    g_ui32CarryNext = 0;
+
+    while(ui32Skip != 0)
+    {
+        i16Ret = OggReadPacket(psFile, &pui8Packet, &i32Len);
+        if((i16Ret == ERR_OGG_PACKET_TOO_LARGE) ||
+           (i16Ret == ERR_OGG_PAGE_LOST))
+        {
+            continue;
+        }
+        if(i16Ret <= 0)
+        {
+            break;
+        }
+
+        i32OutSamples = opus_decode(g_psOpusDecNext,
+                (const unsigned char *)pui8Packet, i32Len, g_pi16CarryBuf,
+                ((ui32Rate * OPUS_FRAME_SIZE_IN_MS) / 1000), 0);
+        if(i32OutSamples > 0)
+        {
+            if((uint32_t)i32OutSamples > ui32Skip)
+            {
+                g_ui32CarryNext = i32OutSamples - ui32Skip;
+                memmove(g_pi16CarryBuf, g_pi16CarryBuf +
+                        (ui32Skip * ui32Channels),
+                        (g_ui32CarryNext * ui32Channels * sizeof(int16_t)));
+                break;
+            }
+
+            ui32Skip -= i32OutSamples;
+        }
+
+        if(i16Ret == 2)
+        {
+            break;
+        }
+    }
+
+    g_bNextReady = true;
+
+    return(true);
+}
+
+//*****************************************************************************
+//
+// Switch the decoder over to the stream that was set up by TrackStart().  The
+// upsampler is only set up again if the sample rate changes, so that the
+// filter runs on from the end of one stream into the next.
+//
+//*****************************************************************************
+static void
+TrackSwitch(void)
+{
+    OpusDecoder *psOpusDec;
+    uint8_t ui8ScaleFactor;
+
+    psOpusDec = sOpusDec;
+    sOpusDec = g_psOpusDecNext;
+    g_psOpusDecNext = psOpusDec;
+
+    g_sOpusHeader = g_sOpusHeaderNext;
+    g_ui32Left = g_ui32LeftNext;
+    g_ui32Carry = g_ui32CarryNext;
+    g_i16TrackPlay = g_i16TrackNext;
+    g_bNextReady = false;
+
+    ui8ScaleFactor = OPUS_PLAYBACK_RATE/g_sOpusHeader.ui32OpusInputSampleRate;
+    if(ui8ScaleFactor != g_ui8ScaleFactor)
     {
-        g_pcop16PingBuf  = (int16_t*)calloc((((g_ui32SizeOfOutBuf *
-                g_ui8ScaleFactor)/OPUS_DATA_SCALER)+1),sizeof(int16_t));
-        g_pcop16PongBuf  = (int16_t*)calloc((((g_ui32SizeOfOutBuf *
-                g_ui8ScaleFactor)/OPUS_DATA_SCALER)+1),sizeof(int16_t));
-        g_bPrime = false;
+        g_ui8ScaleFactor = ui8ScaleFactor;
+        UpsampleInit(&g_sUpsampler, g_ui8ScaleFactor, OPUS_UPSAMPLE_FILTER);
     }
+    g_ui32SizeOfOutBuf = (g_sOpusHeader.ui32OpusInputSampleRate *
+            g_sOpusHeader.ui8OpusChannelCount*OPUS_FRAME_SIZE_IN_MS *
+            OPUS_DATA_SCALER)/1000;
 
-    pcRdBuf          = (uint8_t *)calloc(OPUS_MAX_PACKET,sizeof(uint8_t));
+    //
+    // The time shown starts again for the new stream.
+    //
+    g_ui32BytesPlayed = 0;
+    g_ui32NextUpdate = 0;
+    g_bTrackChanged = true;
+}
+
+//*****************************************************************************
+//
+// In playlist mode, set up the file after the one being read in the list to
+// be played next, once the whole of the current one is in the packet ring.
+// The packet ring is then read from the new file, after an empty packet that
+// marks where its packets start.  Files that are not valid are passed over,
+// and the playlist ends at a file with a different number of channels.
+// Returns true if the packet ring has moved on to the next file.
+//
+//*****************************************************************************
+static bool
+NextTrack(void)
+{
+    tOpusHeadContainer sOpusHeader;
+    tUpsampler sUpsampler;
+    tOggFile *psFile;
+    int16_t i16Track;
 
     //
-    // Check if Ping Buffer has to be filled with the decompressed audio
+    // The stream that was set up last must have been switched to, and its
+    // first frame played from the carry buffer, before the next one can be
+    // set up.  The marker needs a free descriptor.
     //
-    if(g_bRdPingBufferAvailable == false)
+    if(!OPUS_PLAYLIST || (g_i16TrackRead < 0) || g_bNextReady ||
+       (g_ui32Carry != 0) ||
+       (g_sPacketRing.ui32DescCount == g_sPacketRing.ui32NumDesc))
     {
-        //
-        // Read the opus data stream one segment at a time
-        //
-        ui16Ret = OggRead(&g_sOggFile, (uint8_t *)pcRdBuf, &i32len);
+        return(false);
+    }
+
+    psFile = (g_psOggRead == &g_sOggFile) ? &g_sOggFileNext : &g_sOggFile;
 
+    for(i16Track = g_i16TrackRead + 1; (uint32_t)i16Track < g_ui32NumFilenames;
+        i16Track++)
+    {
         //
-        // If there is an error then close the stream
+        // Skip the directories and the ".." entry.
         //
-        if(ui16Ret == 0)
+        if((g_pcFilenames[i16Track][0] == '+') ||
+           (g_pcFilenames[i16Track][0] == '.'))
         {
-            free(g_pcop16PingBuf);
-            free(g_pcop16PongBuf);
-            free(pcRdBuf);
-            opus_decoder_destroy(sOpusDec);
-            return(0);
+            continue;
         }
 
-        //
-        // Decompress the opus stream into raw PCM data for the ping buffer
-        //
-        i32PingOutSamples = opus_decode(sOpusDec,
-                (const unsigned char *)&pcRdBuf[0],
-                i32len,
-                g_pcop16PingBuf,
-                (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER),
-                0);
+        if(OggOpen(g_pcFilenames[i16Track], psFile, &sOpusHeader, true) != 0)
+        {
+            OggClose(psFile);
+            continue;
+        }
 
         //
-        // Process the data for playback rate of 48KHz. 16-bit data is
-        // converted to signed format and upper 5 bits masked. For slower
-        // original sample rate, the buffer is extended by copying the same
-        // sample by a factor or 48KHz divided by the original sample rate
+        // The decoders and the buffers were set up for the number of channels
+        // of the first file, and the rate must be one that can be upsampled.
         //
-        if(g_ui8ScaleFactor == 1)
-        {
-            for(ui32Loop = 0 ; ui32Loop < i32PingOutSamples ; ui32Loop++)
-            {
-                g_pcop16PingBuf[ui32Loop] ^= 0x8000;
-                g_pcop16PingBuf[ui32Loop] = (g_pcop16PingBuf[ui32Loop] >> 5);
-                g_pcop16PingBuf[ui32Loop] &= 0x7FF;
-            }
-        }
-        else
+        if((sOpusHeader.ui8OpusChannelCount !=
+            g_sOpusHeader.ui8OpusChannelCount) ||
+           (sOpusHeader.ui32OpusInputSampleRate == 0) ||
+           !UpsampleInit(&sUpsampler, (OPUS_PLAYBACK_RATE /
+                                       sOpusHeader.ui32OpusInputSampleRate),
+                         OPUS_UPSAMPLE_FILTER) ||
+           !TrackStart(psFile, &sOpusHeader, i16Track))
         {
-            for(ui32Loop = (i32PingOutSamples) ; ui32Loop > 0 ; ui32Loop--)
-            {
-                g_pcop16PingBuf[ui32Loop-1] ^= 0x8000;
-                g_pcop16PingBuf[ui32Loop-1] =
-                        (g_pcop16PingBuf[ui32Loop-1] >> 5);
-                g_pcop16PingBuf[ui32Loop-1] &= 0x7FF;
-                for(ui8ScaleFactorLoop = 0 ;
-                        ui8ScaleFactorLoop < g_ui8ScaleFactor ;
-                        ui8ScaleFactorLoop++)
-                {
-                    g_pcop16PingBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop] =
-                            g_pcop16PingBuf[(ui32Loop-1)];
-                }
-            }
+            OggClose(psFile);
+            break;
         }
 
         //
-        // Initialize the uDMA primary control structure with the source and
-        // destination locations and size of the tarnsfer and then enable the
-        // channel
+        // Go on reading from the new file.
         //
-        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | UDMA_PRI_SELECT,
-                               UDMA_MODE_PINGPONG,
-                               (void *)&g_pcop16PingBuf[0],
-                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
-                               i32PingOutSamples*g_ui8ScaleFactor);
-        uDMAChannelEnable(UDMA_CH8_TIMER5A);
+        OggClose(g_psOggRead);
+        g_psOggRead = psFile;
+        g_i16TrackRead = i16Track;
+        PacketRingPut(&g_sPacketRing, g_sPacketRing.ui32DataWrite, 0,
+                      PKTRING_DESC_NEXT);
+        g_sPacketRing.ui32Flags &= ~PKTRING_FLAG_END;
 
-        //
-        // Set the ping buffer ready flag.
-        //
-        g_bRdPingBufferAvailable = true;
+        return(true);
+    }
 
-        //
-        // Add the number of bytes to played back for time display
-        //
-        g_ui32BytesPlayed += (i32PingOutSamples*g_ui8ScaleFactor);
+    g_i16TrackRead = -1;
+
+    return(false);
+}
 
+//*****************************************************************************
+//
+// Read a batch of packets from the opus file into the packet ring.  Once the
+// whole of the file has been read, the ring goes on to the next file of the
+// playlist if there is one.
+//
+//*****************************************************************************
+static void
+ReadFile(void)
+{
+    if(!(g_sPacketRing.ui32Flags & PKTRING_FLAG_END))
+    {
+        OggReadBatch(g_psOggRead, &g_sPacketRing);
     }
 
-    if(g_bRdPongBufferAvailable == false)
+    if(g_sPacketRing.ui32Flags & PKTRING_FLAG_END)
     {
-        //
-        // Read the opus data stream one segment at a time
-        //
-        ui16Ret = OggRead(&g_sOggFile, (uint8_t *)pcRdBuf, &i32len);
+        NextTrack();
+    }
+}
 
-        //
-        // If there is an error then close the stream
-        //
-        if(ui16Ret == 0)
+//*****************************************************************************
+//
+// Read a batch of packets from the opus file into the packet ring if there is
+// room for at least one more packet of the largest size, or set up the next
+// file of the playlist if the current one has been read.
+//
+//*****************************************************************************
+static void
+ReadPackets(void)
+{
+    uint8_t *pui8Space;
+
+    if((g_sPacketRing.ui32Flags & PKTRING_FLAG_END) ||
+       (PacketRingSpace(&g_sPacketRing, OPUS_MAX_PACKET, &pui8Space) >=
+        OPUS_MAX_PACKET))
+    {
+        ReadFile();
+    }
+}
+
+//*****************************************************************************
+//
+// Get the next packet for the decoder from the packet ring.  The ring is
+// normally filled ahead of time from the main loop, so the file is only read
+// here if the ring has run dry.
+//
+//*****************************************************************************
+static const tPacketDesc *
+GetPacket(void)
+{
+    const tPacketDesc *psPacket;
+
+    psPacket = PacketRingPeek(&g_sPacketRing);
+    if(psPacket == 0)
+    {
+        ReadFile();
+        psPacket = PacketRingPeek(&g_sPacketRing);
+    }
+
+    return(psPacket);
+}
+
+//*****************************************************************************
+//
+// Decode a packet from the packet ring into pi16Buf.  A packet that stands in
+// for a damaged page of the file is not decoded, but concealed by the decoder
+// for the duration of the last packet, so that the gap is filled without
+// decoding garbage.
+//
+//*****************************************************************************
+static int32_t
+DecodePacket(const tPacketDesc *psPacket, int16_t *pi16Buf)
+{
+    opus_int32 i32Samples;
+
+    i32Samples = (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER);
+
+    if(psPacket->ui16Flags & PKTRING_DESC_LOST)
+    {
+        opus_decoder_ctl(sOpusDec,
+                OPUS_GET_LAST_PACKET_DURATION(&i32Samples));
+        if(i32Samples == 0)
         {
-            free(g_pcop16PingBuf);
-            free(g_pcop16PongBuf);
-            free(pcRdBuf);
-            opus_decoder_destroy(sOpusDec);
-            return(0);
+            i32Samples = ((g_sOpusHeader.ui32OpusInputSampleRate *
+                           OPUS_FRAME_SIZE_IN_MS) / 1000);
         }
 
-        //
-        // Decompress the opus stream into raw PCM data for the pong buffer
-        //
-        i32PongOutSamples = opus_decode(sOpusDec,
-                (const unsigned char *)&pcRdBuf[0],
-                i32len,
-                g_pcop16PongBuf,
-                (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER),
-                0);
+        return(opus_decode(sOpusDec, 0, 0, pi16Buf, i32Samples, 0));
+    }
+
+    return(opus_decode(sOpusDec,
+            (const unsigned char *)(g_sPacketRing.pui8Data +
+                                    psPacket->ui32Offset),
+            psPacket->ui16Length,
+            pi16Buf,
+            i32Samples,
+            0));
+}
 
+//*****************************************************************************
+//
+// Fill the free buffers of the audio ring with data from the opus file and run
+// the OPUS decoder to decompress the data.  Each buffer is queued to the
+// output as soon as it is ready.  Returns 2 once the stream has ended and all
+// of its audio has been played.
+//
+//*****************************************************************************
+static uint32_t
+FillAudioBuffer(void)
+{
+    const tPacketDesc *psPacket;
+    tAudioSlot *psSlot;
+    opus_int16 *pcop16Buf;
+    int16_t  *pi16Decode;
+    int32_t  i32OutSamples;
+    uint32_t ui32Samples;
+
+    while(!(g_sAudioRing.ui32Flags & AUDIORING_FLAG_END))
+    {
         //
-        // Process the data for playback rate of 48KHz. 16-bit data is
-        // converted to signed format and upper 5 bits masked. For slower
-        // original sample rate, the buffer is extended by copying the same
-        // sample by a factor or 48KHz divided by the original sample rate
+        // Stop when every buffer is waiting to be played.
         //
-        if(g_ui8ScaleFactor == 1)
+        psSlot = AudioRingFree(&g_sAudioRing);
+        if(psSlot == 0)
         {
-            for(ui32Loop = 0 ; ui32Loop < i32PongOutSamples ; ui32Loop++)
-            {
-                g_pcop16PongBuf[ui32Loop] ^= 0x8000;
-                g_pcop16PongBuf[ui32Loop] = (g_pcop16PongBuf[ui32Loop] >> 5);
-                g_pcop16PongBuf[ui32Loop] &= 0x7FF;
-            }
+            break;
+        }
+        pcop16Buf = psSlot->pi16Data;
+
+        if(g_ui32Carry != 0)
+        {
+            //
+            // A stream starts with the audio after its pre-skip that was
+            // decoded when it was set up.
+            //
+            pi16Decode = g_pi16CarryBuf;
+            i32OutSamples = g_ui32Carry;
+            g_ui32Carry = 0;
         }
         else
         {
-            for(ui32Loop = (i32PongOutSamples) ; ui32Loop > 0 ; ui32Loop--)
+            //
+            // Take the next opus packet from the packet ring.
+            //
+            psPacket = GetPacket();
+
+            //
+            // If there is an error or no more data then end the stream once
+            // the audio in the ring has been played.
+            //
+            if(psPacket == 0)
             {
-                g_pcop16PongBuf[ui32Loop-1] ^= 0x8000;
-                g_pcop16PongBuf[ui32Loop-1] =
-                        (g_pcop16PongBuf[ui32Loop-1] >> 5);
-                g_pcop16PongBuf[ui32Loop-1] &= 0x7FF;
-                for(ui8ScaleFactorLoop = 0 ;
-                        ui8ScaleFactorLoop < g_ui8ScaleFactor ;
-                        ui8ScaleFactorLoop++)
-                {
-                    g_pcop16PongBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop] =
-                            g_pcop16PongBuf[(ui32Loop-1)];
-                }
+                AudioRingEnd(&g_sAudioRing);
+                break;
             }
+
+            //
+            // The packets of the next file of the playlist start after the
+            // marker, so switch to its decoder.  The output goes straight on
+            // from the last sample of this stream to the first of the next.
+            //
+            if(psPacket->ui16Flags & PKTRING_DESC_NEXT)
+            {
+                PacketRingRelease(&g_sPacketRing);
+                TrackSwitch();
+                continue;
+            }
+
+            //
+            // Decompress the opus stream into raw PCM data, either for the
+            // buffer itself or for the upsampler.
+            //
+            pi16Decode = ((g_ui8ScaleFactor > 1) ? g_pi16DecodeBuf :
+                          pcop16Buf);
+            i32OutSamples = DecodePacket(psPacket, pi16Decode);
+            PacketRingRelease(&g_sPacketRing);
         }
 
         //
-        // Initialize the uDMA alternate control structure with the source and
-        // destination locations and size of the tarnsfer and then enable the
-        // channel
+        // Drop the audio after the end of the stream, which is given by the
+        // granule position of its last page.  A packet that could not be
+        // decoded, or that has nothing left to play, leaves the buffer free.
         //
-        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | UDMA_ALT_SELECT,
-                               UDMA_MODE_PINGPONG,
-                               (void *)&g_pcop16PongBuf[0],
-                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
-                               i32PongOutSamples*g_ui8ScaleFactor);
-        uDMAChannelEnable(UDMA_CH8_TIMER5A);
+        if((i32OutSamples > 0) && ((uint32_t)i32OutSamples > g_ui32Left))
+        {
+            i32OutSamples = g_ui32Left;
+        }
+        if(i32OutSamples <= 0)
+        {
+            continue;
+        }
+        g_ui32Left -= i32OutSamples;
 
         //
-        // Set the pong buffer ready flag.
+        // Process the data for playback rate of 48KHz. 16-bit data is
+        // converted to 11-bit unsigned format. For slower
+        // original sample rate, the upsampler interpolates it to 48KHz as it
+        // writes it to the buffer.  The opus-1.1.2 library that this project
+        // links has no opus_decode_ex(), so the conversion is not done by the
+        // decoder.
         //
-        g_bRdPongBufferAvailable = true;
+        ui32Samples = UpsampleProcess(&g_sUpsampler, pi16Decode, i32OutSamples,
+                                      (uint16_t *)pcop16Buf, 5);
+
+        //
+        // Add the buffer to the ring and queue it to the output if the uDMA
+        // has an idle control structure.
+        //
+        AudioRingPut(&g_sAudioRing, ui32Samples);
+        IntDisable(INT_TIMER5A);
+        AudioQueue();
+        IntEnable(INT_TIMER5A);
 
         //
         // Add the number of bytes to played back for time display
         //
-        g_ui32BytesPlayed += (i32PongOutSamples*g_ui8ScaleFactor);
+        g_ui32BytesPlayed += ui32Samples;
     }
 
-    //
-    // Free the sd card buffer
-    //
-    free(pcRdBuf);
+    if((g_sAudioRing.ui32Flags & AUDIORING_FLAG_END) &&
+       AudioRingDrained(&g_sAudioRing))
+    {
+        return(2);
+    }
 
-    return(ui16Ret);
+    return(1);
 }
 
 //*****************************************************************************
@@ -1062,7 +1595,7 @@ PlayPause(tWidget *psWidget)
         // See if this is a valid .opus file that can be opened.
         //
         if(OggOpen(g_pcFilenames[i16Select], &g_sOggFile,
-                &g_sOpusHeader, false) == 0)
+                &g_sOpusHeader, true) == 0)
         {
             //
             // Initialize the OPUS Decoder
@@ -1073,6 +1606,19 @@ PlayPause(tWidget *psWidget)
                 return;
             }
 
+            //
+            // Start with the selected file, which is the first of the
+            // playlist in playlist mode.
+            //
+            g_psOggRead = &g_sOggFile;
+            g_i16TrackRead = i16Select;
+            if(!TrackStart(&g_sOggFile, &g_sOpusHeader, i16Select))
+            {
+                OggClose(&g_sOggFile);
+                return;
+            }
+            TrackSwitch();
+
             //
             // Fill the audio buffer from the file.
             //
@@ -1125,11 +1671,6 @@ PlayPause(tWidget *psWidget)
     }
     else if(g_ePlayState == AUDIO_PAUSED)
     {
-        //
-        // Fill the audio buffer from the file.
-        //
-        FillAudioBuffer();
-
         //
         // Now switching to a play state, so change the button to say paused.
         //
@@ -1138,6 +1679,12 @@ PlayPause(tWidget *psWidget)
         WidgetPaint(WIDGET_ROOT);
 
         g_ePlayState = AUDIO_PLAYING;
+
+        //
+        // Fill the audio buffers from the file, which queues them to the
+        // output again.
+        //
+        FillAudioBuffer();
     }
 }
 
@@ -1160,9 +1707,6 @@ Stop(tWidget *psWidget)
         OggClose(&g_sOggFile);
 
         OpusStop();
-
-        CanvasTextSet(&g_sStatusText, " ");
-        WidgetPaint(WIDGET_ROOT);
     }
 }
 
@@ -1180,9 +1724,13 @@ PopulateFileListBox(bool bRepaint)
     FRESULT iFResult;
 
     //
-    // Empty the list box on the display.
+    // Empty the list box on the display.  A playlist that is playing ends
+    // with the files that have already been set up, as the list no longer
+    // holds the files that follow them.
     //
     ListBoxClear(&g_sDirList);
+    g_ui32NumFilenames = 0;
+    g_i16TrackRead = -1;
 
     //
     // Make sure the list box will be redrawn next time the message queue
@@ -1284,6 +1832,9 @@ PopulateFileListBox(bool bRepaint)
         ui32ItemCount++;
     }
 
+    g_ui32NumFilenames = ((ui32ItemCount < NUM_LIST_STRINGS) ?
+                          ui32ItemCount : NUM_LIST_STRINGS);
+
     //
     // Made it to here, return with no errors.
     //
@@ -1372,34 +1923,7 @@ void OnListBoxChange(tWidget *psWidget, int16_t i16Selected)
             if(OggOpen(g_pcFilenames[i16Sel], &g_sOggFile,
                     &g_sOpusHeader, true) == 0)
             {
-                //
-                // Print the formatted string so that it can be
-                // displayed.
-                //
-                usprintf(g_pcFormat, "%d Hz ",
-                        g_sOpusHeader.ui32OpusInputSampleRate);
-
-                //
-                // Concatenate the number of channels.
-                //
-                if(g_sOpusHeader.ui8OpusChannelCount == 1)
-                {
-                    strcat(g_pcFormat, "Mono");
-                }
-                else
-                {
-                    strcat(g_pcFormat, "Stereo");
-                }
-
-                CanvasTextSet(&g_sOpusInfoSample, g_pcFormat);
-
-                //
-                // Calculate the minutes and seconds in the file.
-                //
-                g_ui16Seconds = g_sOpusHeader.ui32OpusAudioSize[0] /
-                        OPUS_PLAYBACK_RATE;
-                g_ui16Minutes = g_ui16Seconds / 60;
-                g_ui16Seconds -= g_ui16Minutes * 60;
+                DisplayFormat();
 
                 //
                 // Close the file, it will be re-opened on play.
@@ -1588,9 +2112,7 @@ main(void)
     //
     // Not playing anything right now so intiialize all variables.
     //
-    g_bPrime = true;
-    g_bRdPingBufferAvailable = false;
-    g_bRdPongBufferAvailable = false;
+    BufPoolInit(&g_sBufPool, g_pui64PoolData, sizeof(g_pui64PoolData));
     g_ePlayState = AUDIO_NONE;
 
     PopulateFileListBox(true);
@@ -1618,6 +2140,29 @@ main(void)
                 OpusStop();
 
             }
+            else if(AudioRingFree(&g_sAudioRing) == 0)
+            {
+                //
+                // All of the audio buffers are full, so read ahead into the
+                // packet ring now rather than when a buffer is due.
+                //
+                ReadPackets();
+            }
+
+            //
+            // Show the file that is being played once the decoder has moved
+            // on to the next one of the playlist.
+            //
+            if(g_bTrackChanged)
+            {
+                g_bTrackChanged = false;
+                CanvasTextSet(&g_sOpusInfoFileName,
+                              g_pcFilenames[g_i16TrackPlay]);
+                DisplayFormat();
+                DisplayTime(1);
+                WidgetPaint((tWidget *)&g_sOpusInfoFileName);
+                WidgetPaint((tWidget *)&g_sOpusInfoSample);
+            }
 
             //
             // Update the real display time.
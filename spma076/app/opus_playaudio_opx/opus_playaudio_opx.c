@@ -52,6 +52,11 @@
 #include "utils/ustdlib.h"
 #include "third_party/fatfs/src/ff.h"
 #include "third_party/fatfs/src/diskio.h"
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
+#include "opxcode/bufpool.h"
+#include "opxcode/audioring.h"
+#include "opxcode/upsample.h"
 #include "opxcode/opxfile.h"
 #include "drivers/kentec320x240x16_ssd2119.h"
 #include "drivers/frame.h"
@@ -189,6 +194,25 @@ g_ePlayState;
 tOpxFile g_sOpxFile;
 tOpxHeader g_sOpxHeader;
 
+//*****************************************************************************
+//
+// The ring of compressed packets that are read from the file ahead of the
+// decoder.
+//
+//*****************************************************************************
+tPacketRing g_sPacketRing;
+
+//*****************************************************************************
+//
+// The pool that all of the buffers used for playback are taken from.  They
+// are set up once in InitAudio() for each stream, so nothing is allocated
+// from the heap while audio is playing.
+//
+//*****************************************************************************
+static uint64_t g_pui64PoolData[OPUS_PLAYBACK_POOL_SIZE / 8];
+tBufPool g_sBufPool;
+static char g_pcPoolStatus[32];
+
 //*****************************************************************************
 //
 // Widget definitions
@@ -220,8 +244,15 @@ char g_pcFilenames[NUM_LIST_STRINGS][MAX_FILENAME_STRING_LEN];
 //*****************************************************************************
 extern tCanvasWidget g_sOpxInfoBackground;
 
+char g_pcRingStats[32] = "";
+Canvas(g_sOpxInfoRing, &g_sOpxInfoBackground, 0, 0,
+       &g_sKentec320x240x16_SSD2119, BG_MAX_X - 166, BG_MIN_Y + 38, 158, 10,
+       CANVAS_STYLE_FILL | CANVAS_STYLE_TEXT | CANVAS_STYLE_TEXT_RIGHT |
+       CANVAS_STYLE_TEXT_OPAQUE, ClrBlack, ClrWhite, ClrWhite,
+       g_psFontFixed6x8, g_pcRingStats, 0, 0);
+
 char g_pcTime[16] = "";
-Canvas(g_sOpxInfoTime, &g_sOpxInfoBackground, 0, 0,
+Canvas(g_sOpxInfoTime, &g_sOpxInfoBackground, &g_sOpxInfoRing, 0,
        &g_sKentec320x240x16_SSD2119, BG_MAX_X - 166, BG_MIN_Y + 28, 158, 10,
        CANVAS_STYLE_FILL | CANVAS_STYLE_TEXT | CANVAS_STYLE_TEXT_RIGHT |
        CANVAS_STYLE_TEXT_OPAQUE, ClrBlack, ClrWhite, ClrWhite,
@@ -330,18 +361,40 @@ static const char g_pcDirError[] ="Directory Read Error ";
 
 //*****************************************************************************
 //
-// Variable to indicate Ping or Pong Buffer availability
+// The ring of decoded audio buffers that are queued to the output ahead of
+// time, so that the decoder can run several frames ahead of playback.
 //
 //*****************************************************************************
-opus_int16 *g_pcop16PingBuf;
-opus_int16 *g_pcop16PongBuf;
-int32_t  i32PingOutSamples;
-int32_t  i32PongOutSamples;
+tAudioRing g_sAudioRing;
+static tAudioSlot g_psAudioSlots[OPUS_AUDIO_RING_SLOTS];
 uint8_t  g_ui8ScaleFactor;
 uint32_t g_ui32SizeOfOutBuf;
-volatile bool g_bRdPingBufferAvailable;
-volatile bool g_bRdPongBufferAvailable;
-volatile bool g_bPrime;
+
+//*****************************************************************************
+//
+// The upsampler from the rate of the stream to the playback rate, and the
+// buffer that the decoder writes to when the stream is at a lower rate.  The
+// upsampler then writes the output straight into the audio ring.
+//
+//*****************************************************************************
+static tUpsampler g_sUpsampler;
+static int16_t *g_pi16DecodeBuf;
+
+//*****************************************************************************
+//
+// The uDMA control structures of the output channel, which of them hold a
+// buffer from the audio ring, and the one that the uDMA will use next.  The
+// structures are used in turn, so they are always given buffers starting
+// from the next one to keep the buffers in order.
+//
+//*****************************************************************************
+static const uint32_t g_pui32AudioSelect[2] =
+{
+    UDMA_PRI_SELECT,
+    UDMA_ALT_SELECT
+};
+static volatile bool g_pbAudioQueued[2];
+static volatile uint32_t g_ui32AudioNext;
 
 //*****************************************************************************
 //
@@ -359,42 +412,83 @@ uint8_t pui8ControlTable[1024];
 uint8_t pui8ControlTable[1024] __attribute__ ((aligned(1024)));
 #endif
 
+//*****************************************************************************
+//
+// Give the idle uDMA control structures the next buffers from the audio ring
+// and enable the channel.  While playback is paused no more buffers are
+// queued, so the output stops once the queued ones have been played.  This
+// is called from the timer interrupt handler, or with the timer interrupt
+// disabled.
+//
+//*****************************************************************************
+static void
+AudioQueue(void)
+{
+    const tAudioSlot *psSlot;
+    uint32_t ui32Idx;
+    uint32_t ui32Sel;
+
+    for(ui32Idx = 0; ui32Idx < 2; ui32Idx++)
+    {
+        ui32Sel = g_ui32AudioNext ^ ui32Idx;
+
+        if(g_pbAudioQueued[ui32Sel])
+        {
+            continue;
+        }
+
+        if(g_ePlayState == AUDIO_PAUSED)
+        {
+            break;
+        }
+
+        psSlot = AudioRingNext(&g_sAudioRing);
+        if(psSlot == 0)
+        {
+            break;
+        }
+
+        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | g_pui32AudioSelect[ui32Sel],
+                               UDMA_MODE_PINGPONG,
+                               (void *)psSlot->pi16Data,
+                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
+                               psSlot->ui32Samples);
+        g_pbAudioQueued[ui32Sel] = true;
+        uDMAChannelEnable(UDMA_CH8_TIMER5A);
+    }
+}
+
 //*****************************************************************************
 //
 // This is the interrupt handler from the timer when the DMA has completed the
-// transfer of data for Primary or Alternate channel.
+// transfer of data for Primary or Alternate channel.  The buffers that have
+// been played are returned to the audio ring and the idle control structures
+// are given the next ones.
 //
 //*****************************************************************************
 void
 AudioTimerIntHandler(void)
 {
-    uint32_t ui32Mode;
-
     //
     // Clear the Match Interrupt
     //
     TimerIntClear(TIMER_BASE, TIMER_TIMA_DMA);
 
     //
-    // Check if Ping or Pong Buffer is completed
+    // Free the buffers that have been played, in the order that they were
+    // queued.
     //
-    ui32Mode = uDMAChannelModeGet(UDMA_CH8_TIMER5A | UDMA_PRI_SELECT);
-
-    if(ui32Mode == UDMA_MODE_STOP)
-    {
-        g_bRdPingBufferAvailable = false;
-    }
-
-    //
-    // Check if Ping or Pong Buffer is completed
-    //
-    ui32Mode = uDMAChannelModeGet(UDMA_CH8_TIMER5A | UDMA_ALT_SELECT);
-
-    if(ui32Mode == UDMA_MODE_STOP)
+    while(g_pbAudioQueued[g_ui32AudioNext] &&
+          (uDMAChannelModeGet(UDMA_CH8_TIMER5A |
+                              g_pui32AudioSelect[g_ui32AudioNext]) ==
+           UDMA_MODE_STOP))
     {
-        g_bRdPongBufferAvailable = false;
+        g_pbAudioQueued[g_ui32AudioNext] = false;
+        g_ui32AudioNext ^= 1;
+        AudioRingDone(&g_sAudioRing);
     }
 
+    AudioQueue();
 }
 
 //*****************************************************************************
@@ -405,20 +499,45 @@ AudioTimerIntHandler(void)
 int32_t
 InitAudio(void)
 {
+    uint8_t  *pui8PacketData;
+    tPacketDesc *psPacketDesc;
+    int16_t  *pi16AudioData;
+    uint32_t ui32BufSize;
     int32_t  i32error;
 
+    g_ui32BytesPlayed = 0;
+
     //
-    // Initialize the priming variable to true
+    // All of the buffers for the previous stream are free again.
     //
-    g_bPrime = true;
-    g_ui32BytesPlayed = 0;
+    BufPoolReset(&g_sBufPool);
 
     //
-    // Create the decoder
+    // Start with an empty packet ring.
     //
-    sOpusDec = opus_decoder_create(g_sOpxHeader.ui32SampleRate,
-            g_sOpxHeader.ui16NumChannels,
-            &i32error);
+    pui8PacketData = BufPoolAlloc(&g_sBufPool, OPUS_PACKET_RING_SIZE);
+    psPacketDesc = BufPoolAlloc(&g_sBufPool,
+                                OPUS_PACKET_RING_DESC * sizeof(tPacketDesc));
+    if((pui8PacketData == 0) || (psPacketDesc == 0))
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    PacketRingInit(&g_sPacketRing, pui8PacketData, OPUS_PACKET_RING_SIZE,
+                   psPacketDesc, OPUS_PACKET_RING_DESC);
+
+    //
+    // Create the decoder in the buffer pool
+    //
+    sOpusDec = BufPoolAlloc(&g_sBufPool,
+            opus_decoder_get_size(g_sOpxHeader.ui16NumChannels));
+    if(sOpusDec == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    i32error = opus_decoder_init(sOpusDec, g_sOpxHeader.ui32SampleRate,
+            g_sOpxHeader.ui16NumChannels);
 
     //
     // If there was some problem creating the OPUS decoder, then close the write
@@ -438,11 +557,55 @@ InitAudio(void)
     g_ui8ScaleFactor   = OPUS_PLAYBACK_RATE/g_sOpxHeader.ui32SampleRate;
 
     //
-    // Get the Size of the Output Buffer and allocate the Ping and Pong Buffer
+    // Get the Size of the Output Buffer and allocate the buffers of the audio
+    // ring
     //
     g_ui32SizeOfOutBuf = (g_sOpxHeader.ui32SampleRate *
             g_sOpxHeader.ui16NumChannels*OPUS_FRAME_SIZE_IN_MS *
             OPUS_DATA_SCALER)/1000;
+    ui32BufSize = (((g_ui32SizeOfOutBuf * g_ui8ScaleFactor) /
+                    OPUS_DATA_SCALER) + 1);
+    pi16AudioData = BufPoolAlloc(&g_sBufPool, OPUS_AUDIO_RING_SLOTS *
+                                 ui32BufSize * sizeof(int16_t));
+    if(pi16AudioData == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    AudioRingInit(&g_sAudioRing, g_psAudioSlots, OPUS_AUDIO_RING_SLOTS,
+                  pi16AudioData, ui32BufSize);
+
+    //
+    // Set up the upsampler.  A stream at a lower rate than the playback is
+    // decoded into a separate buffer, with space in front of it for the
+    // samples that the filter keeps from the previous frame.  A stream at the
+    // playback rate is decoded straight into the audio ring.
+    //
+    if(!UpsampleInit(&g_sUpsampler, g_ui8ScaleFactor, OPUS_UPSAMPLE_FILTER))
+    {
+        return(OPUS_BAD_ARG);
+    }
+
+    g_pi16DecodeBuf = 0;
+    if(g_ui8ScaleFactor > 1)
+    {
+        g_pi16DecodeBuf = BufPoolAlloc(&g_sBufPool,
+                ((g_ui32SizeOfOutBuf / OPUS_DATA_SCALER) + UPSAMPLE_HISTORY) *
+                sizeof(int16_t));
+        if(g_pi16DecodeBuf == 0)
+        {
+            return(OPUS_ALLOC_FAIL);
+        }
+        g_pi16DecodeBuf += UPSAMPLE_HISTORY;
+    }
+
+    //
+    // Nothing is queued to the uDMA yet.  The alternate control structure is
+    // selected below, so it is the one that is used first.
+    //
+    g_pbAudioQueued[0] = false;
+    g_pbAudioQueued[1] = false;
+    g_ui32AudioNext = 1;
 
 #if 0
     //
@@ -574,18 +737,14 @@ StopAudio(void)
     ROM_GPIOPinWrite(GPIO_PORTD_BASE, GPIO_PIN_4, 0);
 
     //
-    // Set all flags to false condition
+    // Stop the uDMA channel so that nothing is left queued from this stream.
     //
-    g_bRdPongBufferAvailable = false;
-    g_bRdPongBufferAvailable = false;
-    g_bPrime = false;
+    uDMAChannelDisable(UDMA_CH8_TIMER5A);
 
     //
-    // Free the ping and pong buffers, close the decoder and file handle
+    // Close the file handle.  The buffers and the decoder stay in the buffer
+    // pool until the next stream is set up.
     //
-    free(g_pcop16PingBuf);
-    free(g_pcop16PongBuf);
-    opus_decoder_destroy(sOpusDec);
     OpxClose(&g_sOpxFile);
 
 }
@@ -630,6 +789,17 @@ DisplayTime(uint32_t ui32ForceUpdate)
         // Display the updated time on the screen.
         //
         WidgetPaint((tWidget *)&g_sOpxInfoTime);
+
+        //
+        // Show the number of underruns of the audio output, the fewest
+        // buffers that were ready when the output took one, and the longest
+        // time that a buffer took to be filled again after being played.
+        //
+        usprintf(g_pcRingStats, "Underruns %d Fill %d/%d %dms",
+                 g_sAudioRing.ui32Underruns, g_sAudioRing.ui32MinFill,
+                 OPUS_AUDIO_RING_SLOTS,
+                 ((g_sAudioRing.ui32MaxLatency * 1000) / OPUS_PLAYBACK_RATE));
+        WidgetPaint((tWidget *)&g_sOpxInfoRing);
     }
 }
 
@@ -668,7 +838,9 @@ OpxStop(void)
     // Change the play/pause button to say play.
     //
     PushButtonTextSet(&g_sPlayPause, g_pcPlay);
-    CanvasTextSet(&g_sStatusText, " ");
+    usprintf(g_pcPoolStatus, "Buffers used %d of %d bytes",
+             BufPoolHighWater(&g_sBufPool), OPUS_PLAYBACK_POOL_SIZE);
+    CanvasTextSet(&g_sStatusText, g_pcPoolStatus);
     WidgetPaint(WIDGET_ROOT);
 }
 
@@ -826,291 +998,192 @@ ChangeToDirectory(char *pcDirectory)
 
 //*****************************************************************************
 //
-// Fill the audio buffer with data from the opx file and run the OPUS decoder
-// to decompress the data.
+// Read a batch of packets from the opx file into the packet ring if there is
+// room for at least one more packet of the largest size.
 //
 //*****************************************************************************
-static uint32_t
-FillAudioBuffer(void)
+static void
+ReadPackets(void)
 {
-    uint8_t  *pcRdBuf;
-    int32_t  i32len;
-    uint8_t  ui8ScaleFactorLoop;
-    uint32_t ui32Loop;
-    uint16_t ui16Ret = 1;
+    uint8_t *pui8Space;
 
-    //
-    // Allocate the buffer to read from sd card and ping-pong buffer for the
-    // uDMA channels. Also this is performed only once for the audio stream.
-    //
-    if(g_bPrime)
+    if(!(g_sPacketRing.ui32Flags & PKTRING_FLAG_END) &&
+       (PacketRingSpace(&g_sPacketRing, OPUS_MAX_PACKET, &pui8Space) >=
+        OPUS_MAX_PACKET))
     {
-        g_pcop16PingBuf  = (int16_t*)calloc((((g_ui32SizeOfOutBuf *
-                g_ui8ScaleFactor)/OPUS_DATA_SCALER)+1),sizeof(int16_t));
-        g_pcop16PongBuf  = (int16_t*)calloc((((g_ui32SizeOfOutBuf *
-                g_ui8ScaleFactor)/OPUS_DATA_SCALER)+1),sizeof(int16_t));
-        g_bPrime = false;
+        OpxReadBatch(&g_sOpxFile, &g_sPacketRing);
     }
+}
 
-    pcRdBuf          = (uint8_t *)calloc(OPUS_MAX_PACKET,sizeof(uint8_t));
+//*****************************************************************************
+//
+// Get the next packet for the decoder from the packet ring.  The ring is
+// normally filled ahead of time from the main loop, so the file is only read
+// here if the ring has run dry.
+//
+//*****************************************************************************
+static const tPacketDesc *
+GetPacket(void)
+{
+    const tPacketDesc *psPacket;
 
-    //
-    // Check if Ping Buffer has to be filled with the decompressed audio
-    //
-    if(g_bRdPingBufferAvailable == false)
+    psPacket = PacketRingPeek(&g_sPacketRing);
+    if((psPacket == 0) && !(g_sPacketRing.ui32Flags & PKTRING_FLAG_END))
     {
-        //
-        // Read the opx data stream one segment at a time
-        //
-        ui16Ret = OpxRead(&g_sOpxFile, (uint8_t *)pcRdBuf, &i32len);
+        OpxReadBatch(&g_sOpxFile, &g_sPacketRing);
+        psPacket = PacketRingPeek(&g_sPacketRing);
+    }
+
+    return(psPacket);
+}
+
+//*****************************************************************************
+//
+// Fill the free buffers of the audio ring with data from the opx file and run
+// the OPUS decoder to decompress the data.  Each buffer is queued to the
+// output as soon as it is ready.  Returns 2 once the stream has ended and all
+// of its audio has been played.
+//
+//*****************************************************************************
+static uint32_t
+FillAudioBuffer(void)
+{
+    const tPacketDesc *psPacket;
+    tAudioSlot *psSlot;
+    opus_int16 *pcop16Buf;
+    int16_t  *pi16Decode;
+    int32_t  i32OutSamples;
+    uint32_t ui32Samples;
+    uint32_t ui32Loop;
 
+    while(!(g_sAudioRing.ui32Flags & AUDIORING_FLAG_END))
+    {
         //
-        // If there is an error then close the stream
+        // Stop when every buffer is waiting to be played.
         //
-        if(ui16Ret == 0)
+        psSlot = AudioRingFree(&g_sAudioRing);
+        if(psSlot == 0)
         {
-            free(g_pcop16PingBuf);
-            free(g_pcop16PongBuf);
-            free(pcRdBuf);
-            opus_decoder_destroy(sOpusDec);
-            return(0);
+            break;
         }
+        pcop16Buf = psSlot->pi16Data;
 
         //
-        // Decompress the opx stream into raw PCM data for the ping buffer
+        // Take the next packet of the opx data stream from the packet ring.
         //
-        i32PingOutSamples = opus_decode(sOpusDec,
-                (const unsigned char *)&pcRdBuf[0],
-                i32len,
-                g_pcop16PingBuf,
-                (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER),
-                0);
+        psPacket = GetPacket();
 
         //
-        // Process the data for playback rate of 48KHz. 8-bit data is extracted
-        // and converted to signed format. For slower original sample rate, the
-        // buffer is extended by copying the same sample by a factor or 48KHz
-        // divided by the original sample rate
+        // If there is an error or no more data then end the stream once the
+        // audio in the ring has been played.
         //
-        if(g_sOpxHeader.ui16BitsPerSample == 8)
+        if(psPacket == 0)
         {
-            if(g_ui8ScaleFactor == 1)
-            {
-                for(ui32Loop = 0 ; ui32Loop < i32PingOutSamples ; ui32Loop++)
-                {
-                    g_pcop16PingBuf[ui32Loop] &= 0xFF;
-                    g_pcop16PingBuf[ui32Loop] ^= 0x80;
-                    g_pcop16PingBuf[ui32Loop] =
-                            (g_pcop16PingBuf[ui32Loop] << 2);
-                }
-            }
-            else
-            {
-                for(ui32Loop = (i32PingOutSamples) ; ui32Loop > 0 ; ui32Loop--)
-                {
-                    g_pcop16PingBuf[(ui32Loop-1)] &= 0xFF;
-                    g_pcop16PingBuf[(ui32Loop-1)] ^= 0x80;
-                    g_pcop16PingBuf[(ui32Loop-1)] =
-                            (g_pcop16PingBuf[(ui32Loop-1)] << 2);
-                    for(ui8ScaleFactorLoop = 0 ; ui8ScaleFactorLoop < g_ui8ScaleFactor ; ui8ScaleFactorLoop++)
-                    {
-                        g_pcop16PingBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop]   = g_pcop16PingBuf[(ui32Loop-1)];
-                    }
-                }
-            }
+            AudioRingEnd(&g_sAudioRing);
+            break;
         }
+
         //
-        // Process the data for playback rate of 48KHz. 16-bit data is
-        // converted to signed format and upper 5 bits masked. For slower
-        // original sample rate, the buffer is extended by copying the same
-        // sample by a factor or 48KHz divided by the original sample rate
+        // Decompress the opx stream into raw PCM data, either for the buffer
+        // itself or for the upsampler.
         //
-        else
+        pi16Decode = g_pi16DecodeBuf ? g_pi16DecodeBuf : pcop16Buf;
+        i32OutSamples = opus_decode(sOpusDec,
+                (const unsigned char *)(g_sPacketRing.pui8Data +
+                                        psPacket->ui32Offset),
+                psPacket->ui16Length,
+                pi16Decode,
+                (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER),
+                0);
+        if(psPacket->ui16Flags & PKTRING_DESC_LAST)
         {
-            if(g_ui8ScaleFactor == 1)
-            {
-                for(ui32Loop = 0 ; ui32Loop < i32PingOutSamples ; ui32Loop++)
-                {
-                    g_pcop16PingBuf[ui32Loop] ^= 0x8000;
-                    g_pcop16PingBuf[ui32Loop] =
-                            (g_pcop16PingBuf[ui32Loop] >> 5);
-                    g_pcop16PingBuf[ui32Loop] &= 0x7FF;
-                }
-            }
-            else
-            {
-                for(ui32Loop = (i32PingOutSamples) ; ui32Loop > 0 ; ui32Loop--)
-                {
-                    g_pcop16PingBuf[ui32Loop-1] ^= 0x8000;
-                    g_pcop16PingBuf[ui32Loop-1] =
-                            (g_pcop16PingBuf[ui32Loop-1] >> 5);
-                    g_pcop16PingBuf[ui32Loop-1] &= 0x7FF;
-                    for(ui8ScaleFactorLoop = 0 ;
-                            ui8ScaleFactorLoop < g_ui8ScaleFactor ;
-                            ui8ScaleFactorLoop++)
-                    {
-                        g_pcop16PingBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop] =
-                                g_pcop16PingBuf[(ui32Loop-1)];
-                    }
-                }
-            }
+            AudioRingEnd(&g_sAudioRing);
         }
+        PacketRingRelease(&g_sPacketRing);
 
         //
-        // Initialize the uDMA primary control structure with the source and
-        // destination locations and size of the tarnsfer and then enable the
-        // channel
+        // A packet that could not be decoded leaves the buffer free.
         //
-        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | UDMA_PRI_SELECT,
-                               UDMA_MODE_PINGPONG,
-                               (void *)&g_pcop16PingBuf[0],
-                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
-                               i32PingOutSamples*g_ui8ScaleFactor);
-        uDMAChannelEnable(UDMA_CH8_TIMER5A);
-
-        //
-        // Set the ping buffer ready flag.
-        //
-        g_bRdPingBufferAvailable = true;
-
-        //
-        // Add the number of bytes to played back for time display
-        //
-        g_ui32BytesPlayed += i32PingOutSamples;
-
-    }
-
-    if(g_bRdPongBufferAvailable == false)
-    {
-        //
-        // Read the opx data stream one segment at a time
-        //
-        ui16Ret = OpxRead(&g_sOpxFile, (uint8_t *)pcRdBuf, &i32len);
-
-        //
-        // If there is an error then close the stream
-        //
-        if(ui16Ret == 0)
+        if(i32OutSamples <= 0)
         {
-            free(g_pcop16PingBuf);
-            free(g_pcop16PongBuf);
-            free(pcRdBuf);
-            opus_decoder_destroy(sOpusDec);
-            return(0);
+            continue;
         }
 
-        //
-        // Decompress the opx stream into raw PCM data for the pong buffer
-        //
-        i32PongOutSamples = opus_decode(sOpusDec,
-                (const unsigned char *)&pcRdBuf[0],
-                i32len,
-                g_pcop16PongBuf,
-                (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER),
-                0);
-
         //
         // Process the data for playback rate of 48KHz. 8-bit data is extracted
-        // and converted to signed format. For slower original sample rate, the
-        // buffer is extended by copying the same sample by a factor or 48KHz
-        // divided by the original sample rate
+        // from the low byte and converted to 10-bit unsigned format, 16-bit
+        // data is converted to 11-bit unsigned format. For slower original
+        // sample rate, the upsampler interpolates it to 48KHz as it writes it
+        // to the buffer.  The opus-1.1.2 library that this project links has
+        // no opus_decode_ex(), so the conversion is not done by the decoder.
         //
         if(g_sOpxHeader.ui16BitsPerSample == 8)
         {
-            if(g_ui8ScaleFactor == 1)
+            for(ui32Loop = 0 ; ui32Loop < i32OutSamples ; ui32Loop++)
             {
-                for(ui32Loop = 0 ; ui32Loop < i32PongOutSamples ; ui32Loop++)
-                {
-                    g_pcop16PongBuf[ui32Loop] &= 0xFF;
-                    g_pcop16PongBuf[ui32Loop] ^= 0x80;
-                    g_pcop16PongBuf[ui32Loop] =
-                            (g_pcop16PongBuf[ui32Loop] << 2);
-                }
-            }
-            else
-            {
-                for(ui32Loop = (i32PongOutSamples) ; ui32Loop > 0 ; ui32Loop--)
-                {
-                    g_pcop16PongBuf[(ui32Loop-1)] &= 0xFF;
-                    g_pcop16PongBuf[(ui32Loop-1)] ^= 0x80;
-                    g_pcop16PongBuf[(ui32Loop-1)] =
-                            (g_pcop16PongBuf[(ui32Loop-1)] << 2);
-                    for(ui8ScaleFactorLoop = 0 ;
-                            ui8ScaleFactorLoop < g_ui8ScaleFactor ;
-                            ui8ScaleFactorLoop++)
-                    {
-                        g_pcop16PongBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop] =
-                                g_pcop16PongBuf[(ui32Loop-1)];
-                    }
-                }
+                pi16Decode[ui32Loop] =
+                        (int16_t)((uint16_t)pi16Decode[ui32Loop] << 8);
             }
+            ui32Samples = UpsampleProcess(&g_sUpsampler, pi16Decode,
+                                          i32OutSamples,
+                                          (uint16_t *)pcop16Buf, 6);
         }
-        //
-        // Process the data for playback rate of 48KHz. 16-bit data is
-        // converted to signed format and upper 5 bits masked. For slower
-        // original sample rate, the buffer is extended by copying the same
-        // sample by a factor or 48KHz divided by the original sample rate
-        //
         else
         {
-            if(g_ui8ScaleFactor == 1)
-            {
-                for(ui32Loop = 0 ; ui32Loop < i32PongOutSamples ; ui32Loop++)
-                {
-                    g_pcop16PongBuf[ui32Loop] ^= 0x8000;
-                    g_pcop16PongBuf[ui32Loop] =
-                            (g_pcop16PongBuf[ui32Loop] >> 5);
-                    g_pcop16PongBuf[ui32Loop] &= 0x7FF;
-                }
-            }
-            else
-            {
-                for(ui32Loop = (i32PongOutSamples) ; ui32Loop > 0 ; ui32Loop--)
-                {
-                    g_pcop16PongBuf[ui32Loop-1] ^= 0x8000;
-                    g_pcop16PongBuf[ui32Loop-1] =
-                            (g_pcop16PongBuf[ui32Loop-1] >> 5);
-                    g_pcop16PongBuf[ui32Loop-1] &= 0x7FF;
-                    for(ui8ScaleFactorLoop = 0 ;
-                            ui8ScaleFactorLoop < g_ui8ScaleFactor ;
-                            ui8ScaleFactorLoop++)
-                    {
-                        g_pcop16PongBuf[((ui32Loop-1)*g_ui8ScaleFactor)+ui8ScaleFactorLoop] =
-                                g_pcop16PongBuf[(ui32Loop-1)];
-                    }
-                }
-            }
+            ui32Samples = UpsampleProcess(&g_sUpsampler, pi16Decode,
+                                          i32OutSamples,
+                                          (uint16_t *)pcop16Buf, 5);
         }
 
         //
-        // Initialize the uDMA alternate control structure with the source and
-        // destination locations and size of the tarnsfer and then enable the
-        // channel
+        // Add the buffer to the ring and queue it to the output if the uDMA
+        // has an idle control structure.
         //
-        uDMAChannelTransferSet(UDMA_CH8_TIMER5A | UDMA_ALT_SELECT,
-                               UDMA_MODE_PINGPONG,
-                               (void *)&g_pcop16PongBuf[0],
-                               (void *)(TIMER_BASE + TIMER_O_TAMATCHR),
-                               i32PongOutSamples*g_ui8ScaleFactor);
-        uDMAChannelEnable(UDMA_CH8_TIMER5A);
-
-        //
-        // Set the pong buffer ready flag.
-        //
-        g_bRdPongBufferAvailable = true;
+        AudioRingPut(&g_sAudioRing, ui32Samples);
+        IntDisable(INT_TIMER5A);
+        AudioQueue();
+        IntEnable(INT_TIMER5A);
 
         //
         // Add the number of bytes to played back for time display
         //
-        g_ui32BytesPlayed += i32PongOutSamples;
+        g_ui32BytesPlayed += i32OutSamples;
+    }
+
+    if((g_sAudioRing.ui32Flags & AUDIORING_FLAG_END) &&
+       AudioRingDrained(&g_sAudioRing))
+    {
+        return(2);
+    }
+
+    return(1);
+}
+
+//*****************************************************************************
+//
+// Opens a .opx file for playback.  Only mono files are supported by the
+// audio output, so any other file is closed again and reported as invalid.
+//
+//*****************************************************************************
+static int
+OpenOpxFile(const char *pcFileName)
+{
+    if(OpxOpen(pcFileName, &g_sOpxFile) != 0)
+    {
+        OpxClose(&g_sOpxFile);
+        return(-1);
     }
 
     //
-    // Free the sd card buffer
+    // Only mono supported.
     //
-    free(pcRdBuf);
+    if(g_sOpxFile.sOpxHeader.ui16NumChannels > 1)
+    {
+        OpxClose(&g_sOpxFile);
+        return(-1);
+    }
 
-    return(ui16Ret);
+    return(0);
 }
 
 //*****************************************************************************
@@ -1136,7 +1209,7 @@ PlayPause(tWidget *psWidget)
         //
         // See if this is a valid .opx file that can be opened.
         //
-        if(OpxOpen(g_pcFilenames[i16Select], &g_sOpxFile) == 0)
+        if(OpenOpxFile(g_pcFilenames[i16Select]) == 0)
         {
             //
             // Initialize the OPUS Decoder
@@ -1199,11 +1272,6 @@ PlayPause(tWidget *psWidget)
     }
     else if(g_ePlayState == AUDIO_PAUSED)
     {
-        //
-        // Fill the audio buffer from the file.
-        //
-        FillAudioBuffer();
-
         //
         // Now switching to a play state, so change the button to say paused.
         //
@@ -1212,6 +1280,12 @@ PlayPause(tWidget *psWidget)
         WidgetPaint(WIDGET_ROOT);
 
         g_ePlayState = AUDIO_PLAYING;
+
+        //
+        // Fill the audio buffers from the file, which queues them to the
+        // output again.
+        //
+        FillAudioBuffer();
     }
 }
 
@@ -1234,9 +1308,6 @@ Stop(tWidget *psWidget)
         OpxClose(&g_sOpxFile);
 
         OpxStop();
-
-        CanvasTextSet(&g_sStatusText, " ");
-        WidgetPaint(WIDGET_ROOT);
     }
 }
 
@@ -1440,7 +1511,7 @@ void OnListBoxChange(tWidget *psWidget, int16_t i16Selected)
                 OpxStop();
             }
 
-            if(OpxOpen(g_pcFilenames[i16Sel], &g_sOpxFile) == 0)
+            if(OpenOpxFile(g_pcFilenames[i16Sel]) == 0)
             {
                 //
                 // Read the .opx file format.
@@ -1470,10 +1541,19 @@ void OnListBoxChange(tWidget *psWidget, int16_t i16Selected)
                 CanvasTextSet(&g_sOpxInfoSample, g_pcFormat);
 
                 //
-                // Calculate the minutes and seconds in the file.
+                // Calculate the minutes and seconds in the file.  Version 2
+                // files carry the exact number of samples in the header.
                 //
-                g_ui16Seconds = g_sOpxHeader.ui32OrigFileSize /
-                              g_sOpxHeader.ui32AvgByteRate;
+                if(g_sOpxHeader.ui16Version >= 2)
+                {
+                    g_ui16Seconds = g_sOpxHeader.ui32NumSamples /
+                                  g_sOpxHeader.ui32SampleRate;
+                }
+                else
+                {
+                    g_ui16Seconds = g_sOpxHeader.ui32OrigFileSize /
+                                  g_sOpxHeader.ui32AvgByteRate;
+                }
                 g_ui16Minutes = g_ui16Seconds / 60;
                 g_ui16Seconds -= g_ui16Minutes * 60;
 
@@ -1664,9 +1744,7 @@ main(void)
     //
     // Not playing anything right now so intiialize all variables.
     //
-    g_bPrime = true;
-    g_bRdPingBufferAvailable = false;
-    g_bRdPongBufferAvailable = false;
+    BufPoolInit(&g_sBufPool, g_pui64PoolData, sizeof(g_pui64PoolData));
     g_ePlayState = AUDIO_NONE;
 
     PopulateFileListBox(true);
@@ -1694,6 +1772,14 @@ main(void)
                 OpxStop();
 
             }
+            else if(AudioRingFree(&g_sAudioRing) == 0)
+            {
+                //
+                // All of the audio buffers are full, so read ahead into the
+                // packet ring now rather than when a buffer is due.
+                //
+                ReadPackets();
+            }
 
             //
             // Update the real display time.
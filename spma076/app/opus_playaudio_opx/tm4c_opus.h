@@ -34,6 +34,43 @@
 #define OPUS_FRAME_SIZE_IN_MS 20
 #define OPUS_MAX_PACKET       1024
 
+//*****************************************************************************
+//
+// Defines the size of the ring of compressed packets that is read ahead of
+// the decoder and the number of packets it can hold.  The ring must be able
+// to hold at least one packet of OPUS_MAX_PACKET bytes.
+//
+//*****************************************************************************
+#define OPUS_PACKET_RING_SIZE 4096
+#define OPUS_PACKET_RING_DESC 64
+
+//*****************************************************************************
+//
+// Defines the number of decoded buffers that are queued to the audio output.
+// The decoder can run this many frames ahead of the output.
+//
+//*****************************************************************************
+#define OPUS_AUDIO_RING_SLOTS 4
+
+//*****************************************************************************
+//
+// Defines the size of the pool that the packet ring, the decoder state, the
+// audio ring buffers and the upsampler input are taken from when playback is
+// set up.  This must be large enough for a stereo stream at 48 kHz or 24 kHz.
+//
+//*****************************************************************************
+#define OPUS_PLAYBACK_POOL_SIZE (52 * 1024)
+
+//*****************************************************************************
+//
+// Defines how streams at a lower rate are brought up to the playback rate.
+// When set to 1 the samples in between are interpolated by a polyphase
+// filter.  When set to 0 each sample is repeated, which uses less CPU time but
+// leaves images of the audio above the Nyquist frequency of the stream.
+//
+//*****************************************************************************
+#define OPUS_UPSAMPLE_FILTER  1
+
 //*****************************************************************************
 //
 // Defines the playback parameters
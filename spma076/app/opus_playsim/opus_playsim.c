@@ -0,0 +1,1548 @@
+//*****************************************************************************
+//
+// opus_playsim.c - A workstation simulation of the playback pipeline of the
+// OPUS players, to measure how close to real time it runs.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "opus.h"
+#ifndef STORAGE_NO_FATFS
+#include "third_party/fatfs/src/ff.h"
+#endif
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
+#include "opxcode/bufpool.h"
+#include "opxcode/audioring.h"
+#include "opxcode/upsample.h"
+#include "opxcode/oggfile.h"
+#include "opxcode/opxfile.h"
+#include "tm4c_opus.h"
+
+//*****************************************************************************
+//
+// The simulation runs the packet ring, decoder, upsampler and audio ring of
+// the players as they are on the target, with the hardware replaced by a
+// model on a simulated clock:
+//
+// - The timer and uDMA that play out the audio ring at OPUS_PLAYBACK_RATE,
+//   with the two control structures of the ping-pong transfer.  The timer
+//   interrupt handler runs at the time that a transfer completes.
+// - The SD card, as the simulated storage backend, which charges each read a
+//   latency drawn from a recording of the card.
+// - The CPU, which is charged the time that the decoder and the upsampler
+//   take on this machine, multiplied by a slowdown factor that stands for the
+//   difference to the target.
+//
+// The main loop and the functions that it calls follow the ones of the
+// players, so that a change to the pipeline there should be made here too.
+//
+//*****************************************************************************
+
+//*****************************************************************************
+//
+// The most audio ring slots that can be simulated.
+//
+//*****************************************************************************
+#define SIM_MAX_SLOTS           16
+
+//*****************************************************************************
+//
+// The most recorded latencies that are read from a file.
+//
+//*****************************************************************************
+#define SIM_MAX_LATENCIES       65536
+
+//*****************************************************************************
+//
+// The seek check compares SIM_SEEK_WINDOW samples per channel at 48 kHz,
+// SIM_SEEK_SETTLE samples after each position so that the decoder has fully
+// converged, at offsets of up to SIM_SEEK_MAX_OFFSET.  Audio with a mean
+// square value below SIM_SEEK_MIN_POWER is not compared, and a signal to error
+// ratio of SIM_SEEK_MIN_SNR dB is needed for a match.
+//
+//*****************************************************************************
+#define SIM_SEEK_WINDOW         960
+#define SIM_SEEK_SETTLE         9600
+#define SIM_SEEK_MAX_OFFSET     OGG_MAX_PACKET_SAMPLES
+#define SIM_SEEK_MIN_POWER      64
+#define SIM_SEEK_MIN_SNR        40.0
+
+//*****************************************************************************
+//
+// The options of the simulation.
+//
+//*****************************************************************************
+static double g_dSlowdown = 1.0;
+static uint32_t g_ui32NumSlots = OPUS_AUDIO_RING_SLOTS;
+static bool g_bFilter = OPUS_UPSAMPLE_FILTER;
+static bool g_bVerbose;
+static uint32_t g_ui32SeekChecks;
+
+//*****************************************************************************
+//
+// The playback state, as in the players.
+//
+//*****************************************************************************
+static uint64_t g_pui64PoolData[OPUS_PLAYBACK_POOL_SIZE / 8];
+static tBufPool g_sBufPool;
+static tPacketRing g_sPacketRing;
+static tAudioRing g_sAudioRing;
+static tAudioSlot g_psAudioSlots[SIM_MAX_SLOTS];
+static tUpsampler g_sUpsampler;
+static int16_t *g_pi16DecodeBuf;
+static OpusDecoder *g_psOpusDec;
+static uint8_t g_ui8ScaleFactor;
+static uint32_t g_ui32SizeOfOutBuf;
+static uint32_t g_ui32Shift;
+static bool g_bOpx;
+static bool g_b8Bit;
+static tOggFile g_sOggFile;
+static tOpusHeadContainer g_sOpusHeader;
+static tOpxFile g_sOpxFile;
+static tOpxHeader g_sOpxHeader;
+static bool g_pbAudioQueued[2];
+static uint32_t g_ui32AudioNext;
+
+//*****************************************************************************
+//
+// The state of the playlist, as in the Ogg player.  The files of the playlist
+// are the ones given on the command line.
+//
+//*****************************************************************************
+static OpusDecoder *g_psOpusDecNext;
+static tOpusHeadContainer g_sOpusHeaderNext;
+static uint32_t g_ui32LeftNext;
+static uint32_t g_ui32CarryNext;
+static bool g_bNextReady;
+static int16_t *g_pi16CarryBuf;
+static uint32_t g_ui32Left;
+static uint32_t g_ui32Carry;
+static tOggFile g_sOggFileNext;
+static tOggFile *g_psOggRead;
+static int32_t g_i32TrackRead;
+static char **g_ppcTracks;
+static uint32_t g_ui32NumTracks;
+
+//*****************************************************************************
+//
+// The simulated clock of the main loop, in nanoseconds, and the time at which
+// the code that is running now runs, which is a transfer completion while
+// the timer interrupt handler runs.
+//
+//*****************************************************************************
+static uint64_t g_ui64Now;
+static uint64_t g_ui64Time;
+
+//*****************************************************************************
+//
+// The time that the main loop has spent decoding and reading since the start,
+// and the part of it spent reading, at the last frame and now.  The time that
+// it spends waiting for the output is not counted.
+//
+//*****************************************************************************
+static uint64_t g_ui64Busy;
+static uint64_t g_ui64BusyLast;
+static uint64_t g_ui64Read;
+static uint64_t g_ui64ReadLast;
+
+//*****************************************************************************
+//
+// The model of the uDMA channel.  Each control structure holds the number of
+// samples it was given, or none once it has stopped.  The channel plays out
+// the current structure until g_ui64HwEnd and then moves to the other one,
+// which it stops at if that has not been given a buffer.
+//
+//*****************************************************************************
+static uint32_t g_pui32HwSamples[2];
+static uint32_t g_ui32HwCur;
+static bool g_bHwRunning;
+static uint64_t g_ui64HwEnd;
+
+//*****************************************************************************
+//
+// The statistics of the run.
+//
+//*****************************************************************************
+static uint32_t g_ui32Frames;
+static uint32_t g_ui32Errors;
+static uint32_t g_ui32Tracks;
+static uint64_t g_ui64Expected;
+static uint64_t g_ui64CpuTotal;
+static uint64_t g_ui64CpuMax;
+static int32_t g_i32MarginMin = 100000;
+static uint64_t g_ui64AheadMin = UINT64_MAX;
+static uint64_t g_ui64StallStart;
+static uint64_t g_ui64StallTotal;
+static uint64_t g_ui64StallMax;
+
+//*****************************************************************************
+//
+// Return the time taken to play out a number of samples, in nanoseconds.
+//
+//*****************************************************************************
+static uint64_t
+SimSamplesTime(uint32_t ui32Samples)
+{
+    return(((uint64_t)ui32Samples * 1000000000) / OPUS_PLAYBACK_RATE);
+}
+
+//*****************************************************************************
+//
+// Return the CPU time of this thread in nanoseconds.
+//
+//*****************************************************************************
+static uint64_t
+SimCpuTime(void)
+{
+    struct timespec sTime;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &sTime);
+
+    return(((uint64_t)sTime.tv_sec * 1000000000) + sTime.tv_nsec);
+}
+
+//*****************************************************************************
+//
+// The model of uDMAChannelEnable().  A stopped channel starts on its current
+// control structure if that has been given a buffer.
+//
+//*****************************************************************************
+static void
+SimDmaEnable(void)
+{
+    if(!g_bHwRunning && g_pui32HwSamples[g_ui32HwCur])
+    {
+        g_bHwRunning = true;
+        g_ui64HwEnd = g_ui64Time +
+                      SimSamplesTime(g_pui32HwSamples[g_ui32HwCur]);
+
+        if(g_ui64StallStart)
+        {
+            g_ui64StallTotal += g_ui64Time - g_ui64StallStart;
+            if((g_ui64Time - g_ui64StallStart) > g_ui64StallMax)
+            {
+                g_ui64StallMax = g_ui64Time - g_ui64StallStart;
+            }
+            g_ui64StallStart = 0;
+        }
+    }
+}
+
+//*****************************************************************************
+//
+// Give the idle uDMA control structures the next buffers from the audio ring
+// and enable the channel, as AudioQueue() of the players does.
+//
+//*****************************************************************************
+static void
+AudioQueue(void)
+{
+    const tAudioSlot *psSlot;
+    uint32_t ui32Idx;
+    uint32_t ui32Sel;
+
+    for(ui32Idx = 0; ui32Idx < 2; ui32Idx++)
+    {
+        ui32Sel = g_ui32AudioNext ^ ui32Idx;
+
+        if(g_pbAudioQueued[ui32Sel])
+        {
+            continue;
+        }
+
+        psSlot = AudioRingNext(&g_sAudioRing);
+        if(psSlot == 0)
+        {
+            break;
+        }
+
+        g_pui32HwSamples[ui32Sel] = psSlot->ui32Samples;
+        g_pbAudioQueued[ui32Sel] = true;
+        SimDmaEnable();
+    }
+}
+
+//*****************************************************************************
+//
+// The timer interrupt handler of the players, which runs when a transfer has
+// completed.
+//
+//*****************************************************************************
+static void
+AudioTimerIntHandler(void)
+{
+    while(g_pbAudioQueued[g_ui32AudioNext] &&
+          (g_pui32HwSamples[g_ui32AudioNext] == 0))
+    {
+        g_pbAudioQueued[g_ui32AudioNext] = false;
+        g_ui32AudioNext ^= 1;
+        AudioRingDone(&g_sAudioRing);
+    }
+
+    AudioQueue();
+}
+
+//*****************************************************************************
+//
+// Run the output up to the clock of the main loop.  Every transfer that
+// completes by then switches the channel to the other control structure and
+// runs the interrupt handler at the time it completed.  The main loop does not
+// change the audio ring while it decodes, so running the handler late gives
+// the same result as running it at the time.
+//
+//*****************************************************************************
+static void
+SimRun(void)
+{
+    while(g_bHwRunning && (g_ui64HwEnd <= g_ui64Now))
+    {
+        g_ui64Time = g_ui64HwEnd;
+        g_pui32HwSamples[g_ui32HwCur] = 0;
+        g_ui32HwCur ^= 1;
+        g_bHwRunning = false;
+        if(g_pui32HwSamples[g_ui32HwCur])
+        {
+            g_bHwRunning = true;
+            g_ui64HwEnd = g_ui64Time +
+                          SimSamplesTime(g_pui32HwSamples[g_ui32HwCur]);
+        }
+        else if(!(g_sAudioRing.ui32Flags & AUDIORING_FLAG_END))
+        {
+            g_ui64StallStart = g_ui64Time;
+        }
+
+        AudioTimerIntHandler();
+    }
+
+    g_ui64Time = g_ui64Now;
+}
+
+//*****************************************************************************
+//
+// Advance the clock of the main loop by the time spent on some work.  The
+// simulated SD card calls SimReadUs() for each read.
+//
+//*****************************************************************************
+static void
+SimWait(uint64_t ui64Ns)
+{
+    g_ui64Now += ui64Ns;
+    g_ui64Busy += ui64Ns;
+    SimRun();
+}
+
+static void
+SimReadUs(uint32_t ui32Us)
+{
+    g_ui64Read += (uint64_t)ui32Us * 1000;
+    SimWait((uint64_t)ui32Us * 1000);
+}
+
+//*****************************************************************************
+//
+// Return how much audio is queued ahead of the output, in nanoseconds.  It is
+// the rest of the buffer being played and all of the buffers after it.
+//
+//*****************************************************************************
+static uint64_t
+SimAhead(void)
+{
+    uint64_t ui64Ahead;
+    uint32_t ui32Idx;
+
+    ui64Ahead = 0;
+    ui32Idx = g_sAudioRing.ui32Played;
+    if(g_bHwRunning)
+    {
+        ui64Ahead = g_ui64HwEnd - g_ui64Now;
+        ui32Idx++;
+    }
+
+    for(; ui32Idx != g_sAudioRing.ui32Filled; ui32Idx++)
+    {
+        ui64Ahead += SimSamplesTime(g_sAudioRing.psSlots[
+                                    ui32Idx % g_sAudioRing.ui32NumSlots].
+                                    ui32Samples);
+    }
+
+    return(ui64Ahead);
+}
+
+//*****************************************************************************
+//
+// Set up the stream of psFile to be played next and decode the packets up to
+// the end of its pre-skip, as TrackStart() of the Ogg player does.  The
+// number of output samples that the stream should give is added to the
+// number expected for the run.
+//
+//*****************************************************************************
+static bool
+TrackStart(tOggFile *psFile, tOpusHeadContainer *psHeader)
+{
+    const uint8_t *pui8Packet;
+    uint64_t ui64Size;
+    uint32_t ui32Rate;
+    uint32_t ui32Channels;
+    uint32_t ui32Skip;
+    int32_t  i32Len;
+    int32_t  i32OutSamples;
+    int16_t  i16Ret;
+
+    ui32Rate = psHeader->ui32OpusInputSampleRate;
+    ui32Channels = psHeader->ui8OpusChannelCount;
+
+    if(opus_decoder_init(g_psOpusDecNext, ui32Rate, ui32Channels) != OPUS_OK)
+    {
+        return(false);
+    }
+
+    opus_decoder_ctl(g_psOpusDecNext, OPUS_SET_LSB_DEPTH(16));
+
+    g_sOpusHeaderNext = *psHeader;
+
+    ui32Skip = ((psFile->sOpusHeader.ui16OpusPreSkipBytes * ui32Rate) /
+                48000);
+    ui64Size = (((uint64_t)psHeader->ui32OpusAudioSize[1] << 32) |
+                psHeader->ui32OpusAudioSize[0]);
+    g_ui32LeftNext = ((ui64Size != 0) ?
+                      (uint32_t)((ui64Size * ui32Rate) / 48000) : 0xFFFFFFFF);
+    g_ui32CarryNext = 0;
+    g_ui64Expected += (uint64_t)g_ui32LeftNext * (OPUS_PLAYBACK_RATE /
+                                                  ui32Rate);
+
+    while(ui32Skip != 0)
+    {
+        i16Ret = OggReadPacket(psFile, &pui8Packet, &i32Len);
+        if((i16Ret == ERR_OGG_PACKET_TOO_LARGE) ||
+           (i16Ret == ERR_OGG_PAGE_LOST))
+        {
+            continue;
+        }
+        if(i16Ret <= 0)
+        {
+            break;
+        }
+
+        i32OutSamples = opus_decode(g_psOpusDecNext,
+                (const unsigned char *)pui8Packet, i32Len, g_pi16CarryBuf,
+                ((ui32Rate * OPUS_FRAME_SIZE_IN_MS) / 1000), 0);
+        if(i32OutSamples > 0)
+        {
+            if((uint32_t)i32OutSamples > ui32Skip)
+            {
+                g_ui32CarryNext = i32OutSamples - ui32Skip;
+                memmove(g_pi16CarryBuf, g_pi16CarryBuf +
+                        (ui32Skip * ui32Channels),
+                        (g_ui32CarryNext * ui32Channels * sizeof(int16_t)));
+                break;
+            }
+
+            ui32Skip -= i32OutSamples;
+        }
+
+        if(i16Ret == 2)
+        {
+            break;
+        }
+    }
+
+    g_bNextReady = true;
+
+    return(true);
+}
+
+//*****************************************************************************
+//
+// Switch the decoder over to the stream that was set up by TrackStart().
+//
+//*****************************************************************************
+static void
+TrackSwitch(void)
+{
+    OpusDecoder *psOpusDec;
+    uint8_t ui8ScaleFactor;
+
+    psOpusDec = g_psOpusDec;
+    g_psOpusDec = g_psOpusDecNext;
+    g_psOpusDecNext = psOpusDec;
+
+    g_sOpusHeader = g_sOpusHeaderNext;
+    g_ui32Left = g_ui32LeftNext;
+    g_ui32Carry = g_ui32CarryNext;
+    g_bNextReady = false;
+
+    ui8ScaleFactor = OPUS_PLAYBACK_RATE / g_sOpusHeader.ui32OpusInputSampleRate;
+    if(ui8ScaleFactor != g_ui8ScaleFactor)
+    {
+        g_ui8ScaleFactor = ui8ScaleFactor;
+        UpsampleInit(&g_sUpsampler, g_ui8ScaleFactor, g_bFilter);
+    }
+    g_ui32SizeOfOutBuf = (g_sOpusHeader.ui32OpusInputSampleRate *
+                          g_sOpusHeader.ui8OpusChannelCount *
+                          OPUS_FRAME_SIZE_IN_MS * OPUS_DATA_SCALER) / 1000;
+
+    g_ui32Tracks++;
+}
+
+//*****************************************************************************
+//
+// Set up the next file of the playlist once the whole of the current one is
+// in the packet ring, as NextTrack() of the Ogg player does.
+//
+//*****************************************************************************
+static bool
+NextTrack(void)
+{
+    tOpusHeadContainer sOpusHeader;
+    tUpsampler sUpsampler;
+    tOggFile *psFile;
+    int32_t i32Track;
+
+    if(!OPUS_PLAYLIST || g_bOpx || (g_i32TrackRead < 0) || g_bNextReady ||
+       (g_ui32Carry != 0) ||
+       (g_sPacketRing.ui32DescCount == g_sPacketRing.ui32NumDesc))
+    {
+        return(false);
+    }
+
+    psFile = (g_psOggRead == &g_sOggFile) ? &g_sOggFileNext : &g_sOggFile;
+
+    for(i32Track = g_i32TrackRead + 1; (uint32_t)i32Track < g_ui32NumTracks;
+        i32Track++)
+    {
+        if(OggOpen(g_ppcTracks[i32Track], psFile, &sOpusHeader, true) != 0)
+        {
+            OggClose(psFile);
+            fprintf(stderr, "Skipping %s\n", g_ppcTracks[i32Track]);
+            continue;
+        }
+
+        if((sOpusHeader.ui8OpusChannelCount !=
+            g_sOpusHeader.ui8OpusChannelCount) ||
+           (sOpusHeader.ui32OpusInputSampleRate == 0) ||
+           !UpsampleInit(&sUpsampler, (OPUS_PLAYBACK_RATE /
+                                       sOpusHeader.ui32OpusInputSampleRate),
+                         g_bFilter) ||
+           !TrackStart(psFile, &sOpusHeader))
+        {
+            OggClose(psFile);
+            fprintf(stderr, "The playlist ends before %s\n",
+                    g_ppcTracks[i32Track]);
+            break;
+        }
+
+        OggClose(g_psOggRead);
+        g_psOggRead = psFile;
+        g_i32TrackRead = i32Track;
+        PacketRingPut(&g_sPacketRing, g_sPacketRing.ui32DataWrite, 0,
+                      PKTRING_DESC_NEXT);
+        g_sPacketRing.ui32Flags &= ~PKTRING_FLAG_END;
+
+        return(true);
+    }
+
+    g_i32TrackRead = -1;
+
+    return(false);
+}
+
+//*****************************************************************************
+//
+// Read a batch of packets from the file into the packet ring, and go on to
+// the next file of the playlist once the whole of the file has been read.
+//
+//*****************************************************************************
+static void
+ReadFile(void)
+{
+    if(!(g_sPacketRing.ui32Flags & PKTRING_FLAG_END))
+    {
+        if(g_bOpx)
+        {
+            OpxReadBatch(&g_sOpxFile, &g_sPacketRing);
+        }
+        else
+        {
+            OggReadBatch(g_psOggRead, &g_sPacketRing);
+        }
+    }
+
+    if(g_sPacketRing.ui32Flags & PKTRING_FLAG_END)
+    {
+        NextTrack();
+    }
+}
+
+//*****************************************************************************
+//
+// Read a batch of packets from the file into the packet ring if there is
+// room for at least one more packet of the largest size, or set up the next
+// file of the playlist if the current one has been read.
+//
+//*****************************************************************************
+static void
+ReadPackets(void)
+{
+    uint8_t *pui8Space;
+
+    if((g_sPacketRing.ui32Flags & PKTRING_FLAG_END) ||
+       (PacketRingSpace(&g_sPacketRing, OPUS_MAX_PACKET, &pui8Space) >=
+        OPUS_MAX_PACKET))
+    {
+        ReadFile();
+    }
+}
+
+//*****************************************************************************
+//
+// Get the next packet for the decoder from the packet ring, reading the file
+// if the ring has run dry.
+//
+//*****************************************************************************
+static const tPacketDesc *
+GetPacket(void)
+{
+    const tPacketDesc *psPacket;
+
+    psPacket = PacketRingPeek(&g_sPacketRing);
+    if(psPacket == 0)
+    {
+        ReadFile();
+        psPacket = PacketRingPeek(&g_sPacketRing);
+    }
+
+    return(psPacket);
+}
+
+//*****************************************************************************
+//
+// Decode a packet from the packet ring into pi16Buf.  A packet that stands in
+// for a damaged page of an Ogg file is concealed by the decoder.
+//
+//*****************************************************************************
+static int32_t
+DecodePacket(const tPacketDesc *psPacket, int16_t *pi16Buf)
+{
+    opus_int32 i32Samples;
+
+    i32Samples = (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER);
+
+    if(psPacket->ui16Flags & PKTRING_DESC_LOST)
+    {
+        opus_decoder_ctl(g_psOpusDec,
+                OPUS_GET_LAST_PACKET_DURATION(&i32Samples));
+        if(i32Samples == 0)
+        {
+            i32Samples = ((g_sOpusHeader.ui32OpusInputSampleRate *
+                           OPUS_FRAME_SIZE_IN_MS) / 1000);
+        }
+
+        return(opus_decode(g_psOpusDec, 0, 0, pi16Buf, i32Samples, 0));
+    }
+
+    return(opus_decode(g_psOpusDec,
+            (const unsigned char *)(g_sPacketRing.pui8Data +
+                                    psPacket->ui32Offset),
+            psPacket->ui16Length,
+            pi16Buf,
+            i32Samples,
+            0));
+}
+
+//*****************************************************************************
+//
+// Fill the free buffers of the audio ring, as FillAudioBuffer() of the
+// players does, and record the statistics of each frame.  Returns 2 once the
+// stream has ended and all of its audio has been played.
+//
+//*****************************************************************************
+static uint32_t
+FillAudioBuffer(void)
+{
+    const tPacketDesc *psPacket;
+    tAudioSlot *psSlot;
+    int16_t  *pi16Decode;
+    int32_t  i32OutSamples;
+    int32_t  i32Margin;
+    uint32_t ui32Samples;
+    uint32_t ui32Loop;
+    uint64_t ui64Start;
+    uint64_t ui64Cpu;
+    uint64_t ui64Busy;
+    uint64_t ui64Read;
+    uint64_t ui64Ahead;
+
+    while(!(g_sAudioRing.ui32Flags & AUDIORING_FLAG_END))
+    {
+        psSlot = AudioRingFree(&g_sAudioRing);
+        if(psSlot == 0)
+        {
+            break;
+        }
+
+        //
+        // Decode and upsample the frame, and charge the time it took to the
+        // clock.  A stream of the playlist starts with the audio after its
+        // pre-skip from the carry buffer, and ends at its length.
+        //
+        ui64Start = SimCpuTime();
+        if(g_ui32Carry != 0)
+        {
+            pi16Decode = g_pi16CarryBuf;
+            i32OutSamples = g_ui32Carry;
+            g_ui32Carry = 0;
+        }
+        else
+        {
+            psPacket = GetPacket();
+
+            if(psPacket == 0)
+            {
+                AudioRingEnd(&g_sAudioRing);
+                break;
+            }
+
+            if(psPacket->ui16Flags & PKTRING_DESC_NEXT)
+            {
+                PacketRingRelease(&g_sPacketRing);
+                TrackSwitch();
+                continue;
+            }
+
+            pi16Decode = ((g_ui8ScaleFactor > 1) ? g_pi16DecodeBuf :
+                          psSlot->pi16Data);
+            if(g_bOpx)
+            {
+                i32OutSamples = opus_decode(g_psOpusDec,
+                        (const unsigned char *)(g_sPacketRing.pui8Data +
+                                                psPacket->ui32Offset),
+                        psPacket->ui16Length, pi16Decode,
+                        (g_ui32SizeOfOutBuf/OPUS_DATA_SCALER), 0);
+                if(psPacket->ui16Flags & PKTRING_DESC_LAST)
+                {
+                    AudioRingEnd(&g_sAudioRing);
+                }
+            }
+            else
+            {
+                i32OutSamples = DecodePacket(psPacket, pi16Decode);
+            }
+            PacketRingRelease(&g_sPacketRing);
+        }
+
+        if((i32OutSamples > 0) && ((uint32_t)i32OutSamples > g_ui32Left))
+        {
+            i32OutSamples = g_ui32Left;
+        }
+
+        ui32Samples = 0;
+        if(i32OutSamples > 0)
+        {
+            g_ui32Left -= i32OutSamples;
+            if(g_b8Bit)
+            {
+                for(ui32Loop = 0; ui32Loop < (uint32_t)i32OutSamples;
+                    ui32Loop++)
+                {
+                    pi16Decode[ui32Loop] =
+                            (int16_t)((uint16_t)pi16Decode[ui32Loop] << 8);
+                }
+            }
+            ui32Samples = UpsampleProcess(&g_sUpsampler, pi16Decode,
+                                          i32OutSamples,
+                                          (uint16_t *)psSlot->pi16Data,
+                                          g_ui32Shift);
+        }
+
+        ui64Cpu = (uint64_t)((SimCpuTime() - ui64Start) * g_dSlowdown);
+        SimWait(ui64Cpu);
+
+        if(i32OutSamples < 0)
+        {
+            g_ui32Errors++;
+        }
+        if(ui32Samples == 0)
+        {
+            continue;
+        }
+
+        //
+        // The margin is the share of the frame duration that was left over
+        // after all of the reading and decoding since the last frame, and the
+        // audio ahead of the output is how long the output could go on
+        // without this frame.
+        //
+        ui64Busy = g_ui64Busy - g_ui64BusyLast;
+        ui64Read = g_ui64Read - g_ui64ReadLast;
+        g_ui64BusyLast = g_ui64Busy;
+        g_ui64ReadLast = g_ui64Read;
+        ui64Ahead = SimAhead();
+        i32Margin = (int32_t)(100 - ((ui64Busy * 100) /
+                                     SimSamplesTime(ui32Samples)));
+
+        g_ui32Frames++;
+        g_ui64CpuTotal += ui64Cpu;
+        if(ui64Cpu > g_ui64CpuMax)
+        {
+            g_ui64CpuMax = ui64Cpu;
+        }
+        if(i32Margin < g_i32MarginMin)
+        {
+            g_i32MarginMin = i32Margin;
+        }
+        if((g_ui32Frames > 1) && (ui64Ahead < g_ui64AheadMin))
+        {
+            g_ui64AheadMin = ui64Ahead;
+        }
+
+        if(g_bVerbose)
+        {
+            printf("%u,%.3f,%.1f,%.1f,%d,%.3f\n", g_ui32Frames,
+                   g_ui64Now / 1e6, ui64Cpu / 1e3, ui64Read / 1e3, i32Margin,
+                   ui64Ahead / 1e6);
+        }
+
+        AudioRingPut(&g_sAudioRing, ui32Samples);
+        AudioQueue();
+    }
+
+    if((g_sAudioRing.ui32Flags & AUDIORING_FLAG_END) &&
+       AudioRingDrained(&g_sAudioRing))
+    {
+        return(2);
+    }
+
+    return(1);
+}
+
+//*****************************************************************************
+//
+// Set up the pipeline for the open file, as InitAudio() of the players does.
+//
+//*****************************************************************************
+static int32_t
+InitAudio(uint32_t ui32Rate, uint32_t ui32Channels)
+{
+    uint8_t  *pui8PacketData;
+    tPacketDesc *psPacketDesc;
+    int16_t  *pi16AudioData;
+    uint32_t ui32BufSize;
+    uint32_t ui32DecodeSize;
+    int32_t  i32error;
+
+    BufPoolInit(&g_sBufPool, g_pui64PoolData, sizeof(g_pui64PoolData));
+
+    pui8PacketData = BufPoolAlloc(&g_sBufPool, OPUS_PACKET_RING_SIZE);
+    psPacketDesc = BufPoolAlloc(&g_sBufPool,
+                                OPUS_PACKET_RING_DESC * sizeof(tPacketDesc));
+    if((pui8PacketData == 0) || (psPacketDesc == 0))
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    PacketRingInit(&g_sPacketRing, pui8PacketData, OPUS_PACKET_RING_SIZE,
+                   psPacketDesc, OPUS_PACKET_RING_DESC);
+
+    g_psOpusDec = BufPoolAlloc(&g_sBufPool,
+                               opus_decoder_get_size(ui32Channels));
+    if(g_psOpusDec == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    i32error = opus_decoder_init(g_psOpusDec, ui32Rate, ui32Channels);
+    if(i32error != OPUS_OK)
+    {
+        return(i32error);
+    }
+
+    opus_decoder_ctl(g_psOpusDec, OPUS_SET_LSB_DEPTH(g_b8Bit ? 8 : 16));
+
+    g_psOpusDecNext = g_psOpusDec;
+    if(OPUS_PLAYLIST && !g_bOpx)
+    {
+        g_psOpusDecNext = BufPoolAlloc(&g_sBufPool,
+                                       opus_decoder_get_size(ui32Channels));
+        if(g_psOpusDecNext == 0)
+        {
+            return(OPUS_ALLOC_FAIL);
+        }
+    }
+
+    g_ui8ScaleFactor = OPUS_PLAYBACK_RATE / ui32Rate;
+    g_ui32SizeOfOutBuf = (ui32Rate * ui32Channels * OPUS_FRAME_SIZE_IN_MS *
+                          OPUS_DATA_SCALER) / 1000;
+    ui32BufSize = (((g_ui32SizeOfOutBuf * g_ui8ScaleFactor) /
+                    OPUS_DATA_SCALER) + 1);
+    pi16AudioData = BufPoolAlloc(&g_sBufPool, g_ui32NumSlots *
+                                 ui32BufSize * sizeof(int16_t));
+    if(pi16AudioData == 0)
+    {
+        return(OPUS_ALLOC_FAIL);
+    }
+
+    AudioRingInit(&g_sAudioRing, g_psAudioSlots, g_ui32NumSlots,
+                  pi16AudioData, ui32BufSize);
+
+    if(!UpsampleInit(&g_sUpsampler, g_ui8ScaleFactor, g_bFilter))
+    {
+        return(OPUS_BAD_ARG);
+    }
+
+    ui32DecodeSize = ((g_ui8ScaleFactor > 1) ?
+                      (g_ui32SizeOfOutBuf / OPUS_DATA_SCALER) : 0);
+    if(OPUS_PLAYLIST && !g_bOpx)
+    {
+        ui32DecodeSize = (((OPUS_PLAYBACK_RATE / 2) * ui32Channels *
+                           OPUS_FRAME_SIZE_IN_MS) / 1000);
+    }
+
+    g_pi16DecodeBuf = 0;
+    if(ui32DecodeSize != 0)
+    {
+        g_pi16DecodeBuf = BufPoolAlloc(&g_sBufPool,
+                (ui32DecodeSize + UPSAMPLE_HISTORY) * sizeof(int16_t));
+        if(g_pi16DecodeBuf == 0)
+        {
+            return(OPUS_ALLOC_FAIL);
+        }
+        g_pi16DecodeBuf += UPSAMPLE_HISTORY;
+    }
+
+    if(!g_bOpx)
+    {
+        g_pi16CarryBuf = BufPoolAlloc(&g_sBufPool,
+                ((((OPUS_PLAYBACK_RATE * ui32Channels *
+                    OPUS_FRAME_SIZE_IN_MS) / 1000) + UPSAMPLE_HISTORY) *
+                 sizeof(int16_t)));
+        if(g_pi16CarryBuf == 0)
+        {
+            return(OPUS_ALLOC_FAIL);
+        }
+        g_pi16CarryBuf += UPSAMPLE_HISTORY;
+    }
+    g_ui32Carry = 0;
+    g_bNextReady = false;
+
+    //
+    // The uDMA starts on the alternate control structure.
+    //
+    g_pbAudioQueued[0] = false;
+    g_pbAudioQueued[1] = false;
+    g_ui32AudioNext = 1;
+    g_ui32HwCur = 1;
+
+    return(0);
+}
+
+//*****************************************************************************
+//
+// Read the recorded latencies of the SD card, one per line in microseconds.
+//
+//*****************************************************************************
+static uint32_t
+ReadLatencies(const char *pcName, uint32_t *pui32Latency)
+{
+    FILE *psFile;
+    unsigned long ulUs;
+    uint32_t ui32Count;
+    char pcLine[64];
+
+    psFile = fopen(pcName, "r");
+    if(psFile == 0)
+    {
+        return(0);
+    }
+
+    ui32Count = 0;
+    while((ui32Count < SIM_MAX_LATENCIES) &&
+          fgets(pcLine, sizeof(pcLine), psFile))
+    {
+        if(sscanf(pcLine, "%lu", &ulUs) == 1)
+        {
+            pui32Latency[ui32Count++] = (uint32_t)ulUs;
+        }
+    }
+
+    fclose(psFile);
+
+    return(ui32Count);
+}
+
+//*****************************************************************************
+//
+// Decode packets from an Ogg file at 48 kHz until the end of the stream or
+// until ui32Max samples per channel have been stored in pi16Out, discarding
+// the first ui32Skip samples.  Returns the number of samples stored.
+//
+//*****************************************************************************
+static uint32_t
+SeekDecode(OpusDecoder *psDec, tOggFile *psFile, uint32_t ui32Channels,
+           uint32_t ui32Skip, int16_t *pi16Out, uint32_t ui32Max)
+{
+    static int16_t pi16Frame[OGG_MAX_PACKET_SAMPLES * 2];
+    const uint8_t *pui8Packet;
+    uint32_t ui32Stored;
+    uint32_t ui32Start;
+    uint32_t ui32Len;
+    int32_t  i32Len;
+    int32_t  i32OutSamples;
+    int16_t  i16Ret;
+
+    ui32Stored = 0;
+    while(ui32Stored < ui32Max)
+    {
+        i16Ret = OggReadPacket(psFile, &pui8Packet, &i32Len);
+        if((i16Ret == ERR_OGG_PACKET_TOO_LARGE) ||
+           (i16Ret == ERR_OGG_PAGE_LOST))
+        {
+            continue;
+        }
+        if(i16Ret <= 0)
+        {
+            break;
+        }
+
+        i32OutSamples = opus_decode(psDec, (const unsigned char *)pui8Packet,
+                                    i32Len, pi16Frame,
+                                    OGG_MAX_PACKET_SAMPLES, 0);
+        if(i32OutSamples > 0)
+        {
+            ui32Start = ((uint32_t)i32OutSamples < ui32Skip) ?
+                        (uint32_t)i32OutSamples : ui32Skip;
+            ui32Skip -= ui32Start;
+            ui32Len = i32OutSamples - ui32Start;
+            if(ui32Len > (ui32Max - ui32Stored))
+            {
+                ui32Len = ui32Max - ui32Stored;
+            }
+            memcpy(pi16Out + (ui32Stored * ui32Channels),
+                   pi16Frame + (ui32Start * ui32Channels),
+                   ui32Len * ui32Channels * sizeof(int16_t));
+            ui32Stored += ui32Len;
+        }
+
+        if(i16Ret == 2)
+        {
+            break;
+        }
+    }
+
+    return(ui32Stored);
+}
+
+//*****************************************************************************
+//
+// Return the sum of the squared differences of two blocks of samples, or a
+// value of at least ui64Limit if it reaches that.
+//
+//*****************************************************************************
+static uint64_t
+SeekError(const int16_t *pi16A, const int16_t *pi16B, uint32_t ui32Count,
+          uint64_t ui64Limit)
+{
+    uint64_t ui64Error;
+    uint32_t ui32Loop;
+    int32_t  i32Diff;
+
+    ui64Error = 0;
+    for(ui32Loop = 0; (ui32Loop < ui32Count) && (ui64Error < ui64Limit);
+        ui32Loop++)
+    {
+        i32Diff = pi16A[ui32Loop] - pi16B[ui32Loop];
+        ui64Error += (uint64_t)((int64_t)i32Diff * i32Diff);
+    }
+
+    return(ui64Error);
+}
+
+//*****************************************************************************
+//
+// Check OggSeek() on the open Ogg file.  The stream is decoded once from the
+// start at 48 kHz, the rate of the granule positions, and again after seeking
+// to each of ui32Count positions spread over it, discarding the number of
+// samples that OggSeek() gave in ui32SkipSamples.  Once the decoder has
+// converged the audio must then match the audio decoded from the start at the
+// same position closely, and better than at any other offset up to the length
+// of the longest packet.  Positions where the audio is too quiet to be
+// compared are counted but not checked.  Returns the number of positions that
+// failed.
+//
+//*****************************************************************************
+static uint32_t
+SeekCheck(uint32_t ui32Count)
+{
+    OpusDecoder *psDec;
+    int16_t *pi16Ref;
+    int16_t *pi16Seek;
+    uint64_t ui64Size;
+    uint64_t ui64Target;
+    uint64_t ui64Error;
+    uint64_t ui64Best;
+    uint64_t ui64Power;
+    uint32_t ui32Channels;
+    uint32_t ui32PreSkip;
+    uint32_t ui32RefLen;
+    uint32_t ui32Len;
+    uint32_t ui32Skip;
+    uint32_t ui32Pos;
+    uint32_t ui32Idx;
+    uint32_t ui32Quiet;
+    uint32_t ui32Failed;
+    int32_t  i32Offset;
+    int32_t  i32Best;
+    int      iErr;
+    double   dSnr;
+    double   dSnrMin;
+
+    ui32Channels = g_sOpusHeader.ui8OpusChannelCount;
+    ui32PreSkip = g_sOggFile.sOpusHeader.ui16OpusPreSkipBytes;
+    ui64Size = (((uint64_t)g_sOpusHeader.ui32OpusAudioSize[1] << 32) |
+                g_sOpusHeader.ui32OpusAudioSize[0]);
+    if((ui32Channels > 2) ||
+       (ui64Size <= (SIM_SEEK_SETTLE + SIM_SEEK_WINDOW)) ||
+       (ui64Size > (UINT32_MAX - ui32PreSkip - OGG_MAX_PACKET_SAMPLES)))
+    {
+        fprintf(stderr, "The length of the file is not known or too short "
+                "or long to check seeking\n");
+        return(1);
+    }
+
+    //
+    // The decoded audio can run on past the end of the stream by up to one
+    // packet.
+    //
+    ui32RefLen = (uint32_t)ui64Size + ui32PreSkip + OGG_MAX_PACKET_SAMPLES;
+    pi16Ref = malloc(ui32RefLen * ui32Channels * sizeof(int16_t));
+    pi16Seek = malloc(SIM_SEEK_WINDOW * ui32Channels * sizeof(int16_t));
+    psDec = opus_decoder_create(48000, ui32Channels, &iErr);
+    if((pi16Ref == 0) || (pi16Seek == 0) || (psDec == 0))
+    {
+        fprintf(stderr, "Cannot set up the seek check\n");
+        opus_decoder_destroy(psDec);
+        free(pi16Seek);
+        free(pi16Ref);
+        return(1);
+    }
+
+    ui32RefLen = SeekDecode(psDec, &g_sOggFile, ui32Channels, 0, pi16Ref,
+                            ui32RefLen);
+
+    if(g_bVerbose)
+    {
+        printf("target,skip,offset,snr_db\n");
+    }
+
+    ui32Quiet = 0;
+    ui32Failed = 0;
+    dSnrMin = 1000.0;
+    for(ui32Idx = 0; ui32Idx < ui32Count; ui32Idx++)
+    {
+        ui64Target = (((ui64Size - SIM_SEEK_SETTLE - SIM_SEEK_WINDOW) *
+                       ui32Idx) / ui32Count);
+        ui32Pos = (uint32_t)ui64Target + ui32PreSkip + SIM_SEEK_SETTLE;
+        if((ui32Pos + SIM_SEEK_WINDOW) > ui32RefLen)
+        {
+            break;
+        }
+
+        opus_decoder_ctl(psDec, OPUS_RESET_STATE);
+        ui32Len = 0;
+        ui32Skip = 0;
+        if(OggSeek(&g_sOggFile, ui64Target) == 0)
+        {
+            ui32Skip = g_sOggFile.ui32SkipSamples;
+            ui32Len = SeekDecode(psDec, &g_sOggFile, ui32Channels,
+                                 ui32Skip + SIM_SEEK_SETTLE, pi16Seek,
+                                 SIM_SEEK_WINDOW);
+        }
+        if(ui32Len != SIM_SEEK_WINDOW)
+        {
+            printf("Seek to %llu failed\n", (unsigned long long)ui64Target);
+            ui32Failed++;
+            continue;
+        }
+
+        ui64Power = 0;
+        for(ui32Len = 0; ui32Len < (SIM_SEEK_WINDOW * ui32Channels);
+            ui32Len++)
+        {
+            ui64Power += (uint64_t)((int32_t)pi16Ref[(ui32Pos * ui32Channels) +
+                                                     ui32Len] *
+                                    pi16Ref[(ui32Pos * ui32Channels) +
+                                            ui32Len]);
+        }
+        if(ui64Power < ((uint64_t)SIM_SEEK_MIN_POWER * SIM_SEEK_WINDOW *
+                        ui32Channels))
+        {
+            ui32Quiet++;
+            continue;
+        }
+
+        //
+        // Find the offset at which the audio matches best, starting from no
+        // offset.  The sum for an offset is given up as soon as it is no
+        // better than the best so far.
+        //
+        ui64Error = SeekError(pi16Seek, pi16Ref + (ui32Pos * ui32Channels),
+                              SIM_SEEK_WINDOW * ui32Channels, UINT64_MAX);
+        dSnr = ((ui64Error == 0) ? 1000.0 :
+                10.0 * log10((double)ui64Power / ui64Error));
+        ui64Best = ui64Error;
+        i32Best = 0;
+        for(i32Offset = -SIM_SEEK_MAX_OFFSET; i32Offset <= SIM_SEEK_MAX_OFFSET;
+            i32Offset++)
+        {
+            if((i32Offset == 0) || (((int32_t)ui32Pos + i32Offset) < 0) ||
+               ((ui32Pos + i32Offset + SIM_SEEK_WINDOW) > ui32RefLen))
+            {
+                continue;
+            }
+
+            ui64Error = SeekError(pi16Seek,
+                                  pi16Ref + ((ui32Pos + i32Offset) *
+                                             ui32Channels),
+                                  SIM_SEEK_WINDOW * ui32Channels, ui64Best);
+            if(ui64Error < ui64Best)
+            {
+                ui64Best = ui64Error;
+                i32Best = i32Offset;
+            }
+        }
+
+        if(g_bVerbose)
+        {
+            printf("%llu,%u,%d,%.1f\n", (unsigned long long)ui64Target,
+                   ui32Skip, i32Best, dSnr);
+        }
+
+        if(dSnr < dSnrMin)
+        {
+            dSnrMin = dSnr;
+        }
+
+        if((i32Best != 0) || (dSnr < SIM_SEEK_MIN_SNR))
+        {
+            printf("Seek to %llu skipped %u samples: audio is %d samples "
+                   "off, %.1f dB\n", (unsigned long long)ui64Target, ui32Skip,
+                   i32Best, dSnr);
+            ui32Failed++;
+        }
+    }
+
+    printf("Seeks           %u checked, %u too quiet, %u failed, ",
+           ui32Idx - ui32Quiet, ui32Quiet, ui32Failed);
+    if(dSnrMin < 1000.0)
+    {
+        printf("%.1f dB least match\n", dSnrMin);
+    }
+    else
+    {
+        printf("all exact\n");
+    }
+
+    opus_decoder_destroy(psDec);
+    free(pi16Seek);
+    free(pi16Ref);
+
+    return(ui32Failed);
+}
+
+//*****************************************************************************
+//
+// Print how the options are used.
+//
+//*****************************************************************************
+static void
+Usage(const char *pcName)
+{
+    fprintf(stderr,
+            "Usage: %s [options] file.ogg... | file.opx\n"
+            "  -s factor  slowdown of the decoder against this machine "
+            "(default 1)\n"
+            "  -l file    recorded SD read latencies in us, one per line\n"
+            "  -b rate    SD transfer rate in KB/s (default none)\n"
+            "  -n slots   audio ring slots (default %d, at most %d)\n"
+            "  -u 0|1     upsample by repeating samples or by filtering "
+            "(default %d)\n"
+            "  -r seed    seed of the latency draw (default 1)\n"
+            "  -v         print a CSV line for each frame: frame, time (ms), "
+            "decode (us),\n"
+            "             read since the last frame (us), margin (%%), "
+            "audio ahead (ms)\n"
+            "  -k count   check seeking to count positions of an Ogg file "
+            "against the audio\n"
+            "             decoded from the start instead of playing it\n",
+            pcName, OPUS_AUDIO_RING_SLOTS, SIM_MAX_SLOTS,
+            OPUS_UPSAMPLE_FILTER);
+}
+
+//*****************************************************************************
+//
+// Run the simulation of one file.
+//
+//*****************************************************************************
+int
+main(int argc, char *argv[])
+{
+    static uint32_t pui32Latency[SIM_MAX_LATENCIES];
+    tStorageSimModel sModel;
+    const char *pcName;
+    uint32_t ui32Rate;
+    uint32_t ui32Channels;
+    uint32_t ui32Ret;
+    uint64_t ui64Before;
+    size_t   iLen;
+    int      iOpt;
+
+    memset(&sModel, 0, sizeof(sModel));
+    sModel.ui32Seed = 1;
+    sModel.pfnWait = SimReadUs;
+
+    while((iOpt = getopt(argc, argv, "s:l:b:n:u:r:vk:")) != -1)
+    {
+        switch(iOpt)
+        {
+            case 's':
+            {
+                g_dSlowdown = atof(optarg);
+                break;
+            }
+            case 'l':
+            {
+                sModel.pui32Latency = pui32Latency;
+                sModel.ui32NumLatency = ReadLatencies(optarg, pui32Latency);
+                if(sModel.ui32NumLatency == 0)
+                {
+                    fprintf(stderr, "No latencies in %s\n", optarg);
+                    return(1);
+                }
+                break;
+            }
+            case 'b':
+            {
+                sModel.ui32BytesPerMs = (uint32_t)atoi(optarg);
+                break;
+            }
+            case 'n':
+            {
+                g_ui32NumSlots = (uint32_t)atoi(optarg);
+                break;
+            }
+            case 'u':
+            {
+                g_bFilter = (atoi(optarg) != 0);
+                break;
+            }
+            case 'r':
+            {
+                sModel.ui32Seed = (uint32_t)strtoul(optarg, 0, 0);
+                if(sModel.ui32Seed == 0)
+                {
+                    sModel.ui32Seed = 1;
+                }
+                break;
+            }
+            case 'v':
+            {
+                g_bVerbose = true;
+                break;
+            }
+            case 'k':
+            {
+                g_ui32SeekChecks = (uint32_t)atoi(optarg);
+                break;
+            }
+            default:
+            {
+                Usage(argv[0]);
+                return(1);
+            }
+        }
+    }
+
+    if((optind >= argc) || (g_ui32NumSlots < 1) ||
+       (g_ui32NumSlots > SIM_MAX_SLOTS) || (g_dSlowdown <= 0))
+    {
+        Usage(argv[0]);
+        return(1);
+    }
+
+    //
+    // Open the first file, which is read through the simulated SD card from
+    // here on.  Several Ogg files are played one after the other as a
+    // playlist.
+    //
+    StorageSimModelSet(&sModel);
+    pcName = argv[optind];
+    iLen = strlen(pcName);
+    g_bOpx = ((iLen > 4) && !strcmp(pcName + iLen - 4, ".opx"));
+    g_ppcTracks = argv + optind;
+    g_ui32NumTracks = argc - optind;
+    if(g_bOpx)
+    {
+        if((g_ui32NumTracks > 1) || (g_ui32SeekChecks != 0))
+        {
+            Usage(argv[0]);
+            return(1);
+        }
+        if(OpxOpen(pcName, &g_sOpxFile) != 0)
+        {
+            fprintf(stderr, "Cannot open %s\n", pcName);
+            return(1);
+        }
+        OpxGetFormat(&g_sOpxFile, &g_sOpxHeader);
+        ui32Rate = g_sOpxHeader.ui32SampleRate;
+        ui32Channels = g_sOpxHeader.ui16NumChannels;
+        g_b8Bit = (g_sOpxHeader.ui16BitsPerSample == 8);
+    }
+    else
+    {
+        if(OggOpen(pcName, &g_sOggFile, &g_sOpusHeader, true) != 0)
+        {
+            fprintf(stderr, "Cannot open %s\n", pcName);
+            return(1);
+        }
+        ui32Rate = g_sOpusHeader.ui32OpusInputSampleRate;
+        ui32Channels = g_sOpusHeader.ui8OpusChannelCount;
+
+        if(g_ui32SeekChecks != 0)
+        {
+            ui32Ret = SeekCheck(g_ui32SeekChecks);
+            OggClose(&g_sOggFile);
+            return((ui32Ret != 0) ? 1 : 0);
+        }
+    }
+    g_ui32Shift = g_b8Bit ? 6 : 5;
+
+    if(InitAudio(ui32Rate, ui32Channels) != 0)
+    {
+        fprintf(stderr, "Cannot set up playback of %u Hz, %u channels\n",
+                ui32Rate, ui32Channels);
+        return(1);
+    }
+
+    if(g_bOpx)
+    {
+        g_ui32Left = 0xFFFFFFFF;
+    }
+    else
+    {
+        g_psOggRead = &g_sOggFile;
+        g_i32TrackRead = 0;
+        if(!TrackStart(&g_sOggFile, &g_sOpusHeader))
+        {
+            fprintf(stderr, "Cannot start %s\n", pcName);
+            return(1);
+        }
+        TrackSwitch();
+    }
+
+    if(g_bVerbose)
+    {
+        printf("frame,time_ms,decode_us,read_us,margin_pct,ahead_ms\n");
+    }
+
+    //
+    // The main loop of the players.  When a pass through it has nothing to
+    // do, it would spin until the output frees a buffer, so the clock is
+    // moved on to the end of the current transfer.
+    //
+    g_ui64Time = g_ui64Now;
+    while(1)
+    {
+        ui64Before = g_ui64Now;
+
+        ui32Ret = FillAudioBuffer();
+        if(ui32Ret == 2)
+        {
+            break;
+        }
+        else if(AudioRingFree(&g_sAudioRing) == 0)
+        {
+            ReadPackets();
+        }
+
+        if(g_ui64Now == ui64Before)
+        {
+            if(!g_bHwRunning)
+            {
+                fprintf(stderr, "The output stopped with nothing to play\n");
+                return(1);
+            }
+            g_ui64Now = g_ui64HwEnd;
+            SimRun();
+        }
+    }
+
+    if(g_bOpx)
+    {
+        OpxClose(&g_sOpxFile);
+    }
+    else
+    {
+        OggClose(&g_sOggFile);
+        OggClose(&g_sOggFileNext);
+    }
+
+    //
+    // Print the summary.  The samples expected are the lengths given by the
+    // Ogg files, after their pre-skip.
+    //
+    printf("File            %s (%u Hz, %u channels, %s upsampling)\n",
+           pcName, ui32Rate, ui32Channels,
+           (g_bFilter && (g_ui8ScaleFactor > 1)) ? "filtered" : "repeated");
+    printf("Frames          %u in %.3f s, %u not decoded\n", g_ui32Frames,
+           g_ui64Now / 1e9, g_ui32Errors);
+    if(!g_bOpx)
+    {
+        printf("Samples         %u played of %llu expected from %u of %u "
+               "files\n", g_sAudioRing.ui32Clock,
+               (unsigned long long)g_ui64Expected, g_ui32Tracks,
+               g_ui32NumTracks);
+    }
+    printf("Pool used       %u of %u bytes\n", BufPoolHighWater(&g_sBufPool),
+           (uint32_t)sizeof(g_pui64PoolData));
+    printf("Decode          %.1f us average, %.1f us worst (x%.2f)\n",
+           g_ui32Frames ? (g_ui64CpuTotal / 1e3) / g_ui32Frames : 0.0,
+           g_ui64CpuMax / 1e3, g_dSlowdown);
+    printf("SD reads        %u, %.1f us average, %u us worst\n",
+           sModel.ui32Reads,
+           sModel.ui32Reads ? (double)sModel.ui64TotalUs / sModel.ui32Reads :
+           0.0, sModel.ui32MaxUs);
+    printf("Real-time       %d%% worst margin, %.3f ms least audio ahead\n",
+           g_i32MarginMin,
+           (g_ui64AheadMin == UINT64_MAX) ? 0.0 : g_ui64AheadMin / 1e6);
+    printf("Underruns       %u, %.3f ms silent, %.3f ms longest\n",
+           g_sAudioRing.ui32Underruns, g_ui64StallTotal / 1e6,
+           g_ui64StallMax / 1e6);
+    printf("Refill latency  %.3f ms worst, %u of %u buffers least ready\n",
+           (g_sAudioRing.ui32MaxLatency * 1e3) / OPUS_PLAYBACK_RATE,
+           g_sAudioRing.ui32MinFill, g_sAudioRing.ui32NumSlots);
+
+    return((g_sAudioRing.ui32Underruns != 0) ? 2 : 0);
+}
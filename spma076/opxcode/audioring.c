@@ -0,0 +1,256 @@
+//*****************************************************************************
+//
+// audioring.c - A ring of decoded audio buffers that feed the playback DMA.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "opxcode/audioring.h"
+
+//******************************************************************************
+//
+// This function prepares an audio ring for use.
+//
+// \param psRing is the ring to initialize.
+// \param psSlots is the array that will describe the buffers.
+// \param ui32NumSlots is the number of entries in \e psSlots.
+// \param pi16Data is the memory for the buffers, which must hold
+// \e ui32NumSlots times \e ui32SlotSamples samples.
+// \param ui32SlotSamples is the number of samples in each buffer.
+//
+// \return None.
+//
+//******************************************************************************
+void
+AudioRingInit(tAudioRing *psRing, tAudioSlot *psSlots, uint32_t ui32NumSlots,
+              int16_t *pi16Data, uint32_t ui32SlotSamples)
+{
+    uint32_t ui32Idx;
+
+    psRing->psSlots = psSlots;
+    psRing->ui32NumSlots = ui32NumSlots;
+
+    for(ui32Idx = 0; ui32Idx < ui32NumSlots; ui32Idx++)
+    {
+        psSlots[ui32Idx].pi16Data = pi16Data + (ui32Idx * ui32SlotSamples);
+    }
+
+    AudioRingReset(psRing);
+}
+
+//******************************************************************************
+//
+// This function empties an audio ring and clears its statistics.  It must
+// not be called while the output is using the ring.
+//
+// \param psRing is the ring to empty.
+//
+// \return None.
+//
+//******************************************************************************
+void
+AudioRingReset(tAudioRing *psRing)
+{
+    uint32_t ui32Idx;
+
+    psRing->ui32Filled = 0;
+    psRing->ui32Queued = 0;
+    psRing->ui32Played = 0;
+    psRing->ui32Clock = 0;
+    psRing->ui32Flags = 0;
+    psRing->ui32Underruns = 0;
+    psRing->ui32MinFill = psRing->ui32NumSlots;
+    psRing->ui32MaxLatency = 0;
+
+    for(ui32Idx = 0; ui32Idx < psRing->ui32NumSlots; ui32Idx++)
+    {
+        psRing->psSlots[ui32Idx].ui32Samples = 0;
+        psRing->psSlots[ui32Idx].ui32Freed = 0;
+    }
+}
+
+//******************************************************************************
+//
+// This function finds the buffer that is to be filled next.
+//
+// \param psRing is the audio ring.
+//
+// The buffer is handed to the output once it has been filled and passed to
+// AudioRingPut().
+//
+// \return Returns the buffer, or 0 if all of the buffers are waiting to be
+// played out.
+//
+//******************************************************************************
+tAudioSlot *
+AudioRingFree(tAudioRing *psRing)
+{
+    if((psRing->ui32Filled - psRing->ui32Played) >= psRing->ui32NumSlots)
+    {
+        return(0);
+    }
+
+    return(&psRing->psSlots[psRing->ui32Filled % psRing->ui32NumSlots]);
+}
+
+//******************************************************************************
+//
+// This function adds the buffer returned by AudioRingFree() to the ring.
+//
+// \param psRing is the audio ring.
+// \param ui32Samples is the number of samples that were written to the
+// buffer.
+//
+// The time since the buffer was last played out is measured against the
+// output sample clock, which advances a buffer at a time.
+//
+// \return None.
+//
+//******************************************************************************
+void
+AudioRingPut(tAudioRing *psRing, uint32_t ui32Samples)
+{
+    tAudioSlot *psSlot;
+    uint32_t ui32Latency;
+
+    psSlot = &psRing->psSlots[psRing->ui32Filled % psRing->ui32NumSlots];
+    psSlot->ui32Samples = ui32Samples;
+
+    //
+    // The buffers are all free before the output starts, so only count the
+    // ones that have been played out before.
+    //
+    if(psRing->ui32Filled >= psRing->ui32NumSlots)
+    {
+        ui32Latency = psRing->ui32Clock - psSlot->ui32Freed;
+        if(ui32Latency > psRing->ui32MaxLatency)
+        {
+            psRing->ui32MaxLatency = ui32Latency;
+        }
+    }
+
+    psRing->ui32Filled++;
+}
+
+//******************************************************************************
+//
+// This function takes the next buffer for the output.  It is called from the
+// output interrupt handler each time that the DMA can be given a buffer.
+//
+// \param psRing is the audio ring.
+//
+// If no buffer is ready while the output has nothing left to play, the
+// output stops and this is counted as an underrun, unless the end of the
+// stream has been reached.
+//
+// \return Returns the buffer to play out, or 0 if none is ready.
+//
+//******************************************************************************
+const tAudioSlot *
+AudioRingNext(tAudioRing *psRing)
+{
+    const tAudioSlot *psSlot;
+    uint32_t ui32Fill;
+
+    ui32Fill = psRing->ui32Filled - psRing->ui32Queued;
+
+    if(ui32Fill == 0)
+    {
+        if((psRing->ui32Queued == psRing->ui32Played) &&
+           !(psRing->ui32Flags & AUDIORING_FLAG_END))
+        {
+            psRing->ui32Underruns++;
+            psRing->ui32MinFill = 0;
+        }
+        return(0);
+    }
+
+    //
+    // Running low at the end of the stream is expected.
+    //
+    if((ui32Fill < psRing->ui32MinFill) &&
+       !(psRing->ui32Flags & AUDIORING_FLAG_END))
+    {
+        psRing->ui32MinFill = ui32Fill;
+    }
+
+    psSlot = &psRing->psSlots[psRing->ui32Queued % psRing->ui32NumSlots];
+    psRing->ui32Queued++;
+
+    return(psSlot);
+}
+
+//******************************************************************************
+//
+// This function frees the oldest buffer that was taken by AudioRingNext(),
+// once the output has finished playing it.
+//
+// \param psRing is the audio ring.
+//
+// \return None.
+//
+//******************************************************************************
+void
+AudioRingDone(tAudioRing *psRing)
+{
+    tAudioSlot *psSlot;
+
+    if(psRing->ui32Played == psRing->ui32Queued)
+    {
+        return;
+    }
+
+    psSlot = &psRing->psSlots[psRing->ui32Played % psRing->ui32NumSlots];
+    psRing->ui32Clock += psSlot->ui32Samples;
+    psSlot->ui32Freed = psRing->ui32Clock;
+    psRing->ui32Played++;
+}
+
+//******************************************************************************
+//
+// This function marks the end of the stream, after which no more buffers
+// will be added to the ring.
+//
+// \param psRing is the audio ring.
+//
+// \return None.
+//
+//******************************************************************************
+void
+AudioRingEnd(tAudioRing *psRing)
+{
+    psRing->ui32Flags |= AUDIORING_FLAG_END;
+}
+
+//******************************************************************************
+//
+// This function checks whether all of the audio in the ring has been played
+// out.
+//
+// \param psRing is the audio ring.
+//
+// \return Returns \b true if every buffer that was added has been played.
+//
+//******************************************************************************
+bool
+AudioRingDrained(tAudioRing *psRing)
+{
+    return(psRing->ui32Played == psRing->ui32Filled);
+}
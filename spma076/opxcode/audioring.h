@@ -0,0 +1,124 @@
+//*****************************************************************************
+//
+// audioring.h - A ring of decoded audio buffers that feed the playback DMA.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#ifndef AUDIORING_H_
+#define AUDIORING_H_
+
+//******************************************************************************
+//
+// The flag values for the ui32Flags member of the tAudioRing structure.
+//
+//******************************************************************************
+#define AUDIORING_FLAG_END      0x00000001
+
+//*****************************************************************************
+//
+// One buffer of decoded audio in the ring.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The samples, in the format that is written to the output.
+    //
+    int16_t *pi16Data;
+
+    //
+    // The number of samples that are held in the buffer.
+    //
+    uint32_t ui32Samples;
+
+    //
+    // The output sample clock at the time the buffer was last played out.
+    //
+    uint32_t ui32Freed;
+}
+tAudioSlot;
+
+//*****************************************************************************
+//
+// The audio ring.  Buffers are filled in order by the decoder, handed to the
+// output DMA in the same order from its interrupt handler, and become free
+// again once they have been played out.  The counts are free running so that
+// the decoder and the interrupt handler each only write their own.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The buffers and the number of them.
+    //
+    tAudioSlot *psSlots;
+    uint32_t ui32NumSlots;
+
+    //
+    // The number of buffers that have been filled, queued to the output and
+    // played out since the ring was reset.
+    //
+    volatile uint32_t ui32Filled;
+    volatile uint32_t ui32Queued;
+    volatile uint32_t ui32Played;
+
+    //
+    // The number of samples that have been played out.
+    //
+    volatile uint32_t ui32Clock;
+
+    //
+    // A combination of the AUDIORING_FLAG_* values.
+    //
+    volatile uint32_t ui32Flags;
+
+    //
+    // The number of times that the output ran out of buffers to play.
+    //
+    volatile uint32_t ui32Underruns;
+
+    //
+    // The fewest buffers that were ready when the output took one.
+    //
+    volatile uint32_t ui32MinFill;
+
+    //
+    // The longest time, in output samples, between a buffer being played out
+    // and being filled again.
+    //
+    uint32_t ui32MaxLatency;
+}
+tAudioRing;
+
+//*****************************************************************************
+//
+// Prototypes for the APIs.
+//
+//*****************************************************************************
+void AudioRingInit(tAudioRing *psRing, tAudioSlot *psSlots,
+         uint32_t ui32NumSlots, int16_t *pi16Data, uint32_t ui32SlotSamples);
+void AudioRingReset(tAudioRing *psRing);
+tAudioSlot *AudioRingFree(tAudioRing *psRing);
+void AudioRingPut(tAudioRing *psRing, uint32_t ui32Samples);
+const tAudioSlot *AudioRingNext(tAudioRing *psRing);
+void AudioRingDone(tAudioRing *psRing);
+void AudioRingEnd(tAudioRing *psRing);
+bool AudioRingDrained(tAudioRing *psRing);
+
+#endif
@@ -0,0 +1,120 @@
+//*****************************************************************************
+//
+// bufpool.c - A pool of statically allocated buffers that are handed out
+// once when playback is set up.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "opxcode/bufpool.h"
+
+//*****************************************************************************
+//
+// This function prepares a buffer pool for use.
+//
+// \param psPool is the pool to initialize.
+// \param pvData is the memory that the buffers are taken from.  It should be
+// aligned to BUFPOOL_ALIGN bytes.
+// \param ui32Size is the size of \e pvData in bytes.
+//
+// \return None.
+//
+//*****************************************************************************
+void
+BufPoolInit(tBufPool *psPool, void *pvData, uint32_t ui32Size)
+{
+    psPool->pui8Data = (uint8_t *)pvData;
+    psPool->ui32Size = ui32Size;
+    psPool->ui32HighWater = 0;
+
+    BufPoolReset(psPool);
+}
+
+//*****************************************************************************
+//
+// This function returns all of the buffers to the pool, for example when a
+// new file is played.  The high-water mark is kept.
+//
+// \param psPool is the buffer pool.
+//
+// \return None.
+//
+//*****************************************************************************
+void
+BufPoolReset(tBufPool *psPool)
+{
+    psPool->ui32Used = 0;
+}
+
+//*****************************************************************************
+//
+// This function takes a buffer from the pool.
+//
+// \param psPool is the buffer pool.
+// \param ui32Size is the size of the buffer in bytes.
+//
+// The buffer is aligned to BUFPOOL_ALIGN bytes and cleared to zero.  It stays
+// in use until BufPoolReset() is called, as buffers are not returned one at a
+// time.
+//
+// \return Returns a pointer to the buffer, or 0 if there is not enough space
+// left in the pool.
+//
+//*****************************************************************************
+void *
+BufPoolAlloc(tBufPool *psPool, uint32_t ui32Size)
+{
+    uint8_t *pui8Buf;
+
+    ui32Size = (ui32Size + BUFPOOL_ALIGN - 1) & ~(BUFPOOL_ALIGN - 1);
+    if(ui32Size > (psPool->ui32Size - psPool->ui32Used))
+    {
+        return(0);
+    }
+
+    pui8Buf = psPool->pui8Data + psPool->ui32Used;
+    psPool->ui32Used += ui32Size;
+
+    if(psPool->ui32Used > psPool->ui32HighWater)
+    {
+        psPool->ui32HighWater = psPool->ui32Used;
+    }
+
+    memset(pui8Buf, 0, ui32Size);
+
+    return(pui8Buf);
+}
+
+//*****************************************************************************
+//
+// This function returns the largest number of bytes that have been in use at
+// once since the pool was initialized.
+//
+// \param psPool is the buffer pool.
+//
+// \return Returns the high-water mark of the pool in bytes.
+//
+//*****************************************************************************
+uint32_t
+BufPoolHighWater(tBufPool *psPool)
+{
+    return(psPool->ui32HighWater);
+}
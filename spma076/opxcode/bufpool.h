@@ -0,0 +1,72 @@
+//*****************************************************************************
+//
+// bufpool.h - A pool of statically allocated buffers that are handed out
+// once when playback is set up.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#ifndef BUFPOOL_H_
+#define BUFPOOL_H_
+
+//*****************************************************************************
+//
+// The alignment of the buffers handed out by the pool, which is enough for
+// any of the types that are stored in them.
+//
+//*****************************************************************************
+#define BUFPOOL_ALIGN           8
+
+//*****************************************************************************
+//
+// The buffer pool.  The memory is owned by the caller, normally as a static
+// array, and is handed out in order from the start until the pool is reset.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The memory of the pool and its size in bytes.
+    //
+    uint8_t *pui8Data;
+    uint32_t ui32Size;
+
+    //
+    // The number of bytes that have been handed out since the pool was last
+    // reset.
+    //
+    uint32_t ui32Used;
+
+    //
+    // The largest number of bytes that have been in use at once.
+    //
+    uint32_t ui32HighWater;
+}
+tBufPool;
+
+//*****************************************************************************
+//
+// Prototypes for the APIs.
+//
+//*****************************************************************************
+void BufPoolInit(tBufPool *psPool, void *pvData, uint32_t ui32Size);
+void BufPoolReset(tBufPool *psPool);
+void *BufPoolAlloc(tBufPool *psPool, uint32_t ui32Size);
+uint32_t BufPoolHighWater(tBufPool *psPool);
+
+#endif
@@ -0,0 +1,138 @@
+//*****************************************************************************
+//
+// oggcrc.c - The CRC used to check and generate the pages of an Ogg
+// stream.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "opxcode/oggcrc.h"
+
+//*****************************************************************************
+//
+// The generator polynomial of the Ogg page CRC.  The CRC is computed most
+// significant bit first, with a zero initial value and no final inversion.
+//
+//*****************************************************************************
+#define OGGCRC_POLY             0x04C11DB7
+
+//*****************************************************************************
+//
+// The tables for the slicing-by-8 CRC.  Table 0 is the usual byte at a time
+// table, and table k gives the CRC of a byte followed by k zero bytes, so that
+// eight bytes can be looked up independently and combined with exclusive or.
+// The tables are built in RAM on first use, which is faster to look up than
+// flash on parts with flash wait states.
+//
+//*****************************************************************************
+static uint32_t g_ppui32OggCrcTable[8][256];
+static bool g_bOggCrcTable = false;
+
+//*****************************************************************************
+//
+// Build the CRC tables.
+//
+//*****************************************************************************
+static void
+OggCrcTableInit(void)
+{
+    uint32_t ui32Idx;
+    uint32_t ui32Bit;
+    uint32_t ui32Crc;
+    uint32_t ui32Table;
+
+    for(ui32Idx = 0; ui32Idx < 256; ui32Idx++)
+    {
+        ui32Crc = ui32Idx << 24;
+        for(ui32Bit = 0; ui32Bit < 8; ui32Bit++)
+        {
+            ui32Crc = ((ui32Crc & 0x80000000) ?
+                       ((ui32Crc << 1) ^ OGGCRC_POLY) : (ui32Crc << 1));
+        }
+
+        g_ppui32OggCrcTable[0][ui32Idx] = ui32Crc;
+    }
+
+    for(ui32Table = 1; ui32Table < 8; ui32Table++)
+    {
+        for(ui32Idx = 0; ui32Idx < 256; ui32Idx++)
+        {
+            ui32Crc = g_ppui32OggCrcTable[ui32Table - 1][ui32Idx];
+            g_ppui32OggCrcTable[ui32Table][ui32Idx] =
+                    ((ui32Crc << 8) ^ g_ppui32OggCrcTable[0][ui32Crc >> 24]);
+        }
+    }
+
+    g_bOggCrcTable = true;
+}
+
+//*****************************************************************************
+//
+// This function continues the CRC of an Ogg page over more data.
+//
+// \param ui32Crc is the CRC of the data so far, which is zero at the start of
+// a page.
+// \param pui8Data is the data to add to the CRC.
+// \param ui32Len is the number of bytes in \e pui8Data.
+//
+// The CRC of a page is computed over the whole page, header included, with the
+// checksum field of the header taken as zero.  The data is processed eight
+// bytes at a time with one table lookup per byte and no dependency between the
+// lookups, and any remaining bytes one at a time.  The tables are built on the
+// first call.
+//
+// \return Returns the CRC of the data.
+//
+//*****************************************************************************
+uint32_t
+OggCrc(uint32_t ui32Crc, const uint8_t *pui8Data, uint32_t ui32Len)
+{
+    if(!g_bOggCrcTable)
+    {
+        OggCrcTableInit();
+    }
+
+    while(ui32Len >= 8)
+    {
+        ui32Crc ^= (((uint32_t)pui8Data[0] << 24) |
+                    ((uint32_t)pui8Data[1] << 16) |
+                    ((uint32_t)pui8Data[2] << 8) | pui8Data[3]);
+
+        ui32Crc = (g_ppui32OggCrcTable[7][ui32Crc >> 24] ^
+                   g_ppui32OggCrcTable[6][(ui32Crc >> 16) & 0xFF] ^
+                   g_ppui32OggCrcTable[5][(ui32Crc >> 8) & 0xFF] ^
+                   g_ppui32OggCrcTable[4][ui32Crc & 0xFF] ^
+                   g_ppui32OggCrcTable[3][pui8Data[4]] ^
+                   g_ppui32OggCrcTable[2][pui8Data[5]] ^
+                   g_ppui32OggCrcTable[1][pui8Data[6]] ^
+                   g_ppui32OggCrcTable[0][pui8Data[7]]);
+
+        pui8Data += 8;
+        ui32Len -= 8;
+    }
+
+    while(ui32Len--)
+    {
+        ui32Crc = ((ui32Crc << 8) ^
+                   g_ppui32OggCrcTable[0][(ui32Crc >> 24) ^ *pui8Data++]);
+    }
+
+    return(ui32Crc);
+}
@@ -1,7 +1,7 @@
 //******************************************************************************
 //
 // oggfile.c - This file supports reading audio data from a .ogg file and
-// reading the file format.
+// reading the file format, and writing Opus packets to a new .ogg file.
 //
 // Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
 // Software License Agreement
@@ -23,10 +23,1320 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
+#ifndef STORAGE_NO_FATFS
 #include "inc/hw_types.h"
 #include "third_party/fatfs/src/ff.h"
 #include "third_party/fatfs/src/diskio.h"
+#endif
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
 #include "opxcode/oggfile.h"
+#include "opxcode/oggcrc.h"
+
+//******************************************************************************
+//
+// Read a little endian value from a possibly unaligned location in the read
+// buffer.
+//
+//******************************************************************************
+static uint32_t
+OggGetLE32(const uint8_t *pui8Data)
+{
+    return((uint32_t)pui8Data[0] | ((uint32_t)pui8Data[1] << 8) |
+           ((uint32_t)pui8Data[2] << 16) | ((uint32_t)pui8Data[3] << 24));
+}
+
+static uint16_t
+OggGetLE16(const uint8_t *pui8Data)
+{
+    return((uint16_t)(pui8Data[0] | (pui8Data[1] << 8)));
+}
+
+//******************************************************************************
+//
+// Write a little endian value to a possibly unaligned location.
+//
+//******************************************************************************
+static void
+OggPutLE32(uint8_t *pui8Data, uint32_t ui32Value)
+{
+    pui8Data[0] = (uint8_t)ui32Value;
+    pui8Data[1] = (uint8_t)(ui32Value >> 8);
+    pui8Data[2] = (uint8_t)(ui32Value >> 16);
+    pui8Data[3] = (uint8_t)(ui32Value >> 24);
+}
+
+static void
+OggPutLE16(uint8_t *pui8Data, uint16_t ui16Value)
+{
+    pui8Data[0] = (uint8_t)ui16Value;
+    pui8Data[1] = (uint8_t)(ui16Value >> 8);
+}
+
+//******************************************************************************
+//
+// Make sure that the next ui32Bytes bytes after the parse position are held
+// in the read buffer.
+//
+// Data ahead of the packet being assembled, or ahead of the parse position if
+// there is none, is no longer needed and is dropped to make room.  The file is
+// then read in as large a block as fits in the buffer, ending on an
+// OGG_READ_ALIGN boundary when possible, so that a single read normally
+// brings in several pages at once.
+//
+// If the file is mapped the buffer is instead pointed at the mapping, from the
+// first byte that is kept to the end of the file, and nothing is read.  A
+// packet that was joined across pages in pui8ReadBuf keeps being assembled
+// there.
+//
+// \return 0 on success, 1 if the end of the file was reached,
+// ERR_OGG_PACKET_TOO_LARGE if the data can never fit in the buffer or
+// ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggBufferFill(tOggFile *psOggData, uint32_t ui32Bytes)
+{
+    uint32_t ui32Keep;
+    uint32_t ui32Start;
+    uint32_t ui32Size;
+    uint32_t ui32Align;
+    uint32_t ui32Count;
+
+    if((psOggData->ui32BufPos + ui32Bytes) <= psOggData->ui32BufLen)
+    {
+        return(0);
+    }
+
+    //
+    // Work out the first byte that must be kept in the buffer.
+    //
+    if(psOggData->ui32Flags & OGG_FLAG_PACKET)
+    {
+        ui32Keep = psOggData->ui32PacketStart;
+    }
+    else
+    {
+        ui32Keep = psOggData->ui32BufPos;
+    }
+
+    if(psOggData->pui8Map &&
+       (!(psOggData->ui32Flags & OGG_FLAG_PACKET) ||
+        (psOggData->pui8Buf != psOggData->pui8ReadBuf)))
+    {
+        ui32Size = StorageSize(&psOggData->sStorage);
+        ui32Start = (StorageTell(&psOggData->sStorage) -
+                     psOggData->ui32BufLen + ui32Keep);
+
+        psOggData->pui8Buf = psOggData->pui8Map + ui32Start;
+        psOggData->ui32BufLen = ui32Size - ui32Start;
+        psOggData->ui32BufPos -= ui32Keep;
+        if(psOggData->ui32Flags & OGG_FLAG_PACKET)
+        {
+            psOggData->ui32PacketStart -= ui32Keep;
+        }
+
+        if(StorageSeek(&psOggData->sStorage, ui32Size) != 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+
+        return(((psOggData->ui32BufPos + ui32Bytes) >
+                psOggData->ui32BufLen) ? 1 : 0);
+    }
+
+    if((psOggData->ui32BufPos + ui32Bytes - ui32Keep) > OGG_READ_BUF_SIZE)
+    {
+        return(ERR_OGG_PACKET_TOO_LARGE);
+    }
+
+    //
+    // Move the data that is still needed to the start of the buffer.
+    //
+    psOggData->pui8Buf = psOggData->pui8ReadBuf;
+    if(ui32Keep != 0)
+    {
+        memmove(psOggData->pui8ReadBuf, psOggData->pui8ReadBuf + ui32Keep,
+                psOggData->ui32BufLen - ui32Keep);
+        psOggData->ui32BufLen -= ui32Keep;
+        psOggData->ui32BufPos -= ui32Keep;
+        if(psOggData->ui32Flags & OGG_FLAG_PACKET)
+        {
+            psOggData->ui32PacketStart -= ui32Keep;
+        }
+    }
+
+    while((psOggData->ui32BufPos + ui32Bytes) > psOggData->ui32BufLen)
+    {
+        //
+        // Fill the rest of the buffer, but stop on a sector boundary if that
+        // still reads everything that was asked for.
+        //
+        ui32Size = OGG_READ_BUF_SIZE - psOggData->ui32BufLen;
+        ui32Align = ((StorageTell(&psOggData->sStorage) + ui32Size) %
+                     OGG_READ_ALIGN);
+        if((ui32Align < ui32Size) &&
+           ((ui32Size - ui32Align) >=
+            (psOggData->ui32BufPos + ui32Bytes - psOggData->ui32BufLen)))
+        {
+            ui32Size -= ui32Align;
+        }
+
+        if(StorageRead(&psOggData->sStorage,
+                       psOggData->pui8ReadBuf + psOggData->ui32BufLen,
+                       ui32Size, &ui32Count) != 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+
+        if(ui32Count == 0)
+        {
+            return(1);
+        }
+
+        psOggData->ui32BufLen += ui32Count;
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Skip over ui32Bytes bytes after the parse position.  Only data that is not
+// part of a packet being assembled may be skipped.  Anything that is not
+// already in the read buffer is skipped with a seek rather than being read.
+//
+// \return 0 on success or ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggBufferSkip(tOggFile *psOggData, uint32_t ui32Bytes)
+{
+    uint32_t ui32Avail;
+
+    ui32Avail = psOggData->ui32BufLen - psOggData->ui32BufPos;
+
+    if(ui32Bytes <= ui32Avail)
+    {
+        psOggData->ui32BufPos += ui32Bytes;
+        return(0);
+    }
+
+    ui32Bytes -= ui32Avail;
+    psOggData->ui32BufLen = 0;
+    psOggData->ui32BufPos = 0;
+
+    if(StorageSeek(&psOggData->sStorage,
+                   StorageTell(&psOggData->sStorage) + ui32Bytes) != 0)
+    {
+        return(ERR_OGG_READ_FAIL);
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Stands in for the checksum field of a page header when the CRC of the page
+// is checked.
+//
+//******************************************************************************
+static const uint8_t g_pui8OggCrcZero[4] = { 0, 0, 0, 0 };
+
+//******************************************************************************
+//
+// Drop the damaged page at the parse position, along with any packet that was
+// being assembled, and move the parse position on to the next capture
+// pattern, or to the end of the file if there is none.
+//
+// \return ERR_OGG_PAGE_LOST, or ERR_OGG_READ_FAIL if the file could not be
+// read.
+//
+//******************************************************************************
+static int
+OggPageLost(tOggFile *psOggData)
+{
+    int iRet;
+
+    psOggData->ui32Flags &= ~(OGG_FLAG_PACKET | OGG_FLAG_SKIP |
+                              OGG_FLAG_SKIP_TOO_LARGE);
+    psOggData->ui8SegmentCount = 0;
+    psOggData->sOggContainer.ui8PageSegments = 0;
+    psOggData->sOggContainer.ui8OggHeaderType = 0;
+    psOggData->ui32PagesLost++;
+
+    do
+    {
+        psOggData->ui32BufPos++;
+
+        iRet = OggBufferFill(psOggData, 4);
+        if(iRet < 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+
+        if(iRet != 0)
+        {
+            break;
+        }
+    }
+    while(OggGetLE32(psOggData->pui8Buf + psOggData->ui32BufPos) !=
+          (uint32_t)OGGS_FORMAT_HEADSEQ);
+
+    return(ERR_OGG_PAGE_LOST);
+}
+
+//******************************************************************************
+//
+// Check the CRC of the page of ui32Size bytes at the parse position, whose
+// header and lacing table are already in the read buffer.  The CRC is computed
+// with the checksum field taken as zero.
+//
+// If the file is mapped the page is checked in the mapping.  Otherwise the
+// page is brought into the read buffer, and the part of a page that does not
+// fit is read through a small block on the stack before the file is seeked
+// back, so that only that part is read twice.
+// A page that runs past the end of the file cannot be checked and is passed.
+//
+// \return 0 if the page is good, 1 if it is damaged or ERR_OGG_READ_FAIL if
+// the file could not be read.
+//
+//******************************************************************************
+static int
+OggPageCrcCheck(tOggFile *psOggData, uint32_t ui32Size)
+{
+    uint8_t pui8Chunk[OGG_CRC_CHUNK_SIZE];
+    const uint8_t *pui8Page;
+    uint32_t ui32Offset;
+    uint32_t ui32Avail;
+    uint32_t ui32Count;
+    uint32_t ui32Crc;
+    int iRet;
+
+    ui32Offset = (StorageTell(&psOggData->sStorage) - psOggData->ui32BufLen +
+                  psOggData->ui32BufPos);
+
+    if(psOggData->pui8Map)
+    {
+        if((ui32Offset + ui32Size) > StorageSize(&psOggData->sStorage))
+        {
+            return(0);
+        }
+
+        pui8Page = psOggData->pui8Map + ui32Offset;
+        ui32Avail = ui32Size;
+    }
+    else
+    {
+        iRet = OggBufferFill(psOggData, ui32Size);
+        if(iRet == ERR_OGG_PACKET_TOO_LARGE)
+        {
+            //
+            // Fill the whole buffer with as much of the page as fits.
+            //
+            ui32Avail = ((psOggData->ui32Flags & OGG_FLAG_PACKET) ?
+                         psOggData->ui32PacketStart : psOggData->ui32BufPos);
+            iRet = OggBufferFill(psOggData, (OGG_READ_BUF_SIZE + ui32Avail -
+                                             psOggData->ui32BufPos));
+        }
+
+        if(iRet != 0)
+        {
+            return((iRet < 0) ? iRet : 0);
+        }
+
+        pui8Page = psOggData->pui8Buf + psOggData->ui32BufPos;
+        ui32Avail = psOggData->ui32BufLen - psOggData->ui32BufPos;
+        if(ui32Avail > ui32Size)
+        {
+            ui32Avail = ui32Size;
+        }
+    }
+
+    ui32Crc = OggCrc(0, pui8Page, 22);
+    ui32Crc = OggCrc(ui32Crc, g_pui8OggCrcZero, 4);
+    ui32Crc = OggCrc(ui32Crc, pui8Page + 26, ui32Avail - 26);
+
+    if(ui32Avail < ui32Size)
+    {
+        ui32Size -= ui32Avail;
+        ui32Offset = StorageTell(&psOggData->sStorage);
+
+        while(ui32Size != 0)
+        {
+            ui32Avail = ((ui32Size < OGG_CRC_CHUNK_SIZE) ? ui32Size :
+                         OGG_CRC_CHUNK_SIZE);
+            if(StorageRead(&psOggData->sStorage, pui8Chunk, ui32Avail,
+                           &ui32Count) != 0)
+            {
+                return(ERR_OGG_READ_FAIL);
+            }
+
+            if(ui32Count == 0)
+            {
+                ui32Crc = psOggData->sOggContainer.ui32OggChecksum;
+                break;
+            }
+
+            ui32Crc = OggCrc(ui32Crc, pui8Chunk, ui32Count);
+            ui32Size -= ui32Count;
+        }
+
+        if(StorageSeek(&psOggData->sStorage, ui32Offset) != 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+    }
+
+    return((ui32Crc != psOggData->sOggContainer.ui32OggChecksum) ? 1 : 0);
+}
+
+//******************************************************************************
+//
+// Read the header and lacing table of the next page from the read buffer.
+// On return the parse position is at the start of the page body and
+// ui8SegmentCount holds the number of lacing values in the page.
+//
+// The CRC of the page is checked first.  A page that is damaged is dropped
+// and the parse position is moved on to the next page.
+//
+// \return 0 on success, 1 if the end of the file was reached,
+// ERR_OGG_PAGE_LOST if the page was damaged or a negative error code.
+//
+//******************************************************************************
+static int
+OggPageRead(tOggFile *psOggData)
+{
+    const uint8_t *pui8Header;
+    uint32_t ui32Size;
+    uint8_t ui8Segments;
+    uint8_t ui8Idx;
+    int iRet;
+
+    iRet = OggBufferFill(psOggData, OGG_PAGE_HEADER_SIZE);
+    if(iRet != 0)
+    {
+        return(iRet);
+    }
+
+    //
+    // Save the page header so that it can be returned later if requested.
+    //
+    pui8Header = psOggData->pui8Buf + psOggData->ui32BufPos;
+    psOggData->sOggContainer.ui32OggCapturePattern = OggGetLE32(pui8Header);
+    psOggData->sOggContainer.ui8OggVersion = pui8Header[4];
+    psOggData->sOggContainer.ui8OggHeaderType = pui8Header[5];
+    psOggData->sOggContainer.ui32OggGranulePosition[0] =
+            OggGetLE32(pui8Header + 6);
+    psOggData->sOggContainer.ui32OggGranulePosition[1] =
+            OggGetLE32(pui8Header + 10);
+    psOggData->sOggContainer.ui32OggBitstreamSerialNumber =
+            OggGetLE32(pui8Header + 14);
+    psOggData->sOggContainer.ui32OggPageSequenceNumber =
+            OggGetLE32(pui8Header + 18);
+    psOggData->sOggContainer.ui32OggChecksum = OggGetLE32(pui8Header + 22);
+    psOggData->sOggContainer.ui8PageSegments = pui8Header[26];
+
+    if(psOggData->sOggContainer.ui32OggCapturePattern !=
+            (uint32_t)OGGS_FORMAT_HEADSEQ)
+    {
+        return(OggPageLost(psOggData));
+    }
+
+    //
+    // Bring in the lacing table and keep a copy of it.
+    //
+    ui8Segments = psOggData->sOggContainer.ui8PageSegments;
+
+    iRet = OggBufferFill(psOggData, OGG_PAGE_HEADER_SIZE + ui8Segments);
+    if(iRet != 0)
+    {
+        return(iRet);
+    }
+
+    memcpy(psOggData->sOggContainer.ui8SegmentTables,
+           psOggData->pui8Buf + psOggData->ui32BufPos +
+           OGG_PAGE_HEADER_SIZE, ui8Segments);
+
+    //
+    // Drop the page if it is damaged.
+    //
+    ui32Size = OGG_PAGE_HEADER_SIZE + ui8Segments;
+    for(ui8Idx = 0; ui8Idx < ui8Segments; ui8Idx++)
+    {
+        ui32Size += psOggData->sOggContainer.ui8SegmentTables[ui8Idx];
+    }
+
+    iRet = OggPageCrcCheck(psOggData, ui32Size);
+    if(iRet < 0)
+    {
+        return(iRet);
+    }
+
+    if(iRet != 0)
+    {
+        return(OggPageLost(psOggData));
+    }
+
+    psOggData->ui32BufPos += OGG_PAGE_HEADER_SIZE + ui8Segments;
+    psOggData->ui8SegmentCount = ui8Segments;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Check the CRC of the page of ui32Size bytes at ui32Pos in the read buffer,
+// whose header and lacing table are in the buffer.  The part of the page past
+// the end of the buffer is read through a small block on the stack, and the
+// file is seeked back afterwards so that the read buffer still holds the bytes
+// just before the file pointer.
+//
+// \return 0 if the page is good, 1 if it is damaged or runs past the end of
+// the file or ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggPageCrcAt(tOggFile *psOggData, uint32_t ui32Pos, uint32_t ui32Size)
+{
+    uint8_t pui8Chunk[OGG_CRC_CHUNK_SIZE];
+    const uint8_t *pui8Page;
+    uint32_t ui32Offset;
+    uint32_t ui32Avail;
+    uint32_t ui32Count;
+    uint32_t ui32Crc;
+
+    //
+    // A page cut short by the end of the file, as the last page of a
+    // recording that was not closed can be, is as good as damaged.
+    //
+    ui32Offset = StorageTell(&psOggData->sStorage);
+    if((ui32Offset - psOggData->ui32BufLen + ui32Pos + ui32Size) >
+       StorageSize(&psOggData->sStorage))
+    {
+        return(1);
+    }
+
+    pui8Page = psOggData->pui8Buf + ui32Pos;
+    ui32Avail = psOggData->ui32BufLen - ui32Pos;
+    if((ui32Avail > ui32Size) || psOggData->pui8Map)
+    {
+        ui32Avail = ui32Size;
+    }
+
+    ui32Crc = OggCrc(0, pui8Page, 22);
+    ui32Crc = OggCrc(ui32Crc, g_pui8OggCrcZero, 4);
+    ui32Crc = OggCrc(ui32Crc, pui8Page + 26, ui32Avail - 26);
+
+    if(ui32Avail < ui32Size)
+    {
+        ui32Size -= ui32Avail;
+
+        while(ui32Size != 0)
+        {
+            ui32Avail = ((ui32Size < OGG_CRC_CHUNK_SIZE) ? ui32Size :
+                         OGG_CRC_CHUNK_SIZE);
+            if((StorageRead(&psOggData->sStorage, pui8Chunk, ui32Avail,
+                            &ui32Count) != 0) || (ui32Count == 0))
+            {
+                return(ERR_OGG_READ_FAIL);
+            }
+
+            ui32Crc = OggCrc(ui32Crc, pui8Chunk, ui32Count);
+            ui32Size -= ui32Count;
+        }
+
+        if(StorageSeek(&psOggData->sStorage, ui32Offset) != 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+    }
+
+    return((ui32Crc != OggGetLE32(pui8Page + 22)) ? 1 : 0);
+}
+
+//******************************************************************************
+//
+// Check whether a page of the Opus stream starts at ui32Pos in the read
+// buffer.  The granule position of the page is written to pui64Granule.
+// Only a page that lies wholly within the file and whose CRC is right is
+// taken, so that a stray capture pattern in a page body or a truncated last
+// page does not give a wrong granule position.
+//
+// \return The total size of the page in bytes, 0 if there is no good page of
+// the stream at this position, -1 if the header runs past the end of the
+// buffer or ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int32_t
+OggPageCheck(tOggFile *psOggData, uint32_t ui32Pos, uint64_t *pui64Granule)
+{
+    const uint8_t *pui8Header;
+    int32_t i32Size;
+    uint8_t ui8Index;
+    int iRet;
+
+    pui8Header = psOggData->pui8Buf + ui32Pos;
+
+    if((OggGetLE32(pui8Header) != (uint32_t)OGGS_FORMAT_HEADSEQ) ||
+       (pui8Header[4] != 0) ||
+       (OggGetLE32(pui8Header + 14) != psOggData->ui32Serial))
+    {
+        return(0);
+    }
+
+    if((ui32Pos + OGG_PAGE_HEADER_SIZE + pui8Header[26]) >
+       psOggData->ui32BufLen)
+    {
+        return(-1);
+    }
+
+    i32Size = OGG_PAGE_HEADER_SIZE + pui8Header[26];
+    for(ui8Index = 0; ui8Index < pui8Header[26]; ui8Index++)
+    {
+        i32Size += pui8Header[OGG_PAGE_HEADER_SIZE + ui8Index];
+    }
+
+    iRet = OggPageCrcAt(psOggData, ui32Pos, (uint32_t)i32Size);
+    if(iRet != 0)
+    {
+        return((iRet < 0) ? iRet : 0);
+    }
+
+    *pui64Granule = (((uint64_t)OggGetLE32(pui8Header + 10) << 32) |
+                     OggGetLE32(pui8Header + 6));
+
+    return(i32Size);
+}
+
+//******************************************************************************
+//
+// Discard the contents of the read buffer and read up to ui32Size bytes
+// starting at file offset ui32Offset into it.  If the file is mapped the
+// buffer is pointed at those bytes of the mapping instead.
+//
+// \return 0 on success or ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggBufferLoad(tOggFile *psOggData, uint32_t ui32Offset, uint32_t ui32Size)
+{
+    uint32_t ui32Count;
+
+    psOggData->ui32BufLen = 0;
+    psOggData->ui32BufPos = 0;
+
+    if(StorageSeek(&psOggData->sStorage, ui32Offset) != 0)
+    {
+        return(ERR_OGG_READ_FAIL);
+    }
+
+    if(psOggData->pui8Map)
+    {
+        ui32Offset = StorageTell(&psOggData->sStorage);
+        ui32Count = StorageSize(&psOggData->sStorage) - ui32Offset;
+        if(ui32Count > ui32Size)
+        {
+            ui32Count = ui32Size;
+        }
+
+        psOggData->pui8Buf = psOggData->pui8Map + ui32Offset;
+        psOggData->ui32BufLen = ui32Count;
+
+        if(StorageSeek(&psOggData->sStorage, ui32Offset + ui32Count) != 0)
+        {
+            return(ERR_OGG_READ_FAIL);
+        }
+
+        return(0);
+    }
+
+    psOggData->pui8Buf = psOggData->pui8ReadBuf;
+    if(StorageRead(&psOggData->sStorage, psOggData->pui8ReadBuf, ui32Size,
+                   &ui32Count) != 0)
+    {
+        return(ERR_OGG_READ_FAIL);
+    }
+
+    psOggData->ui32BufLen = ui32Count;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Find the first page of the Opus stream at or after file offset ui32Offset
+// that has a granule position.  The search resynchronizes on the OggS
+// capture pattern, so ui32Offset need not be the start of a page.  If the
+// offset is already held in the read buffer no read is made.  On success the
+// parse position is left at the start of the page.
+//
+// \return 0 if a page was found, 1 if there is none before the end of the
+// file or a negative error code.
+//
+//******************************************************************************
+static int
+OggPageFind(tOggFile *psOggData, uint32_t ui32Offset, uint32_t *pui32Page,
+            uint32_t *pui32Size, uint64_t *pui64Granule)
+{
+    uint32_t ui32Block;
+    uint32_t ui32Pos;
+    int32_t i32Size;
+    int iRet;
+
+    //
+    // The read buffer always holds the bytes just before the file pointer.
+    //
+    ui32Block = StorageTell(&psOggData->sStorage) - psOggData->ui32BufLen;
+
+    if((ui32Offset >= ui32Block) &&
+       ((ui32Offset + OGG_PAGE_HEADER_SIZE + MAX_SEG_TABLE) <=
+        StorageTell(&psOggData->sStorage)))
+    {
+        ui32Pos = ui32Offset - ui32Block;
+    }
+    else
+    {
+        iRet = OggBufferLoad(psOggData, ui32Offset, OGG_READ_BUF_SIZE);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+
+        ui32Block = ui32Offset;
+        ui32Pos = 0;
+    }
+
+    while(1)
+    {
+        for(; (ui32Pos + OGG_PAGE_HEADER_SIZE) <= psOggData->ui32BufLen;
+            ui32Pos++)
+        {
+            i32Size = OggPageCheck(psOggData, ui32Pos, pui64Granule);
+
+            if(i32Size == -1)
+            {
+                break;
+            }
+
+            if(i32Size < 0)
+            {
+                return((int)i32Size);
+            }
+
+            if(i32Size == 0)
+            {
+                continue;
+            }
+
+            //
+            // Pages on which no packet ends carry a granule position of -1,
+            // so step over them.
+            //
+            if(*pui64Granule != ~(uint64_t)0)
+            {
+                psOggData->ui32BufPos = ui32Pos;
+                *pui32Page = ui32Block + ui32Pos;
+                *pui32Size = (uint32_t)i32Size;
+                return(0);
+            }
+
+            ui32Pos += (uint32_t)i32Size - 1;
+        }
+
+        if(StorageTell(&psOggData->sStorage) >=
+           StorageSize(&psOggData->sStorage))
+        {
+            return(1);
+        }
+
+        //
+        // Continue from the first position that was not checked.
+        //
+        ui32Block += ui32Pos;
+        iRet = OggBufferLoad(psOggData, ui32Block, OGG_READ_BUF_SIZE);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+        ui32Pos = 0;
+    }
+}
+
+//******************************************************************************
+//
+// Find the granule position of the last page of the Opus stream by reading
+// backwards from the end of the file.
+//
+// \return 0 if a page was found, 1 if there is none or a negative error code.
+//
+//******************************************************************************
+static int
+OggLastGranule(tOggFile *psOggData, uint64_t *pui64Granule)
+{
+    uint32_t ui32Start;
+    uint32_t ui32End;
+    int32_t i32Size;
+    int32_t i32Pos;
+    int iRet;
+
+    ui32End = StorageSize(&psOggData->sStorage);
+
+    while(ui32End > psOggData->ui32DataStart)
+    {
+        if((ui32End - psOggData->ui32DataStart) > OGG_READ_BUF_SIZE)
+        {
+            ui32Start = ui32End - OGG_READ_BUF_SIZE;
+        }
+        else
+        {
+            ui32Start = psOggData->ui32DataStart;
+        }
+
+        iRet = OggBufferLoad(psOggData, ui32Start, ui32End - ui32Start);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+
+        //
+        // Search the block from its end for the capture pattern of a good
+        // page that has a granule position.
+        //
+        for(i32Pos = (int32_t)psOggData->ui32BufLen - OGG_PAGE_HEADER_SIZE;
+            i32Pos >= 0; i32Pos--)
+        {
+            i32Size = OggPageCheck(psOggData, (uint32_t)i32Pos, pui64Granule);
+            if(i32Size < -1)
+            {
+                return((int)i32Size);
+            }
+
+            if((i32Size > 0) && (*pui64Granule != ~(uint64_t)0))
+            {
+                return(0);
+            }
+        }
+
+        if(ui32Start == psOggData->ui32DataStart)
+        {
+            break;
+        }
+
+        //
+        // Overlap the next block with this one by the largest page header so
+        // that a header split across the two is still found.
+        //
+        ui32End = ui32Start + OGG_PAGE_HEADER_SIZE + MAX_SEG_TABLE;
+    }
+
+    return(1);
+}
+
+//******************************************************************************
+//
+// Return the duration of an Opus packet in 48 kHz samples from its TOC byte.
+//
+//******************************************************************************
+static uint32_t
+OggPacketDuration(const uint8_t *pui8Packet, uint32_t ui32Len)
+{
+    uint32_t ui32Frame;
+    uint32_t ui32Frames;
+    uint8_t ui8Toc;
+
+    if(ui32Len == 0)
+    {
+        return(0);
+    }
+
+    ui8Toc = pui8Packet[0];
+
+    //
+    // Work out the frame size from the configuration number.
+    //
+    if(ui8Toc & 0x80)
+    {
+        ui32Frame = (48000 << ((ui8Toc >> 3) & 0x3)) / 400;
+    }
+    else if((ui8Toc & 0x60) == 0x60)
+    {
+        ui32Frame = (ui8Toc & 0x08) ? 960 : 480;
+    }
+    else if(((ui8Toc >> 3) & 0x3) == 3)
+    {
+        ui32Frame = 2880;
+    }
+    else
+    {
+        ui32Frame = (48000 << ((ui8Toc >> 3) & 0x3)) / 100;
+    }
+
+    //
+    // Work out the number of frames from the frame count code.
+    //
+    switch(ui8Toc & 0x3)
+    {
+        case 0:
+        {
+            ui32Frames = 1;
+            break;
+        }
+        case 1:
+        case 2:
+        {
+            ui32Frames = 2;
+            break;
+        }
+        default:
+        {
+            ui32Frames = (ui32Len > 1) ? (pui8Packet[1] & 0x3F) : 0;
+            break;
+        }
+    }
+
+    return(ui32Frame * ui32Frames);
+}
+
+//******************************************************************************
+//
+// Work out the granule position at which the first packet read from the page
+// at file offset ui32Page starts.  On entry pui64Start holds the granule
+// position of the previous page, which is the answer unless the page starts
+// with the end of a packet.  That packet is skipped by OggReadPacket(), so the
+// start is worked back from the granule position of the page, ui64Page, using
+// the durations of the packets that start on it.  The parse position must be
+// at the start of the page.
+//
+// \return 0 if the start is exact, 1 if it could not be worked out and was
+// left at the end of the previous page, which is too early, or
+// ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggPageStart(tOggFile *psOggData, uint32_t ui32Page, uint32_t ui32Size,
+             uint64_t ui64Page, uint64_t *pui64Start)
+{
+    const uint8_t *pui8Header;
+    uint32_t ui32Pos;
+    uint32_t ui32Len;
+    uint32_t ui32Duration;
+    uint8_t ui8Index;
+    bool bContinued;
+    int iRet;
+
+    pui8Header = psOggData->pui8Buf + psOggData->ui32BufPos;
+
+    if(!(pui8Header[5] & OGGS_HEADERTYPE_CONTINUED))
+    {
+        return(0);
+    }
+
+    //
+    // The granule position of the last page may be trimmed to end the audio
+    // part way through a packet, so it can not be worked back from.
+    //
+    if((pui8Header[5] & OGGS_HEADERTYPE_EOS) || (ui64Page < *pui64Start))
+    {
+        return(1);
+    }
+
+    //
+    // Bring in as much of the page as fits if it is not all in the buffer.
+    //
+    if((psOggData->ui32BufPos + ui32Size) > psOggData->ui32BufLen)
+    {
+        iRet = OggBufferLoad(psOggData, ui32Page, OGG_READ_BUF_SIZE);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+
+        pui8Header = psOggData->pui8Buf;
+    }
+
+    ui64Page -= *pui64Start;
+    ui32Pos = OGG_PAGE_HEADER_SIZE + pui8Header[26];
+    ui32Len = 0;
+    bContinued = true;
+
+    for(ui8Index = 0; ui8Index < pui8Header[26]; ui8Index++)
+    {
+        ui32Len += pui8Header[OGG_PAGE_HEADER_SIZE + ui8Index];
+
+        if(pui8Header[OGG_PAGE_HEADER_SIZE + ui8Index] < 255)
+        {
+            if(bContinued)
+            {
+                bContinued = false;
+            }
+            else
+            {
+                //
+                // Only the TOC bytes of the packets are needed.  If one of
+                // them is not in the buffer then fall back to the end of the
+                // previous page.
+                //
+                if((psOggData->ui32BufPos + ui32Pos + 2) >
+                   psOggData->ui32BufLen)
+                {
+                    return(1);
+                }
+
+                ui32Duration = OggPacketDuration(pui8Header + ui32Pos,
+                                                 ui32Len);
+                if(ui32Duration > ui64Page)
+                {
+                    return(1);
+                }
+
+                ui64Page -= ui32Duration;
+            }
+
+            ui32Pos += ui32Len;
+            ui32Len = 0;
+        }
+    }
+
+    *pui64Start += ui64Page;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Set the file up so that the next packet is read from the page at file
+// offset ui32Offset.
+//
+// \return 0 on success or ERR_OGG_READ_FAIL if the file could not be read.
+//
+//******************************************************************************
+static int
+OggPositionSet(tOggFile *psOggData, uint32_t ui32Offset)
+{
+    psOggData->ui32BufLen = 0;
+    psOggData->ui32BufPos = 0;
+    psOggData->ui8SegmentCount = 0;
+    psOggData->ui32Flags &= ~(OGG_FLAG_PACKET | OGG_FLAG_SKIP |
+                              OGG_FLAG_SKIP_TOO_LARGE | OGG_FLAG_HELD);
+    psOggData->sOggContainer.ui8OggHeaderType = 0;
+
+    if(StorageSeek(&psOggData->sStorage, ui32Offset) != 0)
+    {
+        return(ERR_OGG_READ_FAIL);
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Copy the start of a packet that continues on the next page out of the
+// mapping into pui8ReadBuf, so that the rest of the packet can be appended to
+// it.  The parse position is at the start of the body of the next page and
+// the file is seeked there, so that the packet is then read in as if the file
+// were not mapped.  A start that does not fit in pui8ReadBuf is dropped.
+//
+// \return 0 on success or ERR_OGG_READ_FAIL if the file could not be seeked.
+//
+//******************************************************************************
+static int
+OggPacketJoin(tOggFile *psOggData)
+{
+    uint32_t ui32Offset;
+
+    ui32Offset = (StorageTell(&psOggData->sStorage) - psOggData->ui32BufLen +
+                  psOggData->ui32BufPos);
+
+    if(psOggData->ui32PacketLen > OGG_READ_BUF_SIZE)
+    {
+        psOggData->ui32Flags &= ~OGG_FLAG_PACKET;
+        psOggData->ui32Flags |= (OGG_FLAG_SKIP | OGG_FLAG_SKIP_TOO_LARGE);
+        return(0);
+    }
+
+    memcpy(psOggData->pui8ReadBuf,
+           psOggData->pui8Buf + psOggData->ui32PacketStart,
+           psOggData->ui32PacketLen);
+    psOggData->pui8Buf = psOggData->pui8ReadBuf;
+    psOggData->ui32PacketStart = 0;
+    psOggData->ui32BufLen = psOggData->ui32PacketLen;
+    psOggData->ui32BufPos = psOggData->ui32PacketLen;
+
+    if(StorageSeek(&psOggData->sStorage, ui32Offset) != 0)
+    {
+        return(ERR_OGG_READ_FAIL);
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Check whether the next call to OggReadPacket() can return a packet that is
+// already in the read buffer, without reading the file.  Packets that are
+// continued from an earlier page are not looked at and are reported as not
+// buffered.
+//
+// \return true if the packet is buffered or false otherwise.
+//
+//******************************************************************************
+static bool
+OggPacketBuffered(tOggFile *psOggData)
+{
+    const uint8_t *pui8Lacing;
+    uint32_t ui32Pos;
+    uint32_t ui32Run;
+    uint32_t ui32Count;
+
+    if(psOggData->ui32Flags & OGG_FLAG_HELD)
+    {
+        return(true);
+    }
+
+    if(psOggData->ui32Flags & (OGG_FLAG_PACKET | OGG_FLAG_SKIP))
+    {
+        return(false);
+    }
+
+    ui32Pos = psOggData->ui32BufPos;
+    ui32Count = psOggData->ui8SegmentCount;
+    pui8Lacing = (psOggData->sOggContainer.ui8SegmentTables +
+                  psOggData->sOggContainer.ui8PageSegments - ui32Count);
+
+    //
+    // Look ahead at the header of the next page if this one is used up.
+    //
+    if(ui32Count == 0)
+    {
+        if(psOggData->sOggContainer.ui8OggHeaderType & OGGS_HEADERTYPE_EOS)
+        {
+            return(true);
+        }
+
+        if((ui32Pos + OGG_PAGE_HEADER_SIZE) > psOggData->ui32BufLen)
+        {
+            return(false);
+        }
+
+        if(psOggData->pui8Buf[ui32Pos + 5] & OGGS_HEADERTYPE_CONTINUED)
+        {
+            return(false);
+        }
+
+        ui32Count = psOggData->pui8Buf[ui32Pos + 26];
+        pui8Lacing = psOggData->pui8Buf + ui32Pos + OGG_PAGE_HEADER_SIZE;
+        ui32Pos += OGG_PAGE_HEADER_SIZE + ui32Count;
+        if(ui32Pos > psOggData->ui32BufLen)
+        {
+            return(false);
+        }
+    }
+
+    ui32Run = 0;
+    while(ui32Count != 0)
+    {
+        ui32Run += *pui8Lacing;
+        ui32Count--;
+
+        if(*pui8Lacing++ < 255)
+        {
+            return((ui32Pos + ui32Run) <= psOggData->ui32BufLen);
+        }
+    }
+
+    return(false);
+}
+
+//******************************************************************************
+//
+// Write out the page that is being built in the buffer of a file created with
+// OggCreate().  The body of the page is held at OGG_WRITE_BODY in pui8ReadBuf
+// and its lacing values in sOggContainer, so the header is put together just
+// ahead of the body and the whole page is written with a single write.
+// ui8Type is OGGS_HEADERTYPE_EOS to end the stream with this page, or zero.
+//
+// \return 0 on success or ERR_OGG_WRITE_FAIL if the file could not be written.
+//
+//******************************************************************************
+static int
+OggPageWrite(tOggFile *psOggData, uint8_t ui8Type)
+{
+    tOggContainer *psPage;
+    uint8_t *pui8Header;
+    uint32_t ui32Size;
+    uint32_t ui32Count;
+    uint32_t ui32Crc;
+
+    psPage = &psOggData->sOggContainer;
+
+    ui8Type |= psPage->ui8OggHeaderType;
+    if(psPage->ui32OggPageSequenceNumber == 0)
+    {
+        ui8Type |= OGGS_HEADERTYPE_BOS;
+    }
+
+    ui32Size = OGG_PAGE_HEADER_SIZE + psPage->ui8PageSegments;
+    pui8Header = psOggData->pui8ReadBuf + OGG_WRITE_BODY - ui32Size;
+
+    OggPutLE32(pui8Header, OGGS_FORMAT_HEADSEQ);
+    pui8Header[4] = 0;
+    pui8Header[5] = ui8Type;
+    OggPutLE32(pui8Header + 6, (uint32_t)psOggData->ui64PageGranule);
+    OggPutLE32(pui8Header + 10, (uint32_t)(psOggData->ui64PageGranule >> 32));
+    OggPutLE32(pui8Header + 14, psOggData->ui32Serial);
+    OggPutLE32(pui8Header + 18, psPage->ui32OggPageSequenceNumber);
+    OggPutLE32(pui8Header + 22, 0);
+    pui8Header[26] = psPage->ui8PageSegments;
+    memcpy(pui8Header + OGG_PAGE_HEADER_SIZE, psPage->ui8SegmentTables,
+           psPage->ui8PageSegments);
+
+    ui32Size += psOggData->ui32BufLen;
+    ui32Crc = OggCrc(0, pui8Header, ui32Size);
+    OggPutLE32(pui8Header + 22, ui32Crc);
+
+    if((StorageWrite(&psOggData->sStorage, pui8Header, ui32Size,
+                     &ui32Count) != 0) || (ui32Count != ui32Size))
+    {
+        return(ERR_OGG_WRITE_FAIL);
+    }
+
+    //
+    // Start the next page.  It continues a packet if this one ended part way
+    // through one, which is the case if the last lacing value is 255.
+    //
+    psPage->ui32OggPageSequenceNumber++;
+    psPage->ui8OggHeaderType =
+            ((psPage->ui8PageSegments != 0) &&
+             (psPage->ui8SegmentTables[psPage->ui8PageSegments - 1] == 255)) ?
+            OGGS_HEADERTYPE_CONTINUED : 0;
+    psPage->ui8PageSegments = 0;
+    psOggData->ui32BufLen = 0;
+    psOggData->ui64PageGranule = ~(uint64_t)0;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Add a packet to the page that is being built, writing out pages as they
+// fill.  A packet that does not fit in the space left on the page is started
+// on a new page, so that packets are only split across pages if they are
+// larger than a page.  ui64Granule is the granule position at the end of the
+// packet.
+//
+// \return 0 on success or ERR_OGG_WRITE_FAIL if the file could not be written.
+//
+//******************************************************************************
+static int
+OggPagePacket(tOggFile *psOggData, const uint8_t *pui8Packet,
+              uint32_t ui32Len, uint64_t ui64Granule)
+{
+    tOggContainer *psPage;
+    uint32_t ui32Segments;
+    uint32_t ui32Bytes;
+    int iRet;
+
+    psPage = &psOggData->sOggContainer;
+
+    if((psPage->ui8PageSegments != 0) &&
+       (((psOggData->ui32BufLen + ui32Len) > OGG_WRITE_BODY_SIZE) ||
+        ((psPage->ui8PageSegments + (ui32Len / 255) + 1) > MAX_SEG_TABLE)))
+    {
+        iRet = OggPageWrite(psOggData, 0);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+    }
+
+    while(1)
+    {
+        ui32Segments = MAX_SEG_TABLE - psPage->ui8PageSegments;
+
+        if(((psOggData->ui32BufLen + ui32Len) <= OGG_WRITE_BODY_SIZE) &&
+           (((ui32Len / 255) + 1) <= ui32Segments))
+        {
+            break;
+        }
+
+        //
+        // Fill the page with as many whole 255 byte segments as fit and carry
+        // the rest of the packet on to the next page.
+        //
+        if(ui32Segments >
+           ((OGG_WRITE_BODY_SIZE - psOggData->ui32BufLen) / 255))
+        {
+            ui32Segments = ((OGG_WRITE_BODY_SIZE - psOggData->ui32BufLen) /
+                            255);
+        }
+        if(ui32Segments > (ui32Len / 255))
+        {
+            ui32Segments = ui32Len / 255;
+        }
+
+        ui32Bytes = ui32Segments * 255;
+        memcpy(psOggData->pui8ReadBuf + OGG_WRITE_BODY + psOggData->ui32BufLen,
+               pui8Packet, ui32Bytes);
+        memset(psPage->ui8SegmentTables + psPage->ui8PageSegments, 255,
+               ui32Segments);
+        psPage->ui8PageSegments += ui32Segments;
+        psOggData->ui32BufLen += ui32Bytes;
+        pui8Packet += ui32Bytes;
+        ui32Len -= ui32Bytes;
+
+        iRet = OggPageWrite(psOggData, 0);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+    }
+
+    //
+    // The rest of the packet ends on this page.
+    //
+    memcpy(psOggData->pui8ReadBuf + OGG_WRITE_BODY + psOggData->ui32BufLen,
+           pui8Packet, ui32Len);
+    psOggData->ui32BufLen += ui32Len;
+    ui32Segments = ui32Len / 255;
+    memset(psPage->ui8SegmentTables + psPage->ui8PageSegments, 255,
+           ui32Segments);
+    psPage->ui8PageSegments += ui32Segments;
+    psPage->ui8SegmentTables[psPage->ui8PageSegments++] = ui32Len % 255;
+    psOggData->ui64PageGranule = ui64Granule;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// Write out the last page of a file created with OggCreate().  The granule
+// position of the last page gives the end of the audio, which trims the
+// padding that was coded after it in the last packet.
+//
+// \return 0 on success or ERR_OGG_WRITE_FAIL if the file could not be written.
+//
+//******************************************************************************
+static int
+OggWriteEnd(tOggFile *psOggData)
+{
+    uint64_t ui64End;
+
+    ui64End = (psOggData->sOpusHeader.ui16OpusPreSkipBytes +
+               ((psOggData->ui64Samples * 48000) /
+                psOggData->sOpusHeader.ui32OpusInputSampleRate));
+
+    psOggData->ui64PageGranule = psOggData->ui64Granule;
+    if(ui64End < psOggData->ui64PageGranule)
+    {
+        psOggData->ui64PageGranule = ui64End;
+    }
+
+    psOggData->ui32Flags &= ~OGG_FLAG_WRITE;
+
+    return(OggPageWrite(psOggData, OGGS_HEADERTYPE_EOS));
+}
 
 //******************************************************************************
 //
@@ -58,111 +1368,72 @@ OggOpen(const char *pcFileName,
         tOpusHeadContainer *psOpusHeader,
         bool bGetFormat)
 {
-    unsigned char pucBuffer[256];
-    uint8_t  ui8Index;
-    uint32_t *pui32Buffer;
-    uint16_t *pui16Buffer;
-    uint8_t  *pui8Buffer;
-    uint32_t ui32Count;
-
-    //
-    // Create some local pointers using in parsing values.
-    //
-    pui32Buffer = (uint32_t *)pucBuffer;
-    pui16Buffer = (uint16_t *)pucBuffer;
-    pui8Buffer  = (uint8_t *)pucBuffer;
+    const uint8_t *pui8Packet;
+    uint64_t ui64Granule;
+    int32_t i32Len;
+    int iRet;
 
     //
     // Open the file as read only.
     //
-    if(f_open(&psOggData->i16File, pcFileName, FA_READ) != FR_OK)
+    if(StorageOpen(&psOggData->sStorage, STORAGE_DEFAULT, pcFileName,
+                   STORAGE_MODE_READ) != 0)
     {
         return(-1);
     }
 
     //
-    // File is open.
+    // File is open and nothing has been read into the buffer yet.
     //
     psOggData->ui32Flags = OGG_FLAG_FILEOPEN;
+    psOggData->pui8Map = StorageMap(&psOggData->sStorage);
+    psOggData->pui8Buf = psOggData->pui8ReadBuf;
+    psOggData->ui32BufLen = 0;
+    psOggData->ui32BufPos = 0;
+    psOggData->ui8SegmentCount = 0;
+    psOggData->ui32SkipSamples = 0;
+    psOggData->ui32PagesLost = 0;
+    psOggData->sOggContainer.ui8OggHeaderType = 0;
 
     //
-    // Read the first 27 bytes.
-    //
-    if(f_read(&psOggData->i16File, pucBuffer, 27, (UINT *)&ui32Count) != FR_OK)
-    {
-        return(-1);
-    }
-
-    //
-    // Save the audio format data so that it can be returned later if
-    // requested.
-    //
-    psOggData->sOggContainer.ui32OggCapturePattern        =  pui32Buffer[0];
-    psOggData->sOggContainer.ui8OggVersion                =  pui8Buffer[4];
-    psOggData->sOggContainer.ui8OggHeaderType             =  pui8Buffer[5];
-    psOggData->sOggContainer.ui32OggGranulePosition[0]    =  pui16Buffer[3] |
-            (pui16Buffer[4] << 16);
-    psOggData->sOggContainer.ui32OggGranulePosition[1]    =  pui16Buffer[5] |
-            (pui16Buffer[6] << 16);
-    psOggData->sOggContainer.ui32OggBitstreamSerialNumber =  pui16Buffer[7] |
-            (pui16Buffer[8] << 16);
-    psOggData->sOggContainer.ui32OggPageSequenceNumber    =  pui16Buffer[9] |
-            (pui16Buffer[10] << 16);
-    psOggData->sOggContainer.ui32OggChecksum              =  pui16Buffer[11] |
-            (pui16Buffer[12] << 16);
-    psOggData->sOggContainer.ui8PageSegments              =  pui8Buffer[26];
-
-    //
-    // Check if the OggS format is correctly read
+    // The first packet is the OpusHead packet.
     //
-    if(psOggData->sOggContainer.ui32OggCapturePattern !=
-            (uint32_t)OGGS_FORMAT_HEADSEQ)
+    iRet = OggReadPacket(psOggData, &pui8Packet, &i32Len);
+    if(iRet <= 0)
     {
-        return(ERR_OGG_MAGICPACKET_FAIL);
+        return((iRet < 0) ? iRet : -1);
     }
 
     //
-    // If this is the Oggs container for the OpusHead then there should be only
-    // one Page Segment
+    // The OpusHead packet must be alone on the first page of the stream.
     //
-    if(psOggData->sOggContainer.ui8PageSegments != 0x01)
+    if(!(psOggData->sOggContainer.ui8OggHeaderType & OGGS_HEADERTYPE_BOS) ||
+       (psOggData->ui8SegmentCount != 0))
     {
         return(ERR_OPUSHEAD_SEGMENTNUM_FAIL);
     }
 
-    //
-    // Read the Segment Size.
-    //
-    if(f_read(&psOggData->i16File, pucBuffer, 1, (UINT *)&ui32Count) != FR_OK)
-    {
-        return(-1);
-    }
-
-    psOggData->sOggContainer.ui8SegmentTables[0] =  pui8Buffer[0];
+    psOggData->ui32Serial =
+            psOggData->sOggContainer.ui32OggBitstreamSerialNumber;
 
-    //
-    // Now read the Opus container information by reading the next
-    // psOggData->sOggContainer.ui8PageSegments bytes of data from the file
-    //
-    if(f_read(&psOggData->i16File, pucBuffer,
-            psOggData->sOggContainer.ui8SegmentTables[0],
-            (UINT *)&ui32Count) != FR_OK)
+    if(i32Len < 19)
     {
-        return(-1);
+        return(ERR_OPUSHEAD_MAGICPACKET_FAIL);
     }
 
     //
     // Save the audio format data so that it can be returned later if
     // requested.
     //
-    psOggData->sOpusHeader.ui32OpusHeadSignature[0] = pui32Buffer[0];
-    psOggData->sOpusHeader.ui32OpusHeadSignature[1] = pui32Buffer[1];
-    psOggData->sOpusHeader.ui8OpusVersion           = pui8Buffer[8];
-    psOggData->sOpusHeader.ui8OpusChannelCount      = pui8Buffer[9];
-    psOggData->sOpusHeader.ui16OpusPreSkipBytes     = pui16Buffer[5];
-    psOggData->sOpusHeader.ui32OpusInputSampleRate  = pui32Buffer[3];
-    psOggData->sOpusHeader.ui16OpusOutputGain       = pui16Buffer[8];
-    psOggData->sOpusHeader.ui8OpusMappingFamily     = pui8Buffer[18];
+    psOggData->sOpusHeader.ui32OpusHeadSignature[0] = OggGetLE32(pui8Packet);
+    psOggData->sOpusHeader.ui32OpusHeadSignature[1] =
+            OggGetLE32(pui8Packet + 4);
+    psOggData->sOpusHeader.ui8OpusVersion           = pui8Packet[8];
+    psOggData->sOpusHeader.ui8OpusChannelCount      = pui8Packet[9];
+    psOggData->sOpusHeader.ui16OpusPreSkipBytes     = OggGetLE16(pui8Packet + 10);
+    psOggData->sOpusHeader.ui32OpusInputSampleRate  = OggGetLE32(pui8Packet + 12);
+    psOggData->sOpusHeader.ui16OpusOutputGain       = OggGetLE16(pui8Packet + 16);
+    psOggData->sOpusHeader.ui8OpusMappingFamily     = pui8Packet[18];
 
     if(bGetFormat)
     {
@@ -188,338 +1459,809 @@ OggOpen(const char *pcFileName,
     }
 
     //
-    // Read the next 27 bytes.
+    // The second packet is the OpusTags packet, which may span several pages.
+    // Its contents are not used, so one that is too large for the read
+    // buffer is simply skipped.
     //
-    if(f_read(&psOggData->i16File, pucBuffer, 27, (UINT *)&ui32Count) != FR_OK)
+    iRet = OggReadPacket(psOggData, &pui8Packet, &i32Len);
+    if(iRet != ERR_OGG_PACKET_TOO_LARGE)
     {
-        return(-1);
+        if(iRet <= 0)
+        {
+            return((iRet < 0) ? iRet : -1);
+        }
+
+        if((i32Len < 8) ||
+           (OggGetLE32(pui8Packet) != (uint32_t)OPUSTAGS_FORMAT_SEQ0) ||
+           (OggGetLE32(pui8Packet + 4) != (uint32_t)OPUSTAGS_FORMAT_SEQ1))
+        {
+            return(ERR_OPUSTAGS_MAGICPACKET_FAIL);
+        }
     }
 
     //
-    // Save the audio format data so that it can be returned later if
-    // requested.
+    // The audio data must start on a new page.
+    //
+    if(psOggData->ui8SegmentCount != 0)
+    {
+        return(ERR_OPUSTAGS_SEGMENTNUM_FAIL);
+    }
+
+    //
+    // Remember where the audio data starts for seeking.
     //
-    psOggData->sOggContainer.ui32OggCapturePattern        =  pui32Buffer[0];
-    psOggData->sOggContainer.ui8OggVersion                =  pui8Buffer[4];
-    psOggData->sOggContainer.ui8OggHeaderType             =  pui8Buffer[5];
-    psOggData->sOggContainer.ui32OggGranulePosition[0]    =  pui16Buffer[3] |
-            (pui16Buffer[4] << 16);
-    psOggData->sOggContainer.ui32OggGranulePosition[1]    =  pui16Buffer[5] |
-            (pui16Buffer[6] << 16);
-    psOggData->sOggContainer.ui32OggBitstreamSerialNumber =  pui16Buffer[7] |
-            (pui16Buffer[8] << 16);
-    psOggData->sOggContainer.ui32OggPageSequenceNumber    =  pui16Buffer[9] |
-            (pui16Buffer[10] << 16);
-    psOggData->sOggContainer.ui32OggChecksum              =  pui16Buffer[11] |
-            (pui16Buffer[12] << 16);
-    psOggData->sOggContainer.ui8PageSegments              =  pui8Buffer[26];
+    psOggData->ui32DataStart = (StorageTell(&psOggData->sStorage) -
+                                (psOggData->ui32BufLen -
+                                 psOggData->ui32BufPos));
+
+    if(bGetFormat)
+    {
+        //
+        // The size of the audio is the granule position of the last page,
+        // which is found by reading backwards from the end of the file.
+        //
+        iRet = OggLastGranule(psOggData, &ui64Granule);
+        if(iRet < 0)
+        {
+            return(iRet);
+        }
+
+        if((iRet != 0) ||
+           (ui64Granule < psOggData->sOpusHeader.ui16OpusPreSkipBytes))
+        {
+            ui64Granule = 0;
+        }
+        else
+        {
+            ui64Granule -= psOggData->sOpusHeader.ui16OpusPreSkipBytes;
+        }
+
+        psOpusHeader->ui32OpusAudioSize[0] = (uint32_t)ui64Granule;
+        psOpusHeader->ui32OpusAudioSize[1] = (uint32_t)(ui64Granule >> 32);
+
+        //
+        // Leave the file ready to read the first audio packet.
+        //
+        iRet = OggPositionSet(psOggData, psOggData->ui32DataStart);
+        if(iRet != 0)
+        {
+            return(iRet);
+        }
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// This is used to close a .ogg file that was opened with OggOpen() or created
+// with OggCreate().
+//
+// \param psOggData is the file structure that was passed into the OggOpen()
+// or OggCreate() function.
+//
+// This function should be called when a function has completed using a .oggx
+// file that was opened with the OggOpen() function.  This will free up any
+// file system data that is held while the file is open.  A file that is being
+// written is ended first, if the last packet was not marked as such, and is
+// closed even if that fails.
+//
+// \return Returns zero on success or ERR_OGG_WRITE_FAIL if the last page of a
+// file created with OggCreate() could not be written or the file could not be
+// closed.
+//
+//******************************************************************************
+int
+OggClose(tOggFile *psOggData)
+{
+    int iResult;
 
-    if(psOggData->sOggContainer.ui32OggCapturePattern !=
-            (uint32_t)OGGS_FORMAT_HEADSEQ)
-    {
-        return(ERR_OGG_MAGICPACKET_FAIL);
-    }
-    if(psOggData->sOggContainer.ui8PageSegments > MAX_SEG_TABLE)
+    iResult = 0;
+    if(psOggData->ui32Flags & OGG_FLAG_FILEOPEN)
     {
-        return(ERR_OPUSTAGS_SEGMENTNUM_FAIL);
-    }
+        if(psOggData->ui32Flags & OGG_FLAG_WRITE)
+        {
+            iResult = OggWriteEnd(psOggData);
+        }
 
-    //
-    // Read the next psOggData->sOggContainer.ui8PageSegments bytes for size
-    // of the Opus Tags container
-    //
-    if(f_read(&psOggData->i16File, pucBuffer,
-            psOggData->sOggContainer.ui8PageSegments,
-            (UINT *)&ui32Count) != FR_OK)
-    {
-        return(-1);
-    }
+        //
+        // Close out the file.  This is where the file system writes out the
+        // last of the file, so it can fail as well.
+        //
+        if((StorageClose(&psOggData->sStorage) != 0) && (iResult == 0))
+        {
+            iResult = ERR_OGG_WRITE_FAIL;
+        }
 
-    for(ui8Index = 0; ui8Index < psOggData->sOggContainer.ui8PageSegments ;
-            ui8Index++)
-    {
-        psOggData->sOggContainer.ui8SegmentTables[ui8Index] =
-                pui8Buffer[ui8Index];
+        //
+        // Mark file as no longer open.
+        //
+        psOggData->ui32Flags &= ~OGG_FLAG_FILEOPEN;
     }
 
+    return(iResult);
+}
+
+//******************************************************************************
+//
+// This function is used to read the next Opus packet from a file that was
+// opened with the OggOpen() function.
+//
+// \param psOggData is the file structure that was passed into the OggOpen()
+// function.
+// \param ppui8Packet is written with a pointer to the packet.
+// \param pi32OpusLen is written with the length of the packet in bytes.
+//
+// The packet is assembled from all of its lacing values, including those that
+// continue on following pages, and is returned in place in the read buffer
+// held in \e psOggData, or in the file itself if the storage backend maps it.
+// The pointer is only valid until the next call to OggReadPacket(), OggRead()
+// or OggClose().  Pages are brought in from the file in large blocks so that
+// most calls do not access the file at all.
+//
+// A packet that does not fit in the read buffer is skipped and reported with
+// ERR_OGG_PACKET_TOO_LARGE, after which reading may continue with the next
+// packet.  A page that fails its CRC check is dropped, together with the
+// packets that start or end on it, and reported with ERR_OGG_PAGE_LOST so
+// that the decoder can conceal the gap.  Reading then continues with the
+// first packet that starts on a good page.
+//
+// \return Returns 1 if a packet was read, 2 if it was the last packet of the
+// stream, 0 if there are no more packets or a negative error code.
+//
+//******************************************************************************
+int16_t
+OggReadPacket(tOggFile *psOggData, const uint8_t **ppui8Packet,
+              int32_t *pi32OpusLen)
+{
+    uint32_t ui32Run;
+    uint32_t ui32Header;
+    uint8_t ui8Lacing;
+    bool bComplete;
+    int iRet;
+
     //
-    // Read the next ui32BytesToSkip bytes to reach the data payload for OggS
-    // container
+    // Return the packet that OggReadBatch() could not store.  The reader has
+    // not moved since, so the buffer and the page state are unchanged.
     //
-    for(ui8Index = 0; ui8Index < psOggData->sOggContainer.ui8PageSegments ;
-            ui8Index++)
+    if(psOggData->ui32Flags & OGG_FLAG_HELD)
     {
-        if(f_read(&psOggData->i16File, pucBuffer,
-                psOggData->sOggContainer.ui8SegmentTables[ui8Index],
-                (UINT *)&ui32Count) != FR_OK)
+        psOggData->ui32Flags &= ~OGG_FLAG_HELD;
+        *ppui8Packet = psOggData->pui8Buf + psOggData->ui32PacketStart;
+        *pi32OpusLen = psOggData->ui32PacketLen;
+
+        if((psOggData->sOggContainer.ui8OggHeaderType &
+            OGGS_HEADERTYPE_EOS) && (psOggData->ui8SegmentCount == 0))
         {
-            return(-1);
+            return(2);
         }
+
+        return(1);
     }
 
-    if(bGetFormat)
+    while(1)
     {
         //
-        // Now start counting the size of the audio by reading the Ogg stream
-        // till EOS
+        // Move on to the next page once all of the lacing values of this one
+        // have been used.
         //
-        do
+        if(psOggData->ui8SegmentCount == 0)
         {
-            //
-            // Read the next 27 bytes.
-            //
-            if(f_read(&psOggData->i16File, pucBuffer, 27,
-                    (UINT *)&ui32Count) != FR_OK)
+            if(psOggData->sOggContainer.ui8OggHeaderType & OGGS_HEADERTYPE_EOS)
             {
-                return(-1);
+                return(0);
             }
 
-            //
-            // Save the audio format data so that it can be returned later if
-            // requested.
-            //
-            psOggData->sOggContainer.ui32OggCapturePattern        =
-                    pui32Buffer[0];
-            psOggData->sOggContainer.ui8OggVersion                =
-                    pui8Buffer[4];
-            psOggData->sOggContainer.ui8OggHeaderType             =
-                    pui8Buffer[5];
-            psOggData->sOggContainer.ui32OggGranulePosition[0]    =
-                    pui16Buffer[3] | (pui16Buffer[4] << 16);
-            psOggData->sOggContainer.ui32OggGranulePosition[1]    =
-                    pui16Buffer[5] | (pui16Buffer[6] << 16);
-            psOggData->sOggContainer.ui32OggBitstreamSerialNumber =
-                    pui16Buffer[7] | (pui16Buffer[8] << 16);
-            psOggData->sOggContainer.ui32OggPageSequenceNumber    =
-                    pui16Buffer[9] | (pui16Buffer[10] << 16);
-            psOggData->sOggContainer.ui32OggChecksum              =
-                    pui16Buffer[11] | (pui16Buffer[12] << 16);
-            psOggData->sOggContainer.ui8PageSegments              =
-                    pui8Buffer[26];
-
-            if(psOggData->sOggContainer.ui32OggCapturePattern !=
-                    (uint32_t)OGGS_FORMAT_HEADSEQ)
+            iRet = OggPageRead(psOggData);
+            if(iRet != 0)
+            {
+                psOggData->ui32Flags &= ~(OGG_FLAG_PACKET | OGG_FLAG_SKIP |
+                                          OGG_FLAG_SKIP_TOO_LARGE);
+                return((iRet < 0) ? iRet : 0);
+            }
+
+            if(!(psOggData->sOggContainer.ui8OggHeaderType &
+                 OGGS_HEADERTYPE_CONTINUED))
+            {
+                //
+                // If the page holding the rest of a packet was lost then drop
+                // what there is of it.
+                //
+                psOggData->ui32Flags &= ~(OGG_FLAG_PACKET | OGG_FLAG_SKIP |
+                                          OGG_FLAG_SKIP_TOO_LARGE);
+            }
+            else if(psOggData->ui32Flags & OGG_FLAG_PACKET)
             {
-                return(ERR_OGG_MAGICPACKET_FAIL);
+                //
+                // Slide the start of the packet up against the body of this
+                // page so that the whole packet is contiguous.
+                //
+                ui32Header = (OGG_PAGE_HEADER_SIZE +
+                              psOggData->sOggContainer.ui8PageSegments);
+                if(psOggData->pui8Buf == psOggData->pui8ReadBuf)
+                {
+                    memmove(psOggData->pui8ReadBuf +
+                            psOggData->ui32PacketStart + ui32Header,
+                            psOggData->pui8ReadBuf +
+                            psOggData->ui32PacketStart,
+                            psOggData->ui32PacketLen);
+                    psOggData->ui32PacketStart += ui32Header;
+                }
+                else
+                {
+                    iRet = OggPacketJoin(psOggData);
+                    if(iRet != 0)
+                    {
+                        return(iRet);
+                    }
+                }
             }
-            if(psOggData->sOggContainer.ui8PageSegments > MAX_SEG_TABLE)
+            else
             {
-                return(ERR_OPUSTAGS_SEGMENTNUM_FAIL);
+                //
+                // The page starts with the end of a packet whose start was
+                // never read, so skip it.
+                //
+                psOggData->ui32Flags |= OGG_FLAG_SKIP;
             }
 
-            //
-            // Read the next psOggData->sOggContainer.ui8PageSegments bytes
-            // for size of the Opus Tags container
-            //
-            if(f_read(&psOggData->i16File, pucBuffer,
-                    psOggData->sOggContainer.ui8PageSegments,
-                    (UINT *)&ui32Count) != FR_OK)
+            continue;
+        }
+
+        //
+        // Add up the lacing values on this page that belong to the packet.  A
+        // value less than 255 ends the packet.
+        //
+        ui32Run = 0;
+        bComplete = false;
+        while(psOggData->ui8SegmentCount != 0)
+        {
+            ui8Lacing = psOggData->sOggContainer.ui8SegmentTables[
+                    psOggData->sOggContainer.ui8PageSegments -
+                    psOggData->ui8SegmentCount];
+            psOggData->ui8SegmentCount--;
+            ui32Run += ui8Lacing;
+
+            if(ui8Lacing < 255)
+            {
+                bComplete = true;
+                break;
+            }
+        }
+
+        if(!(psOggData->ui32Flags & OGG_FLAG_SKIP))
+        {
+            if(!(psOggData->ui32Flags & OGG_FLAG_PACKET))
+            {
+                psOggData->ui32Flags |= OGG_FLAG_PACKET;
+                psOggData->ui32PacketStart = psOggData->ui32BufPos;
+                psOggData->ui32PacketLen = 0;
+            }
+
+            iRet = OggBufferFill(psOggData, ui32Run);
+            if(iRet == ERR_OGG_PACKET_TOO_LARGE)
+            {
+                //
+                // The packet will not fit in the read buffer, so drop it.
+                //
+                psOggData->ui32Flags &= ~OGG_FLAG_PACKET;
+                psOggData->ui32Flags |= (OGG_FLAG_SKIP |
+                                         OGG_FLAG_SKIP_TOO_LARGE);
+            }
+            else if(iRet != 0)
+            {
+                psOggData->ui32Flags &= ~OGG_FLAG_PACKET;
+                return((iRet < 0) ? iRet : 0);
+            }
+            else
             {
-                return(-1);
+                psOggData->ui32BufPos += ui32Run;
+                psOggData->ui32PacketLen += ui32Run;
             }
+        }
 
-            for(ui8Index = 0;
-                    ui8Index < psOggData->sOggContainer.ui8PageSegments ;
-                    ui8Index++)
+        if(psOggData->ui32Flags & OGG_FLAG_SKIP)
+        {
+            iRet = OggBufferSkip(psOggData, ui32Run);
+            if(iRet != 0)
             {
-                psOggData->sOggContainer.ui8SegmentTables[ui8Index] =
-                        pui8Buffer[ui8Index];
+                return(iRet);
             }
 
-            //
-            // Read the next ui32BytesToSkip bytes to reach the data payload
-            // for OggS container
-            //
-            for(ui8Index = 0;
-                    ui8Index < psOggData->sOggContainer.ui8PageSegments ;
-                    ui8Index++)
+            if(bComplete)
             {
-                if(f_read(&psOggData->i16File, pucBuffer,
-                        psOggData->sOggContainer.ui8SegmentTables[ui8Index],
-                        (UINT *)&ui32Count) != FR_OK)
+                psOggData->ui32Flags &= ~OGG_FLAG_SKIP;
+
+                if(psOggData->ui32Flags & OGG_FLAG_SKIP_TOO_LARGE)
                 {
-                    return(-1);
+                    psOggData->ui32Flags &= ~OGG_FLAG_SKIP_TOO_LARGE;
+                    return(ERR_OGG_PACKET_TOO_LARGE);
                 }
             }
 
-        }while(psOggData->sOggContainer.ui8OggHeaderType !=
-                OGGS_HEADERTYPE_EOS);
+            continue;
+        }
 
-        psOpusHeader->ui32OpusAudioSize[0] =
-                psOggData->sOggContainer.ui32OggGranulePosition[0];
-        psOpusHeader->ui32OpusAudioSize[1] =
-                psOggData->sOggContainer.ui32OggGranulePosition[1];
-    }
+        if(bComplete)
+        {
+            psOggData->ui32Flags &= ~OGG_FLAG_PACKET;
+            *ppui8Packet = psOggData->pui8Buf + psOggData->ui32PacketStart;
+            *pi32OpusLen = psOggData->ui32PacketLen;
 
-    //
-    // Make sure that the segment count is always reset
-    //
-    psOggData->ui8SegmentCount = 0;
+            if((psOggData->sOggContainer.ui8OggHeaderType &
+                OGGS_HEADERTYPE_EOS) && (psOggData->ui8SegmentCount == 0))
+            {
+                return(2);
+            }
 
-    return(0);
+            return(1);
+        }
+    }
 }
 
 //******************************************************************************
 //
-// This is used to close a .ogg file that was opened with OggOpen().
+// This function is used to read audio data from a file that was opened with
+// the OggOpen() function.
 //
 // \param psOggData is the file structure that was passed into the OggOpen()
 // function.
+// \param pucBuffer is the buffer to read data into.
+// \param i32OpusLen is the length of opus packet to decode in the application.
 //
-// This function should be called when a function has completed using a .oggx
-// file that was opened with the OggOpen() function.  This will free up any
-// file system data that is held while the file is open.
+// This function handles reading data from a .ogg file that was opened with
+// the OggOpen() function.  It behaves as OggReadPacket() but copies the packet
+// into \e pucBuffer, which must be large enough to hold the largest packet in
+// the stream.
 //
-// \return None.
+// \return Returns 1 if a packet was read, 2 if it was the last packet of the
+// stream, 0 if there are no more packets or a negative error code.
 //
 //******************************************************************************
-void
-OggClose(tOggFile *psOggData)
+int16_t
+OggRead(tOggFile *psOggData, unsigned char *pucBuffer, int32_t *i32OpusLen)
 {
-    if(psOggData->ui32Flags & OGG_FLAG_FILEOPEN)
-    {
-        //
-        // Close out the file.
-        //
-        f_close(&psOggData->i16File);
+    const uint8_t *pui8Packet;
+    int16_t i16Ret;
 
-        //
-        // Mark file as no longer open.
-        //
-        psOggData->ui32Flags &= ~OGG_FLAG_FILEOPEN;
+    i16Ret = OggReadPacket(psOggData, &pui8Packet, i32OpusLen);
+
+    if(i16Ret > 0)
+    {
+        memcpy(pucBuffer, pui8Packet, *i32OpusLen);
     }
+
+    return(i16Ret);
 }
 
 //******************************************************************************
 //
-// This function is used to read audio data from a file that was opened with
-// the OggOpen() function.
+// This function is used to move the read position of a file that was opened
+// with the OggOpen() function.
 //
 // \param psOggData is the file structure that was passed into the OggOpen()
 // function.
-// \param pucBuffer is the buffer to read data into.
-// \param i32OpusLen is the length of opus packet to decode in the application.
+// \param ui64Granule is the playback position to seek to, in 48 kHz samples
+// from the start of the audio, not counting the pre-skip.
 //
-// This function handles reading data from a .ogg file that was opened with
-// the OggOpen() function.   The function will return the actual number of
-// of bytes read from the file.
+// The page to start reading from is found by bisecting the file on the page
+// granule positions, resynchronizing on the OggS capture pattern at each
+// probe, followed by a short forward walk.  Reading starts at least
+// OGG_PREROLL_SAMPLES before the requested position so that the decoder has
+// converged by the time it reaches it.  On return ui32SkipSamples in
+// \e psOggData holds the number of 48 kHz samples that must be decoded and
+// discarded to reach the requested position exactly.  The decoder should be
+// reset with OPUS_RESET_STATE before decoding from the new position.
+//
+// Seeking beyond the end of the audio leaves the file at the end of the
+// stream.
 //
-// \return This function returns the number of bytes read from the file.
+// \return Returns 0 on success or a negative error code.
 //
 //******************************************************************************
-int16_t
-OggRead(tOggFile *psOggData, unsigned char *pucBuffer, int32_t *i32OpusLen)
+int
+OggSeek(tOggFile *psOggData, uint64_t ui64Granule)
 {
-    uint32_t ui32Count;
-    uint32_t *pui32Buffer;
-    uint16_t *pui16Buffer;
-    uint8_t *pui8Buffer;
-    uint8_t ui8Index;
+    uint64_t ui64Target;
+    uint64_t ui64Search;
+    uint64_t ui64Page;
+    uint64_t ui64Start;
+    uint32_t ui32Lo;
+    uint32_t ui32Hi;
+    uint32_t ui32Mid;
+    uint32_t ui32Page;
+    uint32_t ui32Size;
+    uint32_t ui32Pass;
+    int iRet;
+
+    if(!(psOggData->ui32Flags & OGG_FLAG_FILEOPEN))
+    {
+        return(ERR_OGG_SEEK_FAIL);
+    }
 
     //
-    // Create some local pointers using in parsing values.
+    // Granule positions include the pre-skip.  Aim for a page that ends at
+    // least the pre-roll ahead of the target.
     //
-    pui32Buffer = (uint32_t *)pucBuffer;
-    pui16Buffer = (uint16_t *)pucBuffer;
-    pui8Buffer = (uint8_t *)pucBuffer;
+    ui64Target = ui64Granule + psOggData->sOpusHeader.ui16OpusPreSkipBytes;
+    ui64Search = ((ui64Target > OGG_PREROLL_SAMPLES) ?
+                  (ui64Target - OGG_PREROLL_SAMPLES) : 0);
 
-
-    ////////////////////////////
     //
-    // If there is no segment information available then read the Ogg
-    // container
+    // The buffer may hold a packet that was joined in place, so it can not
+    // be used to look for pages.
     //
-    if(psOggData->ui8SegmentCount == 0)
+    psOggData->ui32BufLen = 0;
+    psOggData->ui32BufPos = 0;
+
+    for(ui32Pass = 0; ; ui32Pass++)
     {
         //
-        // Read the next 27 bytes.
+        // Positions within the pre-roll of the start are decoded from the
+        // first audio page.  The search below would step over that page if
+        // no packet ends on it, and start part way through the first packet.
         //
-        if(f_read(&psOggData->i16File, pucBuffer, 27, (UINT *)&ui32Count) !=
-                FR_OK)
+        if(ui64Search == 0)
         {
-            return(-1);
+            ui32Page = psOggData->ui32DataStart;
+            ui64Start = 0;
+            break;
         }
 
         //
-        // Save the audio format data so that it can be returned later if
-        // requested.
+        // Bisect the file until the range left is no larger than one read.
+        // ui32Lo always points just after a page that ends at or before the
+        // search position, with ui64Start holding its granule position.
         //
-        psOggData->sOggContainer.ui32OggCapturePattern        =
-                pui32Buffer[0];
-        psOggData->sOggContainer.ui8OggVersion                =
-                pui8Buffer[4];
-        psOggData->sOggContainer.ui8OggHeaderType             =
-                pui8Buffer[5];
-        psOggData->sOggContainer.ui32OggGranulePosition[0]    =
-                pui16Buffer[3] | (pui16Buffer[4] << 16);
-        psOggData->sOggContainer.ui32OggGranulePosition[1]    =
-                pui16Buffer[5] | (pui16Buffer[6] << 16);
-        psOggData->sOggContainer.ui32OggBitstreamSerialNumber =
-                pui16Buffer[7] | (pui16Buffer[8] << 16);
-        psOggData->sOggContainer.ui32OggPageSequenceNumber    =
-                pui16Buffer[9] | (pui16Buffer[10] << 16);
-        psOggData->sOggContainer.ui32OggChecksum              =
-                pui16Buffer[11] | (pui16Buffer[12] << 16);
-        psOggData->sOggContainer.ui8PageSegments              =
-                pui8Buffer[26];
-        psOggData->ui8SegmentCount                            =
-                pui8Buffer[26];
-
-        if(psOggData->sOggContainer.ui32OggCapturePattern !=
-                (uint32_t)OGGS_FORMAT_HEADSEQ)
-        {
-            return(ERR_OGG_MAGICPACKET_FAIL);
-        }
-
-        if(psOggData->sOggContainer.ui8PageSegments > MAX_SEG_TABLE)
-        {
-            return(ERR_OPUSTAGS_SEGMENTNUM_FAIL);
+        ui32Lo = psOggData->ui32DataStart;
+        ui32Hi = StorageSize(&psOggData->sStorage);
+        ui64Start = 0;
+
+        while((ui32Hi - ui32Lo) > OGG_READ_BUF_SIZE)
+        {
+            ui32Mid = ui32Lo + ((ui32Hi - ui32Lo) / 2);
+
+            iRet = OggPageFind(psOggData, ui32Mid, &ui32Page, &ui32Size,
+                               &ui64Page);
+            if(iRet < 0)
+            {
+                return(iRet);
+            }
+
+            if((iRet != 0) || (ui32Page >= ui32Hi) ||
+               (ui64Page > ui64Search))
+            {
+                ui32Hi = ui32Mid;
+            }
+            else
+            {
+                ui32Lo = ui32Page + ui32Size;
+                ui64Start = ui64Page;
+            }
         }
 
         //
-        // Read the next psOggData->sOggContainer.ui8PageSegments bytes for
-        // size of the Opus Tags container
+        // Walk forward to the first page that ends after the search
+        // position.  Reading starts with that page.
         //
-        if(f_read(&psOggData->i16File, pucBuffer,
-                psOggData->sOggContainer.ui8PageSegments,
-                (UINT *)&ui32Count) != FR_OK)
+        while(1)
+        {
+            iRet = OggPageFind(psOggData, ui32Lo, &ui32Page, &ui32Size,
+                               &ui64Page);
+            if(iRet < 0)
+            {
+                return(iRet);
+            }
+
+            if(iRet != 0)
+            {
+                //
+                // The position is past the end of the audio.
+                //
+                psOggData->ui32SkipSamples = 0;
+                return(OggPositionSet(psOggData,
+                                      StorageSize(&psOggData->sStorage)));
+            }
+
+            if(ui64Page > ui64Search)
+            {
+                break;
+            }
+
+            ui32Lo = ui32Page + ui32Size;
+            ui64Start = ui64Page;
+        }
+
+        iRet = OggPageStart(psOggData, ui32Page, ui32Size, ui64Page,
+                            &ui64Start);
+        if(iRet < 0)
         {
-            return(-1);
+            return(iRet);
         }
 
-        for(ui8Index = 0; ui8Index < psOggData->sOggContainer.ui8PageSegments ;
-                ui8Index++)
+        if(ui32Pass != 0)
         {
-            psOggData->sOggContainer.ui8SegmentTables[psOggData->ui8SegmentCount-ui8Index-1] =
-                    pui8Buffer[ui8Index];
+            break;
         }
 
+        if(iRet != 0)
+        {
+            //
+            // The start of the page could not be worked out, so search again
+            // for the page before it, which ends at ui64Start.
+            //
+            ui64Search = ((ui64Start != 0) ? (ui64Start - 1) : 0);
+        }
+        else if(ui64Start > ui64Search)
+        {
+            //
+            // The page starts with the end of a long packet so the first
+            // packet returned starts after the search position.  Search again
+            // with room for the longest Opus packet, which is always enough.
+            //
+            ui64Search = ((ui64Search > OGG_MAX_PACKET_SAMPLES) ?
+                          (ui64Search - OGG_MAX_PACKET_SAMPLES) : 0);
+        }
+        else
+        {
+            break;
+        }
     }
 
-    psOggData->ui8SegmentCount--;
+    psOggData->ui32SkipSamples = ((ui64Target > ui64Start) ?
+                                  (uint32_t)(ui64Target - ui64Start) : 0);
 
-    if(f_read(&psOggData->i16File, pucBuffer,
-            psOggData->sOggContainer.ui8SegmentTables[psOggData->ui8SegmentCount],
-            (UINT *)&ui32Count) != FR_OK)
+    return(OggPositionSet(psOggData, ui32Page));
+}
+
+//******************************************************************************
+//
+// This function is used to read packets into a packet ring from a file that
+// was opened with the OggOpen() function.
+//
+// \param psOggData is the file structure that was passed into the OggOpen()
+// function.
+// \param psRing is the packet ring to add the packets to.
+//
+// Packets are read with OggReadPacket() and copied into the ring until it is
+// full or until the next packet is not already in the read buffer, so that
+// the file is read at most once for each call, with a single block read in
+// the usual case.  The last packet of the stream is marked with
+// PKTRING_DESC_LAST.  When the stream ends without one, PKTRING_FLAG_END is
+// set in the ring.  Packets that are too large for the read buffer or for the
+// ring are dropped.  Where a damaged page was dropped, an empty packet marked
+// with PKTRING_DESC_LOST is added in place of the packets that were lost.
+//
+// \return Returns the number of packets added, which is zero if the ring is
+// full or there are no more packets, or a negative error code if no packet
+// could be read.
+//
+//******************************************************************************
+int32_t
+OggReadBatch(tOggFile *psOggData, tPacketRing *psRing)
+{
+    const uint8_t *pui8Packet;
+    uint8_t *pui8Space;
+    int32_t i32Len;
+    int32_t i32Packets;
+    int16_t i16Ret;
+
+    i32Packets = 0;
+    while(psRing->ui32DescCount < psRing->ui32NumDesc)
     {
-        return(-1);
+        if((i32Packets != 0) && !OggPacketBuffered(psOggData))
+        {
+            break;
+        }
+
+        i16Ret = OggReadPacket(psOggData, &pui8Packet, &i32Len);
+        if(i16Ret == ERR_OGG_PACKET_TOO_LARGE)
+        {
+            //
+            // The packet was dropped, carry on with the next one.
+            //
+            continue;
+        }
+
+        if(i16Ret == ERR_OGG_PAGE_LOST)
+        {
+            PacketRingPut(psRing, psRing->ui32DataWrite, 0, PKTRING_DESC_LOST);
+            i32Packets++;
+            continue;
+        }
+
+        if(i16Ret <= 0)
+        {
+            if(i16Ret == 0)
+            {
+                psRing->ui32Flags |= PKTRING_FLAG_END;
+            }
+
+            return((i32Packets != 0) ? i32Packets : i16Ret);
+        }
+
+        //
+        // Drop a packet that is larger than the whole ring.  If there is just
+        // no room yet then keep the packet for the next call.
+        //
+        if((uint32_t)i32Len > psRing->ui32Size)
+        {
+            continue;
+        }
+
+        if(PacketRingSpace(psRing, i32Len, &pui8Space) < (uint32_t)i32Len)
+        {
+            psOggData->ui32Flags |= OGG_FLAG_HELD;
+            break;
+        }
+
+        memcpy(pui8Space, pui8Packet, i32Len);
+        PacketRingPut(psRing, pui8Space - psRing->pui8Data, i32Len,
+                      (i16Ret == 2) ? PKTRING_DESC_LAST : 0);
+        i32Packets++;
+
+        if(i16Ret == 2)
+        {
+            break;
+        }
+    }
+
+    return(i32Packets);
+}
+
+//******************************************************************************
+//
+// This function is called to create a .ogg file holding an Opus stream.
+//
+// \param pcFileName is the null terminated string for the file to create.
+// \param psOggData is the structure used to hold the file state information.
+// \param psOpusHeader holds the format of the audio.  The channel count, which
+// must be 1 or 2, the pre-skip, the input sample rate and the output gain must
+// be filled in.
+// \param pcVendor is the null terminated vendor string for the OpusTags
+// header.
+//
+// This function creates a new .ogg file and writes the OpusHead and OpusTags
+// headers to it, each on a page of its own.  Packets are then added with
+// OggWrite(), and the file must be finished with OggClose().  The packets are
+// collected into pages of up to OGG_READ_BUF_SIZE bytes in the buffer held in
+// \e psOggData, and each page is written to the file with a single write.
+//
+// \return Returns zero on success, the error code of the storage backend if
+// the file could not be created or ERR_OGG_WRITE_FAIL if it could not be
+// written.
+//
+//******************************************************************************
+int
+OggCreate(const char *pcFileName, tOggFile *psOggData,
+          tOpusHeadContainer *psOpusHeader, const char *pcVendor)
+{
+    uint8_t pui8Packet[OPUSHEAD_SIZE];
+    uint32_t ui32Len;
+    int iResult;
+
+    iResult = StorageOpen(&psOggData->sStorage, STORAGE_DEFAULT, pcFileName,
+                          STORAGE_MODE_CREATE);
+    if(iResult != 0)
+    {
+        return(iResult);
+    }
+
+    psOggData->ui32Flags = OGG_FLAG_FILEOPEN | OGG_FLAG_WRITE;
+    psOggData->sOpusHeader = *psOpusHeader;
+    psOggData->sOggContainer.ui8OggHeaderType = 0;
+    psOggData->sOggContainer.ui8PageSegments = 0;
+    psOggData->sOggContainer.ui32OggPageSequenceNumber = 0;
+    psOggData->ui32BufLen = 0;
+    psOggData->ui64PageGranule = ~(uint64_t)0;
+    psOggData->ui64Samples = 0;
+
+    //
+    // Granule positions count every sample decoded from the start of the
+    // stream, so the pre-skip is already in them and they start from 0.  Only
+    // the end of the stream, which OggWriteEnd() trims, adds the pre-skip to
+    // the length of the audio.
+    //
+    psOggData->ui64Granule = 0;
+
+    //
+    // Make up the serial number of the stream from the name of the file, so
+    // that streams from different files differ if they are chained.
+    //
+    psOggData->ui32Serial = OggCrc(0, (const uint8_t *)pcFileName,
+                                   strlen(pcFileName));
+
+    //
+    // The OpusHead and OpusTags headers each have a page to themselves.
+    //
+    OggPutLE32(pui8Packet, OPUSHEAD_FORMAT_SEQ0);
+    OggPutLE32(pui8Packet + 4, OPUSHEAD_FORMAT_SEQ1);
+    pui8Packet[8] = 1;
+    pui8Packet[9] = psOpusHeader->ui8OpusChannelCount;
+    OggPutLE16(pui8Packet + 10, psOpusHeader->ui16OpusPreSkipBytes);
+    OggPutLE32(pui8Packet + 12, psOpusHeader->ui32OpusInputSampleRate);
+    OggPutLE16(pui8Packet + 16, psOpusHeader->ui16OpusOutputGain);
+    pui8Packet[18] = 0;
+
+    iResult = OggPagePacket(psOggData, pui8Packet, OPUSHEAD_SIZE, 0);
+    if(iResult == 0)
+    {
+        iResult = OggPageWrite(psOggData, 0);
+    }
+    if(iResult != 0)
+    {
+        return(iResult);
     }
 
     //
-    // Write the Length of the packet
+    // The OpusTags header is built in place in the page buffer, with the
+    // vendor string and no user comments.
     //
-    *i32OpusLen =
-            psOggData->sOggContainer.ui8SegmentTables[psOggData->ui8SegmentCount];
+    ui32Len = strlen(pcVendor);
+    if(ui32Len > (OGG_WRITE_BODY_SIZE - 16))
+    {
+        ui32Len = OGG_WRITE_BODY_SIZE - 16;
+    }
+
+    OggPutLE32(psOggData->pui8ReadBuf + OGG_WRITE_BODY, OPUSTAGS_FORMAT_SEQ0);
+    OggPutLE32(psOggData->pui8ReadBuf + OGG_WRITE_BODY + 4,
+               OPUSTAGS_FORMAT_SEQ1);
+    OggPutLE32(psOggData->pui8ReadBuf + OGG_WRITE_BODY + 8, ui32Len);
+    memcpy(psOggData->pui8ReadBuf + OGG_WRITE_BODY + 12, pcVendor, ui32Len);
+    OggPutLE32(psOggData->pui8ReadBuf + OGG_WRITE_BODY + 12 + ui32Len, 0);
+
+    ui32Len += 16;
+    memset(psOggData->sOggContainer.ui8SegmentTables, 255, ui32Len / 255);
+    psOggData->sOggContainer.ui8SegmentTables[ui32Len / 255] = ui32Len % 255;
+    psOggData->sOggContainer.ui8PageSegments = (ui32Len / 255) + 1;
+    psOggData->ui32BufLen = ui32Len;
+    psOggData->ui64PageGranule = 0;
+
+    return(OggPageWrite(psOggData, 0));
+}
+
+//******************************************************************************
+//
+// This function is used to add a packet to a file created with OggCreate().
+//
+// \param psOggData is the file structure that was passed into the OggCreate()
+// function.
+// \param pui8Packet is the packet.
+// \param i32OpusLen is the length of the packet.
+// \param ui32Samples is the number of samples per channel of audio coded in
+// the packet, at the input sample rate.  This is less than the frame size for
+// a packet that was padded out at the end of the audio.
+// \param bLast is true for the last packet of the file.
+//
+// The packet is added to the page in the buffer held in \e psOggData, which is
+// only written to the file once it is full.  The last packet ends the stream
+// and is written at once.
+//
+// \return Returns 0 on success, -1 if the file is not being written or
+// ERR_OGG_WRITE_FAIL if it could not be written.
+//
+//******************************************************************************
+int
+OggWrite(tOggFile *psOggData, const uint8_t *pui8Packet, int32_t i32OpusLen,
+         uint32_t ui32Samples, bool bLast)
+{
+    int iRet;
 
-    if(psOggData->sOggContainer.ui8OggHeaderType == OGGS_HEADERTYPE_CONT)
+    if(!(psOggData->ui32Flags & OGG_FLAG_WRITE) || (i32OpusLen < 0))
     {
-        return(1);
+        return(-1);
     }
-    else if((psOggData->sOggContainer.ui8OggHeaderType == OGGS_HEADERTYPE_EOS) &&
-            (psOggData->ui8SegmentCount == 0))
+
+    psOggData->ui64Granule += OggPacketDuration(pui8Packet, i32OpusLen);
+    psOggData->ui64Samples += ui32Samples;
+
+    iRet = OggPagePacket(psOggData, pui8Packet, i32OpusLen,
+                         psOggData->ui64Granule);
+
+    if((iRet == 0) && bLast)
     {
-        return(2);
+        iRet = OggWriteEnd(psOggData);
     }
 
-    return(1);
+    return(iRet);
 }
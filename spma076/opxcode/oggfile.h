@@ -1,7 +1,7 @@
 //*****************************************************************************
 //
 // oggfile.h - This file supports reading audio data from a .ogg file and
-// reading the file format.
+// reading the file format, and writing Opus packets to a new .ogg file.
 //
 // Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
 // Software License Agreement
@@ -34,15 +34,18 @@
 #define OGGS_HEADERTYPE_BOS     0x02
 #define OGGS_HEADERTYPE_CONT    0x00
 #define OGGS_HEADERTYPE_EOS     0x04
+#define OGGS_HEADERTYPE_CONTINUED 0x01
 
 #define OPUSHEAD_FORMAT_SEQ0    'supO'
 #define OPUSHEAD_FORMAT_SEQ1    'daeH'
 #define OPUSTAGS_FORMAT_SEQ0    'supO'
 #define OPUSTAGS_FORMAT_SEQ1    'sgaT'
 
+#define OPUSHEAD_SIZE           19
+
 //*****************************************************************************
 //
-// Error codes that can be returned by OggOpen and OggRead.
+// Error codes that can be returned by OggOpen, OggRead and OggWrite.
 //
 //*****************************************************************************
 #define ERR_OGG_MAGICPACKET_FAIL      -101
@@ -50,20 +53,90 @@
 #define ERR_OPUSHEAD_SEGMENTNUM_FAIL  -103
 #define ERR_OPUSTAGS_MAGICPACKET_FAIL -105
 #define ERR_OPUSTAGS_SEGMENTNUM_FAIL  -106
+#define ERR_OGG_READ_FAIL             -107
+#define ERR_OGG_PACKET_TOO_LARGE      -108
+#define ERR_OGG_SEEK_FAIL             -109
+#define ERR_OGG_WRITE_FAIL            -110
+#define ERR_OGG_PAGE_LOST             -111
+
+//*****************************************************************************
+//
+// Define for Maximum Size of Segment Table.  A page may carry up to 255 lacing
+// values so the whole table is always kept.
+//
+//*****************************************************************************
+#define MAX_SEG_TABLE                 255
+
+//*****************************************************************************
+//
+// Size of the fixed part of an OggS page header, before the lacing table.
+//
+//*****************************************************************************
+#define OGG_PAGE_HEADER_SIZE          27
+
+//*****************************************************************************
+//
+// Size of the read buffer held in tOggFile.  The file is read in blocks of up
+// to this size, ending on an OGG_READ_ALIGN boundary so that FatFs can transfer
+// whole sectors straight into the buffer.  Packets are returned as pointers
+// into this buffer, so the largest packet that can be returned is this size
+// less one page header and lacing table.
+//
+//*****************************************************************************
+#ifndef OGG_READ_BUF_SIZE
+#define OGG_READ_BUF_SIZE             4096
+#endif
+#define OGG_READ_ALIGN                512
+
+//*****************************************************************************
+//
+// Size of the block, held on the stack, that the rest of a page that does not
+// fit in the read buffer is read through to check its CRC.
+//
+//*****************************************************************************
+#define OGG_CRC_CHUNK_SIZE            256
+
+//*****************************************************************************
+//
+// When a file is being written the read buffer holds the page being built.
+// Its body starts at OGG_WRITE_BODY, leaving room ahead of it for the largest
+// page header, so a page is at most OGG_READ_BUF_SIZE bytes.
+//
+//*****************************************************************************
+#define OGG_WRITE_BODY                (OGG_PAGE_HEADER_SIZE + MAX_SEG_TABLE)
+#define OGG_WRITE_BODY_SIZE           (OGG_READ_BUF_SIZE - OGG_WRITE_BODY)
+
+//*****************************************************************************
+//
+// Amount of audio, in 48 kHz samples, that OggSeek() starts decoding ahead of
+// the requested position so that the decoder has converged by the time it is
+// reached.
+//
+//*****************************************************************************
+#define OGG_PREROLL_SAMPLES           3840
 
 //*****************************************************************************
 //
-// Define for Maximum Size of Segment Table
+// Duration of the longest Opus packet, 120 ms, in 48 kHz samples.
 //
 //*****************************************************************************
-#define MAX_SEG_TABLE                 50
+#define OGG_MAX_PACKET_SAMPLES        5760
 
 //*****************************************************************************
 //
-// Define for File Open
+// Defines for the tOggFile state flags.  PACKET is set while a packet that
+// spans pages is being assembled and SKIP while the remainder of a packet is
+// being discarded.  HELD is set when OggReadBatch() had no room for the last
+// packet it read, which is then returned first by the next read.  WRITE is
+// set while a file created with OggCreate() has not yet been ended.
 //
 //*****************************************************************************
 #define OGG_FLAG_FILEOPEN             0x00000001
+#define OGG_FLAG_PACKET               0x00000002
+#define OGG_FLAG_SKIP                 0x00000004
+#define OGG_FLAG_SKIP_TOO_LARGE       0x00000008
+#define OGG_FLAG_HELD                 0x00000010
+#define OGG_FLAG_WRITE                0x00000020
 
 //*****************************************************************************
 //
@@ -163,7 +236,7 @@ typedef struct
     uint8_t ui8OpusMappingFamily;
 
     //
-    // Mapping Family
+    // Length of the audio in 48 kHz samples, not counting the pre-skip.
     //
     uint32_t ui32OpusAudioSize[2];
 }
@@ -189,17 +262,75 @@ typedef struct
     //
     // The file information for the current file.
     //
-    FIL i16File;
+    tStorage sStorage;
 
     //
-    // Current state flags, a combination of the WAV_FLAG_* values.
+    // Current state flags, a combination of the OGG_FLAG_* values.
     //
     uint32_t ui32Flags;
 
     //
-    // Current state flags, a combination of the WAV_FLAG_* values.
+    // Number of lacing values of the current page not yet consumed.
     //
     uint8_t ui8SegmentCount;
+
+    //
+    // The whole file if the storage backend can map it, or 0 otherwise.
+    //
+    const uint8_t *pui8Map;
+
+    //
+    // The buffer being parsed.  This is pui8ReadBuf, or a window onto
+    // pui8Map that ends at the end of the file if the file is mapped.
+    //
+    const uint8_t *pui8Buf;
+
+    //
+    // Number of valid bytes in pui8Buf and the offset of the next byte to be
+    // parsed.
+    //
+    uint32_t ui32BufLen;
+    uint32_t ui32BufPos;
+
+    //
+    // Offset and length in pui8Buf of the packet being assembled.
+    //
+    uint32_t ui32PacketStart;
+    uint32_t ui32PacketLen;
+
+    //
+    // Serial number of the Opus stream and file offset of its first audio
+    // page.
+    //
+    uint32_t ui32Serial;
+    uint32_t ui32DataStart;
+
+    //
+    // Number of 48 kHz samples that must be decoded and discarded after
+    // OggSeek() to reach the requested position.
+    //
+    uint32_t ui32SkipSamples;
+
+    //
+    // Number of pages that were dropped because they were damaged.
+    //
+    uint32_t ui32PagesLost;
+
+    //
+    // While writing, the granule position at the end of the last packet added,
+    // the granule position of the page being built, which is -1 until a
+    // packet ends on it, and the number of samples per channel added at the
+    // input sample rate.
+    //
+    uint64_t ui64Granule;
+    uint64_t ui64PageGranule;
+    uint64_t ui64Samples;
+
+    //
+    // Read buffer holding one or more pages from the file, or the page being
+    // built while writing.
+    //
+    uint8_t pui8ReadBuf[OGG_READ_BUF_SIZE];
 } tOggFile;
 
 //*****************************************************************************
@@ -211,8 +342,16 @@ int OggOpen(const char *pcFileName,
         tOggFile *psOggData,
         tOpusHeadContainer *psOpusHeader,
         bool bGetFormat);
-void OggClose(tOggFile *psOggData);
+int OggClose(tOggFile *psOggData);
 int16_t OggRead(tOggFile *psOggData, unsigned char *pucBuffer,
          int32_t *i32OpusLen);
+int16_t OggReadPacket(tOggFile *psOggData, const uint8_t **ppui8Packet,
+         int32_t *pi32OpusLen);
+int OggSeek(tOggFile *psOggData, uint64_t ui64Granule);
+int32_t OggReadBatch(tOggFile *psOggData, tPacketRing *psRing);
+int OggCreate(const char *pcFileName, tOggFile *psOggData,
+        tOpusHeadContainer *psOpusHeader, const char *pcVendor);
+int OggWrite(tOggFile *psOggData, const uint8_t *pui8Packet,
+        int32_t i32OpusLen, uint32_t ui32Samples, bool bLast);
 
 #endif
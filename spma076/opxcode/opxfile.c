@@ -1,7 +1,7 @@
 //******************************************************************************
 //
-// opxfile.c - This file supports reading audio data from a .opx file and
-// reading the file format.
+// opxfile.c - This file supports reading and writing audio data in a .opx
+// file and reading the file format.
 //
 // Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
 // Software License Agreement
@@ -22,11 +22,51 @@
 //******************************************************************************
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef STORAGE_NO_FATFS
 #include "inc/hw_types.h"
 #include "third_party/fatfs/src/ff.h"
 #include "third_party/fatfs/src/diskio.h"
+#endif
+#include "opxcode/storage.h"
+#include "opxcode/pktring.h"
 #include "opxcode/opxfile.h"
 
+//******************************************************************************
+//
+// Read and write little endian values at possibly unaligned locations.
+//
+//******************************************************************************
+static uint32_t
+OpxGetLE32(const uint8_t *pui8Data)
+{
+    return((uint32_t)pui8Data[0] | ((uint32_t)pui8Data[1] << 8) |
+           ((uint32_t)pui8Data[2] << 16) | ((uint32_t)pui8Data[3] << 24));
+}
+
+static uint16_t
+OpxGetLE16(const uint8_t *pui8Data)
+{
+    return((uint16_t)(pui8Data[0] | (pui8Data[1] << 8)));
+}
+
+static void
+OpxPutLE32(uint8_t *pui8Data, uint32_t ui32Value)
+{
+    pui8Data[0] = (uint8_t)ui32Value;
+    pui8Data[1] = (uint8_t)(ui32Value >> 8);
+    pui8Data[2] = (uint8_t)(ui32Value >> 16);
+    pui8Data[3] = (uint8_t)(ui32Value >> 24);
+}
+
+static void
+OpxPutLE16(uint8_t *pui8Data, uint16_t ui16Value)
+{
+    pui8Data[0] = (uint8_t)ui16Value;
+    pui8Data[1] = (uint8_t)(ui16Value >> 8);
+}
+
 //******************************************************************************
 //
 // This function returns the format of a opx file that has been opened with
@@ -56,7 +96,14 @@ OpxGetFormat(tOpxFile *psOpxData, tOpxHeader *psOpxHeader)
     psOpxHeader->ui32SampleRate = psOpxData->sOpxHeader.ui32SampleRate;
     psOpxHeader->ui32OrigFileSize = psOpxData->sOpxHeader.ui32OrigFileSize;
     psOpxHeader->ui32AvgByteRate = psOpxData->sOpxHeader.ui32AvgByteRate;
-
+    psOpxHeader->ui16Version = psOpxData->sOpxHeader.ui16Version;
+    psOpxHeader->ui16FrameSamples = psOpxData->sOpxHeader.ui16FrameSamples;
+    psOpxHeader->ui32NumFrames = psOpxData->sOpxHeader.ui32NumFrames;
+    psOpxHeader->ui32NumSamples = psOpxData->sOpxHeader.ui32NumSamples;
+    psOpxHeader->ui32SeekTableOffset =
+            psOpxData->sOpxHeader.ui32SeekTableOffset;
+    psOpxHeader->ui32SeekInterval = psOpxData->sOpxHeader.ui32SeekInterval;
+    psOpxHeader->ui32SeekEntries = psOpxData->sOpxHeader.ui32SeekEntries;
 }
 
 //******************************************************************************
@@ -83,21 +130,15 @@ OpxGetFormat(tOpxFile *psOpxData, tOpxHeader *psOpxHeader)
 int
 OpxOpen(const char *pcFileName, tOpxFile *psOpxData)
 {
-    unsigned char pucBuffer[20];
-    uint32_t *pui32Buffer;
-    uint16_t *pui16Buffer;
+    uint8_t pui8Buffer[OPX_V2_HEADER_SIZE + OPX_RECORD_HEADER_SIZE];
+    uint32_t ui32Signature;
     uint32_t ui32Count;
 
-    //
-    // Create some local pointers using in parsing values.
-    //
-    pui32Buffer = (uint32_t *)pucBuffer;
-    pui16Buffer = (uint16_t *)pucBuffer;
-
     //
     // Open the file as read only.
     //
-    if(f_open(&psOpxData->i16File, pcFileName, FA_READ) != FR_OK)
+    if(StorageOpen(&psOpxData->sStorage, STORAGE_DEFAULT, pcFileName,
+                   STORAGE_MODE_READ) != 0)
     {
         return(-1);
     }
@@ -106,11 +147,13 @@ OpxOpen(const char *pcFileName, tOpxFile *psOpxData)
     // File is open.
     //
     psOpxData->ui32Flags = OPX_FLAG_FILEOPEN;
+    psOpxData->ui32Frame = 0;
 
     //
-    // Read the first 12 bytes.
+    // Read the part of the header that is common to both versions.
     //
-    if(f_read(&psOpxData->i16File, pucBuffer, 16, (UINT *)&ui32Count) != FR_OK)
+    if((StorageRead(&psOpxData->sStorage, pui8Buffer, 16, &ui32Count) != 0) ||
+       (ui32Count != 16))
     {
         return(-1);
     }
@@ -118,7 +161,9 @@ OpxOpen(const char *pcFileName, tOpxFile *psOpxData)
     //
     // Look for Opus Header tag.
     //
-    if(pui32Buffer[0] != OPX_FORMAT_HEADSEQ)
+    ui32Signature = OpxGetLE32(pui8Buffer);
+    if((ui32Signature != OPX_FORMAT_HEADSEQ) &&
+       (ui32Signature != OPX_FORMAT_HEADSEQ_V2))
     {
         return(-1);
     }
@@ -127,53 +172,239 @@ OpxOpen(const char *pcFileName, tOpxFile *psOpxData)
     // Save the audio format data so that it can be returned later if
     // requested.
     //
-    psOpxData->sOpxHeader.ui16NumChannels =  pui16Buffer[2];
-    psOpxData->sOpxHeader.ui16BitsPerSample =  pui16Buffer[3];
-    psOpxData->sOpxHeader.ui32SampleRate = pui32Buffer[2];
-    psOpxData->sOpxHeader.ui32OrigFileSize = pui32Buffer[3];
+    psOpxData->sOpxHeader.ui32HeaderDelimiter = ui32Signature;
+    psOpxData->sOpxHeader.ui16NumChannels = OpxGetLE16(pui8Buffer + 4);
+    psOpxData->sOpxHeader.ui16BitsPerSample = OpxGetLE16(pui8Buffer + 6);
+    psOpxData->sOpxHeader.ui32SampleRate = OpxGetLE32(pui8Buffer + 8);
+    psOpxData->sOpxHeader.ui32OrigFileSize = OpxGetLE32(pui8Buffer + 12);
     psOpxData->sOpxHeader.ui32AvgByteRate =
-            (pui32Buffer[2] * pui16Buffer[2] * pui16Buffer[3])/8;
+            (psOpxData->sOpxHeader.ui32SampleRate *
+             psOpxData->sOpxHeader.ui16NumChannels *
+             psOpxData->sOpxHeader.ui16BitsPerSample) / 8;
+    psOpxData->sOpxHeader.ui16Version = 1;
+    psOpxData->sOpxHeader.ui16FrameSamples = 0;
+    psOpxData->sOpxHeader.ui32NumFrames = 0;
+    psOpxData->sOpxHeader.ui32NumSamples = 0;
+    psOpxData->sOpxHeader.ui32SeekTableOffset = 0;
+    psOpxData->sOpxHeader.ui32SeekInterval = 0;
+    psOpxData->sOpxHeader.ui32SeekEntries = 0;
+    psOpxData->ui16NextRecord = 0;
+
+    if(ui32Signature == OPX_FORMAT_HEADSEQ_V2)
+    {
+        //
+        // Read the rest of the version 2 header along with the header of the
+        // first record.  A file without packets ends with the header or with
+        // its seek table, so only the header has to be there in full.
+        //
+        if((StorageRead(&psOpxData->sStorage, pui8Buffer + 16,
+                        sizeof(pui8Buffer) - 16, &ui32Count) != 0) ||
+           (ui32Count < (OPX_V2_HEADER_SIZE - 16)))
+        {
+            return(-1);
+        }
+
+        psOpxData->sOpxHeader.ui16Version = OpxGetLE16(pui8Buffer + 16);
+        psOpxData->sOpxHeader.ui16FrameSamples = OpxGetLE16(pui8Buffer + 18);
+        psOpxData->sOpxHeader.ui32NumFrames = OpxGetLE32(pui8Buffer + 20);
+        psOpxData->sOpxHeader.ui32NumSamples = OpxGetLE32(pui8Buffer + 24);
+        psOpxData->sOpxHeader.ui32SeekTableOffset =
+                OpxGetLE32(pui8Buffer + 28);
+        psOpxData->sOpxHeader.ui32SeekInterval = OpxGetLE32(pui8Buffer + 32);
+        psOpxData->sOpxHeader.ui32SeekEntries = OpxGetLE32(pui8Buffer + 36);
+
+        //
+        // If there are no packets the seek table, if any, follows the header
+        // directly and there is nothing to read.
+        //
+        if((psOpxData->sOpxHeader.ui32NumFrames == 0) &&
+           (psOpxData->sOpxHeader.ui32SeekTableOffset == OPX_V2_HEADER_SIZE))
+        {
+            psOpxData->ui32Flags |= OPX_FLAG_LAST;
+            return(0);
+        }
+
+        if(ui32Count != (sizeof(pui8Buffer) - 16))
+        {
+            return(-1);
+        }
+
+        psOpxData->ui16NextRecord =
+                OpxGetLE16(pui8Buffer + OPX_V2_HEADER_SIZE);
+    }
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// This function is called to create a version 2 .opx file.
+//
+// \param pcFileName is the null terminated string for the file to create.
+// \param psOpxData is the structure used to hold the file state information.
+// \param psOpxHeader holds the format of the audio.  The number of channels,
+// bits per sample, sample rate, original file size and samples per frame must
+// be filled in.
+//
+// This function creates a new .opx file and writes a placeholder header to it.
+// Packets are then added with OpxWrite(), and the file must be finished with
+// OpxClose(), which writes the seek table and the final header.
+//
+// \return Returns zero on success or the error code of the storage backend
+// otherwise.
+//
+//******************************************************************************
+int
+OpxCreate(const char *pcFileName, tOpxFile *psOpxData,
+          tOpxHeader *psOpxHeader)
+{
+    uint8_t pui8Buffer[OPX_V2_HEADER_SIZE];
+    uint32_t ui32Count;
+    int iResult;
+
+    iResult = StorageOpen(&psOpxData->sStorage, STORAGE_DEFAULT, pcFileName,
+                          STORAGE_MODE_CREATE);
+    if(iResult != 0)
+    {
+        return(iResult);
+    }
+
+    psOpxData->ui32Flags = OPX_FLAG_FILEOPEN | OPX_FLAG_WRITE;
+    psOpxData->ui32Frame = 0;
+
+    psOpxData->sOpxHeader = *psOpxHeader;
+    psOpxData->sOpxHeader.ui32HeaderDelimiter = OPX_FORMAT_HEADSEQ_V2;
+    psOpxData->sOpxHeader.ui16Version = 2;
+    psOpxData->sOpxHeader.ui32NumFrames = 0;
+    psOpxData->sOpxHeader.ui32NumSamples = 0;
+    psOpxData->sOpxHeader.ui32SeekTableOffset = 0;
+    psOpxData->sOpxHeader.ui32SeekInterval = OPX_SEEK_INTERVAL;
+    psOpxData->sOpxHeader.ui32SeekEntries = 0;
+
+    //
+    // Reserve room for the header, which is written again on close.
+    //
+    memset(pui8Buffer, 0, sizeof(pui8Buffer));
+    iResult = StorageWrite(&psOpxData->sStorage, pui8Buffer,
+                           sizeof(pui8Buffer), &ui32Count);
+
+    return(iResult);
+}
+
+//******************************************************************************
+//
+// Write the version 2 header and seek table of a file being created.  Returns
+// zero on success, the error code of the storage backend or -1 if a write was
+// short.
+//
+//******************************************************************************
+static int
+OpxFinish(tOpxFile *psOpxData)
+{
+    uint8_t pui8Buffer[OPX_V2_HEADER_SIZE];
+    tOpxHeader *psHeader;
+    uint32_t ui32Count;
+    uint32_t ui32Idx;
+    int iResult;
+
+    psHeader = &psOpxData->sOpxHeader;
 
     //
-    // Only mono supported.
+    // The seek table follows the last packet.
     //
-    if(psOpxData->sOpxHeader.ui16NumChannels > 1)
+    psHeader->ui32SeekTableOffset = StorageTell(&psOpxData->sStorage);
+    for(ui32Idx = 0; ui32Idx < psHeader->ui32SeekEntries; ui32Idx++)
+    {
+        OpxPutLE32((uint8_t *)&psOpxData->pui32SeekTable[ui32Idx],
+                   psOpxData->pui32SeekTable[ui32Idx]);
+    }
+    iResult = StorageWrite(&psOpxData->sStorage, psOpxData->pui32SeekTable,
+                           psHeader->ui32SeekEntries * 4, &ui32Count);
+    if(iResult != 0)
+    {
+        return(iResult);
+    }
+    if(ui32Count != (psHeader->ui32SeekEntries * 4))
     {
         return(-1);
     }
 
-    return(0);
+    OpxPutLE32(pui8Buffer, OPX_FORMAT_HEADSEQ_V2);
+    OpxPutLE16(pui8Buffer + 4, psHeader->ui16NumChannels);
+    OpxPutLE16(pui8Buffer + 6, psHeader->ui16BitsPerSample);
+    OpxPutLE32(pui8Buffer + 8, psHeader->ui32SampleRate);
+    OpxPutLE32(pui8Buffer + 12, psHeader->ui32OrigFileSize);
+    OpxPutLE16(pui8Buffer + 16, psHeader->ui16Version);
+    OpxPutLE16(pui8Buffer + 18, psHeader->ui16FrameSamples);
+    OpxPutLE32(pui8Buffer + 20, psHeader->ui32NumFrames);
+    OpxPutLE32(pui8Buffer + 24, psHeader->ui32NumSamples);
+    OpxPutLE32(pui8Buffer + 28, psHeader->ui32SeekTableOffset);
+    OpxPutLE32(pui8Buffer + 32, psHeader->ui32SeekInterval);
+    OpxPutLE32(pui8Buffer + 36, psHeader->ui32SeekEntries);
+
+    iResult = StorageSeek(&psOpxData->sStorage, 0);
+    if(iResult == 0)
+    {
+        iResult = StorageWrite(&psOpxData->sStorage, pui8Buffer,
+                               sizeof(pui8Buffer), &ui32Count);
+    }
+    if((iResult == 0) && (ui32Count != sizeof(pui8Buffer)))
+    {
+        iResult = -1;
+    }
+
+    return(iResult);
 }
 
 //******************************************************************************
 //
-// This is used to close a .opx file that was opened with OpxOpen().
+// This is used to close a .opx file that was opened with OpxOpen() or
+// created with OpxCreate().
 //
 // \param psOpxData is the file structure that was passed into the OpxOpen()
-// function.
+// or OpxCreate() function.
 //
 // This function should be called when a function has completed using a .opx
 // file that was opened with the OpxOpen() function.  This will free up any
-// file system data that is held while the file is open.
+// file system data that is held while the file is open.  For a file created
+// with OpxCreate() the seek table and final header are written first, and the
+// file is closed even if that fails.
 //
-// \return None.
+// \return Returns zero on success, the error code of the storage backend if
+// the file could not be written or closed, or -1 if the seek table or header
+// of a file created with OpxCreate() could not be written.
 //
 //******************************************************************************
-void
+int
 OpxClose(tOpxFile *psOpxData)
 {
+    int iResult, iClose;
+
+    iResult = 0;
     if(psOpxData->ui32Flags & OPX_FLAG_FILEOPEN)
     {
+        if(psOpxData->ui32Flags & OPX_FLAG_WRITE)
+        {
+            iResult = OpxFinish(psOpxData);
+        }
+
         //
-        // Close out the file.
+        // Close out the file, which also writes out what the file system
+        // still has cached.
         //
-        f_close(&psOpxData->i16File);
+        iClose = StorageClose(&psOpxData->sStorage);
+        if(iResult == 0)
+        {
+            iResult = iClose;
+        }
 
         //
         // Mark file as no longer open.
         //
-        psOpxData->ui32Flags &= ~OPX_FLAG_FILEOPEN;
+        psOpxData->ui32Flags &= ~(OPX_FLAG_FILEOPEN | OPX_FLAG_WRITE);
     }
+
+    return(iResult);
 }
 
 //******************************************************************************
@@ -184,12 +415,16 @@ OpxClose(tOpxFile *psOpxData)
 // \param psOpxData is the file structure that was passed into the OpxOpen()
 // function.
 // \param pucBuffer is the buffer to read data into.
+// \param i32OpxLen is written with the length of the packet.
 //
 // This function handles reading data from a .opx file that was opened with
-// the OpxOpen() function.   The function will return the actual number of
-// of bytes read from the file.
+// the OpxOpen() function.  For a version 2 file the packet and the header of
+// the record that follows it are read with a single read of the file, so
+// \e pucBuffer must have room for OPX_RECORD_HEADER_SIZE bytes beyond the
+// largest packet.
 //
-// \return This function returns the number of bytes read from the file.
+// \return Returns 1 if a packet was read, 2 if it was the last packet or 0 on
+// error or if there are no more packets.
 //
 //******************************************************************************
 uint16_t
@@ -198,12 +433,49 @@ OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer, int32_t *i32OpxLen)
     uint32_t ui32OpxDelimiter;
     int32_t  i32len;
     uint32_t ui32Count;
+    uint32_t ui32Size;
+
+    if(psOpxData->sOpxHeader.ui16Version >= 2)
+    {
+        if(psOpxData->ui32Flags & OPX_FLAG_LAST)
+        {
+            return(0);
+        }
+
+        //
+        // Read this packet and the header of the next one together.
+        //
+        i32len = psOpxData->ui16NextRecord & OPX_RECORD_LEN_M;
+        ui32Size = i32len;
+        if(!(psOpxData->ui16NextRecord & OPX_RECORD_LAST))
+        {
+            ui32Size += OPX_RECORD_HEADER_SIZE;
+        }
+
+        if((StorageRead(&psOpxData->sStorage, pucBuffer, ui32Size,
+                        &ui32Count) != 0) || (ui32Count != ui32Size))
+        {
+            return(0);
+        }
+
+        *i32OpxLen = i32len;
+        psOpxData->ui32Frame++;
+
+        if(psOpxData->ui16NextRecord & OPX_RECORD_LAST)
+        {
+            psOpxData->ui32Flags |= OPX_FLAG_LAST;
+            return(2);
+        }
+
+        psOpxData->ui16NextRecord = OpxGetLE16(pucBuffer + i32len);
+        return(1);
+    }
 
     //
     // Read the delimiter info and check if this is the last segment
     //
-    if(f_read(&psOpxData->i16File, &ui32OpxDelimiter, 4, (UINT *)&ui32Count)
-            != FR_OK)
+    if(StorageRead(&psOpxData->sStorage, &ui32OpxDelimiter, 4, &ui32Count)
+            != 0)
     {
         return(0);
     }
@@ -211,8 +483,8 @@ OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer, int32_t *i32OpxLen)
     //
     // Read the file opx segement length
     //
-    if(f_read(&psOpxData->i16File, &i32len, 4, (UINT *)&ui32Count)
-            != FR_OK)
+    if(StorageRead(&psOpxData->sStorage, &i32len, 4, &ui32Count)
+            != 0)
     {
         return(0);
     }
@@ -220,8 +492,8 @@ OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer, int32_t *i32OpxLen)
     //
     // Read the data in another buffer from the file.
     //
-    if(f_read(&psOpxData->i16File, pucBuffer, i32len, (UINT *)&ui32Count)
-            != FR_OK)
+    if(StorageRead(&psOpxData->sStorage, pucBuffer, i32len, &ui32Count)
+            != 0)
     {
         return(0);
     }
@@ -230,6 +502,8 @@ OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer, int32_t *i32OpxLen)
     // Write the Length of the packet
     //
     *i32OpxLen = i32len;
+    psOpxData->ui32Frame++;
+    psOpxData->ui16NextRecord = 0;
 
     if(ui32OpxDelimiter == OPX_FORMAT_MIDSEQ)
     {
@@ -245,3 +519,307 @@ OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer, int32_t *i32OpxLen)
     }
 
 }
+
+//******************************************************************************
+//
+// This function is used to move the read position of a file that was opened
+// with the OpxOpen() function.
+//
+// \param psOpxData is the file structure that was passed into the OpxOpen()
+// function.
+// \param ui32Frame is the frame to seek to.
+//
+// The seek table of a version 2 file is used to move to the closest frame at
+// or before \e ui32Frame that has an entry, with one read of the table and
+// one of the record header.  The caller may then read and discard packets to
+// reach \e ui32Frame exactly.  Version 1 files have no seek table and can not
+// be seeked.
+//
+// \return Returns the index of the frame that will be read next or -1 on
+// error.
+//
+//******************************************************************************
+int32_t
+OpxSeek(tOpxFile *psOpxData, uint32_t ui32Frame)
+{
+    uint8_t pui8Buffer[4];
+    uint32_t ui32Entry;
+    uint32_t ui32Count;
+
+    if((psOpxData->sOpxHeader.ui16Version < 2) ||
+       (psOpxData->sOpxHeader.ui32SeekEntries == 0) ||
+       (psOpxData->ui32Flags & OPX_FLAG_WRITE))
+    {
+        return(-1);
+    }
+
+    ui32Entry = ui32Frame / psOpxData->sOpxHeader.ui32SeekInterval;
+    if(ui32Entry >= psOpxData->sOpxHeader.ui32SeekEntries)
+    {
+        ui32Entry = psOpxData->sOpxHeader.ui32SeekEntries - 1;
+    }
+
+    //
+    // Look up the offset of the record and read its header.
+    //
+    if((StorageSeek(&psOpxData->sStorage,
+                    psOpxData->sOpxHeader.ui32SeekTableOffset +
+                    (ui32Entry * 4)) != 0) ||
+       (StorageRead(&psOpxData->sStorage, pui8Buffer, 4,
+                    &ui32Count) != 0) || (ui32Count != 4))
+    {
+        return(-1);
+    }
+
+    if((StorageSeek(&psOpxData->sStorage, OpxGetLE32(pui8Buffer)) != 0) ||
+       (StorageRead(&psOpxData->sStorage, pui8Buffer,
+                    OPX_RECORD_HEADER_SIZE, &ui32Count) != 0) ||
+       (ui32Count != OPX_RECORD_HEADER_SIZE))
+    {
+        return(-1);
+    }
+
+    psOpxData->ui16NextRecord = OpxGetLE16(pui8Buffer);
+    psOpxData->ui32Flags &= ~OPX_FLAG_LAST;
+    psOpxData->ui32Frame = ui32Entry * psOpxData->sOpxHeader.ui32SeekInterval;
+
+    return((int32_t)psOpxData->ui32Frame);
+}
+
+//******************************************************************************
+//
+// This function is used to add a packet to a file created with OpxCreate().
+//
+// \param psOpxData is the file structure that was passed into the OpxCreate()
+// function.
+// \param pucRecord holds the packet, starting OPX_RECORD_HEADER_SIZE bytes in
+// so that the record header can be filled in ahead of it.
+// \param i32OpxLen is the length of the packet.
+// \param ui32Samples is the number of samples per channel coded in the
+// packet.
+// \param bLast is true for the last packet of the file.
+//
+// The record header and packet are written with a single write to the file.
+//
+// \return Returns 0 on success or -1 on error.
+//
+//******************************************************************************
+int
+OpxWrite(tOpxFile *psOpxData, unsigned char *pucRecord, int32_t i32OpxLen,
+         uint32_t ui32Samples, bool bLast)
+{
+    tOpxHeader *psHeader;
+    uint32_t ui32Count;
+    uint32_t ui32Idx;
+
+    psHeader = &psOpxData->sOpxHeader;
+
+    if((i32OpxLen < 0) || (i32OpxLen > OPX_RECORD_LEN_M))
+    {
+        return(-1);
+    }
+
+    //
+    // Add a seek table entry every ui32SeekInterval frames.  When the table
+    // is full, keep every other entry and double the interval.
+    //
+    if((psOpxData->ui32Frame % psHeader->ui32SeekInterval) == 0)
+    {
+        if(psHeader->ui32SeekEntries == OPX_SEEK_TABLE_SIZE)
+        {
+            for(ui32Idx = 0; ui32Idx < (OPX_SEEK_TABLE_SIZE / 2); ui32Idx++)
+            {
+                psOpxData->pui32SeekTable[ui32Idx] =
+                        psOpxData->pui32SeekTable[ui32Idx * 2];
+            }
+            psHeader->ui32SeekEntries = OPX_SEEK_TABLE_SIZE / 2;
+            psHeader->ui32SeekInterval *= 2;
+        }
+
+        if((psOpxData->ui32Frame % psHeader->ui32SeekInterval) == 0)
+        {
+            psOpxData->pui32SeekTable[psHeader->ui32SeekEntries++] =
+                    StorageTell(&psOpxData->sStorage);
+        }
+    }
+
+    OpxPutLE16(pucRecord, (uint16_t)(i32OpxLen |
+                                     (bLast ? OPX_RECORD_LAST : 0)));
+
+    if((StorageWrite(&psOpxData->sStorage, pucRecord,
+                     i32OpxLen + OPX_RECORD_HEADER_SIZE,
+                     &ui32Count) != 0) ||
+       (ui32Count != (uint32_t)(i32OpxLen + OPX_RECORD_HEADER_SIZE)))
+    {
+        return(-1);
+    }
+
+    psOpxData->ui32Frame++;
+    psHeader->ui32NumFrames++;
+    psHeader->ui32NumSamples += ui32Samples;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// This function is used to read as many packets as will fit into a packet
+// ring from a file that was opened with the OpxOpen() function.
+//
+// \param psOpxData is the file structure that was passed into the OpxOpen()
+// function.
+// \param psRing is the packet ring to add the packets to.
+//
+// The free space of the ring is filled with a single read of the file and the
+// records that were read whole are added to the ring in place, so the packets
+// are not copied again.  The part of a record that did not fit is given back
+// with a seek and is read again by the next call.  The ring must be able to
+// hold the largest record of the file when it is empty.  The last packet of
+// the file is marked with PKTRING_DESC_LAST.
+//
+// \return Returns the number of packets added, which is zero if the ring is
+// full or the last packet has already been read, or -1 on error.
+//
+//******************************************************************************
+int32_t
+OpxReadBatch(tOpxFile *psOpxData, tPacketRing *psRing)
+{
+    uint8_t *pui8Space;
+    uint32_t ui32Space;
+    uint32_t ui32Base;
+    uint32_t ui32Count;
+    uint32_t ui32Pos;
+    uint32_t ui32Min;
+    uint32_t ui32Len;
+    uint32_t ui32Size;
+    uint32_t ui32Delimiter;
+    uint16_t ui16Record;
+    int32_t i32Packets;
+    bool bLast;
+
+    if(psOpxData->ui32Flags & OPX_FLAG_LAST)
+    {
+        return(0);
+    }
+
+    //
+    // A version 2 record is known to need its packet and the header of the
+    // next record.  For version 1 the packet length is only known if the
+    // last call read the record header but not the whole packet.
+    //
+    if(psOpxData->sOpxHeader.ui16Version >= 2)
+    {
+        ui32Min = ((psOpxData->ui16NextRecord & OPX_RECORD_LEN_M) +
+                   OPX_RECORD_HEADER_SIZE);
+    }
+    else
+    {
+        ui32Min = psOpxData->ui16NextRecord + 8;
+    }
+
+    ui32Space = PacketRingSpace(psRing, ui32Min, &pui8Space);
+    if(ui32Space < ui32Min)
+    {
+        return(0);
+    }
+    ui32Base = pui8Space - psRing->pui8Data;
+
+    if(StorageRead(&psOpxData->sStorage, pui8Space, ui32Space,
+                   &ui32Count) != 0)
+    {
+        return(-1);
+    }
+
+    //
+    // Add every record that was read whole to the ring.
+    //
+    i32Packets = 0;
+    ui32Pos = 0;
+    ui16Record = ((psOpxData->sOpxHeader.ui16Version >= 2) ?
+                  psOpxData->ui16NextRecord : 0);
+    while(psRing->ui32DescCount < psRing->ui32NumDesc)
+    {
+        if(psOpxData->sOpxHeader.ui16Version >= 2)
+        {
+            ui32Len = ui16Record & OPX_RECORD_LEN_M;
+            bLast = (ui16Record & OPX_RECORD_LAST) ? true : false;
+            ui32Size = ui32Len + (bLast ? 0 : OPX_RECORD_HEADER_SIZE);
+            if((ui32Pos + ui32Size) > ui32Count)
+            {
+                break;
+            }
+
+            PacketRingPut(psRing, ui32Base + ui32Pos, ui32Len,
+                          bLast ? PKTRING_DESC_LAST : 0);
+
+            if(!bLast)
+            {
+                ui16Record = OpxGetLE16(pui8Space + ui32Pos + ui32Len);
+            }
+        }
+        else
+        {
+            if((ui32Pos + 8) > ui32Count)
+            {
+                break;
+            }
+
+            ui32Delimiter = OpxGetLE32(pui8Space + ui32Pos);
+            ui32Len = OpxGetLE32(pui8Space + ui32Pos + 4);
+            if(((ui32Delimiter != OPX_FORMAT_MIDSEQ) &&
+                (ui32Delimiter != OPX_FORMAT_ENDSEQ)) ||
+               (ui32Len > 0xFFFF))
+            {
+                return(-1);
+            }
+
+            bLast = (ui32Delimiter == OPX_FORMAT_ENDSEQ) ? true : false;
+            ui32Size = ui32Len + 8;
+            if((ui32Pos + ui32Size) > ui32Count)
+            {
+                ui16Record = (uint16_t)ui32Len;
+                break;
+            }
+
+            ui16Record = 0;
+
+            PacketRingPut(psRing, ui32Base + ui32Pos + 8, ui32Len,
+                          bLast ? PKTRING_DESC_LAST : 0);
+        }
+
+        ui32Pos += ui32Size;
+        psOpxData->ui32Frame++;
+        i32Packets++;
+
+        if(bLast)
+        {
+            psOpxData->ui32Flags |= OPX_FLAG_LAST;
+            break;
+        }
+    }
+
+    psOpxData->ui16NextRecord = ui16Record;
+
+    //
+    // Give back the part of the file that was not used.
+    //
+    if(ui32Pos != ui32Count)
+    {
+        if(StorageSeek(&psOpxData->sStorage, StorageTell(&psOpxData->sStorage) -
+                   (ui32Count - ui32Pos)) != 0)
+        {
+            return(-1);
+        }
+    }
+
+    //
+    // If nothing fit even though the file ended short of the space there is a
+    // truncated record.
+    //
+    if((i32Packets == 0) && (ui32Count < ui32Space))
+    {
+        return(-1);
+    }
+
+    return(i32Packets);
+}
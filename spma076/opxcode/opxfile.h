@@ -30,6 +30,8 @@
 //
 //******************************************************************************
 #define OPX_FLAG_FILEOPEN       0x00000001
+#define OPX_FLAG_WRITE          0x00000002
+#define OPX_FLAG_LAST           0x00000004
 
 //******************************************************************************
 //
@@ -40,6 +42,42 @@
 #define OPX_FORMAT_MIDSEQ      0x0064694d
 #define OPX_FORMAT_ENDSEQ      0x00646e45
 
+//******************************************************************************
+//
+// Version 2 of the opx format starts with "HD2" instead of "HDR".  The header
+// is OPX_V2_HEADER_SIZE bytes long:
+//
+//  0  "HD2\0"                  20  total number of frames (32 bit)
+//  4  channels (16 bit)         24  total number of samples (32 bit)
+//  6  bits per sample (16 bit)  28  file offset of the seek table (32 bit)
+//  8  sample rate (32 bit)      32  frames between seek table entries (32 bit)
+// 12  original file size        36  number of seek table entries (32 bit)
+// 16  version (16 bit)
+// 18  samples per frame (16 bit)
+//
+// Each packet is stored after a OPX_RECORD_HEADER_SIZE byte record header
+// holding its length, with OPX_RECORD_LAST set on the last packet.  Since the
+// header of the next record directly follows a packet, both are read with one
+// f_read().  The seek table follows the last packet and holds the file offset
+// of the record header of every N'th frame.  All values are little endian.
+//
+//******************************************************************************
+#define OPX_FORMAT_HEADSEQ_V2  0x00324448
+#define OPX_V2_HEADER_SIZE     40
+#define OPX_RECORD_HEADER_SIZE 2
+#define OPX_RECORD_LAST        0x8000
+#define OPX_RECORD_LEN_M       0x7FFF
+
+//******************************************************************************
+//
+// The number of frames between seek table entries when a file is created and
+// the number of entries held while writing.  Once the table is full every
+// other entry is dropped and the interval is doubled.
+//
+//******************************************************************************
+#define OPX_SEEK_INTERVAL      50
+#define OPX_SEEK_TABLE_SIZE    256
+
 //*****************************************************************************
 //
 // The opx file header information.
@@ -77,6 +115,30 @@ typedef struct
     //
     uint32_t ui32AvgByteRate;
 
+    //
+    // The format version, 1 or 2.  The remaining fields are only known for
+    // version 2 files and are zero otherwise.
+    //
+    uint16_t ui16Version;
+
+    //
+    // The number of samples per channel in each frame.
+    //
+    uint16_t ui16FrameSamples;
+
+    //
+    // The total number of frames and samples per channel in the file.
+    //
+    uint32_t ui32NumFrames;
+    uint32_t ui32NumSamples;
+
+    //
+    // The file offset of the seek table, the number of frames between its
+    // entries and the number of entries.
+    //
+    uint32_t ui32SeekTableOffset;
+    uint32_t ui32SeekInterval;
+    uint32_t ui32SeekEntries;
 }
 tOpxHeader;
 
@@ -95,12 +157,29 @@ typedef struct
     //
     // The file information for the current file.
     //
-    FIL i16File;
+    tStorage sStorage;
 
     //
-    // Current state flags, a combination of the WAV_FLAG_* values.
+    // Current state flags, a combination of the OPX_FLAG_* values.
     //
     uint32_t ui32Flags;
+
+    //
+    // The record header of the next packet in a version 2 file.  For a
+    // version 1 file this is the length of the next packet if OpxReadBatch()
+    // has read its record header, or zero.
+    //
+    uint16_t ui16NextRecord;
+
+    //
+    // The index of the next frame to be read or written.
+    //
+    uint32_t ui32Frame;
+
+    //
+    // The seek table of a file being written.
+    //
+    uint32_t pui32SeekTable[OPX_SEEK_TABLE_SIZE];
 } tOpxFile;
 
 //*****************************************************************************
@@ -110,8 +189,14 @@ typedef struct
 //*****************************************************************************
 void OpxGetFormat(tOpxFile *psOpxData, tOpxHeader *psOpxHeader);
 int OpxOpen(const char *pcFileName, tOpxFile *psOpxData);
-void OpxClose(tOpxFile *psOpxData);
+int OpxClose(tOpxFile *psOpxData);
 uint16_t OpxRead(tOpxFile *psOpxData, unsigned char *pucBuffer,
          int32_t *i32OpxLen);
+int32_t OpxSeek(tOpxFile *psOpxData, uint32_t ui32Frame);
+int OpxCreate(const char *pcFileName, tOpxFile *psOpxData,
+         tOpxHeader *psOpxHeader);
+int OpxWrite(tOpxFile *psOpxData, unsigned char *pucRecord, int32_t i32OpxLen,
+         uint32_t ui32Samples, bool bLast);
+int32_t OpxReadBatch(tOpxFile *psOpxData, tPacketRing *psRing);
 
 #endif
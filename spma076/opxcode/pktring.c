@@ -0,0 +1,229 @@
+//******************************************************************************
+//
+// pktring.c - A ring of compressed packets that is filled from a file in
+// batches and emptied one packet at a time by the decoder.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "opxcode/pktring.h"
+
+//******************************************************************************
+//
+// This function prepares a packet ring for use.
+//
+// \param psRing is the ring to initialize.
+// \param pui8Data is the buffer that will hold the compressed packets.
+// \param ui32Size is the size of \e pui8Data in bytes.
+// \param psDesc is the array that will hold the packet descriptors.
+// \param ui32NumDesc is the number of entries in \e psDesc.
+//
+// \return None.
+//
+//******************************************************************************
+void
+PacketRingInit(tPacketRing *psRing, uint8_t *pui8Data, uint32_t ui32Size,
+               tPacketDesc *psDesc, uint32_t ui32NumDesc)
+{
+    psRing->pui8Data = pui8Data;
+    psRing->ui32Size = ui32Size;
+    psRing->psDesc = psDesc;
+    psRing->ui32NumDesc = ui32NumDesc;
+
+    PacketRingReset(psRing);
+}
+
+//******************************************************************************
+//
+// This function empties a packet ring, for example when a new file is opened.
+//
+// \param psRing is the ring to empty.
+//
+// \return None.
+//
+//******************************************************************************
+void
+PacketRingReset(tPacketRing *psRing)
+{
+    psRing->ui32DescRead = 0;
+    psRing->ui32DescCount = 0;
+    psRing->ui32DataWrite = 0;
+    psRing->ui32Flags = 0;
+}
+
+//******************************************************************************
+//
+// This function finds the space that the next packets can be stored in.
+//
+// \param psRing is the packet ring.
+// \param ui32Min is the smallest amount of space that is useful to the
+// caller.
+// \param ppui8Space is written with the start of the space.
+//
+// The space returned is contiguous and starts where the next packet is to be
+// stored.  If there is less than \e ui32Min bytes before the end of the data
+// buffer, the space at the start of the buffer is used instead when it is
+// larger.  Packets are added in the space with PacketRingPut(), in the order
+// that they are stored.
+//
+// \return Returns the number of bytes of space, which is zero if all of the
+// descriptors are in use.
+//
+//******************************************************************************
+uint32_t
+PacketRingSpace(tPacketRing *psRing, uint32_t ui32Min, uint8_t **ppui8Space)
+{
+    uint32_t ui32Read;
+
+    *ppui8Space = psRing->pui8Data + psRing->ui32DataWrite;
+
+    if(psRing->ui32DescCount == psRing->ui32NumDesc)
+    {
+        return(0);
+    }
+
+    //
+    // Start again from the beginning of the buffer when it is empty.
+    //
+    if(psRing->ui32DescCount == 0)
+    {
+        psRing->ui32DataWrite = 0;
+        *ppui8Space = psRing->pui8Data;
+        return(psRing->ui32Size);
+    }
+
+    ui32Read = psRing->psDesc[psRing->ui32DescRead].ui32Offset;
+
+    //
+    // If the data has already wrapped around then the space ends at the
+    // oldest packet.
+    //
+    if(psRing->ui32DataWrite <= ui32Read)
+    {
+        return(ui32Read - psRing->ui32DataWrite);
+    }
+
+    //
+    // Otherwise use the end of the buffer, or the start of it if that is
+    // larger and the end is too small.
+    //
+    if(((psRing->ui32Size - psRing->ui32DataWrite) < ui32Min) &&
+       (ui32Read > (psRing->ui32Size - psRing->ui32DataWrite)))
+    {
+        psRing->ui32DataWrite = 0;
+        *ppui8Space = psRing->pui8Data;
+        return(ui32Read);
+    }
+
+    return(psRing->ui32Size - psRing->ui32DataWrite);
+}
+
+//******************************************************************************
+//
+// This function adds a packet to the ring.
+//
+// \param psRing is the packet ring.
+// \param ui32Offset is the offset of the packet from the start of the data
+// buffer.  It must lie in the space returned by the last call to
+// PacketRingSpace() and after any packet that was already added in it.
+// \param ui32Length is the length of the packet.
+// \param ui16Flags is PKTRING_DESC_LAST for the last packet of the file,
+// PKTRING_DESC_LOST for an empty packet that stands in for lost data,
+// PKTRING_DESC_NEXT for an empty packet that marks where the packets of the
+// next file start, or zero otherwise.
+//
+// \return None.
+//
+//******************************************************************************
+void
+PacketRingPut(tPacketRing *psRing, uint32_t ui32Offset, uint32_t ui32Length,
+              uint16_t ui16Flags)
+{
+    tPacketDesc *psDesc;
+    uint32_t ui32Idx;
+
+    ui32Idx = psRing->ui32DescRead + psRing->ui32DescCount;
+    if(ui32Idx >= psRing->ui32NumDesc)
+    {
+        ui32Idx -= psRing->ui32NumDesc;
+    }
+
+    psDesc = &psRing->psDesc[ui32Idx];
+    psDesc->ui32Offset = ui32Offset;
+    psDesc->ui16Length = (uint16_t)ui32Length;
+    psDesc->ui16Flags = ui16Flags;
+
+    psRing->ui32DescCount++;
+    psRing->ui32DataWrite = ui32Offset + ui32Length;
+
+    if(ui16Flags & PKTRING_DESC_LAST)
+    {
+        psRing->ui32Flags |= PKTRING_FLAG_END;
+    }
+}
+
+//******************************************************************************
+//
+// This function returns the oldest packet in the ring without removing it.
+//
+// \param psRing is the packet ring.
+//
+// The packet data is at \e ui32Offset bytes into the ring data buffer and
+// stays there until PacketRingRelease() is called.
+//
+// \return Returns the descriptor of the packet or 0 if the ring is empty.
+//
+//******************************************************************************
+const tPacketDesc *
+PacketRingPeek(tPacketRing *psRing)
+{
+    if(psRing->ui32DescCount == 0)
+    {
+        return(0);
+    }
+
+    return(&psRing->psDesc[psRing->ui32DescRead]);
+}
+
+//******************************************************************************
+//
+// This function removes the oldest packet from the ring once the decoder is
+// done with it.
+//
+// \param psRing is the packet ring.
+//
+// \return None.
+//
+//******************************************************************************
+void
+PacketRingRelease(tPacketRing *psRing)
+{
+    if(psRing->ui32DescCount == 0)
+    {
+        return;
+    }
+
+    psRing->ui32DescRead++;
+    if(psRing->ui32DescRead == psRing->ui32NumDesc)
+    {
+        psRing->ui32DescRead = 0;
+    }
+    psRing->ui32DescCount--;
+}
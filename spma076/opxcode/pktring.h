@@ -0,0 +1,121 @@
+//*****************************************************************************
+//
+// pktring.h - A ring of compressed packets that is filled from a file in
+// batches and emptied one packet at a time by the decoder.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//*****************************************************************************
+
+#ifndef PKTRING_H_
+#define PKTRING_H_
+
+//******************************************************************************
+//
+// The flag values for the ui16Flags member of the tPacketDesc structure.
+//
+//******************************************************************************
+#define PKTRING_DESC_LAST       0x0001
+#define PKTRING_DESC_LOST       0x0002
+#define PKTRING_DESC_NEXT       0x0004
+
+//******************************************************************************
+//
+// The flag values for the ui32Flags member of the tPacketRing structure.
+//
+//******************************************************************************
+#define PKTRING_FLAG_END        0x00000001
+
+//*****************************************************************************
+//
+// Describes one packet held in the ring.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The offset of the packet from the start of the ring data.
+    //
+    uint32_t ui32Offset;
+
+    //
+    // The length of the packet in bytes.
+    //
+    uint16_t ui16Length;
+
+    //
+    // A combination of the PKTRING_DESC_* values.
+    //
+    uint16_t ui16Flags;
+}
+tPacketDesc;
+
+//*****************************************************************************
+//
+// The packet ring.  Both the data and the descriptor arrays are owned by the
+// caller.  Packets are stored whole, so each one is contiguous in the data
+// array, and are removed in the order that they were added.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The compressed data and its size in bytes.
+    //
+    uint8_t *pui8Data;
+    uint32_t ui32Size;
+
+    //
+    // The packet descriptors and the number of them.
+    //
+    tPacketDesc *psDesc;
+    uint32_t ui32NumDesc;
+
+    //
+    // The index of the oldest descriptor and the number that are in use.
+    //
+    uint32_t ui32DescRead;
+    uint32_t ui32DescCount;
+
+    //
+    // The offset at which the next packet will be stored.
+    //
+    uint32_t ui32DataWrite;
+
+    //
+    // A combination of the PKTRING_FLAG_* values.
+    //
+    uint32_t ui32Flags;
+}
+tPacketRing;
+
+//*****************************************************************************
+//
+// Prototypes for the APIs.
+//
+//*****************************************************************************
+void PacketRingInit(tPacketRing *psRing, uint8_t *pui8Data, uint32_t ui32Size,
+         tPacketDesc *psDesc, uint32_t ui32NumDesc);
+void PacketRingReset(tPacketRing *psRing);
+uint32_t PacketRingSpace(tPacketRing *psRing, uint32_t ui32Min,
+         uint8_t **ppui8Space);
+void PacketRingPut(tPacketRing *psRing, uint32_t ui32Offset,
+         uint32_t ui32Length, uint16_t ui16Flags);
+const tPacketDesc *PacketRingPeek(tPacketRing *psRing);
+void PacketRingRelease(tPacketRing *psRing);
+
+#endif
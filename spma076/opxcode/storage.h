@@ -0,0 +1,217 @@
+//*****************************************************************************
+//
+// storage.h - A small file I/O interface that lets the .opx and .ogg file
+// code run on FatFs or on a POSIX file system.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//*****************************************************************************
+
+#ifndef STORAGE_H_
+#define STORAGE_H_
+
+//*****************************************************************************
+//
+// The FatFs backend is built unless STORAGE_NO_FATFS is defined.  When it is
+// built, "third_party/fatfs/src/ff.h" must be included before this file.  The
+// POSIX backend is built when STORAGE_POSIX is defined and is then the one
+// used by OpxOpen(), OpxCreate() and OggOpen().  The simulated SD card
+// backend, which reads through the POSIX backend, is built and used instead
+// when STORAGE_SIM is defined as well.
+//
+//*****************************************************************************
+#ifdef STORAGE_SIM
+#define STORAGE_DEFAULT         (&g_sStorageSim)
+#elif defined(STORAGE_POSIX)
+#define STORAGE_DEFAULT         (&g_sStoragePosix)
+#else
+#define STORAGE_DEFAULT         (&g_sStorageFatFs)
+#endif
+
+//*****************************************************************************
+//
+// The modes that a file may be opened in.
+//
+//*****************************************************************************
+#define STORAGE_MODE_READ       0x00000001
+#define STORAGE_MODE_CREATE     0x00000002
+
+typedef struct sStorage tStorage;
+
+//*****************************************************************************
+//
+// The functions provided by a storage backend.  All but pfnTell, pfnSize and
+// pfnMap return zero on success.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // Open a file in one of the STORAGE_MODE_* modes.  STORAGE_MODE_CREATE
+    // fails if the file already exists.
+    //
+    int (*pfnOpen)(tStorage *psFile, const char *pcName, uint32_t ui32Mode);
+
+    //
+    // Close the file.  This writes out any data that the backend still has
+    // cached, so it can fail for a file that was written.
+    //
+    int (*pfnClose)(tStorage *psFile);
+
+    //
+    // Read or write up to ui32Size bytes at the file pointer.  The number of
+    // bytes transferred is written to pui32Count.
+    //
+    int (*pfnRead)(tStorage *psFile, void *pvBuffer, uint32_t ui32Size,
+                   uint32_t *pui32Count);
+    int (*pfnWrite)(tStorage *psFile, const void *pvBuffer, uint32_t ui32Size,
+                    uint32_t *pui32Count);
+
+    //
+    // Move the file pointer, return the file pointer and return the size of
+    // the file.
+    //
+    int (*pfnSeek)(tStorage *psFile, uint32_t ui32Offset);
+    uint32_t (*pfnTell)(tStorage *psFile);
+    uint32_t (*pfnSize)(tStorage *psFile);
+
+    //
+    // Return the whole of a file that was opened for reading mapped in
+    // memory, or 0 if the backend can not do this.  The mapping stays valid
+    // until the file is closed.
+    //
+    const uint8_t *(*pfnMap)(tStorage *psFile);
+}
+tStorageFuncs;
+
+//*****************************************************************************
+//
+// An open file.
+//
+//*****************************************************************************
+struct sStorage
+{
+    //
+    // The backend that the file was opened with.
+    //
+    const tStorageFuncs *psFuncs;
+
+#ifndef STORAGE_NO_FATFS
+    //
+    // The FatFs file object.
+    //
+    FIL sFile;
+#endif
+
+#ifdef STORAGE_POSIX
+    //
+    // The POSIX file descriptor, the mapping of a file opened for reading,
+    // its size and the file pointer within it.
+    //
+    int iFd;
+    const uint8_t *pui8Map;
+    uint32_t ui32Size;
+    uint32_t ui32Pos;
+#endif
+};
+
+//*****************************************************************************
+//
+// The available backends.
+//
+//*****************************************************************************
+#ifndef STORAGE_NO_FATFS
+extern const tStorageFuncs g_sStorageFatFs;
+#endif
+#ifdef STORAGE_POSIX
+extern const tStorageFuncs g_sStoragePosix;
+#endif
+#ifdef STORAGE_SIM
+extern const tStorageFuncs g_sStorageSim;
+#endif
+
+#ifdef STORAGE_SIM
+//*****************************************************************************
+//
+// The timing model of the simulated SD card.  Each read takes one of the
+// recorded latencies, drawn at random, plus the time to transfer the data.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The recorded latencies of reads, in microseconds, and their number.
+    // With no latencies a read only takes the transfer time.
+    //
+    const uint32_t *pui32Latency;
+    uint32_t ui32NumLatency;
+
+    //
+    // The transfer rate in bytes per millisecond, or 0 for none.
+    //
+    uint32_t ui32BytesPerMs;
+
+    //
+    // The seed of the random draw of the latencies.
+    //
+    uint32_t ui32Seed;
+
+    //
+    // The function that is called with the simulated time of each read, in
+    // microseconds, to advance the clock of the simulation.
+    //
+    void (*pfnWait)(uint32_t ui32Us);
+
+    //
+    // The number of reads, the longest and the total of their times.
+    //
+    uint32_t ui32Reads;
+    uint32_t ui32MaxUs;
+    uint64_t ui64TotalUs;
+}
+tStorageSimModel;
+
+void StorageSimModelSet(tStorageSimModel *psModel);
+#endif
+
+//*****************************************************************************
+//
+// Calls through to the backend of an open file.
+//
+//*****************************************************************************
+#define StorageOpen(psFile, psBackend, pcName, ui32Mode)                      \
+        ((psFile)->psFuncs = (psBackend),                                     \
+         (psBackend)->pfnOpen((psFile), (pcName), (ui32Mode)))
+#define StorageClose(psFile)                                                  \
+        ((psFile)->psFuncs->pfnClose(psFile))
+#define StorageRead(psFile, pvBuffer, ui32Size, pui32Count)                   \
+        ((psFile)->psFuncs->pfnRead((psFile), (pvBuffer), (ui32Size),         \
+                                    (pui32Count)))
+#define StorageWrite(psFile, pvBuffer, ui32Size, pui32Count)                  \
+        ((psFile)->psFuncs->pfnWrite((psFile), (pvBuffer), (ui32Size),        \
+                                     (pui32Count)))
+#define StorageSeek(psFile, ui32Offset)                                       \
+        ((psFile)->psFuncs->pfnSeek((psFile), (ui32Offset)))
+#define StorageTell(psFile)                                                   \
+        ((psFile)->psFuncs->pfnTell(psFile))
+#define StorageSize(psFile)                                                   \
+        ((psFile)->psFuncs->pfnSize(psFile))
+#define StorageMap(psFile)                                                    \
+        (((psFile)->psFuncs->pfnMap != 0) ?                                   \
+         (psFile)->psFuncs->pfnMap(psFile) : 0)
+
+#endif
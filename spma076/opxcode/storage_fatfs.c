@@ -0,0 +1,110 @@
+//******************************************************************************
+//
+// storage_fatfs.c - The FatFs backend of the storage interface.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef STORAGE_NO_FATFS
+
+#include "third_party/fatfs/src/ff.h"
+#include "opxcode/storage.h"
+
+static int
+StorageFatFsOpen(tStorage *psFile, const char *pcName, uint32_t ui32Mode)
+{
+    if(ui32Mode & STORAGE_MODE_CREATE)
+    {
+        return((int)f_open(&psFile->sFile, pcName,
+                           (FA_WRITE | FA_CREATE_NEW)));
+    }
+
+    return((int)f_open(&psFile->sFile, pcName, FA_READ));
+}
+
+static int
+StorageFatFsClose(tStorage *psFile)
+{
+    return((int)f_close(&psFile->sFile));
+}
+
+static int
+StorageFatFsRead(tStorage *psFile, void *pvBuffer, uint32_t ui32Size,
+                 uint32_t *pui32Count)
+{
+    UINT uCount;
+    FRESULT iFResult;
+
+    iFResult = f_read(&psFile->sFile, pvBuffer, ui32Size, &uCount);
+    *pui32Count = uCount;
+
+    return((int)iFResult);
+}
+
+static int
+StorageFatFsWrite(tStorage *psFile, const void *pvBuffer, uint32_t ui32Size,
+                  uint32_t *pui32Count)
+{
+    UINT uCount;
+    FRESULT iFResult;
+
+    iFResult = f_write(&psFile->sFile, pvBuffer, ui32Size, &uCount);
+    *pui32Count = uCount;
+
+    return((int)iFResult);
+}
+
+static int
+StorageFatFsSeek(tStorage *psFile, uint32_t ui32Offset)
+{
+    return((int)f_lseek(&psFile->sFile, ui32Offset));
+}
+
+static uint32_t
+StorageFatFsTell(tStorage *psFile)
+{
+    return(f_tell(&psFile->sFile));
+}
+
+static uint32_t
+StorageFatFsSize(tStorage *psFile)
+{
+    return(f_size(&psFile->sFile));
+}
+
+//******************************************************************************
+//
+// FatFs reads through its sector buffer, so files can not be mapped.
+//
+//******************************************************************************
+const tStorageFuncs g_sStorageFatFs =
+{
+    StorageFatFsOpen,
+    StorageFatFsClose,
+    StorageFatFsRead,
+    StorageFatFsWrite,
+    StorageFatFsSeek,
+    StorageFatFsTell,
+    StorageFatFsSize,
+    0
+};
+
+#endif
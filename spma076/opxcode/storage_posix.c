@@ -0,0 +1,229 @@
+//******************************************************************************
+//
+// storage_posix.c - The POSIX backend of the storage interface, used to run
+// the .opx and .ogg file code on a workstation.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifndef STORAGE_NO_FATFS
+#include "third_party/fatfs/src/ff.h"
+#endif
+#include "opxcode/storage.h"
+
+#ifdef STORAGE_POSIX
+
+//******************************************************************************
+//
+// Files opened for reading are mapped whole, so reads are copies out of the
+// mapping and the parsers can use the mapping directly.  Files opened for
+// writing use the file descriptor.
+//
+//******************************************************************************
+static int
+StoragePosixOpen(tStorage *psFile, const char *pcName, uint32_t ui32Mode)
+{
+    struct stat sStat;
+    void *pvMap;
+
+    psFile->pui8Map = 0;
+    psFile->ui32Size = 0;
+    psFile->ui32Pos = 0;
+
+    if(ui32Mode & STORAGE_MODE_CREATE)
+    {
+        psFile->iFd = open(pcName, O_RDWR | O_CREAT | O_EXCL, 0644);
+        return((psFile->iFd < 0) ? -1 : 0);
+    }
+
+    psFile->iFd = open(pcName, O_RDONLY);
+    if(psFile->iFd < 0)
+    {
+        return(-1);
+    }
+
+    if((fstat(psFile->iFd, &sStat) != 0) || (sStat.st_size > 0xFFFFFFFF))
+    {
+        close(psFile->iFd);
+        psFile->iFd = -1;
+        return(-1);
+    }
+
+    psFile->ui32Size = (uint32_t)sStat.st_size;
+
+    //
+    // An empty file can not be mapped, but also has nothing to read.
+    //
+    if(psFile->ui32Size != 0)
+    {
+        pvMap = mmap(0, psFile->ui32Size, PROT_READ, MAP_PRIVATE,
+                     psFile->iFd, 0);
+        if(pvMap == MAP_FAILED)
+        {
+            close(psFile->iFd);
+            psFile->iFd = -1;
+            return(-1);
+        }
+
+        psFile->pui8Map = (const uint8_t *)pvMap;
+    }
+
+    return(0);
+}
+
+static int
+StoragePosixClose(tStorage *psFile)
+{
+    int iResult;
+
+    iResult = 0;
+    if(psFile->pui8Map)
+    {
+        munmap((void *)psFile->pui8Map, psFile->ui32Size);
+        psFile->pui8Map = 0;
+    }
+
+    if(psFile->iFd >= 0)
+    {
+        if(close(psFile->iFd) != 0)
+        {
+            iResult = -1;
+        }
+        psFile->iFd = -1;
+    }
+
+    return(iResult);
+}
+
+static int
+StoragePosixRead(tStorage *psFile, void *pvBuffer, uint32_t ui32Size,
+                 uint32_t *pui32Count)
+{
+    ssize_t iCount;
+
+    if(psFile->pui8Map || (psFile->ui32Size == 0))
+    {
+        if(ui32Size > (psFile->ui32Size - psFile->ui32Pos))
+        {
+            ui32Size = psFile->ui32Size - psFile->ui32Pos;
+        }
+
+        memcpy(pvBuffer, psFile->pui8Map + psFile->ui32Pos, ui32Size);
+        psFile->ui32Pos += ui32Size;
+        *pui32Count = ui32Size;
+        return(0);
+    }
+
+    iCount = pread(psFile->iFd, pvBuffer, ui32Size, psFile->ui32Pos);
+    if(iCount < 0)
+    {
+        *pui32Count = 0;
+        return(-1);
+    }
+
+    psFile->ui32Pos += (uint32_t)iCount;
+    *pui32Count = (uint32_t)iCount;
+
+    return(0);
+}
+
+static int
+StoragePosixWrite(tStorage *psFile, const void *pvBuffer, uint32_t ui32Size,
+                  uint32_t *pui32Count)
+{
+    ssize_t iCount;
+
+    if(psFile->pui8Map)
+    {
+        *pui32Count = 0;
+        return(-1);
+    }
+
+    iCount = pwrite(psFile->iFd, pvBuffer, ui32Size, psFile->ui32Pos);
+    if(iCount < 0)
+    {
+        *pui32Count = 0;
+        return(-1);
+    }
+
+    psFile->ui32Pos += (uint32_t)iCount;
+    if(psFile->ui32Pos > psFile->ui32Size)
+    {
+        psFile->ui32Size = psFile->ui32Pos;
+    }
+    *pui32Count = (uint32_t)iCount;
+
+    return(0);
+}
+
+//******************************************************************************
+//
+// As with f_lseek(), a read only file can not be seeked past its end.
+//
+//******************************************************************************
+static int
+StoragePosixSeek(tStorage *psFile, uint32_t ui32Offset)
+{
+    if(psFile->pui8Map && (ui32Offset > psFile->ui32Size))
+    {
+        ui32Offset = psFile->ui32Size;
+    }
+
+    psFile->ui32Pos = ui32Offset;
+
+    return(0);
+}
+
+static uint32_t
+StoragePosixTell(tStorage *psFile)
+{
+    return(psFile->ui32Pos);
+}
+
+static uint32_t
+StoragePosixSize(tStorage *psFile)
+{
+    return(psFile->ui32Size);
+}
+
+static const uint8_t *
+StoragePosixMap(tStorage *psFile)
+{
+    return(psFile->pui8Map);
+}
+
+const tStorageFuncs g_sStoragePosix =
+{
+    StoragePosixOpen,
+    StoragePosixClose,
+    StoragePosixRead,
+    StoragePosixWrite,
+    StoragePosixSeek,
+    StoragePosixTell,
+    StoragePosixSize,
+    StoragePosixMap
+};
+
+#endif
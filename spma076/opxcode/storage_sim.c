@@ -0,0 +1,178 @@
+//******************************************************************************
+//
+// storage_sim.c - A simulated SD card backend of the storage interface, which
+// reads files through the POSIX backend and charges each read the time that
+// it would take on the card.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#ifndef STORAGE_NO_FATFS
+#include "third_party/fatfs/src/ff.h"
+#endif
+#include "opxcode/storage.h"
+
+#ifdef STORAGE_SIM
+
+//******************************************************************************
+//
+// The timing model in use.
+//
+//******************************************************************************
+static tStorageSimModel *g_psStorageSimModel;
+
+//******************************************************************************
+//
+// This function sets the timing model of the simulated SD card.
+//
+// \param psModel is the model, which must stay valid while files are read.
+// Its statistics are cleared.
+//
+// \return None.
+//
+//******************************************************************************
+void
+StorageSimModelSet(tStorageSimModel *psModel)
+{
+    psModel->ui32Reads = 0;
+    psModel->ui32MaxUs = 0;
+    psModel->ui64TotalUs = 0;
+    g_psStorageSimModel = psModel;
+}
+
+//******************************************************************************
+//
+// Charge the time of a read of ui32Size bytes to the simulation.
+//
+//******************************************************************************
+static void
+StorageSimWait(uint32_t ui32Size)
+{
+    tStorageSimModel *psModel;
+    uint32_t ui32Us;
+
+    psModel = g_psStorageSimModel;
+    if(psModel == 0)
+    {
+        return;
+    }
+
+    ui32Us = 0;
+    if(psModel->ui32NumLatency != 0)
+    {
+        //
+        // Draw one of the recorded latencies with a xorshift generator, so
+        // that a run can be repeated with the same seed.
+        //
+        psModel->ui32Seed ^= psModel->ui32Seed << 13;
+        psModel->ui32Seed ^= psModel->ui32Seed >> 17;
+        psModel->ui32Seed ^= psModel->ui32Seed << 5;
+        ui32Us = psModel->pui32Latency[psModel->ui32Seed %
+                                       psModel->ui32NumLatency];
+    }
+
+    if(psModel->ui32BytesPerMs != 0)
+    {
+        ui32Us += (uint32_t)(((uint64_t)ui32Size * 1000) /
+                             psModel->ui32BytesPerMs);
+    }
+
+    psModel->ui32Reads++;
+    psModel->ui64TotalUs += ui32Us;
+    if(ui32Us > psModel->ui32MaxUs)
+    {
+        psModel->ui32MaxUs = ui32Us;
+    }
+
+    if(psModel->pfnWait)
+    {
+        psModel->pfnWait(ui32Us);
+    }
+}
+
+static int
+StorageSimOpen(tStorage *psFile, const char *pcName, uint32_t ui32Mode)
+{
+    return(g_sStoragePosix.pfnOpen(psFile, pcName, ui32Mode));
+}
+
+static int
+StorageSimClose(tStorage *psFile)
+{
+    return(g_sStoragePosix.pfnClose(psFile));
+}
+
+static int
+StorageSimRead(tStorage *psFile, void *pvBuffer, uint32_t ui32Size,
+               uint32_t *pui32Count)
+{
+    int iResult;
+
+    iResult = g_sStoragePosix.pfnRead(psFile, pvBuffer, ui32Size, pui32Count);
+    StorageSimWait(*pui32Count);
+
+    return(iResult);
+}
+
+static int
+StorageSimWrite(tStorage *psFile, const void *pvBuffer, uint32_t ui32Size,
+                uint32_t *pui32Count)
+{
+    return(g_sStoragePosix.pfnWrite(psFile, pvBuffer, ui32Size, pui32Count));
+}
+
+static int
+StorageSimSeek(tStorage *psFile, uint32_t ui32Offset)
+{
+    return(g_sStoragePosix.pfnSeek(psFile, ui32Offset));
+}
+
+static uint32_t
+StorageSimTell(tStorage *psFile)
+{
+    return(g_sStoragePosix.pfnTell(psFile));
+}
+
+static uint32_t
+StorageSimSize(tStorage *psFile)
+{
+    return(g_sStoragePosix.pfnSize(psFile));
+}
+
+//******************************************************************************
+//
+// Like FatFs on the card, the files are never mapped, so that every access
+// goes through a read.
+//
+//******************************************************************************
+const tStorageFuncs g_sStorageSim =
+{
+    StorageSimOpen,
+    StorageSimClose,
+    StorageSimRead,
+    StorageSimWrite,
+    StorageSimSeek,
+    StorageSimTell,
+    StorageSimSize,
+    0
+};
+
+#endif
@@ -0,0 +1,260 @@
+//*****************************************************************************
+//
+// upsample.c - Integer ratio upsampling of decoded audio to the
+// playback rate.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "opxcode/upsample.h"
+
+//******************************************************************************
+//
+// The polyphase filters for each ratio.  They are Kaiser windowed sinc low
+// pass filters cut off just below the Nyquist frequency of the input, with
+// about 55 dB of rejection of the images.  Each phase is stored in the order
+// of the input samples it is applied to, oldest first, and is scaled to a gain
+// of exactly 1.0 in Q15 so that silence stays at the middle of the output
+// range.
+//
+//******************************************************************************
+static const int16_t g_pi16Upsample2[2 * UPSAMPLE_TAPS] =
+{
+      130,  -311,   346,   255, -2868, 26962,
+    11406, -4688,  2203,  -890,   258,   -35,
+      -35,   258,  -890,  2203, -4688, 11406,
+    26962, -2868,   255,   346,  -311,   130
+};
+
+static const int16_t g_pi16Upsample3[3 * UPSAMPLE_TAPS] =
+{
+      190,  -479,   737,  -547, -1277, 28326,
+     8445, -4041,  2080,  -913,   293,   -46,
+       20,    75,  -561,  1922, -5331, 20259,
+    20259, -5331,  1922,  -561,    75,    20,
+      -46,   293,  -913,  2080, -4041,  8445,
+    28326, -1277,  -547,   737,  -479,   190
+};
+
+static const int16_t g_pi16Upsample4[4 * UPSAMPLE_TAPS] =
+{
+      221,  -565,   941,  -985,  -335, 28811,
+     7012, -3660,  1980,  -905,   304,   -51,
+       80,  -110,  -163,  1258, -4547, 24034,
+    15948, -5354,  2260,  -828,   211,   -21,
+      -21,   211,  -828,  2260, -5354, 15948,
+    24034, -4547,  1258,  -163,  -110,    80,
+      -51,   304,  -905,  1980, -3660,  7012,
+    28811,  -335,  -985,   941,  -565,   221
+};
+
+static const int16_t g_pi16Upsample6[6 * UPSAMPLE_TAPS] =
+{
+      252,  -651,  1148, -1439,   699, 29160,
+     5624, -3250,  1856,  -886,   310,   -55,
+      157,  -341,   362,   260, -2884, 26961,
+    11427, -4744,  2274,  -950,   294,   -48,
+       62,   -43,  -317,  1530, -4915, 22859,
+    17431, -5441,  2204,  -770,   178,   -10,
+      -10,   178,  -770,  2204, -5441, 17431,
+    22859, -4915,  1530,  -317,   -43,    62,
+      -48,   294,  -950,  2274, -4744, 11427,
+    26961, -2884,   260,   362,  -341,   157,
+      -55,   310,  -886,  1856, -3250,  5624,
+    29160,   699, -1439,  1148,  -651,   252
+};
+
+//******************************************************************************
+//
+// This function prepares an upsampler for a stream.
+//
+// \param psUp is the upsampler to initialize.
+// \param ui32Factor is the ratio of the output rate to the input rate, which
+// must be 1, 2, 3, 4 or 6.
+// \param bFilter is \b true to interpolate the output with the polyphase
+// filter, or \b false to repeat each input sample instead.
+//
+// \return Returns \b true if the ratio is supported, or \b false otherwise.
+//
+//******************************************************************************
+bool
+UpsampleInit(tUpsampler *psUp, uint32_t ui32Factor, bool bFilter)
+{
+    switch(ui32Factor)
+    {
+        case 1:
+        {
+            psUp->pi16Coef = 0;
+            break;
+        }
+        case 2:
+        {
+            psUp->pi16Coef = g_pi16Upsample2;
+            break;
+        }
+        case 3:
+        {
+            psUp->pi16Coef = g_pi16Upsample3;
+            break;
+        }
+        case 4:
+        {
+            psUp->pi16Coef = g_pi16Upsample4;
+            break;
+        }
+        case 6:
+        {
+            psUp->pi16Coef = g_pi16Upsample6;
+            break;
+        }
+        default:
+        {
+            return(false);
+        }
+    }
+
+    if(!bFilter)
+    {
+        psUp->pi16Coef = 0;
+    }
+    psUp->ui32Factor = ui32Factor;
+
+    UpsampleReset(psUp);
+
+    return(true);
+}
+
+//******************************************************************************
+//
+// This function clears the samples that the filter holds from the previous
+// frame, for the start of a new stream.
+//
+// \param psUp is the upsampler.
+//
+// \return None.
+//
+//******************************************************************************
+void
+UpsampleReset(tUpsampler *psUp)
+{
+    memset(psUp->pi16History, 0, sizeof(psUp->pi16History));
+}
+
+//******************************************************************************
+//
+// This function upsamples a frame of decoded audio and converts it to the
+// unsigned samples that are written to the output.
+//
+// \param psUp is the upsampler.
+// \param pi16In is the frame of signed 16-bit input samples.  It must be
+// preceded by UPSAMPLE_HISTORY samples of space that this function writes to.
+// \param ui32Samples is the number of samples in \e pi16In.
+// \param pui16Out is the buffer for the output samples, which must hold
+// \e ui32Samples times the ratio of the upsampler.
+// \param ui32Shift is the number of bits that the unsigned output samples are
+// shifted right by, to fit the range of the output.
+//
+// Each output sample is written once, in order, so \e pui16Out can be the
+// buffer that is played out.  When the ratio is 1 the output can also be the
+// input buffer itself.
+//
+// \return Returns the number of output samples.
+//
+//******************************************************************************
+uint32_t
+UpsampleProcess(tUpsampler *psUp, int16_t *pi16In, uint32_t ui32Samples,
+                uint16_t *pui16Out, uint32_t ui32Shift)
+{
+    const int16_t *pi16Coef;
+    const int16_t *pi16X;
+    uint32_t ui32Factor;
+    uint32_t ui32Idx;
+    uint32_t ui32Phase;
+    uint32_t ui32Tap;
+    int32_t i32Acc;
+    uint16_t ui16Sample;
+
+    ui32Factor = psUp->ui32Factor;
+
+    //
+    // Repeat each sample when there is no filter.  This is also the plain
+    // conversion when the input is already at the output rate.
+    //
+    if(psUp->pi16Coef == 0)
+    {
+        for(ui32Idx = 0; ui32Idx < ui32Samples; ui32Idx++)
+        {
+            ui16Sample = (uint16_t)(pi16In[ui32Idx] + 32768) >> ui32Shift;
+            for(ui32Phase = 0; ui32Phase < ui32Factor; ui32Phase++)
+            {
+                *pui16Out++ = ui16Sample;
+            }
+        }
+
+        return(ui32Samples * ui32Factor);
+    }
+
+    //
+    // Put the end of the previous frame in front of this one, so that the
+    // filter can run over the frame without checking where it starts, and
+    // keep the end of this frame for the next one.
+    //
+    memcpy(pi16In - UPSAMPLE_HISTORY, psUp->pi16History,
+           sizeof(psUp->pi16History));
+    pi16X = pi16In + ui32Samples - UPSAMPLE_HISTORY;
+    memcpy(psUp->pi16History, pi16X, sizeof(psUp->pi16History));
+
+    //
+    // Each input sample gives one output sample from each phase of the
+    // filter, which are applied to the last UPSAMPLE_TAPS input samples.
+    //
+    pi16X = pi16In - UPSAMPLE_HISTORY;
+    for(ui32Idx = 0; ui32Idx < ui32Samples; ui32Idx++, pi16X++)
+    {
+        pi16Coef = psUp->pi16Coef;
+        for(ui32Phase = 0; ui32Phase < ui32Factor; ui32Phase++)
+        {
+            i32Acc = 1 << 14;
+            for(ui32Tap = 0; ui32Tap < UPSAMPLE_TAPS; ui32Tap++)
+            {
+                i32Acc += (int32_t)pi16Coef[ui32Tap] * pi16X[ui32Tap];
+            }
+            pi16Coef += UPSAMPLE_TAPS;
+
+            //
+            // Saturate the filter overshoot on full scale input and offset
+            // the sample to the unsigned range of the output.
+            //
+            i32Acc >>= 15;
+            if(i32Acc > 32767)
+            {
+                i32Acc = 32767;
+            }
+            else if(i32Acc < -32768)
+            {
+                i32Acc = -32768;
+            }
+            *pui16Out++ = (uint16_t)(i32Acc + 32768) >> ui32Shift;
+        }
+    }
+
+    return(ui32Samples * ui32Factor);
+}
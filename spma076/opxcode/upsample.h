@@ -0,0 +1,79 @@
+//*****************************************************************************
+//
+// upsample.h - Integer ratio upsampling of decoded audio to the
+// playback rate.
+//
+// Copyright (c) 2012-2015 Texas Instruments Incorporated.  All rights reserved.
+// Software License Agreement
+// 
+// Texas Instruments (TI) is supplying this software for use solely and
+// exclusively on TI's microcontroller products. The software is owned by
+// TI and/or its suppliers, and is protected under applicable copyright
+// laws. You may not combine this software with "viral" open-source
+// software in order to form a larger program.
+// 
+// THIS SOFTWARE IS PROVIDED "AS IS" AND WITH ALL FAULTS.
+// NO WARRANTIES, WHETHER EXPRESS, IMPLIED OR STATUTORY, INCLUDING, BUT
+// NOT LIMITED TO, IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE APPLY TO THIS SOFTWARE. TI SHALL NOT, UNDER ANY
+// CIRCUMSTANCES, BE LIABLE FOR SPECIAL, INCIDENTAL, OR CONSEQUENTIAL
+// DAMAGES, FOR ANY REASON WHATSOEVER.
+// 
+//******************************************************************************
+
+#ifndef UPSAMPLE_H_
+#define UPSAMPLE_H_
+
+//******************************************************************************
+//
+// The number of taps of each phase of the polyphase filter.
+//
+//******************************************************************************
+#define UPSAMPLE_TAPS           12
+
+//******************************************************************************
+//
+// The number of samples of space that must precede the input that is passed
+// to UpsampleProcess().  The samples that the filter still needs from the
+// previous frame are placed there.
+//
+//******************************************************************************
+#define UPSAMPLE_HISTORY        (UPSAMPLE_TAPS - 1)
+
+//*****************************************************************************
+//
+// The state of the upsampler for one mono stream.
+//
+//*****************************************************************************
+typedef struct
+{
+    //
+    // The coefficients of the polyphase filter, UPSAMPLE_TAPS for each of the
+    // ui32Factor phases, or 0 if each sample is repeated instead.
+    //
+    const int16_t *pi16Coef;
+
+    //
+    // The number of output samples for each input sample.
+    //
+    uint32_t ui32Factor;
+
+    //
+    // The last input samples of the previous frame.
+    //
+    int16_t pi16History[UPSAMPLE_HISTORY];
+}
+tUpsampler;
+
+//*****************************************************************************
+//
+// Prototypes for the APIs.
+//
+//*****************************************************************************
+bool UpsampleInit(tUpsampler *psUp, uint32_t ui32Factor, bool bFilter);
+void UpsampleReset(tUpsampler *psUp);
+uint32_t UpsampleProcess(tUpsampler *psUp, int16_t *pi16In,
+                         uint32_t ui32Samples, uint16_t *pui16Out,
+                         uint32_t ui32Shift);
+
+#endif